@@ -36,6 +36,19 @@ public interface IHardwareVideoDecoder : IDisposable
     /// <returns>True if decode succeeded and frame was rendered</returns>
     bool DecodeAndRender(ReadOnlySpan<byte> nalUnit, bool isKeyframe);
 
+    /// <summary>
+    /// Marks the end of an access unit: every NAL unit of the frame was passed,
+    /// so the frame is decoded without waiting for the next one.
+    /// </summary>
+    void EndAccessUnit() { }
+
+    /// <summary>
+    /// Gets whether SPS and PPS NAL units may also be passed to DecodeAndRender.
+    /// Decoders that take them apply a new SPS at the next IDR frame, so a
+    /// resolution change mid-stream needs no new decoder.
+    /// </summary>
+    bool AcceptsInBandParameterSets => false;
+
     /// <summary>
     /// Gets the native renderer handle for embedding in UI.
     /// On macOS: NSView with CAMetalLayer
@@ -45,6 +45,31 @@ public class VaapiDecoder : IHardwareVideoDecoder
         int nalLength,
         [MarshalAs(UnmanagedType.I1)] bool isKeyframe);
 
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    private static extern bool va_decoder_end_access_unit(nint decoder);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    private static extern bool va_decoder_decode_and_render_timed(
+        nint decoder,
+        nint nalData,
+        int nalLength,
+        [MarshalAs(UnmanagedType.I1)] bool isKeyframe,
+        long captureTimeUs);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    private static extern bool va_decoder_set_presentation(nint decoder, int targetLatencyMs);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    private static extern bool va_decoder_start_async(nint decoder, int queueCapacity);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    private static extern bool va_decoder_get_stats(nint decoder, out VaDecoderStats stats);
+
     [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
     private static extern nint va_decoder_get_view(nint decoder);
 
@@ -60,6 +85,7 @@ public class VaapiDecoder : IHardwareVideoDecoder
     public bool IsInitialized => _isInitialized;
     public (int Width, int Height) VideoDimensions => (_width, _height);
     public nint NativeViewHandle => _handle != nint.Zero ? va_decoder_get_view(_handle) : nint.Zero;
+    public bool AcceptsInBandParameterSets => true;
 
     private VaapiDecoder(nint handle)
     {
@@ -124,6 +150,12 @@ public class VaapiDecoder : IHardwareVideoDecoder
         {
             if (va_decoder_initialize(_handle, width, height, (nint)spsPtr, sps.Length, (nint)ppsPtr, pps.Length))
             {
+                // Decode and present off the network thread; without the worker
+                // thread, DecodeAndRender keeps decoding synchronously
+                if (!va_decoder_start_async(_handle, 0))
+                {
+                    Console.WriteLine("VaapiDecoder: Worker thread unavailable, decoding synchronously");
+                }
                 _isInitialized = true;
                 return true;
             }
@@ -143,6 +175,52 @@ public class VaapiDecoder : IHardwareVideoDecoder
         }
     }
 
+    public void EndAccessUnit()
+    {
+        if (!_isInitialized || _isDisposed || _handle == nint.Zero)
+            return;
+
+        va_decoder_end_access_unit(_handle);
+    }
+
+    /// <summary>
+    /// Decodes a NAL unit captured at captureTimeUs (sender's clock, microseconds),
+    /// so that presentation can be scheduled and display latency measured.
+    /// </summary>
+    public unsafe bool DecodeAndRender(ReadOnlySpan<byte> nalUnit, bool isKeyframe, long captureTimeUs)
+    {
+        if (!_isInitialized || _isDisposed || _handle == nint.Zero)
+            return false;
+
+        fixed (byte* nalPtr = nalUnit)
+        {
+            return va_decoder_decode_and_render_timed(_handle, (nint)nalPtr, nalUnit.Length, isKeyframe, captureTimeUs);
+        }
+    }
+
+    /// <summary>
+    /// Holds frames until targetLatencyMs after their earliest possible arrival and
+    /// shows them once per vsync (0 shows frames as soon as they are decoded).
+    /// </summary>
+    public bool SetPresentation(int targetLatencyMs)
+    {
+        if (_isDisposed || _handle == nint.Zero)
+            return false;
+
+        return va_decoder_set_presentation(_handle, targetLatencyMs);
+    }
+
+    /// <summary>
+    /// Gets the native decoder's queue and frame counters, or null if unavailable.
+    /// </summary>
+    public VaDecoderStats? GetStats()
+    {
+        if (_isDisposed || _handle == nint.Zero)
+            return null;
+
+        return va_decoder_get_stats(_handle, out var stats) ? stats : null;
+    }
+
     public void SetDisplaySize(int width, int height)
     {
         if (_handle != nint.Zero)
@@ -173,3 +251,26 @@ public class VaapiDecoder : IHardwareVideoDecoder
         _isInitialized = false;
     }
 }
+
+/// <summary>
+/// Counters of the native VA-API decoder (matches VaDecoderStats in capi.h).
+/// </summary>
+[StructLayout(LayoutKind.Sequential)]
+public struct VaDecoderStats
+{
+    public uint QueueDepth;
+    public uint MaxQueueDepth;
+    public ulong NalsQueued;
+    public ulong NalsDropped;
+    public ulong Resyncs;
+    public ulong FramesDecoded;
+    public ulong FramesPresented;
+    public ulong FramesSkipped;
+    public long DisplayLatencyUs;
+    public long AverageDisplayLatencyUs;
+    public long MaxDisplayLatencyUs;
+    public long VsyncPeriodUs;
+    public ulong FramesTimed;
+    public ulong FramesLate;
+    public ulong VsyncsMissed;
+}
@@ -237,10 +237,19 @@ public class VideoDecoderManager : IAsyncDisposable
                 if (nal.Length == 0) continue;
                 var nalType = nal[0] & 0x1F;
 
-                // Only send VCL NAL units (coded slice data) to the decoder
+                // SPS (7) and PPS (8) also go to decoders that take them in band,
+                // so a new resolution reaches the decoder at the next IDR frame.
+                // The first pair initialized the decoder above.
+                if ((nalType == 7 || nalType == 8) && hwDecoder.AcceptsInBandParameterSets)
+                {
+                    hwDecoder.DecodeAndRender(nal, false);
+                    continue;
+                }
+
+                // Otherwise only send VCL NAL units (coded slice data) to the decoder
                 // Type 1 = Non-IDR slice (P/B frame)
                 // Type 5 = IDR slice (keyframe)
-                // Skip all other NAL types (SPS=7, PPS=8, SEI=6, AUD=9, etc.)
+                // Skip all other NAL types (SEI=6, AUD=9, etc.)
                 if (nalType != 1 && nalType != 5)
                 {
                     continue;
@@ -255,6 +264,8 @@ public class VideoDecoderManager : IAsyncDisposable
             }
             if (nalsSent > 0)
             {
+                // The frame's slices are all in; decode it without waiting for the next frame
+                hwDecoder.EndAccessUnit();
                 Console.WriteLine($"VideoDecoderManager: Hardware decoded {nalsSent} NAL units for {streamType}");
             }
             return true;
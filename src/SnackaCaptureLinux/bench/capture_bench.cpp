@@ -0,0 +1,335 @@
+// capture_bench: time the parts of the capture pipeline that run without an X
+// server, GPU or sound server.
+//
+// microphone: PulseMicrophoneCapturer's RNNoise path, one call per PulseAudio
+// fragment (10 ms by default) as the callback thread makes it, per noise
+// suppression mode. Reports the cost per callback and how much of the
+// fragment's real time it takes.
+//
+// rnnoise: rnnoise_process_frame with each network kernel variant the CPU
+// supports (C, SSE4.1, AVX2+FMA), forced per state.
+//
+// batch: rnnoise_process_frames over 1 to 8 streams against one
+// rnnoise_process_frame call per stream, as cost per stream and frame.
+//
+// fft: RNNoise's forward and inverse transform of one frame's window, with
+// the half-length FFT against the full complex FFT it replaced.
+
+#include "PulseMicrophoneCapturer.h"
+#include "rnnoise_bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    double seconds = 10.0;      // Audio per run
+    size_t fragment = 480;      // Stereo frames per callback
+    bool microphone = false;
+    bool rnnoise = false;
+    bool batch = false;
+    bool fft = false;
+};
+
+void PrintUsage() {
+    std::fprintf(stderr,
+        "Usage: capture_bench [OPTIONS] [SECTION...]\n"
+        "\n"
+        "Times the capture pipeline's CPU work without a sound server. Runs every\n"
+        "section if none is named.\n"
+        "\n"
+        "SECTIONS:\n"
+        "    microphone          RNNoise microphone path per PulseAudio callback, per\n"
+        "                        noise suppression mode\n"
+        "    rnnoise             rnnoise_process_frame per network kernel variant\n"
+        "    batch               rnnoise_process_frames per batch size, against single calls\n"
+        "    fft                 RNNoise transforms per frame, half-length against full FFT\n"
+        "\n"
+        "OPTIONS:\n"
+        "    --seconds <n>       Audio processed per run (default: 10)\n"
+        "    --fragment <n>      Stereo frames per microphone callback (default: 480 = 10 ms)\n");
+}
+
+double NowMicroseconds() {
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stereo test signal: a tone with noise, gated on and off every 200 ms. With
+// identicalChannels the right channel copies the left, as a mono microphone
+// delivers it.
+std::vector<int16_t> MakeSignal(size_t frames, bool identicalChannels) {
+    std::vector<int16_t> samples(frames * 2);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < frames; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = static_cast<float>(static_cast<int>(seed >> 20) - 2048);
+        float gate = (i / 9600) % 2 == 0 ? 1.0f : 0.0f;
+        float left = gate * 6000.0f * std::sin(static_cast<float>(i) * 0.03f) + noise;
+        float right = identicalChannels ? left : gate * 4000.0f * std::sin(static_cast<float>(i) * 0.05f) - noise;
+        samples[i * 2] = static_cast<int16_t>(left);
+        samples[i * 2 + 1] = static_cast<int16_t>(right);
+    }
+    return samples;
+}
+
+}  // namespace
+
+namespace snacka {
+
+class MicrophoneBench {
+public:
+    explicit MicrophoneBench(NoiseSuppressionMode mode)
+        : m_capturer(mode) {
+        m_capturer.m_callback = [](const int16_t*, size_t, uint64_t) {};
+    }
+
+    // Feed the signal in fragments and time each ProcessWithRNNoise call
+    std::vector<double> Run(const std::vector<int16_t>& signal, size_t fragment) {
+        size_t totalFrames = signal.size() / 2;
+        std::vector<double> times;
+        times.reserve(totalFrames / fragment + 1);
+        for (size_t offset = 0; offset < totalFrames; offset += fragment) {
+            size_t count = std::min(fragment, totalFrames - offset);
+            double start = NowMicroseconds();
+            m_capturer.ProcessWithRNNoise(signal.data() + offset * 2, count, 0);
+            times.push_back(NowMicroseconds() - start);
+        }
+        return times;
+    }
+
+private:
+    PulseMicrophoneCapturer m_capturer;
+};
+
+}  // namespace snacka
+
+using namespace snacka;
+
+namespace {
+
+void BenchMicrophone(const Options& options) {
+    size_t frames = static_cast<size_t>(options.seconds * PulseMicrophoneCapturer::GetSampleRate());
+    std::vector<int16_t> mono = MakeSignal(frames, true);
+    std::vector<int16_t> stereo = MakeSignal(frames, false);
+    double fragmentUs = 1e6 * static_cast<double>(options.fragment) / PulseMicrophoneCapturer::GetSampleRate();
+
+    struct Run {
+        NoiseSuppressionMode mode;
+        const char* input;
+        const std::vector<int16_t>* signal;
+    };
+    const Run runs[] = {
+        {NoiseSuppressionMode::Auto, "mono", &mono},
+        {NoiseSuppressionMode::Auto, "stereo", &stereo},
+        {NoiseSuppressionMode::Mono, "stereo", &stereo},
+        {NoiseSuppressionMode::Linked, "stereo", &stereo},
+        {NoiseSuppressionMode::Dual, "stereo", &stereo},
+    };
+    // The capturer logs to stderr, so the table is printed after the runs
+    std::vector<std::string> rows;
+    for (const Run& run : runs) {
+        MicrophoneBench bench(run.mode);
+        std::vector<double> times = bench.Run(*run.signal, options.fragment);
+
+        double total = 0;
+        for (double t : times) {
+            total += t;
+        }
+        double mean = total / static_cast<double>(times.size());
+        std::sort(times.begin(), times.end());
+        double p50 = times[times.size() / 2];
+        double p99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+
+        std::string name = std::string(NoiseSuppressionModeName(run.mode)) + " (" + run.input + ")";
+        char row[128];
+        std::snprintf(row, sizeof(row), "  %-16s %9.1f %9.1f %9.1f %9.1f %6.2f%%\n", name.c_str(), mean,
+                      p50, p99, times.back(), 100.0 * mean / fragmentUs);
+        rows.push_back(row);
+    }
+
+    std::printf("microphone: %zu-frame callbacks (%.1f ms), %.0f s of audio\n",
+                options.fragment, fragmentUs / 1000.0, options.seconds);
+    std::printf("  %-16s %9s %9s %9s %9s %7s\n", "mode", "mean us", "p50 us", "p99 us", "max us", "load");
+    for (const std::string& row : rows) {
+        std::fputs(row.c_str(), stdout);
+    }
+}
+
+// The left channel of the stereo test signal as RNNoise frames
+std::vector<float> MakeFrames(size_t frames) {
+    std::vector<int16_t> samples = MakeSignal(frames, false);
+    std::vector<float> left(frames);
+    for (size_t i = 0; i < frames; i++) {
+        left[i] = samples[i * 2];
+    }
+    return left;
+}
+
+void BenchRnnoiseArchs(const Options& options) {
+    constexpr int kFrameSize = 480;
+    constexpr int kWarmup = 50;
+    int frames = static_cast<int>(options.seconds * 100);
+    std::vector<float> in = MakeFrames(static_cast<size_t>(frames + kWarmup) * kFrameSize);
+    float out[kFrameSize];
+
+    std::printf("rnnoise: rnnoise_process_frame, %d frames per kernel variant\n", frames);
+    std::printf("  %-10s %9s %7s\n", "kernels", "us/frame", "vs c");
+    int highest = rnnoise_bench_highest_arch();
+    double baseline = 0;
+    for (int arch = 0; arch < rnnoise_bench_arch_count(); arch++) {
+        if (arch > highest) {
+            std::printf("  %-10s not supported by this CPU\n", rnnoise_bench_arch_name(arch));
+            continue;
+        }
+        DenoiseState* st = rnnoise_bench_create(arch);
+        for (int frame = 0; frame < kWarmup; frame++) {
+            rnnoise_process_frame(st, out, in.data() + frame * kFrameSize);
+        }
+        double start = NowMicroseconds();
+        for (int frame = kWarmup; frame < kWarmup + frames; frame++) {
+            rnnoise_process_frame(st, out, in.data() + frame * kFrameSize);
+        }
+        double perFrame = (NowMicroseconds() - start) / frames;
+        rnnoise_destroy(st);
+
+        if (arch == 0) {
+            baseline = perFrame;
+        }
+        std::printf("  %-10s %9.1f %6.2fx\n", rnnoise_bench_arch_name(arch), perFrame, baseline / perFrame);
+    }
+}
+
+void BenchRnnoiseBatch(const Options& options) {
+    constexpr int kFrameSize = 480;
+    constexpr int kMaxStreams = 8;
+    int frames = static_cast<int>(options.seconds * 100);
+    std::vector<float> in = MakeFrames(static_cast<size_t>(frames) * kFrameSize);
+    static float out[kMaxStreams][kFrameSize];
+
+    std::printf("batch: %d frames per stream, us per stream and frame\n", frames);
+    std::printf("  %-8s %9s %9s %7s\n", "streams", "single", "batched", "speedup");
+    for (int n = 1; n <= kMaxStreams; n++) {
+        DenoiseState* single[kMaxStreams];
+        DenoiseState* batched[kMaxStreams];
+        float* outPtrs[kMaxStreams];
+        const float* inPtrs[kMaxStreams];
+        float vad[kMaxStreams];
+        for (int s = 0; s < n; s++) {
+            single[s] = rnnoise_create(nullptr);
+            batched[s] = rnnoise_create(nullptr);
+            outPtrs[s] = out[s];
+        }
+
+        // Every stream gets the same audio; the work does not depend on it
+        double start = NowMicroseconds();
+        for (int frame = 0; frame < frames; frame++) {
+            for (int s = 0; s < n; s++) {
+                rnnoise_process_frame(single[s], out[s], in.data() + frame * kFrameSize);
+            }
+        }
+        double singleTime = (NowMicroseconds() - start) / (frames * n);
+
+        start = NowMicroseconds();
+        for (int frame = 0; frame < frames; frame++) {
+            for (int s = 0; s < n; s++) {
+                inPtrs[s] = in.data() + frame * kFrameSize;
+            }
+            rnnoise_process_frames(batched, n, outPtrs, inPtrs, vad);
+        }
+        double batchedTime = (NowMicroseconds() - start) / (frames * n);
+
+        for (int s = 0; s < n; s++) {
+            rnnoise_destroy(single[s]);
+            rnnoise_destroy(batched[s]);
+        }
+        std::printf("  %-8d %9.1f %9.1f %6.2fx\n", n, singleTime, batchedTime, singleTime / batchedTime);
+    }
+}
+
+void BenchRnnoiseTransforms(const Options& options) {
+    constexpr int kWindowSize = 960;
+    int frames = static_cast<int>(options.seconds * 100);
+    std::vector<float> in = MakeFrames(static_cast<size_t>(frames + 1) * kWindowSize / 2);
+    float out[kWindowSize];
+
+    // Consecutive windows overlap by half, as in rnnoise_process_frame
+    std::printf("fft: forward and inverse transform, %d frames\n", frames);
+    std::printf("  %-12s %9s %7s\n", "fft", "us/frame", "speedup");
+    double full = 0;
+    for (int useFull : {1, 0}) {
+        for (int frame = 0; frame < std::min(frames, 50); frame++) {
+            rnnoise_bench_transforms(out, in.data() + frame * kWindowSize / 2, useFull);
+        }
+        double start = NowMicroseconds();
+        for (int frame = 0; frame < frames; frame++) {
+            rnnoise_bench_transforms(out, in.data() + frame * kWindowSize / 2, useFull);
+        }
+        double perFrame = (NowMicroseconds() - start) / frames;
+        if (useFull) {
+            full = perFrame;
+        }
+        std::printf("  %-12s %9.2f %6.2fx\n", useFull ? "full 960" : "half 480", perFrame, full / perFrame);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    bool any = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fragment") == 0 && i + 1 < argc) {
+            options.fragment = static_cast<size_t>(std::atol(argv[++i]));
+        } else if (std::strcmp(argv[i], "microphone") == 0) {
+            options.microphone = true;
+            any = true;
+        } else if (std::strcmp(argv[i], "rnnoise") == 0) {
+            options.rnnoise = true;
+            any = true;
+        } else if (std::strcmp(argv[i], "batch") == 0) {
+            options.batch = true;
+            any = true;
+        } else if (std::strcmp(argv[i], "fft") == 0) {
+            options.fft = true;
+            any = true;
+        } else {
+            PrintUsage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (options.seconds <= 0 || options.fragment == 0) {
+        PrintUsage();
+        return 1;
+    }
+    if (!any) {
+        options.microphone = true;
+        options.rnnoise = true;
+        options.batch = true;
+        options.fft = true;
+    }
+
+    if (options.microphone) {
+        BenchMicrophone(options);
+    }
+    if (options.rnnoise) {
+        BenchRnnoiseArchs(options);
+    }
+    if (options.batch) {
+        BenchRnnoiseBatch(options);
+    }
+    if (options.fft) {
+        BenchRnnoiseTransforms(options);
+    }
+    return 0;
+}
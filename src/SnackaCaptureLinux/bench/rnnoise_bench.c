@@ -0,0 +1,73 @@
+// RNNoise internals for capture_bench (see rnnoise_bench.h)
+
+#include "denoise.c"
+
+#include "rnnoise_bench.h"
+
+#ifdef RNN_ENABLE_X86_RTCD
+static const char *s_arch_names[] = {"c", "sse4.1", "avx2+fma"};
+#else
+static const char *s_arch_names[] = {"c"};
+#endif
+
+int rnnoise_bench_arch_count(void) {
+    return (int)(sizeof(s_arch_names) / sizeof(s_arch_names[0]));
+}
+
+const char *rnnoise_bench_arch_name(int arch) {
+    return s_arch_names[arch];
+}
+
+int rnnoise_bench_highest_arch(void) {
+    return rnn_select_arch();
+}
+
+DenoiseState *rnnoise_bench_create(int arch) {
+    DenoiseState *st = rnnoise_create(NULL);
+    if (st) {
+        st->arch = arch;
+    }
+    return st;
+}
+
+// The transforms as they were, with the full complex FFT
+static void full_forward(kiss_fft_cpx *out, const float *in) {
+    kiss_fft_cpx x[WINDOW_SIZE];
+    kiss_fft_cpx y[WINDOW_SIZE];
+    for (int i = 0; i < WINDOW_SIZE; i++) {
+        x[i].r = in[i];
+        x[i].i = 0;
+    }
+    rnn_fft(&rnn_kfft, x, y, 0);
+    for (int i = 0; i < FREQ_SIZE; i++) {
+        out[i] = y[i];
+    }
+}
+
+static void full_inverse(float *out, const kiss_fft_cpx *in) {
+    kiss_fft_cpx x[WINDOW_SIZE];
+    kiss_fft_cpx y[WINDOW_SIZE];
+    for (int i = 0; i < FREQ_SIZE; i++) {
+        x[i] = in[i];
+    }
+    for (int i = FREQ_SIZE; i < WINDOW_SIZE; i++) {
+        x[i].r = x[WINDOW_SIZE - i].r;
+        x[i].i = -x[WINDOW_SIZE - i].i;
+    }
+    rnn_fft(&rnn_kfft, x, y, 0);
+    out[0] = WINDOW_SIZE * y[0].r;
+    for (int i = 1; i < WINDOW_SIZE; i++) {
+        out[i] = WINDOW_SIZE * y[WINDOW_SIZE - i].r;
+    }
+}
+
+void rnnoise_bench_transforms(float *out, const float *in, int full) {
+    kiss_fft_cpx spectrum[FREQ_SIZE];
+    if (full) {
+        full_forward(spectrum, in);
+        full_inverse(out, spectrum);
+    } else {
+        forward_transform(spectrum, in);
+        inverse_transform(out, spectrum);
+    }
+}
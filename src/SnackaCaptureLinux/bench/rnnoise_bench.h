@@ -0,0 +1,29 @@
+#pragma once
+
+// RNNoise internals for capture_bench. rnnoise_bench.c includes denoise.c to
+// reach them, so capture_bench builds it in place of denoise.c.
+
+#include "rnnoise.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Network kernel variants built in: C, then SSE4.1 and AVX2+FMA on x86
+int rnnoise_bench_arch_count(void);
+const char *rnnoise_bench_arch_name(int arch);
+
+// Highest variant this CPU supports, as rnnoise_create selects it
+int rnnoise_bench_highest_arch(void);
+
+// Create a state that runs the given kernel variant
+DenoiseState *rnnoise_bench_create(int arch);
+
+// Forward and inverse transform of one 960-sample window, with the
+// half-length FFT rnnoise_process_frame runs or, if full is set, the
+// 960-point complex FFT it replaced
+void rnnoise_bench_transforms(float *out, const float *in, int full);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,453 @@
+#include "ColorConverter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SNACKA_COLOR_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define SNACKA_COLOR_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+
+namespace snacka {
+
+// BT.601 limited range, 8-bit fixed point:
+//   Y = ((66R + 129G + 25B + 128) >> 8) + 16
+//   U = ((-38R - 74G + 112B + 128) >> 8) + 128
+//   V = ((112R - 94G - 18B + 128) >> 8) + 128
+// Every intermediate of the U/V expressions fits in int16 and the Y expression fits in
+// uint16, so the SIMD kernels compute them in 16-bit lanes and match the scalar path exactly.
+
+namespace {
+
+inline uint8_t LumaScalar(int r, int g, int b) {
+    int y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    return static_cast<uint8_t>(std::clamp(y, 0, 255));
+}
+
+inline void ConvertLumaRowScalar(const uint8_t* src, uint8_t* yRow, int x0, int width) {
+    for (int x = x0; x < width; x++) {
+        const uint8_t* pixel = src + x * 4;
+        yRow[x] = LumaScalar(pixel[2], pixel[1], pixel[0]);
+    }
+}
+
+inline void ConvertChromaRowScalar(const uint8_t* src0, const uint8_t* src1, uint8_t* uvRow,
+                                   int x0, int width) {
+    for (int x = x0; x + 1 < width; x += 2) {
+        const uint8_t* p0 = src0 + x * 4;
+        const uint8_t* p1 = src1 + x * 4;
+
+        int b = (p0[0] + p0[4] + p1[0] + p1[4]) / 4;
+        int g = (p0[1] + p0[5] + p1[1] + p1[5]) / 4;
+        int r = (p0[2] + p0[6] + p1[2] + p1[6]) / 4;
+
+        int u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        int v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+
+        uvRow[x] = static_cast<uint8_t>(std::clamp(u, 0, 255));
+        uvRow[x + 1] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+    }
+}
+
+// Finish a row pair (or a trailing single row) with the scalar path from column x0
+inline void ConvertTailScalar(const uint8_t* src0, const uint8_t* src1,
+                              uint8_t* yRow0, uint8_t* yRow1, uint8_t* uvRow,
+                              int x0, int width) {
+    ConvertLumaRowScalar(src0, yRow0, x0, width);
+    if (src1) {
+        ConvertLumaRowScalar(src1, yRow1, x0, width);
+        ConvertChromaRowScalar(src0, src1, uvRow, x0, width);
+    }
+}
+
+#if defined(SNACKA_COLOR_X86)
+
+// ---------------------------------------------------------------------------
+// SSE2 (baseline on x86-64): 16 pixels x 2 rows per iteration
+// ---------------------------------------------------------------------------
+
+// Load 8 BGRA pixels and split them into 16-bit B, G and R lanes
+inline void LoadBGR8_SSE2(const uint8_t* p, __m128i& b, __m128i& g, __m128i& r) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+
+    b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                        _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                        _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+inline __m128i Luma_SSE2(__m128i b, __m128i g, __m128i r) {
+    // Unsigned 16-bit arithmetic; the sum never exceeds 56228
+    __m128i y = _mm_mullo_epi16(r, _mm_set1_epi16(66));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_add_epi16(y, _mm_set1_epi16(128));
+    return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+// Average 2x2 blocks of two rows of 8 pixels: 4 results in 32-bit lanes
+inline __m128i Average2x2_SSE2(__m128i row0, __m128i row1) {
+    __m128i sum = _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+    return _mm_srli_epi32(sum, 2);
+}
+
+// Chroma for 8 averaged pixels, returned as interleaved U/V bytes
+inline __m128i Chroma_SSE2(__m128i b, __m128i g, __m128i r) {
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxVal = _mm_set1_epi16(255);
+
+    __m128i u = _mm_mullo_epi16(r, _mm_set1_epi16(-38));
+    u = _mm_add_epi16(u, _mm_mullo_epi16(g, _mm_set1_epi16(-74)));
+    u = _mm_add_epi16(u, _mm_mullo_epi16(b, _mm_set1_epi16(112)));
+    u = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(u, round), 8), round);
+
+    __m128i v = _mm_mullo_epi16(r, _mm_set1_epi16(112));
+    v = _mm_add_epi16(v, _mm_mullo_epi16(g, _mm_set1_epi16(-94)));
+    v = _mm_add_epi16(v, _mm_mullo_epi16(b, _mm_set1_epi16(-18)));
+    v = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(v, round), 8), round);
+
+    u = _mm_max_epi16(_mm_min_epi16(u, maxVal), zero);
+    v = _mm_max_epi16(_mm_min_epi16(v, maxVal), zero);
+    return _mm_or_si128(u, _mm_slli_epi16(v, 8));
+}
+
+void ConvertBGRAToNV12SSE2(const uint8_t* bgra, int srcStride,
+                           uint8_t* yPlane, int yStride,
+                           uint8_t* uvPlane, int uvStride,
+                           int width, int height) {
+    const int simdWidth = width & ~15;
+
+    int y = 0;
+    for (; y + 1 < height; y += 2) {
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        const uint8_t* src1 = src0 + srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        uint8_t* yRow1 = yRow0 + yStride;
+        uint8_t* uvRow = uvPlane + static_cast<size_t>(y / 2) * uvStride;
+
+        for (int x = 0; x < simdWidth; x += 16) {
+            __m128i b0a, g0a, r0a, b0b, g0b, r0b;
+            __m128i b1a, g1a, r1a, b1b, g1b, r1b;
+            LoadBGR8_SSE2(src0 + x * 4, b0a, g0a, r0a);
+            LoadBGR8_SSE2(src0 + x * 4 + 32, b0b, g0b, r0b);
+            LoadBGR8_SSE2(src1 + x * 4, b1a, g1a, r1a);
+            LoadBGR8_SSE2(src1 + x * 4 + 32, b1b, g1b, r1b);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(yRow0 + x),
+                             _mm_packus_epi16(Luma_SSE2(b0a, g0a, r0a), Luma_SSE2(b0b, g0b, r0b)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(yRow1 + x),
+                             _mm_packus_epi16(Luma_SSE2(b1a, g1a, r1a), Luma_SSE2(b1b, g1b, r1b)));
+
+            __m128i b = _mm_packs_epi32(Average2x2_SSE2(b0a, b1a), Average2x2_SSE2(b0b, b1b));
+            __m128i g = _mm_packs_epi32(Average2x2_SSE2(g0a, g1a), Average2x2_SSE2(g0b, g1b));
+            __m128i r = _mm_packs_epi32(Average2x2_SSE2(r0a, r1a), Average2x2_SSE2(r0b, r1b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(uvRow + x), Chroma_SSE2(b, g, r));
+        }
+
+        ConvertTailScalar(src0, src1, yRow0, yRow1, uvRow, simdWidth, width);
+    }
+
+    if (y < height) {
+        // Odd height: the last row only contributes luma
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        for (int x = 0; x < simdWidth; x += 16) {
+            __m128i ba, ga, ra, bb, gb, rb;
+            LoadBGR8_SSE2(src0 + x * 4, ba, ga, ra);
+            LoadBGR8_SSE2(src0 + x * 4 + 32, bb, gb, rb);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(yRow0 + x),
+                             _mm_packus_epi16(Luma_SSE2(ba, ga, ra), Luma_SSE2(bb, gb, rb)));
+        }
+        ConvertTailScalar(src0, nullptr, yRow0, nullptr, nullptr, simdWidth, width);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AVX2: 32 pixels x 2 rows per iteration, compiled for AVX2 only in these functions
+// so the binary still runs on CPUs without it
+// ---------------------------------------------------------------------------
+
+#define SNACKA_TARGET_AVX2 __attribute__((target("avx2")))
+
+// Load 16 BGRA pixels and split them into 16-bit B, G and R lanes (in pixel order)
+SNACKA_TARGET_AVX2
+inline void LoadBGR16_AVX2(const uint8_t* p, __m256i& b, __m256i& g, __m256i& r) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+
+    // packs works per 128-bit lane; the permute restores pixel order
+    b = _mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask));
+    g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+                           _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask));
+    r = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+                           _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+    b = _mm256_permute4x64_epi64(b, 0xD8);
+    g = _mm256_permute4x64_epi64(g, 0xD8);
+    r = _mm256_permute4x64_epi64(r, 0xD8);
+}
+
+SNACKA_TARGET_AVX2
+inline __m256i Luma_AVX2(__m256i b, __m256i g, __m256i r) {
+    __m256i y = _mm256_mullo_epi16(r, _mm256_set1_epi16(66));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+    y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+    return _mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(16));
+}
+
+SNACKA_TARGET_AVX2
+inline __m256i PackLuma_AVX2(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+SNACKA_TARGET_AVX2
+inline __m256i Average2x2_AVX2(__m256i row0, __m256i row1) {
+    __m256i sum = _mm256_madd_epi16(_mm256_add_epi16(row0, row1), _mm256_set1_epi16(1));
+    return _mm256_srli_epi32(sum, 2);
+}
+
+SNACKA_TARGET_AVX2
+inline __m256i PackAverages_AVX2(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+}
+
+SNACKA_TARGET_AVX2
+inline __m256i Chroma_AVX2(__m256i b, __m256i g, __m256i r) {
+    const __m256i round = _mm256_set1_epi16(128);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxVal = _mm256_set1_epi16(255);
+
+    __m256i u = _mm256_mullo_epi16(r, _mm256_set1_epi16(-38));
+    u = _mm256_add_epi16(u, _mm256_mullo_epi16(g, _mm256_set1_epi16(-74)));
+    u = _mm256_add_epi16(u, _mm256_mullo_epi16(b, _mm256_set1_epi16(112)));
+    u = _mm256_add_epi16(_mm256_srai_epi16(_mm256_add_epi16(u, round), 8), round);
+
+    __m256i v = _mm256_mullo_epi16(r, _mm256_set1_epi16(112));
+    v = _mm256_add_epi16(v, _mm256_mullo_epi16(g, _mm256_set1_epi16(-94)));
+    v = _mm256_add_epi16(v, _mm256_mullo_epi16(b, _mm256_set1_epi16(-18)));
+    v = _mm256_add_epi16(_mm256_srai_epi16(_mm256_add_epi16(v, round), 8), round);
+
+    u = _mm256_max_epi16(_mm256_min_epi16(u, maxVal), zero);
+    v = _mm256_max_epi16(_mm256_min_epi16(v, maxVal), zero);
+    return _mm256_or_si256(u, _mm256_slli_epi16(v, 8));
+}
+
+SNACKA_TARGET_AVX2
+void ConvertBGRAToNV12AVX2(const uint8_t* bgra, int srcStride,
+                           uint8_t* yPlane, int yStride,
+                           uint8_t* uvPlane, int uvStride,
+                           int width, int height) {
+    const int simdWidth = width & ~31;
+
+    int y = 0;
+    for (; y + 1 < height; y += 2) {
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        const uint8_t* src1 = src0 + srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        uint8_t* yRow1 = yRow0 + yStride;
+        uint8_t* uvRow = uvPlane + static_cast<size_t>(y / 2) * uvStride;
+
+        for (int x = 0; x < simdWidth; x += 32) {
+            __m256i b0a, g0a, r0a, b0b, g0b, r0b;
+            __m256i b1a, g1a, r1a, b1b, g1b, r1b;
+            LoadBGR16_AVX2(src0 + x * 4, b0a, g0a, r0a);
+            LoadBGR16_AVX2(src0 + x * 4 + 64, b0b, g0b, r0b);
+            LoadBGR16_AVX2(src1 + x * 4, b1a, g1a, r1a);
+            LoadBGR16_AVX2(src1 + x * 4 + 64, b1b, g1b, r1b);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(yRow0 + x),
+                                PackLuma_AVX2(Luma_AVX2(b0a, g0a, r0a), Luma_AVX2(b0b, g0b, r0b)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(yRow1 + x),
+                                PackLuma_AVX2(Luma_AVX2(b1a, g1a, r1a), Luma_AVX2(b1b, g1b, r1b)));
+
+            __m256i b = PackAverages_AVX2(Average2x2_AVX2(b0a, b1a), Average2x2_AVX2(b0b, b1b));
+            __m256i g = PackAverages_AVX2(Average2x2_AVX2(g0a, g1a), Average2x2_AVX2(g0b, g1b));
+            __m256i r = PackAverages_AVX2(Average2x2_AVX2(r0a, r1a), Average2x2_AVX2(r0b, r1b));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(uvRow + x), Chroma_AVX2(b, g, r));
+        }
+
+        ConvertTailScalar(src0, src1, yRow0, yRow1, uvRow, simdWidth, width);
+    }
+
+    if (y < height) {
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        for (int x = 0; x < simdWidth; x += 32) {
+            __m256i ba, ga, ra, bb, gb, rb;
+            LoadBGR16_AVX2(src0 + x * 4, ba, ga, ra);
+            LoadBGR16_AVX2(src0 + x * 4 + 64, bb, gb, rb);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(yRow0 + x),
+                                PackLuma_AVX2(Luma_AVX2(ba, ga, ra), Luma_AVX2(bb, gb, rb)));
+        }
+        ConvertTailScalar(src0, nullptr, yRow0, nullptr, nullptr, simdWidth, width);
+    }
+}
+
+#undef SNACKA_TARGET_AVX2
+
+#elif defined(SNACKA_COLOR_NEON)
+
+// ---------------------------------------------------------------------------
+// NEON (baseline on AArch64): 16 pixels x 2 rows per iteration
+// ---------------------------------------------------------------------------
+
+inline uint8x16_t Luma_NEON(uint8x16_t b, uint8x16_t g, uint8x16_t r) {
+    const uint16x8_t round = vdupq_n_u16(128);
+    const uint8x8_t offset = vdup_n_u8(16);
+
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), vdup_n_u8(66));
+    lo = vmlal_u8(lo, vget_low_u8(g), vdup_n_u8(129));
+    lo = vmlal_u8(lo, vget_low_u8(b), vdup_n_u8(25));
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), vdup_n_u8(66));
+    hi = vmlal_u8(hi, vget_high_u8(g), vdup_n_u8(129));
+    hi = vmlal_u8(hi, vget_high_u8(b), vdup_n_u8(25));
+
+    return vcombine_u8(vadd_u8(vshrn_n_u16(vaddq_u16(lo, round), 8), offset),
+                       vadd_u8(vshrn_n_u16(vaddq_u16(hi, round), 8), offset));
+}
+
+// Average 2x2 blocks of two rows of 16 pixels: 8 results in 16-bit lanes
+inline int16x8_t Average2x2_NEON(uint8x16_t row0, uint8x16_t row1) {
+    uint16x8_t sum = vaddq_u16(vpaddlq_u8(row0), vpaddlq_u8(row1));
+    return vreinterpretq_s16_u16(vshrq_n_u16(sum, 2));
+}
+
+void ConvertBGRAToNV12NEON(const uint8_t* bgra, int srcStride,
+                           uint8_t* yPlane, int yStride,
+                           uint8_t* uvPlane, int uvStride,
+                           int width, int height) {
+    const int simdWidth = width & ~15;
+    const int16x8_t round = vdupq_n_s16(128);
+
+    int y = 0;
+    for (; y + 1 < height; y += 2) {
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        const uint8_t* src1 = src0 + srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        uint8_t* yRow1 = yRow0 + yStride;
+        uint8_t* uvRow = uvPlane + static_cast<size_t>(y / 2) * uvStride;
+
+        for (int x = 0; x < simdWidth; x += 16) {
+            // val[0] = B, val[1] = G, val[2] = R, val[3] = X
+            uint8x16x4_t p0 = vld4q_u8(src0 + x * 4);
+            uint8x16x4_t p1 = vld4q_u8(src1 + x * 4);
+
+            vst1q_u8(yRow0 + x, Luma_NEON(p0.val[0], p0.val[1], p0.val[2]));
+            vst1q_u8(yRow1 + x, Luma_NEON(p1.val[0], p1.val[1], p1.val[2]));
+
+            int16x8_t b = Average2x2_NEON(p0.val[0], p1.val[0]);
+            int16x8_t g = Average2x2_NEON(p0.val[1], p1.val[1]);
+            int16x8_t r = Average2x2_NEON(p0.val[2], p1.val[2]);
+
+            int16x8_t u = vmulq_n_s16(r, -38);
+            u = vmlaq_n_s16(u, g, -74);
+            u = vmlaq_n_s16(u, b, 112);
+            u = vaddq_s16(vshrq_n_s16(vaddq_s16(u, round), 8), round);
+
+            int16x8_t v = vmulq_n_s16(r, 112);
+            v = vmlaq_n_s16(v, g, -94);
+            v = vmlaq_n_s16(v, b, -18);
+            v = vaddq_s16(vshrq_n_s16(vaddq_s16(v, round), 8), round);
+
+            uint8x8x2_t uv;
+            uv.val[0] = vqmovun_s16(u);
+            uv.val[1] = vqmovun_s16(v);
+            vst2_u8(uvRow + x, uv);
+        }
+
+        ConvertTailScalar(src0, src1, yRow0, yRow1, uvRow, simdWidth, width);
+    }
+
+    if (y < height) {
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        for (int x = 0; x < simdWidth; x += 16) {
+            uint8x16x4_t p0 = vld4q_u8(src0 + x * 4);
+            vst1q_u8(yRow0 + x, Luma_NEON(p0.val[0], p0.val[1], p0.val[2]));
+        }
+        ConvertTailScalar(src0, nullptr, yRow0, nullptr, nullptr, simdWidth, width);
+    }
+}
+
+#endif
+
+}  // namespace
+
+void ConvertBGRAToNV12Scalar(const uint8_t* bgra, int srcStride,
+                             uint8_t* yPlane, int yStride,
+                             uint8_t* uvPlane, int uvStride,
+                             int width, int height) {
+    int y = 0;
+    for (; y + 1 < height; y += 2) {
+        const uint8_t* src0 = bgra + static_cast<size_t>(y) * srcStride;
+        uint8_t* yRow0 = yPlane + static_cast<size_t>(y) * yStride;
+        ConvertTailScalar(src0, src0 + srcStride, yRow0, yRow0 + yStride,
+                          uvPlane + static_cast<size_t>(y / 2) * uvStride, 0, width);
+    }
+    if (y < height) {
+        ConvertTailScalar(bgra + static_cast<size_t>(y) * srcStride, nullptr,
+                          yPlane + static_cast<size_t>(y) * yStride, nullptr, nullptr, 0, width);
+    }
+}
+
+BGRAToNV12Fn GetBGRAToNV12Kernel(ColorConverterIsa isa) {
+    switch (isa) {
+        case ColorConverterIsa::Scalar:
+            return ConvertBGRAToNV12Scalar;
+#if defined(SNACKA_COLOR_X86)
+        case ColorConverterIsa::SSE2:
+            return __builtin_cpu_supports("sse2") ? ConvertBGRAToNV12SSE2 : nullptr;
+        case ColorConverterIsa::AVX2:
+            return __builtin_cpu_supports("avx2") ? ConvertBGRAToNV12AVX2 : nullptr;
+#elif defined(SNACKA_COLOR_NEON)
+        case ColorConverterIsa::NEON:
+            return ConvertBGRAToNV12NEON;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+BGRAToNV12Fn SelectBGRAToNV12Kernel(ColorConverterIsa* selectedIsa) {
+    // Fastest first
+    static constexpr ColorConverterIsa kPreference[] = {
+        ColorConverterIsa::AVX2,
+        ColorConverterIsa::NEON,
+        ColorConverterIsa::SSE2,
+        ColorConverterIsa::Scalar,
+    };
+
+    for (ColorConverterIsa isa : kPreference) {
+        if (BGRAToNV12Fn kernel = GetBGRAToNV12Kernel(isa)) {
+            if (selectedIsa) {
+                *selectedIsa = isa;
+            }
+            return kernel;
+        }
+    }
+
+    // Unreachable: the scalar kernel is always available
+    if (selectedIsa) {
+        *selectedIsa = ColorConverterIsa::Scalar;
+    }
+    return ConvertBGRAToNV12Scalar;
+}
+
+const char* ColorConverterIsaName(ColorConverterIsa isa) {
+    switch (isa) {
+        case ColorConverterIsa::Scalar: return "scalar";
+        case ColorConverterIsa::SSE2: return "SSE2";
+        case ColorConverterIsa::AVX2: return "AVX2";
+        case ColorConverterIsa::NEON: return "NEON";
+    }
+    return "unknown";
+}
+
+}  // namespace snacka
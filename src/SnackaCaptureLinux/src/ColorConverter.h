@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace snacka {
+
+/// BGRA (32bpp, XShm ZPixmap layout) to NV12 conversion kernel.
+/// Converts a width x height block of pixels with BT.601 limited-range coefficients,
+/// writing the Y plane and the interleaved UV plane in a single pass over the source.
+/// Chroma is the truncated average of each 2x2 block.
+/// Callers may convert a sub-rectangle by offsetting all three pointers, as long as the
+/// rectangle starts on an even row and column so chroma stays aligned.
+/// @param bgra Source pixels (B, G, R, X byte order)
+/// @param srcStride Source row pitch in bytes
+/// @param yPlane Destination Y plane
+/// @param yStride Y plane row pitch in bytes
+/// @param uvPlane Destination interleaved UV plane
+/// @param uvStride UV plane row pitch in bytes
+/// @param width Number of pixels per row to convert
+/// @param height Number of rows to convert
+using BGRAToNV12Fn = void (*)(const uint8_t* bgra, int srcStride,
+                              uint8_t* yPlane, int yStride,
+                              uint8_t* uvPlane, int uvStride,
+                              int width, int height);
+
+/// Instruction set used by a conversion kernel
+enum class ColorConverterIsa {
+    Scalar,
+    SSE2,
+    AVX2,
+    NEON
+};
+
+/// Scalar reference implementation. All SIMD kernels are bit-exact with this one.
+void ConvertBGRAToNV12Scalar(const uint8_t* bgra, int srcStride,
+                             uint8_t* yPlane, int yStride,
+                             uint8_t* uvPlane, int uvStride,
+                             int width, int height);
+
+/// Get the kernel for a specific instruction set
+/// @return nullptr if the kernel is not compiled in or not supported by this CPU
+BGRAToNV12Fn GetBGRAToNV12Kernel(ColorConverterIsa isa);
+
+/// Pick the fastest kernel supported by the running CPU
+/// @param selectedIsa Receives the instruction set of the returned kernel (optional)
+BGRAToNV12Fn SelectBGRAToNV12Kernel(ColorConverterIsa* selectedIsa = nullptr);
+
+/// Get a printable name for an instruction set
+const char* ColorConverterIsaName(ColorConverterIsa isa);
+
+}  // namespace snacka
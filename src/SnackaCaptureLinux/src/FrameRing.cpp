@@ -0,0 +1,223 @@
+#include "FrameRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace snacka {
+
+bool ParseDropPolicy(const std::string& name, DropPolicy& policy) {
+    if (name == "oldest") {
+        policy = DropPolicy::DropOldest;
+    } else if (name == "newest") {
+        policy = DropPolicy::DropNewest;
+    } else if (name == "block") {
+        policy = DropPolicy::Block;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* DropPolicyName(DropPolicy policy) {
+    switch (policy) {
+        case DropPolicy::DropOldest: return "oldest";
+        case DropPolicy::DropNewest: return "newest";
+        case DropPolicy::Block: return "block";
+    }
+    return "unknown";
+}
+
+FrameRing::FrameRing(size_t capacity, size_t maxFrameSize, DropPolicy policy, bool resyncOnKeyframe)
+    : m_capacity(std::max<size_t>(1, capacity))
+    , m_policy(policy)
+    , m_resyncOnKeyframe(resyncOnKeyframe)
+    , m_buffers(m_capacity + 1)
+    , m_queue(m_capacity)
+    , m_free(m_capacity + 1) {
+    // Every buffer starts on the free list
+    for (size_t i = 0; i < m_buffers.size(); i++) {
+        // Default-initialized, so untouched pages of large slots stay uncommitted
+        m_buffers[i].capacity = std::max<size_t>(1, maxFrameSize);
+        m_buffers[i].data.reset(new uint8_t[m_buffers[i].capacity]);
+        m_free[i] = static_cast<uint32_t>(i);
+    }
+    m_freeWrite.store(m_buffers.size(), std::memory_order_relaxed);
+}
+
+bool FrameRing::Push(const uint8_t* data, size_t size, uint64_t timestamp, bool isKeyframe) {
+    const uint64_t sequence = m_nextSequence++;
+    const uint64_t write = m_write.load(std::memory_order_relaxed);
+    uint32_t buffer = NO_BUFFER;
+    bool droppedAny = false;
+
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+
+    while (true) {
+        uint64_t read = m_read.load(std::memory_order_acquire);
+        if (write - read < m_capacity) {
+            break;
+        }
+
+        if (m_policy == DropPolicy::DropNewest ||
+            (m_policy == DropPolicy::Block && m_closed.load(std::memory_order_acquire))) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (m_policy == DropPolicy::DropOldest) {
+            // Races with the consumer taking the same frame; whoever wins the CAS owns
+            // its buffer, so the producer reuses it for this frame
+            uint32_t oldest = m_queue[read % m_capacity].load(std::memory_order_relaxed);
+            if (m_read.compare_exchange_weak(read, read + 1, std::memory_order_acq_rel)) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                buffer = oldest;
+                droppedAny = true;
+                break;
+            }
+            continue;
+        }
+
+        // Block: sleep until the consumer takes a frame (re-check after reading the event count)
+        auto start = std::chrono::steady_clock::now();
+        uint32_t events = m_consumerEvents.load(std::memory_order_acquire);
+        if (write - m_read.load(std::memory_order_acquire) >= m_capacity &&
+            !m_closed.load(std::memory_order_acquire)) {
+            m_consumerEvents.wait(events, std::memory_order_acquire);
+        }
+        m_blockedUs.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    }
+
+    if (buffer == NO_BUFFER) {
+        // With fewer than capacity frames queued and at most one held by the consumer,
+        // at least one of the capacity + 1 buffers is on the free list
+        uint64_t freeRead = m_freeRead.load(std::memory_order_relaxed);
+        if (freeRead == m_freeWrite.load(std::memory_order_acquire)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer = m_free[freeRead % m_free.size()];
+        m_freeRead.store(freeRead + 1, std::memory_order_release);
+    }
+
+    // The producer owns the buffer until it is queued, so it can grow it
+    RingFrame& frame = m_buffers[buffer];
+    if (size > frame.capacity) {
+        frame.data.reset(new uint8_t[size]);
+        frame.capacity = size;
+        m_grown.fetch_add(1, std::memory_order_relaxed);
+    }
+    memcpy(frame.data.get(), data, size);
+    frame.size = size;
+    frame.timestamp = timestamp;
+    frame.sequence = sequence;
+    frame.isKeyframe = isKeyframe;
+
+    m_queue[write % m_capacity].store(buffer, std::memory_order_relaxed);
+    m_write.store(write + 1, std::memory_order_release);
+    NotifyProducer();
+
+    uint32_t depth = static_cast<uint32_t>(write + 1 - m_read.load(std::memory_order_relaxed));
+    if (depth > m_maxDepth.load(std::memory_order_relaxed)) {
+        m_maxDepth.store(depth, std::memory_order_relaxed);
+    }
+
+    return !droppedAny;
+}
+
+const RingFrame* FrameRing::Pop() {
+    while (true) {
+        // The frame returned last time is done with
+        ReleaseHeldBuffer();
+
+        uint64_t read = m_read.load(std::memory_order_acquire);
+        if (read == m_write.load(std::memory_order_acquire)) {
+            // Empty: sleep until the producer pushes (re-check after reading the event count)
+            uint32_t events = m_producerEvents.load(std::memory_order_acquire);
+            bool closed = m_closed.load(std::memory_order_acquire);
+            if (read != m_write.load(std::memory_order_acquire)) {
+                continue;
+            }
+            if (closed) {
+                return nullptr;
+            }
+            m_producerEvents.wait(events, std::memory_order_acquire);
+            continue;
+        }
+
+        // Claim the frame; fails if the producer dropped it in the meantime, in which
+        // case the index read here may already be stale
+        uint32_t buffer = m_queue[read % m_capacity].load(std::memory_order_relaxed);
+        if (!m_read.compare_exchange_weak(read, read + 1, std::memory_order_acq_rel)) {
+            continue;
+        }
+        m_heldBuffer = buffer;
+        NotifyConsumer();
+
+        const RingFrame& frame = m_buffers[buffer];
+        bool gap = frame.sequence != m_lastSequence + 1;
+        m_lastSequence = frame.sequence;
+
+        // Frames after a gap reference pictures that never arrived
+        if (m_resyncOnKeyframe) {
+            if (gap) {
+                m_resyncing = true;
+            }
+            if (m_resyncing && !frame.isKeyframe) {
+                m_skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            m_resyncing = false;
+        }
+
+        m_popped.fetch_add(1, std::memory_order_relaxed);
+        return &frame;
+    }
+}
+
+void FrameRing::ReleaseHeldBuffer() {
+    if (m_heldBuffer == NO_BUFFER) {
+        return;
+    }
+    // Never overflows: the free list has room for every buffer
+    uint64_t freeWrite = m_freeWrite.load(std::memory_order_relaxed);
+    m_free[freeWrite % m_free.size()] = m_heldBuffer;
+    m_freeWrite.store(freeWrite + 1, std::memory_order_release);
+    m_heldBuffer = NO_BUFFER;
+}
+
+void FrameRing::Close() {
+    m_closed.store(true, std::memory_order_release);
+    NotifyProducer();
+    NotifyConsumer();
+}
+
+FrameRingStats FrameRing::GetStats() const {
+    FrameRingStats stats;
+    stats.pushed = m_pushed.load(std::memory_order_relaxed);
+    stats.popped = m_popped.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    stats.skipped = m_skipped.load(std::memory_order_relaxed);
+    stats.blockedUs = m_blockedUs.load(std::memory_order_relaxed);
+    stats.grown = m_grown.load(std::memory_order_relaxed);
+    uint64_t read = m_read.load(std::memory_order_relaxed);
+    uint64_t write = m_write.load(std::memory_order_relaxed);
+    stats.depth = static_cast<uint32_t>(write > read ? write - read : 0);
+    stats.maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void FrameRing::NotifyProducer() {
+    // Wakes a consumer waiting for frames
+    m_producerEvents.fetch_add(1, std::memory_order_release);
+    m_producerEvents.notify_one();
+}
+
+void FrameRing::NotifyConsumer() {
+    // Wakes a producer waiting for space
+    m_consumerEvents.fetch_add(1, std::memory_order_release);
+    m_consumerEvents.notify_one();
+}
+
+}  // namespace snacka
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// What FrameRing::Push does when every slot is taken
+enum class DropPolicy {
+    DropOldest,  // Discard the oldest queued frame (lowest latency)
+    DropNewest,  // Discard the frame being pushed
+    Block        // Wait for the consumer (nothing lost, the producer absorbs the stall)
+};
+
+/// Parse a --drop-policy value ("oldest", "newest" or "block")
+/// @return false if the name is not recognized
+bool ParseDropPolicy(const std::string& name, DropPolicy& policy);
+
+/// Get the command line name of a policy
+const char* DropPolicyName(DropPolicy policy);
+
+/// A queued frame
+struct RingFrame {
+    std::unique_ptr<uint8_t[]> data;  // Preallocated; only the first size bytes are valid
+    size_t capacity = 0;        // Bytes allocated at data
+    size_t size = 0;
+    uint64_t timestamp = 0;
+    uint64_t sequence = 0;      // Push order, counting dropped frames too
+    bool isKeyframe = false;
+};
+
+/// Ring counters (a snapshot, readable from any thread)
+struct FrameRingStats {
+    uint64_t pushed = 0;     // Frames offered by the producer
+    uint64_t popped = 0;     // Frames handed to the consumer
+    uint64_t dropped = 0;    // Frames discarded by the drop policy
+    uint64_t skipped = 0;    // Frames discarded while waiting for a keyframe after a drop
+    uint64_t blockedUs = 0;  // Time the producer spent waiting for space (Block policy)
+    uint64_t grown = 0;      // Slots reallocated for a frame above the preallocated size
+    uint32_t depth = 0;      // Frames queued now
+    uint32_t maxDepth = 0;   // Most frames ever queued at once
+};
+
+/// Fixed-capacity single-producer/single-consumer queue of frame copies.
+/// Push and Pop never take a lock; they only sleep (on a futex) when the ring
+/// is empty or, with DropPolicy::Block, full. Every slot is allocated at the
+/// expected frame size up front, so pushes only allocate to grow a slot for a
+/// larger frame (say, when a camera negotiates a bigger format).
+class FrameRing {
+public:
+    /// @param capacity Frames that can be queued
+    /// @param maxFrameSize Bytes preallocated per frame; a slot given a larger frame
+    ///        is reallocated. Pages are only touched once a frame that large is queued.
+    /// @param policy What Push does when the ring is full
+    /// @param resyncOnKeyframe After a drop, discard frames up to the next keyframe
+    ///        (for inter-coded streams that cannot be decoded across a gap)
+    FrameRing(size_t capacity, size_t maxFrameSize, DropPolicy policy, bool resyncOnKeyframe);
+
+    /// Queue a copy of a frame. Producer thread only.
+    /// @return false if this frame (or a queued one, to make room) was dropped
+    bool Push(const uint8_t* data, size_t size, uint64_t timestamp, bool isKeyframe = false);
+
+    /// Take the next frame, waiting while the ring is empty. Consumer thread only.
+    /// The frame stays valid until the next call to Pop().
+    /// @return null once the ring is closed and drained
+    const RingFrame* Pop();
+
+    /// Stop waiting: Pop() returns null once drained, and a blocked Push() drops its frame
+    void Close();
+
+    /// Get a snapshot of the counters
+    FrameRingStats GetStats() const;
+
+private:
+    void ReleaseHeldBuffer();
+    void NotifyConsumer();
+    void NotifyProducer();
+
+    const size_t m_capacity;
+    const DropPolicy m_policy;
+    const bool m_resyncOnKeyframe;
+
+    // Frame buffers; one more than the capacity so the consumer can hold one while
+    // the ring is full. Each buffer is owned by exactly one of: the queue, the free
+    // list, the producer (while filling) or the consumer (until its next Pop).
+    std::vector<RingFrame> m_buffers;
+
+    // Queue of buffer indices. Indices are not wrapped. The producer owns m_write;
+    // m_read is advanced by the consumer, and by the producer when it drops the
+    // oldest frame (the CAS winner owns that buffer).
+    std::vector<std::atomic<uint32_t>> m_queue;
+    alignas(64) std::atomic<uint64_t> m_write{0};
+    alignas(64) std::atomic<uint64_t> m_read{0};
+
+    // Buffers handed back by the consumer (consumer owns m_freeWrite, producer m_freeRead)
+    std::vector<uint32_t> m_free;
+    alignas(64) std::atomic<uint64_t> m_freeWrite{0};
+    alignas(64) std::atomic<uint64_t> m_freeRead{0};
+
+    // Bumped on every push/pop so the other side can sleep on them
+    alignas(64) std::atomic<uint32_t> m_producerEvents{0};
+    alignas(64) std::atomic<uint32_t> m_consumerEvents{0};
+    std::atomic<bool> m_closed{false};
+
+    static constexpr uint32_t NO_BUFFER = UINT32_MAX;
+
+    // Producer state
+    uint64_t m_nextSequence = 0;
+
+    // Consumer state
+    uint32_t m_heldBuffer = NO_BUFFER;
+    uint64_t m_lastSequence = UINT64_MAX;
+    bool m_resyncing = false;
+
+    // Counters
+    std::atomic<uint64_t> m_pushed{0};
+    std::atomic<uint64_t> m_popped{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_skipped{0};
+    std::atomic<uint64_t> m_blockedUs{0};
+    std::atomic<uint64_t> m_grown{0};
+    std::atomic<uint32_t> m_maxDepth{0};
+};
+
+}  // namespace snacka
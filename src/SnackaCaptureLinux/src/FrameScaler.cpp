@@ -0,0 +1,306 @@
+#include "FrameScaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace snacka {
+
+namespace {
+
+constexpr int WEIGHT_BITS = 14;
+constexpr int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+// Horizontal pass keeps 6 fractional bits: (Q14 * 8-bit) >> 8 = Q6
+constexpr int HORIZONTAL_SHIFT = 8;
+// Vertical pass: Q14 * Q6 = Q20 back to 8-bit
+constexpr int VERTICAL_SHIFT = 20;
+
+inline uint32_t LoadPixel(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline void StorePixel(uint8_t* p, uint32_t value) {
+    std::memcpy(p, &value, sizeof(value));
+}
+
+}  // namespace
+
+bool ParseScaleFilter(const std::string& name, ScaleFilter& filter) {
+    if (name == "nearest") {
+        filter = ScaleFilter::Nearest;
+    } else if (name == "bilinear") {
+        filter = ScaleFilter::Bilinear;
+    } else if (name == "box") {
+        filter = ScaleFilter::Box;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* ScaleFilterName(ScaleFilter filter) {
+    switch (filter) {
+        case ScaleFilter::Nearest: return "nearest";
+        case ScaleFilter::Bilinear: return "bilinear";
+        case ScaleFilter::Box: return "box";
+    }
+    return "unknown";
+}
+
+FrameScaler::FrameScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                         ScaleFilter filter, int stripeCount)
+    : m_srcWidth(srcWidth)
+    , m_srcHeight(srcHeight)
+    , m_dstWidth(dstWidth)
+    , m_dstHeight(dstHeight)
+    , m_filter(filter) {
+    // Exact 2:1 is the same 2x2 average for box and bilinear (bilinear samples at pixel centers)
+    if (filter != ScaleFilter::Nearest && srcWidth == dstWidth * 2 && srcHeight == dstHeight * 2) {
+        m_kernel = Kernel::Box2to1;
+    } else if (filter == ScaleFilter::Box && srcWidth * 2 == dstWidth * 3 && srcHeight * 2 == dstHeight * 3) {
+        m_kernel = Kernel::Box3to2;
+    }
+
+    if (m_kernel != Kernel::Generic) {
+        return;
+    }
+
+    m_horizontal = BuildCoefficients(srcWidth, dstWidth, filter);
+    m_vertical = BuildCoefficients(srcHeight, dstHeight, filter);
+
+    m_scratch.resize(std::max(1, stripeCount));
+    for (auto& scratch : m_scratch) {
+        scratch.rows.resize(static_cast<size_t>(m_vertical.taps) * dstWidth * 3);
+        scratch.rowTags.assign(m_vertical.taps, -1);
+        scratch.accum.resize(static_cast<size_t>(dstWidth) * 3);
+    }
+}
+
+FrameScaler::Coefficients FrameScaler::BuildCoefficients(int srcSize, int dstSize, ScaleFilter filter) {
+    const double scale = static_cast<double>(srcSize) / dstSize;
+
+    // Contributions (source index, weight) for each output index
+    std::vector<std::vector<std::pair<int, double>>> contributions(dstSize);
+    int taps = 1;
+
+    for (int i = 0; i < dstSize; i++) {
+        auto& contribution = contributions[i];
+
+        switch (filter) {
+            case ScaleFilter::Nearest: {
+                int j = std::min(static_cast<int>(i * scale), srcSize - 1);
+                contribution.emplace_back(j, 1.0);
+                break;
+            }
+            case ScaleFilter::Bilinear: {
+                double center = std::clamp((i + 0.5) * scale - 0.5, 0.0, static_cast<double>(srcSize - 1));
+                int j = static_cast<int>(center);
+                double frac = center - j;
+                contribution.emplace_back(j, 1.0 - frac);
+                if (j + 1 < srcSize) {
+                    contribution.emplace_back(j + 1, frac);
+                }
+                break;
+            }
+            case ScaleFilter::Box: {
+                // Average the source area covered by the output pixel
+                double lo = i * scale;
+                double hi = (i + 1) * scale;
+                for (int j = static_cast<int>(lo); j < srcSize && j < hi; j++) {
+                    double overlap = std::min(hi, j + 1.0) - std::max(lo, static_cast<double>(j));
+                    if (overlap > 1e-9) {
+                        contribution.emplace_back(j, overlap / scale);
+                    }
+                }
+                break;
+            }
+        }
+
+        taps = std::max(taps, contribution.back().first - contribution.front().first + 1);
+    }
+
+    Coefficients coeffs;
+    coeffs.taps = std::min(taps, srcSize);
+    coeffs.start.resize(dstSize);
+    coeffs.weights.assign(static_cast<size_t>(dstSize) * coeffs.taps, 0);
+
+    for (int i = 0; i < dstSize; i++) {
+        // Fixed window width: shift the window left near the edge, padding with zero weights
+        int start = std::clamp(contributions[i].front().first, 0, srcSize - coeffs.taps);
+        coeffs.start[i] = start;
+
+        uint16_t* weights = &coeffs.weights[static_cast<size_t>(i) * coeffs.taps];
+        int sum = 0;
+        int largest = 0;
+        for (const auto& [j, w] : contributions[i]) {
+            int index = j - start;
+            weights[index] = static_cast<uint16_t>(std::lround(w * WEIGHT_ONE));
+            sum += weights[index];
+            if (weights[index] > weights[largest]) {
+                largest = index;
+            }
+        }
+
+        // Make the weights sum to exactly one so flat areas stay flat
+        weights[largest] = static_cast<uint16_t>(weights[largest] + (WEIGHT_ONE - sum));
+    }
+
+    return coeffs;
+}
+
+void FrameScaler::ScaleRows(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                            int rowBegin, int rowEnd, int stripeIndex) {
+    switch (m_kernel) {
+        case Kernel::Box2to1:
+            ScaleRowsBox2to1(src, srcStride, dst, dstStride, rowBegin, rowEnd);
+            break;
+        case Kernel::Box3to2:
+            ScaleRowsBox3to2(src, srcStride, dst, dstStride, rowBegin, rowEnd);
+            break;
+        case Kernel::Generic:
+            ScaleRowsGeneric(src, srcStride, dst, dstStride, rowBegin, rowEnd, m_scratch[stripeIndex]);
+            break;
+    }
+}
+
+const char* FrameScaler::GetKernelName() const {
+    switch (m_kernel) {
+        case Kernel::Box2to1: return "2:1 average";
+        case Kernel::Box3to2: return "3:2 box";
+        case Kernel::Generic: return ScaleFilterName(m_filter);
+    }
+    return "unknown";
+}
+
+void FrameScaler::FilterRowHorizontal(const uint8_t* srcRow, uint16_t* out) const {
+    const int taps = m_horizontal.taps;
+
+    for (int x = 0; x < m_dstWidth; x++) {
+        const uint8_t* pixel = srcRow + m_horizontal.start[x] * 4;
+        const uint16_t* weights = &m_horizontal.weights[static_cast<size_t>(x) * taps];
+
+        uint32_t b = 0, g = 0, r = 0;
+        for (int t = 0; t < taps; t++) {
+            b += weights[t] * pixel[t * 4 + 0];
+            g += weights[t] * pixel[t * 4 + 1];
+            r += weights[t] * pixel[t * 4 + 2];
+        }
+
+        constexpr uint32_t round = 1u << (HORIZONTAL_SHIFT - 1);
+        out[x * 3 + 0] = static_cast<uint16_t>((b + round) >> HORIZONTAL_SHIFT);
+        out[x * 3 + 1] = static_cast<uint16_t>((g + round) >> HORIZONTAL_SHIFT);
+        out[x * 3 + 2] = static_cast<uint16_t>((r + round) >> HORIZONTAL_SHIFT);
+    }
+}
+
+void FrameScaler::ScaleRowsGeneric(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                                   int rowBegin, int rowEnd, StripeScratch& scratch) {
+    const int taps = m_vertical.taps;
+    const size_t rowSamples = static_cast<size_t>(m_dstWidth) * 3;
+
+    // Cached rows belong to the previous frame
+    std::fill(scratch.rowTags.begin(), scratch.rowTags.end(), -1);
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        const int start = m_vertical.start[y];
+        const uint16_t* weights = &m_vertical.weights[static_cast<size_t>(y) * taps];
+
+        std::fill(scratch.accum.begin(), scratch.accum.end(), 0u);
+
+        for (int t = 0; t < taps; t++) {
+            if (weights[t] == 0) {
+                continue;
+            }
+
+            // Window starts only move forward, so slot (row % taps) is unique within a window
+            const int srcRow = start + t;
+            const int slot = srcRow % taps;
+            uint16_t* filtered = &scratch.rows[slot * rowSamples];
+            if (scratch.rowTags[slot] != srcRow) {
+                FilterRowHorizontal(src + static_cast<size_t>(srcRow) * srcStride, filtered);
+                scratch.rowTags[slot] = srcRow;
+            }
+
+            const uint32_t weight = weights[t];
+            uint32_t* accum = scratch.accum.data();
+            for (size_t i = 0; i < rowSamples; i++) {
+                accum[i] += weight * filtered[i];
+            }
+        }
+
+        constexpr uint32_t round = 1u << (VERTICAL_SHIFT - 1);
+        const uint32_t* accum = scratch.accum.data();
+        uint8_t* out = dst + static_cast<size_t>(y) * dstStride;
+        for (int x = 0; x < m_dstWidth; x++) {
+            out[x * 4 + 0] = static_cast<uint8_t>((accum[x * 3 + 0] + round) >> VERTICAL_SHIFT);
+            out[x * 4 + 1] = static_cast<uint8_t>((accum[x * 3 + 1] + round) >> VERTICAL_SHIFT);
+            out[x * 4 + 2] = static_cast<uint8_t>((accum[x * 3 + 2] + round) >> VERTICAL_SHIFT);
+            out[x * 4 + 3] = 255;
+        }
+    }
+}
+
+void FrameScaler::ScaleRowsBox2to1(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                                   int rowBegin, int rowEnd) {
+    // Average 2x2 blocks, two channels at a time in 16-bit fields of a 32-bit word
+    constexpr uint32_t mask = 0x00FF00FF;
+    constexpr uint32_t round = 0x00020002;
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        const uint8_t* row0 = src + static_cast<size_t>(y) * 2 * srcStride;
+        const uint8_t* row1 = row0 + srcStride;
+        uint8_t* out = dst + static_cast<size_t>(y) * dstStride;
+
+        for (int x = 0; x < m_dstWidth; x++) {
+            uint32_t a = LoadPixel(row0 + x * 8);
+            uint32_t b = LoadPixel(row0 + x * 8 + 4);
+            uint32_t c = LoadPixel(row1 + x * 8);
+            uint32_t d = LoadPixel(row1 + x * 8 + 4);
+
+            uint32_t even = (a & mask) + (b & mask) + (c & mask) + (d & mask) + round;
+            uint32_t odd = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + round;
+
+            StorePixel(out + x * 4, ((even >> 2) & mask) | (((odd >> 2) & mask) << 8));
+        }
+    }
+}
+
+void FrameScaler::ScaleRowsBox3to2(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                                   int rowBegin, int rowEnd) {
+    // Each 2x2 output block covers a 3x3 source block. Along each axis the first output
+    // takes source pixels 0 and 1 with weights 2:1 and the second takes 1 and 2 with 1:2,
+    // so every output is a 9-weight sum (4, 2, 2, 1 arranged per corner).
+    for (int y = rowBegin; y < rowEnd; y++) {
+        const int block = y / 2;
+        const uint8_t* rowNear;
+        const uint8_t* rowFar;
+        if (y % 2 == 0) {
+            rowNear = src + static_cast<size_t>(block * 3) * srcStride;
+            rowFar = rowNear + srcStride;
+        } else {
+            rowNear = src + static_cast<size_t>(block * 3 + 2) * srcStride;
+            rowFar = rowNear - srcStride;
+        }
+        uint8_t* out = dst + static_cast<size_t>(y) * dstStride;
+
+        for (int x = 0; x < m_dstWidth; x += 2) {
+            const int sx = (x / 2) * 3 * 4;
+            for (int c = 0; c < 3; c++) {
+                int v0 = 2 * rowNear[sx + c] + rowFar[sx + c];
+                int v1 = 2 * rowNear[sx + 4 + c] + rowFar[sx + 4 + c];
+                int v2 = 2 * rowNear[sx + 8 + c] + rowFar[sx + 8 + c];
+
+                out[x * 4 + c] = static_cast<uint8_t>((2 * v0 + v1 + 4) / 9);
+                out[x * 4 + 4 + c] = static_cast<uint8_t>((v1 + 2 * v2 + 4) / 9);
+            }
+            out[x * 4 + 3] = 255;
+            out[x * 4 + 7] = 255;
+        }
+    }
+}
+
+}  // namespace snacka
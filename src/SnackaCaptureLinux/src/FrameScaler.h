@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace snacka {
+
+/// Resampling filter used when the output size differs from the captured size
+enum class ScaleFilter {
+    Nearest,   // Point sampling (cheapest, aliases on downscale)
+    Bilinear,  // 2x2 taps, good for small ratios and upscaling
+    Box        // Area averaging, best quality for downscaling
+};
+
+/// Parse a --scale-filter value ("nearest", "bilinear" or "box")
+/// @return false if the name is not recognized
+bool ParseScaleFilter(const std::string& name, ScaleFilter& filter);
+
+/// Get the command line name of a filter
+const char* ScaleFilterName(ScaleFilter filter);
+
+/// Fixed-point BGRA to BGRA scaler with precomputed filter coefficients.
+/// Scales separably: each source row is filtered horizontally into a 16-bit
+/// intermediate, then output rows are blended vertically from those.
+/// Exact 2:1 (box or bilinear) and 3:2 (box) ratios use dedicated kernels.
+/// Rows can be scaled in independent stripes from several threads.
+class FrameScaler {
+public:
+    /// @param srcWidth Source width in pixels
+    /// @param srcHeight Source height in pixels
+    /// @param dstWidth Output width in pixels
+    /// @param dstHeight Output height in pixels
+    /// @param filter Resampling filter
+    /// @param stripeCount Number of stripes that may be scaled concurrently
+    FrameScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                ScaleFilter filter, int stripeCount = 1);
+
+    /// Scale output rows [rowBegin, rowEnd) into dst.
+    /// rowBegin must be even; concurrent calls must use distinct stripe indices.
+    /// @param src Source BGRA pixels
+    /// @param srcStride Source row pitch in bytes
+    /// @param dst Output BGRA pixels (dstWidth x dstHeight)
+    /// @param dstStride Output row pitch in bytes
+    /// @param rowBegin First output row to produce
+    /// @param rowEnd One past the last output row to produce
+    /// @param stripeIndex Index of the calling stripe (selects scratch memory)
+    void ScaleRows(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                   int rowBegin, int rowEnd, int stripeIndex = 0);
+
+    /// Get a description of the kernel in use (for logging)
+    const char* GetKernelName() const;
+
+private:
+    enum class Kernel {
+        Generic,
+        Box2to1,
+        Box3to2
+    };
+
+    // Filter window for every output pixel of one axis: weights are Q14 and sum to 1 << 14
+    struct Coefficients {
+        int taps = 1;
+        std::vector<int> start;        // First source index per output index
+        std::vector<uint16_t> weights;  // taps weights per output index
+    };
+
+    // Per-stripe cache of horizontally filtered source rows
+    struct StripeScratch {
+        std::vector<uint16_t> rows;  // taps rows of dstWidth * 3 Q6 samples
+        std::vector<int> rowTags;    // Source row held by each slot (-1 = empty)
+        std::vector<uint32_t> accum; // Vertical accumulator for one output row
+    };
+
+    static Coefficients BuildCoefficients(int srcSize, int dstSize, ScaleFilter filter);
+
+    void ScaleRowsGeneric(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                          int rowBegin, int rowEnd, StripeScratch& scratch);
+    void ScaleRowsBox2to1(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                          int rowBegin, int rowEnd);
+    void ScaleRowsBox3to2(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                          int rowBegin, int rowEnd);
+    void FilterRowHorizontal(const uint8_t* srcRow, uint16_t* out) const;
+
+    int m_srcWidth;
+    int m_srcHeight;
+    int m_dstWidth;
+    int m_dstHeight;
+    ScaleFilter m_filter;
+    Kernel m_kernel = Kernel::Generic;
+
+    Coefficients m_horizontal;
+    Coefficients m_vertical;
+    std::vector<StripeScratch> m_scratch;
+};
+
+}  // namespace snacka
@@ -0,0 +1,60 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+
+namespace snacka {
+
+int LatencyHistogram::BucketIndex(uint32_t us) {
+    // Values below SUB_BUCKETS get a bucket each; above, the top three bits pick the bucket
+    if (us < SUB_BUCKETS) {
+        return static_cast<int>(us);
+    }
+    int msb = 31 - __builtin_clz(us);
+    if (msb >= MAX_BITS) {
+        return NUM_BUCKETS - 1;
+    }
+    int sub = static_cast<int>(us >> (msb - 2)) & (SUB_BUCKETS - 1);
+    return (msb - 1) * SUB_BUCKETS + sub;
+}
+
+uint32_t LatencyHistogram::BucketUpperBound(int index) {
+    if (index < SUB_BUCKETS) {
+        return static_cast<uint32_t>(index);
+    }
+    int msb = index / SUB_BUCKETS + 1;
+    int sub = index % SUB_BUCKETS;
+    return ((static_cast<uint32_t>(SUB_BUCKETS + sub + 1)) << (msb - 2)) - 1;
+}
+
+void LatencyHistogram::Record(uint32_t us) {
+    m_buckets[BucketIndex(us)]++;
+    m_count++;
+    m_max = std::max(m_max, us);
+}
+
+uint32_t LatencyHistogram::Percentile(double percentile) const {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    // Rank of the sample at this percentile (1-based)
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(m_count) + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, m_count);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+void LatencyHistogram::Reset() {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_max = 0;
+}
+
+}  // namespace snacka
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace snacka {
+
+/// Log-linear histogram of latencies in microseconds.
+/// Each power of two is split into 4 buckets, so percentiles are within 25%
+/// over a range of 0 us to ~16 s. Not thread-safe: record and read from one thread.
+class LatencyHistogram {
+public:
+    /// Add one sample (values beyond the range land in the last bucket)
+    void Record(uint32_t us);
+
+    /// Get the upper bound of the bucket holding the given percentile
+    /// @param percentile 0-100
+    /// @return Latency in microseconds (0 if empty)
+    uint32_t Percentile(double percentile) const;
+
+    /// Get the largest sample recorded
+    uint32_t GetMax() const { return m_max; }
+
+    /// Get the number of samples recorded
+    uint64_t GetCount() const { return m_count; }
+
+    /// Forget all samples
+    void Reset();
+
+private:
+    static constexpr int SUB_BUCKETS = 4;
+    static constexpr int MAX_BITS = 24;
+    static constexpr int NUM_BUCKETS = (MAX_BITS - 1) * SUB_BUCKETS;
+
+    static int BucketIndex(uint32_t us);
+    static uint32_t BucketUpperBound(int index);
+
+    std::array<uint32_t, NUM_BUCKETS> m_buckets = {};
+    uint64_t m_count = 0;
+    uint32_t m_max = 0;
+};
+
+}  // namespace snacka
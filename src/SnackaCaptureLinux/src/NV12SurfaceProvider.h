@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace snacka {
+
+/// Writable NV12 frame memory (Y plane plus interleaved UV plane at half height)
+struct NV12Surface {
+    uint8_t* yPlane = nullptr;
+    uint8_t* uvPlane = nullptr;
+    int yStride = 0;   // Bytes per Y row
+    int uvStride = 0;  // Bytes per UV row
+
+    /// Frames submitted since this surface's memory was last written:
+    /// 1 = it still holds the previous frame, 0 = contents are undefined.
+    /// Writers that track changes only need to redo what changed in that many frames.
+    int age = 0;
+};
+
+/// Hands out NV12 surfaces for a capturer to write frames into directly,
+/// so frames reach the encoder without an intermediate copy.
+/// Surfaces are used one at a time: AcquireSurface() must be followed by
+/// exactly one SubmitSurface() or ReleaseSurface() before the next acquire.
+/// All calls must come from the same thread.
+class NV12SurfaceProvider {
+public:
+    virtual ~NV12SurfaceProvider() = default;
+
+    /// Map the next surface for writing
+    /// @param surface Receives the plane pointers, pitches and content age
+    /// @return false if no surface is available (the frame should be dropped)
+    virtual bool AcquireSurface(NV12Surface& surface) = 0;
+
+    /// Unmap the acquired surface and hand it over as the next frame
+    /// @param timestampMs Presentation timestamp in milliseconds
+    /// @return true if the frame was accepted
+    virtual bool SubmitSurface(int64_t timestampMs) = 0;
+
+    /// Unmap the acquired surface without submitting it.
+    /// Its contents are treated as undefined afterwards.
+    virtual void ReleaseSurface() = 0;
+};
+
+}  // namespace snacka
@@ -0,0 +1,252 @@
+#include "PipeWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace snacka {
+
+namespace {
+
+// Most buffers a single packet may consist of
+constexpr int MAX_PACKET_PARTS = 8;
+
+}  // namespace
+
+PipeWriter::PipeWriter(int fd, const char* name)
+    : m_fd(fd)
+    , m_name(name) {
+}
+
+bool PipeWriter::WritePacket(const void* data, size_t size) {
+    iovec part{const_cast<void*>(data), size};
+    return WritePacket(&part, 1);
+}
+
+bool PipeWriter::WritePacket(const iovec* parts, int count) {
+    if (count <= 0 || count > MAX_PACKET_PARTS) {
+        return false;
+    }
+
+    size_t size = 0;
+    for (int i = 0; i < count; i++) {
+        size += parts[i].iov_len;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_failed) {
+        return false;
+    }
+    m_stats.packets++;
+
+    if (m_writing) {
+        // Queue behind the writing thread. It may be this thread (a log line about
+        // its own write), which must not wait for itself.
+        if (m_writerThread != std::this_thread::get_id()) {
+            m_drainedCv.wait(lock, [&]() {
+                return m_failed || !m_writing || m_pending.size() + size <= MAX_PENDING_BYTES;
+            });
+            if (m_failed) {
+                return false;
+            }
+        }
+        if (m_writing) {
+            for (int i = 0; i < count; i++) {
+                const uint8_t* base = static_cast<const uint8_t*>(parts[i].iov_base);
+                m_pending.insert(m_pending.end(), base, base + parts[i].iov_len);
+            }
+            m_stats.bytesInFlight += size;
+            m_stats.maxBytesInFlight = std::max(m_stats.maxBytesInFlight, m_stats.bytesInFlight);
+            return true;
+        }
+    }
+
+    // Nobody is writing: send this packet straight from the caller's buffers
+    m_writing = true;
+    m_writerThread = std::this_thread::get_id();
+    m_stats.bytesInFlight += size;
+    m_stats.maxBytesInFlight = std::max(m_stats.maxBytesInFlight, m_stats.bytesInFlight);
+    lock.unlock();
+
+    iovec iov[MAX_PACKET_PARTS];
+    std::copy(parts, parts + count, iov);
+    bool ok = WriteAll(iov, count, size);
+
+    lock.lock();
+    m_stats.bytesInFlight -= size;
+
+    // Then everything other threads queued meanwhile, one writev per batch
+    while (ok && !m_pending.empty()) {
+        m_batch.swap(m_pending);
+        lock.unlock();
+        m_drainedCv.notify_all();
+
+        iovec batch{m_batch.data(), m_batch.size()};
+        ok = WriteAll(&batch, 1, m_batch.size());
+
+        lock.lock();
+        m_stats.bytesInFlight -= m_batch.size();
+        m_batch.clear();
+    }
+
+    if (!ok) {
+        m_failed = true;
+        m_stats.bytesInFlight -= m_pending.size();
+        m_pending.clear();
+    }
+    m_writing = false;
+    m_writerThread = {};
+    lock.unlock();
+    m_drainedCv.notify_all();
+
+    return ok;
+}
+
+bool PipeWriter::WriteAll(iovec* iov, int count, size_t size) {
+    auto start = Clock::now();
+    uint64_t syscalls = 0;
+    size_t written = 0;
+    int error = 0;
+
+    while (count > 0) {
+        ssize_t result = writev(m_fd, iov, count);
+        syscalls++;
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        written += result;
+
+        // Skip the buffers that were written completely and advance into a partial one
+        size_t remaining = static_cast<size_t>(result);
+        while (count > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+
+    uint64_t blockedUs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    uint64_t blockedMs = blockedUs / 1000;
+    bool stalled = blockedMs >= static_cast<uint64_t>(STALL_THRESHOLD_MS);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.syscalls += syscalls;
+        m_stats.bytesWritten += written;
+        m_stats.blockedUs += blockedUs;
+        if (stalled) {
+            m_stats.stalls++;
+            m_stats.longestStallMs = std::max(m_stats.longestStallMs, blockedMs);
+        }
+    }
+
+    // Logging is safe here: the mutex is released, and log lines written to this
+    // same pipe are queued behind the current write
+    if (error != 0) {
+        if (error == EPIPE) {
+            std::cerr << "SnackaCaptureLinux: " << m_name << " pipe closed\n";
+        } else {
+            std::cerr << "SnackaCaptureLinux: Error writing to " << m_name << ": " << strerror(error) << "\n";
+        }
+        return false;
+    }
+
+    if (stalled) {
+        ReportStall(blockedMs, size);
+    }
+    return true;
+}
+
+void PipeWriter::ReportStall(uint64_t stallMs, size_t size) {
+    m_unreportedStalls++;
+
+    auto now = Clock::now();
+    if (now - m_lastStallReport < std::chrono::seconds(1)) {
+        return;
+    }
+    m_lastStallReport = now;
+
+    // Bytes the reader has not consumed yet (only meaningful for pipes)
+    int pipeBytes = -1;
+    if (ioctl(m_fd, FIONREAD, &pipeBytes) < 0) {
+        pipeBytes = -1;
+    }
+
+    size_t inFlight;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        inFlight = m_stats.bytesInFlight;
+    }
+
+    std::cerr << "SnackaCaptureLinux: " << m_name << " stalled for " << stallMs << " ms writing "
+              << size << " bytes (" << m_unreportedStalls << " stall(s) since last report, "
+              << inFlight << " bytes in flight";
+    if (pipeBytes >= 0) {
+        std::cerr << ", " << pipeBytes << " bytes unread in pipe";
+    }
+    std::cerr << ")\n";
+    m_unreportedStalls = 0;
+}
+
+bool PipeWriter::HasFailed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failed;
+}
+
+PipeWriterStats PipeWriter::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+namespace {
+
+// Partial log line of the calling thread (one PipeLineBuffer per process)
+thread_local std::string t_logLine;
+
+}  // namespace
+
+PipeLineBuffer::PipeLineBuffer(PipeWriter& writer, std::ostream& stream)
+    : m_writer(writer)
+    , m_stream(stream)
+    , m_previous(stream.rdbuf(this)) {
+}
+
+PipeLineBuffer::~PipeLineBuffer() {
+    m_stream.rdbuf(m_previous);
+}
+
+PipeLineBuffer::int_type PipeLineBuffer::overflow(int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        char c = traits_type::to_char_type(ch);
+        Append(&c, 1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize PipeLineBuffer::xsputn(const char* data, std::streamsize count) {
+    Append(data, static_cast<size_t>(count));
+    return count;
+}
+
+void PipeLineBuffer::Append(const char* data, size_t size) {
+    t_logLine.append(data, size);
+
+    size_t end = t_logLine.rfind('\n');
+    if (end == std::string::npos) {
+        return;
+    }
+    m_writer.WritePacket(t_logLine.data(), end + 1);
+    t_logLine.erase(0, end + 1);
+}
+
+}  // namespace snacka
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/uio.h>
+
+namespace snacka {
+
+/// Counters of one output pipe
+struct PipeWriterStats {
+    uint64_t packets = 0;        // Packets (and log lines) accepted
+    uint64_t bytesWritten = 0;   // Bytes that reached the pipe
+    uint64_t syscalls = 0;       // writev() calls
+    uint64_t blockedUs = 0;      // Time spent inside writev()
+    uint64_t stalls = 0;         // Writes that blocked for at least STALL_THRESHOLD_MS
+    uint64_t longestStallMs = 0;
+    size_t bytesInFlight = 0;    // Accepted but not written yet
+    size_t maxBytesInFlight = 0;
+};
+
+/// Writes whole packets to a blocking pipe (stdout or stderr).
+/// A packet given as several buffers (e.g. MCAP header + PCM) goes out with a
+/// single writev(), and no other packet or log line written through the same
+/// PipeWriter can land inside it. While one thread is writing, packets from other
+/// threads are copied into a pending batch that the writing thread sends with its
+/// next writev(), so callers only wait for the pipe when the batch is full.
+class PipeWriter {
+public:
+    /// Writes blocked at least this long are reported as pipe stalls
+    static constexpr int STALL_THRESHOLD_MS = 100;
+
+    /// @param fd Pipe to write to (left open)
+    /// @param name Stream name used in stall reports
+    PipeWriter(int fd, const char* name);
+
+    PipeWriter(const PipeWriter&) = delete;
+    PipeWriter& operator=(const PipeWriter&) = delete;
+
+    /// Write a packet made of several buffers
+    /// @return false once the pipe has failed (e.g. the reader closed it)
+    bool WritePacket(const iovec* parts, int count);
+
+    /// Write a packet from one buffer
+    bool WritePacket(const void* data, size_t size);
+
+    /// Check if a write has failed; everything written afterwards is discarded
+    bool HasFailed() const;
+
+    /// Get a snapshot of the counters
+    PipeWriterStats GetStats() const;
+
+    /// Get the stream name
+    const char* GetName() const { return m_name; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Largest pending batch before callers wait for the writer
+    static constexpr size_t MAX_PENDING_BYTES = 1 << 20;
+
+    bool WriteAll(iovec* iov, int count, size_t size);
+    void ReportStall(uint64_t stallMs, size_t size);
+
+    const int m_fd;
+    const char* m_name;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_drainedCv;
+    bool m_writing = false;          // A thread is inside WriteAll
+    std::thread::id m_writerThread;
+    bool m_failed = false;
+    std::vector<uint8_t> m_pending;  // Packets waiting for the writing thread
+    std::vector<uint8_t> m_batch;    // Batch being written (swapped with m_pending)
+    PipeWriterStats m_stats;
+
+    // Stall reports are limited to one per second (writing thread only)
+    Clock::time_point m_lastStallReport;
+    uint64_t m_unreportedStalls = 0;
+};
+
+/// Stream buffer that collects text per thread and hands complete lines to a
+/// PipeWriter. Installed as std::cerr's buffer so that log lines cannot tear the
+/// binary packets sharing stderr.
+class PipeLineBuffer : public std::streambuf {
+public:
+    /// Install as the buffer of a stream until destroyed
+    PipeLineBuffer(PipeWriter& writer, std::ostream& stream);
+    ~PipeLineBuffer() override;
+
+    PipeLineBuffer(const PipeLineBuffer&) = delete;
+    PipeLineBuffer& operator=(const PipeLineBuffer&) = delete;
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* data, std::streamsize count) override;
+
+private:
+    void Append(const char* data, size_t size);
+
+    PipeWriter& m_writer;
+    std::ostream& m_stream;
+    std::streambuf* m_previous;
+};
+
+}  // namespace snacka
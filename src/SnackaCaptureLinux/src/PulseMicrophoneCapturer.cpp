@@ -10,16 +10,75 @@ extern "C" {
 
 namespace snacka {
 
+namespace {
+
+// Split interleaved stereo into two float channels (RNNoise takes 16-bit
+// range floats)
+inline void DeinterleaveStereo(const int16_t* input, float* left, float* right, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        left[i] = static_cast<float>(input[i * 2]);
+        right[i] = static_cast<float>(input[i * 2 + 1]);
+    }
+}
+
+// Interleave a whole RNNoise frame back to 16-bit stereo, saturating. The
+// fixed length lets the compiler vectorize the loop.
+template <size_t Frames>
+inline void InterleaveStereo(const float* left, const float* right, int16_t* output) {
+    for (size_t i = 0; i < Frames; i++) {
+        output[i * 2] = static_cast<int16_t>(std::clamp(left[i], -32768.0f, 32767.0f));
+        output[i * 2 + 1] = static_cast<int16_t>(std::clamp(right[i], -32768.0f, 32767.0f));
+    }
+}
+
+}  // namespace
+
+bool ParseNoiseSuppressionMode(const std::string& name, NoiseSuppressionMode& mode) {
+    if (name == "off") {
+        mode = NoiseSuppressionMode::Off;
+    } else if (name == "auto") {
+        mode = NoiseSuppressionMode::Auto;
+    } else if (name == "mono") {
+        mode = NoiseSuppressionMode::Mono;
+    } else if (name == "linked") {
+        mode = NoiseSuppressionMode::Linked;
+    } else if (name == "dual") {
+        mode = NoiseSuppressionMode::Dual;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* NoiseSuppressionModeName(NoiseSuppressionMode mode) {
+    switch (mode) {
+        case NoiseSuppressionMode::Off: return "off";
+        case NoiseSuppressionMode::Auto: return "auto";
+        case NoiseSuppressionMode::Mono: return "mono";
+        case NoiseSuppressionMode::Linked: return "linked";
+        case NoiseSuppressionMode::Dual: return "dual";
+    }
+    return "unknown";
+}
+
 // Static members for enumeration
 std::vector<MicrophoneInfo>* PulseMicrophoneCapturer::s_enumeratedMicrophones = nullptr;
 std::mutex PulseMicrophoneCapturer::s_enumerationMutex;
 
-PulseMicrophoneCapturer::PulseMicrophoneCapturer(bool noiseSuppression)
-    : m_noiseSuppressionEnabled(noiseSuppression) {
-    if (m_noiseSuppressionEnabled) {
+PulseMicrophoneCapturer::PulseMicrophoneCapturer(NoiseSuppressionMode noiseSuppression)
+    : m_noiseSuppression(noiseSuppression) {
+    if (m_noiseSuppression != NoiseSuppressionMode::Off) {
+        // Mono only needs one state; linked adds the state that runs the network
         m_rnnoiseLeft = rnnoise_create(nullptr);
-        m_rnnoiseRight = rnnoise_create(nullptr);
-        std::cerr << "PulseMicrophoneCapturer: RNNoise noise suppression enabled\n";
+        if (m_noiseSuppression != NoiseSuppressionMode::Mono) {
+            m_rnnoiseRight = rnnoise_create(nullptr);
+        }
+        if (m_noiseSuppression == NoiseSuppressionMode::Linked) {
+            m_rnnoiseMid = rnnoise_create(nullptr);
+        }
+        m_output.resize(MAX_OUTPUT_FRAMES * 2);
+        std::cerr << "PulseMicrophoneCapturer: RNNoise noise suppression enabled ("
+                  << NoiseSuppressionModeName(m_noiseSuppression) << ")\n";
     }
 }
 
@@ -31,6 +90,9 @@ PulseMicrophoneCapturer::~PulseMicrophoneCapturer() {
     if (m_rnnoiseRight) {
         rnnoise_destroy(m_rnnoiseRight);
     }
+    if (m_rnnoiseMid) {
+        rnnoise_destroy(m_rnnoiseMid);
+    }
 }
 
 std::vector<MicrophoneInfo> PulseMicrophoneCapturer::EnumerateMicrophones() {
@@ -436,67 +498,101 @@ void PulseMicrophoneCapturer::ProcessAudio(const void* data, size_t length) {
 
     std::lock_guard<std::mutex> lock(m_callbackMutex);
     if (m_callback) {
-        if (m_noiseSuppressionEnabled) {
-            // Copy to vector for RNNoise processing
-            std::vector<int16_t> samples(inputSamples, inputSamples + sampleCount * 2);
-            ProcessWithRNNoise(samples);
-            if (!samples.empty()) {
-                m_callback(samples.data(), samples.size() / 2, timestamp);
-            }
+        if (m_noiseSuppression != NoiseSuppressionMode::Off) {
+            ProcessWithRNNoise(inputSamples, sampleCount, timestamp);
         } else {
             m_callback(inputSamples, sampleCount, timestamp);
         }
     }
 }
 
-void PulseMicrophoneCapturer::ProcessWithRNNoise(std::vector<int16_t>& samples) {
-    if (!m_rnnoiseLeft || !m_rnnoiseRight) return;
-
-    // Convert stereo Int16 samples to separate float channels
-    size_t frameCount = samples.size() / 2;
-
-    for (size_t i = 0; i < frameCount; i++) {
-        // RNNoise expects float values in range -32768 to 32767
-        m_leftBuffer.push_back(static_cast<float>(samples[i * 2]));
-        m_rightBuffer.push_back(static_cast<float>(samples[i * 2 + 1]));
-    }
-
-    // Process complete 480-sample frames and rebuild output
-    std::vector<int16_t> processedSamples;
-
-    while (m_leftBuffer.size() >= RNNOISE_FRAME_SIZE &&
-           m_rightBuffer.size() >= RNNOISE_FRAME_SIZE) {
-        // Process left channel
-        std::vector<float> leftFrame(m_leftBuffer.begin(),
-                                     m_leftBuffer.begin() + RNNOISE_FRAME_SIZE);
-        std::vector<float> processedLeft(RNNOISE_FRAME_SIZE);
-        rnnoise_process_frame(m_rnnoiseLeft, processedLeft.data(), leftFrame.data());
-
-        // Process right channel
-        std::vector<float> rightFrame(m_rightBuffer.begin(),
-                                      m_rightBuffer.begin() + RNNOISE_FRAME_SIZE);
-        std::vector<float> processedRight(RNNOISE_FRAME_SIZE);
-        rnnoise_process_frame(m_rnnoiseRight, processedRight.data(), rightFrame.data());
-
-        // Convert back to Int16 stereo and append to output
-        for (int i = 0; i < RNNOISE_FRAME_SIZE; i++) {
-            int16_t leftSample = static_cast<int16_t>(
-                std::clamp(processedLeft[i], -32768.0f, 32767.0f));
-            int16_t rightSample = static_cast<int16_t>(
-                std::clamp(processedRight[i], -32768.0f, 32767.0f));
-            processedSamples.push_back(leftSample);
-            processedSamples.push_back(rightSample);
+void PulseMicrophoneCapturer::ProcessWithRNNoise(const int16_t* samples, size_t sampleCount, uint64_t timestamp) {
+    if (!m_rnnoiseLeft ||
+        (m_noiseSuppression != NoiseSuppressionMode::Mono && !m_rnnoiseRight) ||
+        (m_noiseSuppression == NoiseSuppressionMode::Linked && !m_rnnoiseMid)) {
+        return;
+    }
+
+    // Fill 480-sample frames straight from the fragment; a partial frame
+    // waits for the next fragment
+    while (sampleCount > 0) {
+        size_t count = std::min(sampleCount, RNNOISE_FRAME_SIZE - m_frameFill);
+        DeinterleaveStereo(samples, m_leftFrame.data() + m_frameFill, m_rightFrame.data() + m_frameFill, count);
+        m_frameFill += count;
+        samples += count * 2;
+        sampleCount -= count;
+
+        if (m_frameFill < RNNOISE_FRAME_SIZE) {
+            break;
         }
+        m_frameFill = 0;
 
-        // Remove processed samples from buffers
-        m_leftBuffer.erase(m_leftBuffer.begin(),
-                          m_leftBuffer.begin() + RNNOISE_FRAME_SIZE);
-        m_rightBuffer.erase(m_rightBuffer.begin(),
-                           m_rightBuffer.begin() + RNNOISE_FRAME_SIZE);
+        DenoiseFrame();
+
+        InterleaveStereo<RNNOISE_FRAME_SIZE>(m_leftFrame.data(), m_rightFrame.data(),
+                                             m_output.data() + m_outputFrames * 2);
+        m_outputFrames += RNNOISE_FRAME_SIZE;
+
+        // An unusually large fragment is delivered in pieces rather than growing the buffer
+        if (m_outputFrames == MAX_OUTPUT_FRAMES) {
+            m_callback(m_output.data(), m_outputFrames, timestamp);
+            m_outputFrames = 0;
+        }
     }
 
-    // Replace output with processed samples
-    samples = std::move(processedSamples);
+    if (m_outputFrames > 0) {
+        m_callback(m_output.data(), m_outputFrames, timestamp);
+        m_outputFrames = 0;
+    }
+}
+
+void PulseMicrophoneCapturer::DenoiseFrame() {
+    float* left = m_leftFrame.data();
+    float* right = m_rightFrame.data();
+
+    switch (m_noiseSuppression) {
+        case NoiseSuppressionMode::Mono:
+            for (int i = 0; i < RNNOISE_FRAME_SIZE; i++) {
+                left[i] = (left[i] + right[i]) * 0.5f;
+            }
+            rnnoise_process_frame(m_rnnoiseLeft, left, left);
+            m_rightFrame = m_leftFrame;
+            break;
+
+        case NoiseSuppressionMode::Linked: {
+            DenoiseState* states[2] = {m_rnnoiseLeft, m_rnnoiseRight};
+            float* outputs[2] = {left, right};
+            const float* inputs[2] = {left, right};
+            rnnoise_process_frame_linked(m_rnnoiseMid, states, outputs, inputs, 2);
+            break;
+        }
+
+        case NoiseSuppressionMode::Auto:
+            // Most microphones are mono duplicated onto both channels
+            if (m_leftFrame == m_rightFrame) {
+                rnnoise_process_frame(m_rnnoiseLeft, left, left);
+                m_rightFrame = m_leftFrame;
+                m_autoMono = true;
+                break;
+            }
+            if (m_autoMono) {
+                // The right state sat idle while the left one saw the same
+                // input; continue from the left state (it holds no pointers
+                // into itself, so a byte copy is a valid state)
+                memcpy(m_rnnoiseRight, m_rnnoiseLeft, rnnoise_get_size());
+                m_autoMono = false;
+            }
+            [[fallthrough]];
+
+        default: {
+            // Both channels in one call, which reads the network weights once
+            DenoiseState* states[2] = {m_rnnoiseLeft, m_rnnoiseRight};
+            float* outputs[2] = {left, right};
+            const float* inputs[2] = {left, right};
+            rnnoise_process_frames(states, 2, outputs, inputs, nullptr);
+            break;
+        }
+    }
 }
 
 uint64_t PulseMicrophoneCapturer::GetTimestampMs() const {
@@ -5,6 +5,7 @@
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <array>
 #include <vector>
 #include <cstdint>
 #include <string>
@@ -21,11 +22,27 @@ namespace snacka {
 /// @param timestamp Timestamp in milliseconds
 using MicrophoneCallback = std::function<void(const int16_t* data, size_t sampleCount, uint64_t timestamp)>;
 
+/// How the two microphone channels are denoised
+enum class NoiseSuppressionMode {
+    Off,
+    Auto,    // Mono while both channels carry the same samples, dual otherwise
+    Mono,    // Denoise the channel average once and output it on both channels
+    Linked,  // One set of gains from the channel average, applied to each channel
+    Dual     // Denoise each channel on its own (twice the cost)
+};
+
+/// Parse a --noise-suppression value ("auto", "mono", "linked", "dual" or "off")
+/// @return false if the name is not recognized
+bool ParseNoiseSuppressionMode(const std::string& name, NoiseSuppressionMode& mode);
+
+/// Get the command line name of a mode
+const char* NoiseSuppressionModeName(NoiseSuppressionMode mode);
+
 /// PulseAudio capturer for microphone input
 /// Captures from microphone sources (not monitor sources)
 class PulseMicrophoneCapturer {
 public:
-    PulseMicrophoneCapturer(bool noiseSuppression = true);
+    PulseMicrophoneCapturer(NoiseSuppressionMode noiseSuppression = NoiseSuppressionMode::Auto);
     ~PulseMicrophoneCapturer();
 
     /// Initialize the microphone capturer
@@ -85,20 +102,40 @@ private:
     MicrophoneCallback m_callback;
     std::mutex m_callbackMutex;
 
-    // RNNoise noise suppression
-    bool m_noiseSuppressionEnabled = true;
+    // RNNoise noise suppression. All buffers are sized up front, so the
+    // PulseAudio callback thread never allocates.
+    NoiseSuppressionMode m_noiseSuppression = NoiseSuppressionMode::Auto;
     DenoiseState* m_rnnoiseLeft = nullptr;
     DenoiseState* m_rnnoiseRight = nullptr;
+    DenoiseState* m_rnnoiseMid = nullptr;  // Gain network of linked mode
+    bool m_autoMono = false;               // Auto mode: the last frame was denoised once
     static constexpr int RNNOISE_FRAME_SIZE = 480;
-    std::vector<float> m_leftBuffer;
-    std::vector<float> m_rightBuffer;
 
-    // Process audio through RNNoise
-    void ProcessWithRNNoise(std::vector<int16_t>& samples);
+    // Output frames held before they are passed to the callback (100ms)
+    static constexpr size_t MAX_OUTPUT_FRAMES = RNNOISE_FRAME_SIZE * 10;
+
+    // The RNNoise frame being filled, one channel per array (denoised in place)
+    std::array<float, RNNOISE_FRAME_SIZE> m_leftFrame = {};
+    std::array<float, RNNOISE_FRAME_SIZE> m_rightFrame = {};
+    size_t m_frameFill = 0;
+
+    // Denoised interleaved output for the current fragment
+    std::vector<int16_t> m_output;
+    size_t m_outputFrames = 0;
+
+    // Denoise the frame in m_leftFrame/m_rightFrame in place
+    void DenoiseFrame();
+
+    // Process audio through RNNoise and pass the denoised frames to the callback
+    void ProcessWithRNNoise(const int16_t* samples, size_t sampleCount, uint64_t timestamp);
 
     // Static data for enumeration callback
     static std::vector<MicrophoneInfo>* s_enumeratedMicrophones;
     static std::mutex s_enumerationMutex;
+
+    // Feed fragments to ProcessWithRNNoise without a PulseAudio stream
+    friend class MicrophoneFramingTest;
+    friend class MicrophoneBench;
 };
 
 }  // namespace snacka
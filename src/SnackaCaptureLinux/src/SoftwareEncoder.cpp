@@ -0,0 +1,237 @@
+#include "SoftwareEncoder.h"
+
+#include <dlfcn.h>
+#include <iostream>
+
+// The ABI changes with every x264 build, and the soname and x264_encoder_open
+// carry the build number
+#define SNACKA_X264_STRING(x) #x
+#define SNACKA_X264_BUILD_STRING(build) SNACKA_X264_STRING(build)
+#define SNACKA_X264_SONAME "libx264.so." SNACKA_X264_BUILD_STRING(X264_BUILD)
+#define SNACKA_X264_ENCODER_OPEN "x264_encoder_open_" SNACKA_X264_BUILD_STRING(X264_BUILD)
+
+namespace snacka {
+
+/// The libx264 functions the encoder uses
+struct X264Api {
+    decltype(&x264_param_default_preset) paramDefaultPreset;
+    decltype(&x264_param_apply_profile) paramApplyProfile;
+    decltype(&x264_encoder_open) encoderOpen;
+    decltype(&x264_encoder_encode) encoderEncode;
+    decltype(&x264_encoder_delayed_frames) encoderDelayedFrames;
+    decltype(&x264_encoder_close) encoderClose;
+    decltype(&x264_picture_alloc) pictureAlloc;
+    decltype(&x264_picture_clean) pictureClean;
+};
+
+namespace {
+
+template <typename T>
+bool LoadSymbol(void* library, const char* name, T& function) {
+    function = reinterpret_cast<T>(dlsym(library, name));
+    if (!function) {
+        std::cerr << "SnackaCaptureLinux: " << SNACKA_X264_SONAME << " has no " << name << "\n";
+    }
+    return function != nullptr;
+}
+
+// Load libx264 on first use; the library stays loaded
+// @return null if it is missing or not the expected build
+const X264Api* LoadX264() {
+    static const X264Api* api = []() -> const X264Api* {
+        void* library = dlopen(SNACKA_X264_SONAME, RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            std::cerr << "SnackaCaptureLinux: Cannot load " << SNACKA_X264_SONAME
+                      << " (install the libx264 package for software encoding)\n";
+            return nullptr;
+        }
+
+        static X264Api loaded;
+        bool ok = LoadSymbol(library, "x264_param_default_preset", loaded.paramDefaultPreset) &&
+                  LoadSymbol(library, "x264_param_apply_profile", loaded.paramApplyProfile) &&
+                  LoadSymbol(library, SNACKA_X264_ENCODER_OPEN, loaded.encoderOpen) &&
+                  LoadSymbol(library, "x264_encoder_encode", loaded.encoderEncode) &&
+                  LoadSymbol(library, "x264_encoder_delayed_frames", loaded.encoderDelayedFrames) &&
+                  LoadSymbol(library, "x264_encoder_close", loaded.encoderClose) &&
+                  LoadSymbol(library, "x264_picture_alloc", loaded.pictureAlloc) &&
+                  LoadSymbol(library, "x264_picture_clean", loaded.pictureClean);
+        if (!ok) {
+            dlclose(library);
+            return nullptr;
+        }
+        return &loaded;
+    }();
+    return api;
+}
+
+}  // namespace
+
+bool SoftwareEncoder::IsAvailable() {
+    return LoadX264() != nullptr;
+}
+
+SoftwareEncoder::SoftwareEncoder(int width, int height, int fps, int bitrateMbps)
+    : m_width(width)
+    , m_height(height)
+    , m_fps(fps)
+    , m_bitrateKbps(bitrateMbps * 1000) {
+}
+
+SoftwareEncoder::~SoftwareEncoder() {
+    Stop();
+}
+
+bool SoftwareEncoder::Initialize() {
+    if (m_initialized) {
+        return true;
+    }
+
+    m_x264 = LoadX264();
+    if (!m_x264) {
+        return false;
+    }
+
+    // Above 1080p only the fastest preset keeps up in real time on typical desktops
+    const bool large = static_cast<int64_t>(m_width) * m_height > 1920 * 1080;
+    const char* preset = large ? "ultrafast" : "veryfast";
+
+    x264_param_t param;
+    if (m_x264->paramDefaultPreset(&param, preset, "zerolatency") < 0) {
+        std::cerr << "SnackaCaptureLinux: x264 preset " << preset << " not available\n";
+        return false;
+    }
+
+    param.i_csp = X264_CSP_NV12;
+    param.i_width = m_width;
+    param.i_height = m_height;
+    param.i_fps_num = m_fps;
+    param.i_fps_den = 1;
+    param.b_vfr_input = 0;
+    param.i_log_level = X264_LOG_WARNING;
+
+    // Keyframe every second, like the VAAPI encoder
+    param.i_keyint_max = m_fps;
+    param.i_keyint_min = m_fps;
+
+    // Average bitrate with a two-frame VBV window to keep frame sizes even
+    param.rc.i_rc_method = X264_RC_ABR;
+    param.rc.i_bitrate = m_bitrateKbps;
+    param.rc.i_vbv_max_bitrate = m_bitrateKbps;
+    param.rc.i_vbv_buffer_size = m_bitrateKbps / m_fps * 2;
+
+    // The converter writes BT.601 limited range; say so in the VUI (SMPTE 170M)
+    param.vui.b_fullrange = 0;
+    param.vui.i_colorprim = 6;
+    param.vui.i_transfer = 6;
+    param.vui.i_colmatrix = 6;
+
+    // AVCC output (4-byte length prefixes) with SPS/PPS in front of every keyframe
+    param.b_annexb = 0;
+    param.b_repeat_headers = 1;
+
+    if (m_x264->paramApplyProfile(&param, "high") < 0) {
+        std::cerr << "SnackaCaptureLinux: x264 High profile not available\n";
+        return false;
+    }
+
+    m_encoder = m_x264->encoderOpen(&param);
+    if (!m_encoder) {
+        std::cerr << "SnackaCaptureLinux: Failed to open x264 encoder\n";
+        return false;
+    }
+
+    if (m_x264->pictureAlloc(&m_picture, X264_CSP_NV12, m_width, m_height) < 0) {
+        std::cerr << "SnackaCaptureLinux: Failed to allocate x264 picture\n";
+        Stop();
+        return false;
+    }
+    m_pictureAllocated = true;
+
+    m_initialized = true;
+    std::cerr << "SnackaCaptureLinux: x264 encoder initialized (" << preset << ", "
+              << m_bitrateKbps << " kbps)\n";
+    return true;
+}
+
+bool SoftwareEncoder::AcquireSurface(NV12Surface& surface) {
+    if (!m_initialized || m_pictureAcquired) {
+        return false;
+    }
+
+    surface.yPlane = m_picture.img.plane[0];
+    surface.uvPlane = m_picture.img.plane[1];
+    surface.yStride = m_picture.img.i_stride[0];
+    surface.uvStride = m_picture.img.i_stride[1];
+    surface.age = m_pictureWritten ? 1 : 0;
+
+    m_pictureAcquired = true;
+    return true;
+}
+
+void SoftwareEncoder::ReleaseSurface() {
+    m_pictureAcquired = false;
+    m_pictureWritten = false;
+}
+
+bool SoftwareEncoder::SubmitSurface(int64_t timestampMs) {
+    if (!m_pictureAcquired) {
+        return false;
+    }
+    m_pictureAcquired = false;
+    m_pictureWritten = true;
+
+    // x264 copies the picture, so it can be written again as soon as this returns.
+    // Input is constant frame rate, so pts only has to give the order.
+    (void)timestampMs;
+    m_picture.i_type = m_keyframeRequested.exchange(false) ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    m_picture.i_pts = m_frameCount++;
+
+    return EncodePicture(&m_picture);
+}
+
+bool SoftwareEncoder::EncodePicture(x264_picture_t* picture) {
+    x264_nal_t* nals = nullptr;
+    int numNals = 0;
+    x264_picture_t output;
+
+    int size = m_x264->encoderEncode(m_encoder, &nals, &numNals, picture, &output);
+    if (size < 0) {
+        std::cerr << "SnackaCaptureLinux: x264 encode failed\n";
+        return false;
+    }
+
+    // NAL payloads are contiguous and already carry their length prefixes
+    if (size > 0 && m_callback) {
+        m_callback(nals[0].p_payload, static_cast<size_t>(size), output.b_keyframe != 0);
+    }
+    return true;
+}
+
+void SoftwareEncoder::Flush() {
+    if (!m_initialized) {
+        return;
+    }
+    while (m_x264->encoderDelayedFrames(m_encoder) > 0) {
+        if (!EncodePicture(nullptr)) {
+            break;
+        }
+    }
+}
+
+void SoftwareEncoder::Stop() {
+    Flush();
+
+    if (m_pictureAllocated) {
+        m_x264->pictureClean(&m_picture);
+        m_pictureAllocated = false;
+    }
+
+    if (m_encoder) {
+        m_x264->encoderClose(m_encoder);
+        m_encoder = nullptr;
+    }
+
+    m_initialized = false;
+}
+
+}  // namespace snacka
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "VideoEncoder.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+extern "C" {
+#include <x264.h>
+}
+
+namespace snacka {
+
+struct X264Api;
+
+/// CPU H.264 encoder using x264, for machines without a VAAPI encoder.
+/// Tuned for latency (no B-frames, no lookahead), so every submitted frame is
+/// encoded and delivered to the callback before SubmitSurface() returns.
+/// x264 writes AVCC length prefixes and repeats SPS/PPS on keyframes itself.
+/// libx264 is loaded at run time, so machines without it still capture (with
+/// VAAPI or raw NV12); only the x264 build the headers describe is accepted.
+class SoftwareEncoder : public VideoEncoder {
+public:
+    /// Check that libx264 can be loaded
+    static bool IsAvailable();
+
+    SoftwareEncoder(int width, int height, int fps, int bitrateMbps = 6);
+    ~SoftwareEncoder() override;
+
+    /// Initialize the encoder
+    /// @return true if initialization succeeded
+    bool Initialize() override;
+
+    /// Get the input picture for writing. It keeps its contents between frames (age 1).
+    bool AcquireSurface(NV12Surface& surface) override;
+
+    /// Encode the acquired picture and deliver the output
+    bool SubmitSurface(int64_t timestampMs) override;
+
+    /// Give the picture back without encoding it
+    void ReleaseSurface() override;
+
+    /// Make the next submitted frame an IDR frame
+    void RequestKeyframe() override { m_keyframeRequested = true; }
+
+    /// Encode any frames x264 still holds
+    void Flush() override;
+
+    /// Stop the encoder and release resources
+    void Stop() override;
+
+    /// Set the callback for encoded data (called on the submitting thread)
+    void SetCallback(EncodedCallback callback) override { m_callback = callback; }
+
+    /// Get the name of the encoder being used
+    const char* GetEncoderName() const override { return m_encoderName.c_str(); }
+
+    /// Check if the encoder is initialized
+    bool IsInitialized() const override { return m_initialized; }
+
+    /// Get the frame size
+    int GetWidth() const override { return m_width; }
+    int GetHeight() const override { return m_height; }
+
+private:
+    bool EncodePicture(x264_picture_t* picture);
+
+    // Configuration
+    int m_width;
+    int m_height;
+    int m_fps;
+    int m_bitrateKbps;
+
+    // State
+    bool m_initialized = false;
+    std::string m_encoderName = "x264 (software)";
+    int64_t m_frameCount = 0;
+    std::atomic<bool> m_keyframeRequested{false};
+
+    // x264 objects
+    const X264Api* m_x264 = nullptr;
+    x264_t* m_encoder = nullptr;
+    x264_picture_t m_picture = {};
+    bool m_pictureAllocated = false;
+    bool m_pictureAcquired = false;
+    bool m_pictureWritten = false;  // m_picture holds the previous frame
+
+    // Callback
+    EncodedCallback m_callback;
+};
+
+}  // namespace snacka
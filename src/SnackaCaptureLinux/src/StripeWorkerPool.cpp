@@ -0,0 +1,95 @@
+#include "StripeWorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace snacka {
+
+StripeWorkerPool::StripeWorkerPool(int threadCount)
+    : m_threadCount(std::max(1, threadCount))
+    , m_stripeTimesUs(m_threadCount, 0) {
+    m_workers.reserve(m_threadCount - 1);
+    for (int i = 1; i < m_threadCount; i++) {
+        m_workers.emplace_back(&StripeWorkerPool::WorkerLoop, this, i);
+    }
+}
+
+StripeWorkerPool::~StripeWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_startCv.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void StripeWorkerPool::Run(const StripeJob& job) {
+    if (m_threadCount == 1) {
+        RunStripe(job, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_pending = m_threadCount - 1;
+        m_generation++;
+    }
+    m_startCv.notify_all();
+
+    // The caller handles stripe 0 while the workers handle the rest
+    RunStripe(job, 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCv.wait(lock, [this] { return m_pending == 0; });
+    m_job = nullptr;
+}
+
+void StripeWorkerPool::RunStripe(const StripeJob& job, int stripeIndex) {
+    auto start = std::chrono::steady_clock::now();
+    job(stripeIndex);
+    m_stripeTimesUs[stripeIndex] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+void StripeWorkerPool::WorkerLoop(int stripeIndex) {
+    uint64_t seenGeneration = 0;
+
+    while (true) {
+        const StripeJob* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCv.wait(lock, [&] { return m_shutdown || m_generation != seenGeneration; });
+            if (m_shutdown) {
+                return;
+            }
+            seenGeneration = m_generation;
+            job = m_job;
+        }
+
+        RunStripe(*job, stripeIndex);
+
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            last = (--m_pending == 0);
+        }
+        if (last) {
+            m_doneCv.notify_one();
+        }
+    }
+}
+
+void StripeWorkerPool::GetStripeRows(int rows, int stripeIndex, int& rowBegin, int& rowEnd) const {
+    // Even number of rows per stripe keeps each 2x2 chroma block inside one stripe
+    int rowsPerStripe = (rows / m_threadCount) & ~1;
+    rowBegin = std::min(rows, stripeIndex * rowsPerStripe);
+    rowEnd = (stripeIndex == m_threadCount - 1) ? rows : std::min(rows, rowBegin + rowsPerStripe);
+}
+
+}  // namespace snacka
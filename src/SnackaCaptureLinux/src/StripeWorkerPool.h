@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace snacka {
+
+/// Persistent worker pool that runs one job per horizontal stripe of a frame.
+/// Stripe 0 runs on the calling thread and stripe i on worker i - 1, so a pool
+/// of N threads creates only N - 1 workers and never hands work between threads
+/// beyond the start/finish handshake.
+class StripeWorkerPool {
+public:
+    /// Job for one stripe
+    /// @param stripeIndex Index of the stripe (0 .. GetThreadCount() - 1)
+    using StripeJob = std::function<void(int stripeIndex)>;
+
+    /// @param threadCount Number of stripes processed in parallel (including the caller)
+    explicit StripeWorkerPool(int threadCount);
+    ~StripeWorkerPool();
+
+    StripeWorkerPool(const StripeWorkerPool&) = delete;
+    StripeWorkerPool& operator=(const StripeWorkerPool&) = delete;
+
+    /// Run the job once per stripe and wait until every stripe has finished.
+    /// Per-stripe wall time is recorded and can be read with GetStripeTimesUs().
+    void Run(const StripeJob& job);
+
+    /// Number of stripes per Run()
+    int GetThreadCount() const { return m_threadCount; }
+
+    /// Time each stripe took during the last Run(), in microseconds
+    const std::vector<uint32_t>& GetStripeTimesUs() const { return m_stripeTimesUs; }
+
+    /// Split `rows` into GetThreadCount() ranges with even boundaries so NV12
+    /// chroma rows never straddle two stripes. The last stripe takes the remainder.
+    /// @param rows Total number of rows
+    /// @param stripeIndex Stripe to compute the range for
+    /// @param rowBegin Receives the first row of the stripe
+    /// @param rowEnd Receives one past the last row of the stripe
+    void GetStripeRows(int rows, int stripeIndex, int& rowBegin, int& rowEnd) const;
+
+private:
+    void WorkerLoop(int stripeIndex);
+    void RunStripe(const StripeJob& job, int stripeIndex);
+
+    int m_threadCount;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_startCv;
+    std::condition_variable m_doneCv;
+    const StripeJob* m_job = nullptr;
+    uint64_t m_generation = 0;
+    int m_pending = 0;
+    bool m_shutdown = false;
+
+    std::vector<uint32_t> m_stripeTimesUs;
+};
+
+}  // namespace snacka
@@ -0,0 +1,124 @@
+#include "TileHasher.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace snacka {
+
+namespace {
+
+// Never produced by HashTile (the final mix forces the low bit on), so it marks "unknown"
+constexpr uint64_t INVALID_HASH = 0;
+
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+
+inline uint64_t Load64(const uint8_t* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t Mix(uint64_t h, uint64_t value) {
+    h ^= value * PRIME_2;
+    h = (h << 31) | (h >> 33);
+    return h * PRIME_1;
+}
+
+}  // namespace
+
+TileHasher::TileHasher(int width, int height, int tileSize)
+    : m_width(width)
+    , m_height(height)
+    , m_tileSize(std::max(2, tileSize & ~1))
+    , m_tilesX((width + m_tileSize - 1) / m_tileSize)
+    , m_tilesY((height + m_tileSize - 1) / m_tileSize)
+    , m_hashes(static_cast<size_t>(m_tilesX) * m_tilesY, INVALID_HASH) {
+}
+
+uint64_t TileHasher::HashTile(const uint8_t* bgra, int stride, int width, int height) {
+    // Four independent lanes keep the multiplies from serializing
+    uint64_t h0 = PRIME_1;
+    uint64_t h1 = PRIME_2;
+    uint64_t h2 = PRIME_1 ^ PRIME_2;
+    uint64_t h3 = PRIME_1 + PRIME_2;
+
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = bgra + static_cast<size_t>(y) * stride;
+        size_t i = 0;
+        for (; i + 32 <= rowBytes; i += 32) {
+            h0 = Mix(h0, Load64(row + i));
+            h1 = Mix(h1, Load64(row + i + 8));
+            h2 = Mix(h2, Load64(row + i + 16));
+            h3 = Mix(h3, Load64(row + i + 24));
+        }
+        for (; i + 8 <= rowBytes; i += 8) {
+            h0 = Mix(h0, Load64(row + i));
+        }
+        if (i < rowBytes) {
+            uint32_t tail;
+            std::memcpy(&tail, row + i, sizeof(tail));
+            h1 = Mix(h1, tail);
+        }
+    }
+
+    uint64_t h = Mix(Mix(Mix(h0, h1), h2), h3);
+    h ^= h >> 29;
+    return h | 1;
+}
+
+size_t TileHasher::FindChangedTiles(const uint8_t* bgra, int stride, std::vector<PixelRect>& changed) {
+    size_t changedTiles = 0;
+
+    for (int ty = 0; ty < m_tilesY; ty++) {
+        const int y0 = ty * m_tileSize;
+        const int y1 = std::min(m_height, y0 + m_tileSize);
+        bool inRun = false;
+
+        for (int tx = 0; tx < m_tilesX; tx++) {
+            const int x0 = tx * m_tileSize;
+            const int x1 = std::min(m_width, x0 + m_tileSize);
+
+            uint64_t hash = HashTile(bgra + static_cast<size_t>(y0) * stride + static_cast<size_t>(x0) * 4,
+                                     stride, x1 - x0, y1 - y0);
+            uint64_t& stored = m_hashes[static_cast<size_t>(ty) * m_tilesX + tx];
+            bool tileChanged = (hash != stored);
+            stored = hash;
+
+            if (!tileChanged) {
+                inRun = false;
+                continue;
+            }
+
+            changedTiles++;
+            if (inRun) {
+                changed.back().x1 = x1;
+            } else {
+                changed.push_back({x0, y0, x1, y1});
+                inRun = true;
+            }
+        }
+    }
+
+    return changedTiles;
+}
+
+void TileHasher::Invalidate(const PixelRect& rect) {
+    const int tx0 = std::max(0, rect.x0 / m_tileSize);
+    const int ty0 = std::max(0, rect.y0 / m_tileSize);
+    const int tx1 = std::min(m_tilesX, (rect.x1 + m_tileSize - 1) / m_tileSize);
+    const int ty1 = std::min(m_tilesY, (rect.y1 + m_tileSize - 1) / m_tileSize);
+
+    for (int ty = ty0; ty < ty1; ty++) {
+        std::fill(m_hashes.begin() + static_cast<size_t>(ty) * m_tilesX + tx0,
+                  m_hashes.begin() + static_cast<size_t>(ty) * m_tilesX + tx1,
+                  INVALID_HASH);
+    }
+}
+
+void TileHasher::InvalidateAll() {
+    std::fill(m_hashes.begin(), m_hashes.end(), INVALID_HASH);
+}
+
+}  // namespace snacka
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace snacka {
+
+/// Pixel rectangle [x0, x1) x [y0, y1)
+struct PixelRect {
+    int x0, y0, x1, y1;
+};
+
+/// Detects which parts of a BGRA frame changed by keeping a 64-bit hash per tile.
+/// Used as a software damage source when XDamage is unavailable or reports the
+/// whole screen (e.g. compositors that repaint everything every frame).
+class TileHasher {
+public:
+    static constexpr int DEFAULT_TILE_SIZE = 64;
+
+    /// @param width Frame width in pixels
+    /// @param height Frame height in pixels
+    /// @param tileSize Tile edge in pixels (must be even)
+    TileHasher(int width, int height, int tileSize = DEFAULT_TILE_SIZE);
+
+    /// Hash every tile of the frame and remember the hashes for the next call.
+    /// Horizontally adjacent changed tiles are merged into one rectangle.
+    /// @param bgra Frame pixels (4 bytes per pixel)
+    /// @param stride Row pitch in bytes
+    /// @param changed Receives the rectangles of tiles whose hash differs from the last call
+    /// @return Number of changed tiles
+    size_t FindChangedTiles(const uint8_t* bgra, int stride, std::vector<PixelRect>& changed);
+
+    /// Forget the hashes of all tiles touching the rectangle (content changed behind our back)
+    void Invalidate(const PixelRect& rect);
+
+    /// Forget all hashes, so the next FindChangedTiles() reports every tile
+    void InvalidateAll();
+
+private:
+    static uint64_t HashTile(const uint8_t* bgra, int stride, int width, int height);
+
+    int m_width;
+    int m_height;
+    int m_tileSize;
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<uint64_t> m_hashes;
+};
+
+}  // namespace snacka
@@ -276,7 +276,7 @@ void V4L2Capturer::Stop() {
 }
 
 void V4L2Capturer::CaptureLoop() {
-    uint64_t frameCount = 0;
+    m_frameCount = 0;
     auto nv12Size = CalculateNV12FrameSize(m_width, m_height);
 
     std::cerr << "V4L2Capturer: Capture loop starting\n";
@@ -322,21 +322,30 @@ void V4L2Capturer::CaptureLoop() {
         // Get frame data
         const uint8_t* frameData = static_cast<const uint8_t*>(m_buffers[buf.index].start);
 
-        if (m_needsConversion) {
-            // Convert YUYV to NV12
-            ConvertYUYVToNV12(frameData, m_nv12Buffer.data());
-            frameData = m_nv12Buffer.data();
-        }
-
-        frameCount++;
-        if (frameCount <= 5 || frameCount % 100 == 0) {
-            std::cerr << "V4L2Capturer: Frame " << frameCount
+        m_frameCount++;
+        if (m_frameCount <= 5 || m_frameCount % 100 == 0) {
+            std::cerr << "V4L2Capturer: Frame " << m_frameCount
                       << " (" << m_width << "x" << m_height << " NV12)\n";
         }
 
-        // Call callback
-        if (m_callback) {
-            m_callback(frameData, nv12Size, elapsedMs);
+        if (m_surfaceProvider) {
+            // Convert or copy straight into the encoder's surface
+            if (!WriteToSurface(frameData, elapsedMs) && m_frameCount <= 5) {
+                std::cerr << "V4L2Capturer: No surface available for frame " << m_frameCount << "\n";
+            }
+        } else {
+            if (m_needsConversion) {
+                // Convert YUYV to NV12
+                uint8_t* yPlane = m_nv12Buffer.data();
+                uint8_t* uvPlane = yPlane + static_cast<size_t>(m_width) * m_height;
+                ConvertYUYVToNV12(frameData, yPlane, m_width, uvPlane, m_width);
+                frameData = m_nv12Buffer.data();
+            }
+
+            // Call callback
+            if (m_callback) {
+                m_callback(frameData, nv12Size, elapsedMs);
+            }
         }
 
         // Re-queue buffer
@@ -346,21 +355,42 @@ void V4L2Capturer::CaptureLoop() {
         }
     }
 
-    std::cerr << "V4L2Capturer: Capture loop ended (" << frameCount << " frames)\n";
+    std::cerr << "V4L2Capturer: Capture loop ended (" << m_frameCount << " frames)\n";
+}
+
+bool V4L2Capturer::WriteToSurface(const uint8_t* frameData, uint64_t timestamp) {
+    NV12Surface surface;
+    if (!m_surfaceProvider->AcquireSurface(surface)) {
+        return false;
+    }
+
+    if (m_needsConversion) {
+        ConvertYUYVToNV12(frameData, surface.yPlane, surface.yStride, surface.uvPlane, surface.uvStride);
+    } else {
+        // Native NV12: one copy from the V4L2 buffer into the surface
+        const uint8_t* src = frameData;
+        for (int y = 0; y < m_height; y++) {
+            memcpy(surface.yPlane + static_cast<size_t>(y) * surface.yStride, src, m_width);
+            src += m_width;
+        }
+        for (int y = 0; y < m_height / 2; y++) {
+            memcpy(surface.uvPlane + static_cast<size_t>(y) * surface.uvStride, src, m_width);
+            src += m_width;
+        }
+    }
+
+    m_surfaceProvider->SubmitSurface(static_cast<int64_t>(timestamp));
+    return true;
 }
 
-void V4L2Capturer::ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* nv12) {
+void V4L2Capturer::ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* yPlane, int yStride, uint8_t* uvPlane, int uvStride) {
     // YUYV format: Y0 U0 Y1 V0 Y2 U1 Y3 V1 ...
     // NV12 format: Y plane (full resolution), then interleaved UV plane (half height)
 
-    int yPlaneSize = m_width * m_height;
-    uint8_t* yPlane = nv12;
-    uint8_t* uvPlane = nv12 + yPlaneSize;
-
     // Extract Y values (every other byte from YUYV)
     for (int y = 0; y < m_height; y++) {
         const uint8_t* yuyvRow = yuyv + y * m_width * 2;
-        uint8_t* yRow = yPlane + y * m_width;
+        uint8_t* yRow = yPlane + static_cast<size_t>(y) * yStride;
 
         for (int x = 0; x < m_width; x++) {
             yRow[x] = yuyvRow[x * 2];
@@ -372,7 +402,7 @@ void V4L2Capturer::ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* nv12) {
         // Average UV from two rows
         const uint8_t* yuyvRow0 = yuyv + (y * 2) * m_width * 2;
         const uint8_t* yuyvRow1 = yuyv + (y * 2 + 1) * m_width * 2;
-        uint8_t* uvRow = uvPlane + y * m_width;
+        uint8_t* uvRow = uvPlane + static_cast<size_t>(y) * uvStride;
 
         for (int x = 0; x < m_width / 2; x++) {
             // U comes first in YUYV
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "NV12SurfaceProvider.h"
 #include "Protocol.h"
 
 #include <linux/videodev2.h>
@@ -31,7 +32,12 @@ public:
     /// @return true if initialization succeeded
     bool Initialize(const std::string& cameraId, int width, int height, int fps);
 
-    /// Start capturing - calls callback for each frame
+    /// Write frames straight into surfaces handed out by the provider (e.g. the encoder)
+    /// instead of passing them to the frame callback. Call before Start().
+    /// @param provider Surface provider matching GetWidth() x GetHeight(), or null to use the callback
+    void SetSurfaceProvider(NV12SurfaceProvider* provider) { m_surfaceProvider = provider; }
+
+    /// Start capturing - calls callback for each frame (unless a surface provider is set)
     void Start(CameraFrameCallback callback);
 
     /// Stop capturing
@@ -44,6 +50,9 @@ public:
     int GetWidth() const { return m_width; }
     int GetHeight() const { return m_height; }
 
+    /// Get the number of frames captured (read after Stop())
+    uint64_t GetFrameCount() const { return m_frameCount; }
+
 private:
     void CaptureLoop();
     bool OpenDevice(const std::string& cameraId);
@@ -52,7 +61,8 @@ private:
     void StopStreaming();
     void CleanupMmap();
     bool NegotiateFormat();
-    void ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* nv12);
+    bool WriteToSurface(const uint8_t* frameData, uint64_t timestamp);
+    void ConvertYUYVToNV12(const uint8_t* yuyv, uint8_t* yPlane, int yStride, uint8_t* uvPlane, int uvStride);
 
     // Configuration
     std::string m_devicePath;
@@ -87,8 +97,12 @@ private:
     // Callback
     CameraFrameCallback m_callback;
 
+    // Zero-copy output into provider surfaces
+    NV12SurfaceProvider* m_surfaceProvider = nullptr;
+
     // Timing
     struct timespec m_startTime;
+    uint64_t m_frameCount = 0;
 };
 
 }  // namespace snacka
@@ -2,6 +2,7 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <fstream>
@@ -44,19 +45,27 @@ bool VaapiEncoder::Initialize() {
         return false;
     }
 
+    if (!CreateUploadImages()) {
+        std::cerr << "SnackaCaptureLinux: Failed to create VAAPI upload images\n";
+        Cleanup();
+        return false;
+    }
+
     if (!CreateContext()) {
         std::cerr << "SnackaCaptureLinux: Failed to create VAAPI context\n";
         Cleanup();
         return false;
     }
 
-    if (!CreateCodedBuffer()) {
-        std::cerr << "SnackaCaptureLinux: Failed to create coded buffer\n";
+    if (!CreateCodedBuffers()) {
+        std::cerr << "SnackaCaptureLinux: Failed to create coded buffers\n";
         Cleanup();
         return false;
     }
 
     m_initialized = true;
+    m_readoutRunning = true;
+    m_readoutThread = std::thread(&VaapiEncoder::ReadoutLoop, this);
     std::cerr << "SnackaCaptureLinux: VAAPI encoder initialized (" << m_encoderName << ")\n";
     return true;
 }
@@ -192,7 +201,7 @@ bool VaapiEncoder::CreateConfig() {
 }
 
 bool VaapiEncoder::CreateSurfaces() {
-    m_surfaces.resize(NUM_SURFACES);
+    m_surfaces.resize(NUM_SURFACES, VA_INVALID_SURFACE);
 
     VAStatus status = vaCreateSurfaces(
         m_vaDisplay,
@@ -207,6 +216,26 @@ bool VaapiEncoder::CreateSurfaces() {
 
     if (status != VA_STATUS_SUCCESS) {
         std::cerr << "SnackaCaptureLinux: Failed to create surfaces: " << vaErrorStr(status) << "\n";
+        m_surfaces.clear();
+        return false;
+    }
+
+    m_reconSurfaces.resize(NUM_RECON_SURFACES, VA_INVALID_SURFACE);
+
+    status = vaCreateSurfaces(
+        m_vaDisplay,
+        VA_RT_FORMAT_YUV420,
+        m_width,
+        m_height,
+        m_reconSurfaces.data(),
+        NUM_RECON_SURFACES,
+        nullptr,
+        0
+    );
+
+    if (status != VA_STATUS_SUCCESS) {
+        std::cerr << "SnackaCaptureLinux: Failed to create reconstructed surfaces: " << vaErrorStr(status) << "\n";
+        m_reconSurfaces.clear();
         return false;
     }
 
@@ -214,14 +243,17 @@ bool VaapiEncoder::CreateSurfaces() {
 }
 
 bool VaapiEncoder::CreateContext() {
+    std::vector<VASurfaceID> renderTargets = m_surfaces;
+    renderTargets.insert(renderTargets.end(), m_reconSurfaces.begin(), m_reconSurfaces.end());
+
     VAStatus status = vaCreateContext(
         m_vaDisplay,
         m_configId,
         m_width,
         m_height,
         VA_PROGRESSIVE,
-        m_surfaces.data(),
-        static_cast<int>(m_surfaces.size()),
+        renderTargets.data(),
+        static_cast<int>(renderTargets.size()),
         &m_contextId
     );
 
@@ -233,89 +265,200 @@ bool VaapiEncoder::CreateContext() {
     return true;
 }
 
-bool VaapiEncoder::CreateCodedBuffer() {
-    // Allocate buffer large enough for worst case (uncompressed frame)
+bool VaapiEncoder::CreateCodedBuffers() {
+    // Allocate buffers large enough for worst case (uncompressed frame)
     unsigned int codedBufSize = m_width * m_height * 3 / 2;
 
-    VAStatus status = vaCreateBuffer(
-        m_vaDisplay,
-        m_contextId,
-        VAEncCodedBufferType,
-        codedBufSize,
-        1,
-        nullptr,
-        &m_codedBuf
-    );
+    m_codedBufs.resize(NUM_SURFACES, VA_INVALID_ID);
+    for (auto& codedBuf : m_codedBufs) {
+        VAStatus status = vaCreateBuffer(
+            m_vaDisplay,
+            m_contextId,
+            VAEncCodedBufferType,
+            codedBufSize,
+            1,
+            nullptr,
+            &codedBuf
+        );
+
+        if (status != VA_STATUS_SUCCESS) {
+            std::cerr << "SnackaCaptureLinux: Failed to create coded buffer: " << vaErrorStr(status) << "\n";
+            codedBuf = VA_INVALID_ID;
+            return false;
+        }
+    }
+
+    return true;
+}
 
+bool VaapiEncoder::CreateUploadImages() {
+    // Prefer images derived from the surfaces: frames are then written straight into
+    // encoder memory. Only usable when the driver exposes the surfaces as linear NV12.
+    m_uploadImages.resize(m_surfaces.size());
+    for (auto& upload : m_uploadImages) {
+        upload.image.image_id = VA_INVALID_ID;
+    }
+
+    m_derivedImages = true;
+    for (size_t i = 0; i < m_surfaces.size(); i++) {
+        VAImage& image = m_uploadImages[i].image;
+        VAStatus status = vaDeriveImage(m_vaDisplay, m_surfaces[i], &image);
+        if (status != VA_STATUS_SUCCESS || image.format.fourcc != VA_FOURCC_NV12) {
+            if (status == VA_STATUS_SUCCESS) {
+                vaDestroyImage(m_vaDisplay, image.image_id);
+            }
+            image.image_id = VA_INVALID_ID;
+            m_derivedImages = false;
+            break;
+        }
+    }
+
+    if (m_derivedImages) {
+        std::cerr << "SnackaCaptureLinux: Writing frames directly into VAAPI surfaces\n";
+        return true;
+    }
+
+    // Fall back to one staging image that is copied into the surface by the driver
+    DestroyUploadImages();
+    m_uploadImages.resize(1);
+
+    VAImageFormat format = {};
+    format.fourcc = VA_FOURCC_NV12;
+    format.byte_order = VA_LSB_FIRST;
+    format.bits_per_pixel = 12;
+
+    VAStatus status = vaCreateImage(m_vaDisplay, &format, m_width, m_height, &m_uploadImages[0].image);
     if (status != VA_STATUS_SUCCESS) {
-        std::cerr << "SnackaCaptureLinux: Failed to create coded buffer: " << vaErrorStr(status) << "\n";
+        std::cerr << "SnackaCaptureLinux: Failed to create upload image: " << vaErrorStr(status) << "\n";
+        m_uploadImages.clear();
         return false;
     }
 
+    std::cerr << "SnackaCaptureLinux: Surfaces cannot be mapped, uploading frames with vaPutImage\n";
     return true;
 }
 
-bool VaapiEncoder::EncodeNV12(const uint8_t* nv12Data, size_t size, int64_t timestampMs) {
-    if (!m_initialized) {
+void VaapiEncoder::DestroyUploadImages() {
+    if (m_mappedImage >= 0) {
+        vaUnmapBuffer(m_vaDisplay, m_uploadImages[m_mappedImage].image.buf);
+        m_mappedImage = -1;
+    }
+    for (auto& upload : m_uploadImages) {
+        if (upload.image.image_id != VA_INVALID_ID) {
+            vaDestroyImage(m_vaDisplay, upload.image.image_id);
+        }
+    }
+    m_uploadImages.clear();
+}
+
+bool VaapiEncoder::AcquireSurface(NV12Surface& surface) {
+    if (!m_initialized || m_mappedImage >= 0) {
         return false;
     }
 
-    // Get current surface
-    VASurfaceID surface = m_surfaces[m_currentSurface];
+    // The surface we write next is the oldest one in flight once all are busy
+    {
+        std::unique_lock<std::mutex> lock(m_pipelineMutex);
+        m_pipelineCv.wait(lock, [this] {
+            return m_inFlight.size() < static_cast<size_t>(NUM_SURFACES) || !m_readoutRunning;
+        });
+        if (!m_readoutRunning) {
+            return false;
+        }
+    }
+
+    int index = m_derivedImages ? m_currentSurface : 0;
+    UploadImage& upload = m_uploadImages[index];
 
-    // Upload NV12 data to surface
-    VAImage image;
-    VAStatus status = vaDeriveImage(m_vaDisplay, surface, &image);
+    void* data = nullptr;
+    std::lock_guard<std::mutex> vaLock(m_vaMutex);
+    VAStatus status = vaMapBuffer(m_vaDisplay, upload.image.buf, &data);
     if (status != VA_STATUS_SUCCESS) {
-        std::cerr << "SnackaCaptureLinux: Failed to derive image: " << vaErrorStr(status) << "\n";
+        std::cerr << "SnackaCaptureLinux: Failed to map surface: " << vaErrorStr(status) << "\n";
         return false;
     }
 
-    void* imageData = nullptr;
-    status = vaMapBuffer(m_vaDisplay, image.buf, &imageData);
-    if (status != VA_STATUS_SUCCESS) {
-        vaDestroyImage(m_vaDisplay, image.image_id);
+    uint8_t* base = static_cast<uint8_t*>(data);
+    surface.yPlane = base + upload.image.offsets[0];
+    surface.uvPlane = base + upload.image.offsets[1];
+    surface.yStride = static_cast<int>(upload.image.pitches[0]);
+    surface.uvStride = static_cast<int>(upload.image.pitches[1]);
+    surface.age = upload.writtenFrame < 0 ? 0 : static_cast<int>(m_submittedFrames - upload.writtenFrame);
+
+    m_mappedImage = index;
+    m_acquireTime = Clock::now();
+    return true;
+}
+
+void VaapiEncoder::ReleaseSurface() {
+    if (m_mappedImage < 0) {
+        return;
+    }
+
+    UploadImage& upload = m_uploadImages[m_mappedImage];
+    std::lock_guard<std::mutex> vaLock(m_vaMutex);
+    vaUnmapBuffer(m_vaDisplay, upload.image.buf);
+    upload.writtenFrame = -1;
+    m_mappedImage = -1;
+}
+
+bool VaapiEncoder::SubmitSurface(int64_t timestampMs) {
+    if (m_mappedImage < 0) {
         return false;
     }
 
-    // Copy NV12 data (Y plane then UV plane)
-    size_t ySize = static_cast<size_t>(m_width) * m_height;
-    size_t uvSize = ySize / 2;
+    UploadImage& upload = m_uploadImages[m_mappedImage];
+    m_mappedImage = -1;
 
-    // Copy Y plane
-    uint8_t* dst = static_cast<uint8_t*>(imageData) + image.offsets[0];
-    const uint8_t* src = nv12Data;
-    for (int y = 0; y < m_height; y++) {
-        memcpy(dst, src, m_width);
-        dst += image.pitches[0];
-        src += m_width;
+    std::lock_guard<std::mutex> vaLock(m_vaMutex);
+    VAStatus status = vaUnmapBuffer(m_vaDisplay, upload.image.buf);
+    if (status != VA_STATUS_SUCCESS) {
+        std::cerr << "SnackaCaptureLinux: Failed to unmap surface: " << vaErrorStr(status) << "\n";
+        upload.writtenFrame = -1;
+        return false;
     }
+    upload.writtenFrame = m_submittedFrames++;
 
-    // Copy UV plane
-    dst = static_cast<uint8_t*>(imageData) + image.offsets[1];
-    for (int y = 0; y < m_height / 2; y++) {
-        memcpy(dst, src, m_width);
-        dst += image.pitches[1];
-        src += m_width;
+    if (!m_derivedImages) {
+        status = vaPutImage(m_vaDisplay, m_surfaces[m_currentSurface], upload.image.image_id,
+                            0, 0, m_width, m_height, 0, 0, m_width, m_height);
+        if (status != VA_STATUS_SUCCESS) {
+            std::cerr << "SnackaCaptureLinux: Failed to upload image: " << vaErrorStr(status) << "\n";
+            return false;
+        }
     }
 
-    vaUnmapBuffer(m_vaDisplay, image.buf);
-    vaDestroyImage(m_vaDisplay, image.image_id);
+    return EncodeCurrentSurface(timestampMs);
+}
+
+bool VaapiEncoder::EncodeCurrentSurface(int64_t timestampMs) {
+    InFlightFrame frame;
+    frame.surfaceIndex = m_currentSurface;
+    frame.acquired = m_acquireTime;
+    frame.submitted = Clock::now();
 
     // Determine if this should be a keyframe
     bool isKeyframe = (m_frameCount % m_gopSize == 0);
+    if (m_keyframeRequested.exchange(false)) {
+        isKeyframe = true;
+    }
+    frame.isKeyframe = isKeyframe;
 
-    // Encode the frame
+    // Queue the frame on the GPU; the readout thread waits for it
     if (!EncodeFrame(timestampMs, isKeyframe)) {
         return false;
     }
+    frame.queued = Clock::now();
 
-    // Get encoded data and output
-    GetEncodedData(isKeyframe);
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        m_inFlight.push_back(frame);
+    }
+    m_pipelineCv.notify_all();
 
     // Update state
-    m_refSurfaceIndex = m_currentSurface;
-    m_refSurface = surface;
+    m_refSurface = m_reconSurfaces[m_currentRecon];
+    m_currentRecon = (m_currentRecon + 1) % NUM_RECON_SURFACES;
     m_currentSurface = (m_currentSurface + 1) % NUM_SURFACES;
     m_frameCount++;
     m_frameNumInGop++;
@@ -340,29 +483,22 @@ bool VaapiEncoder::EncodeFrame(int64_t timestampMs, bool forceKeyframe) {
     }
 
     // Render picture (creates parameter buffers and submits them)
-    if (!RenderPicture(currentSurface, isIdr)) {
+    if (!RenderPicture(m_reconSurfaces[m_currentRecon], isIdr)) {
         vaEndPicture(m_vaDisplay, m_contextId);
         return false;
     }
 
-    // End picture
+    // End picture (queues the encode; completion is awaited on the readout thread)
     status = vaEndPicture(m_vaDisplay, m_contextId);
     if (status != VA_STATUS_SUCCESS) {
         std::cerr << "SnackaCaptureLinux: vaEndPicture failed: " << vaErrorStr(status) << "\n";
         return false;
     }
 
-    // Wait for encoding to complete
-    status = vaSyncSurface(m_vaDisplay, currentSurface);
-    if (status != VA_STATUS_SUCCESS) {
-        std::cerr << "SnackaCaptureLinux: vaSyncSurface failed: " << vaErrorStr(status) << "\n";
-        return false;
-    }
-
     return true;
 }
 
-bool VaapiEncoder::RenderPicture(VASurfaceID surface, bool isIdr) {
+bool VaapiEncoder::RenderPicture(VASurfaceID reconSurface, bool isIdr) {
     VAStatus status;
 
     // Sequence parameter buffer (SPS) - only for IDR frames
@@ -410,7 +546,7 @@ bool VaapiEncoder::RenderPicture(VASurfaceID surface, bool isIdr) {
     // Picture parameter buffer (PPS)
     VAEncPictureParameterBufferH264 picParam = {};
 
-    picParam.CurrPic.picture_id = surface;
+    picParam.CurrPic.picture_id = reconSurface;
     picParam.CurrPic.TopFieldOrderCnt = m_frameCount * 2;
     picParam.CurrPic.flags = 0;
 
@@ -424,7 +560,7 @@ bool VaapiEncoder::RenderPicture(VASurfaceID surface, bool isIdr) {
         picParam.ReferenceFrames[i].flags = VA_PICTURE_H264_INVALID;
     }
 
-    picParam.coded_buf = m_codedBuf;
+    picParam.coded_buf = m_codedBufs[m_currentSurface];
     picParam.pic_fields.bits.idr_pic_flag = isIdr ? 1 : 0;
     picParam.pic_fields.bits.reference_pic_flag = 1;
     // Use CABAC for High/Main profiles (~10-15% better compression than CAVLC)
@@ -499,35 +635,101 @@ bool VaapiEncoder::RenderPicture(VASurfaceID surface, bool isIdr) {
     return true;
 }
 
-bool VaapiEncoder::GetEncodedData(bool isKeyframe) {
-    VACodedBufferSegment* bufferSegment = nullptr;
+void VaapiEncoder::ReadoutLoop() {
+    while (true) {
+        InFlightFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_pipelineMutex);
+            m_pipelineCv.wait(lock, [this] { return !m_inFlight.empty() || !m_readoutRunning; });
+            if (m_inFlight.empty()) {
+                return;  // Stopping, and everything submitted has been read out
+            }
+            frame = m_inFlight.front();
+        }
+
+        // Frames complete in submission order, so waiting on the oldest never stalls a newer one
+        VAStatus status = vaSyncSurface(m_vaDisplay, m_surfaces[frame.surfaceIndex]);
+        auto encoded = Clock::now();
+        if (status != VA_STATUS_SUCCESS) {
+            std::cerr << "SnackaCaptureLinux: vaSyncSurface failed: " << vaErrorStr(status) << "\n";
+        } else {
+            GetEncodedData(m_codedBufs[frame.surfaceIndex], frame.isKeyframe);
+        }
+        auto done = Clock::now();
+
+        auto elapsedUs = [](Clock::time_point from, Clock::time_point to) {
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+        };
+        m_stageLatency[STAGE_WRITE].Record(elapsedUs(frame.acquired, frame.submitted));
+        m_stageLatency[STAGE_SUBMIT].Record(elapsedUs(frame.submitted, frame.queued));
+        m_stageLatency[STAGE_ENCODE].Record(elapsedUs(frame.queued, encoded));
+        m_stageLatency[STAGE_READOUT].Record(elapsedUs(encoded, done));
+        m_stageLatency[STAGE_TOTAL].Record(elapsedUs(frame.acquired, done));
+
+        // Only now may the surface and its coded buffer be reused
+        {
+            std::lock_guard<std::mutex> lock(m_pipelineMutex);
+            m_inFlight.pop_front();
+        }
+        m_pipelineCv.notify_all();
 
-    VAStatus status = vaMapBuffer(m_vaDisplay, m_codedBuf, reinterpret_cast<void**>(&bufferSegment));
-    if (status != VA_STATUS_SUCCESS) {
-        std::cerr << "SnackaCaptureLinux: Failed to map coded buffer: " << vaErrorStr(status) << "\n";
-        return false;
+        if (++m_readoutFrames % 300 == 0) {
+            LogLatencyStats();
+        }
     }
+}
+
+bool VaapiEncoder::GetEncodedData(VABufferID codedBuf, bool isKeyframe) {
+    m_avccBuffer.clear();
 
-    // Process all segments
-    while (bufferSegment != nullptr) {
-        if (bufferSegment->buf && bufferSegment->size > 0) {
-            // Convert Annex-B to AVCC and invoke callback
-            ConvertAnnexBToAVCC(
-                static_cast<const uint8_t*>(bufferSegment->buf),
-                bufferSegment->size,
-                isKeyframe
-            );
+    {
+        std::lock_guard<std::mutex> vaLock(m_vaMutex);
+
+        VACodedBufferSegment* bufferSegment = nullptr;
+        VAStatus status = vaMapBuffer(m_vaDisplay, codedBuf, reinterpret_cast<void**>(&bufferSegment));
+        if (status != VA_STATUS_SUCCESS) {
+            std::cerr << "SnackaCaptureLinux: Failed to map coded buffer: " << vaErrorStr(status) << "\n";
+            return false;
         }
-        bufferSegment = reinterpret_cast<VACodedBufferSegment*>(bufferSegment->next);
+
+        // Convert all segments from Annex-B to AVCC
+        while (bufferSegment != nullptr) {
+            if (bufferSegment->buf && bufferSegment->size > 0) {
+                ConvertAnnexBToAVCC(
+                    static_cast<const uint8_t*>(bufferSegment->buf),
+                    bufferSegment->size
+                );
+            }
+            bufferSegment = reinterpret_cast<VACodedBufferSegment*>(bufferSegment->next);
+        }
+
+        vaUnmapBuffer(m_vaDisplay, codedBuf);
     }
 
-    vaUnmapBuffer(m_vaDisplay, m_codedBuf);
+    // Invoke callback with AVCC data, outside the VA lock (the consumer may block on a pipe)
+    if (!m_avccBuffer.empty() && m_callback) {
+        m_callback(m_avccBuffer.data(), m_avccBuffer.size(), isKeyframe);
+    }
     return true;
 }
 
-void VaapiEncoder::ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size, bool isKeyframe) {
-    m_avccBuffer.clear();
+void VaapiEncoder::LogLatencyStats() {
+    static const char* const STAGE_NAMES[STAGE_COUNT] = {"write", "submit", "encode", "readout", "total"};
 
+    std::cerr << "SnackaCaptureLinux: Encode latency p50/p95/max";
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        const LatencyHistogram& histogram = m_stageLatency[stage];
+        std::cerr << (stage == 0 ? " " : ", ") << STAGE_NAMES[stage] << " "
+                  << histogram.Percentile(50) << "/" << histogram.Percentile(95) << "/" << histogram.GetMax() << "us";
+    }
+    std::cerr << " over " << m_stageLatency[STAGE_TOTAL].GetCount() << " frames\n";
+
+    for (auto& histogram : m_stageLatency) {
+        histogram.Reset();
+    }
+}
+
+void VaapiEncoder::ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size) {
     // Parse Annex-B format and convert to AVCC (4-byte length prefix)
     size_t i = 0;
     while (i < size) {
@@ -588,32 +790,44 @@ void VaapiEncoder::ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size, bool
 
         i = nalEnd;
     }
-
-    // Invoke callback with AVCC data
-    if (!m_avccBuffer.empty() && m_callback) {
-        m_callback(m_avccBuffer.data(), m_avccBuffer.size(), isKeyframe);
-    }
 }
 
 void VaapiEncoder::Flush() {
-    // Nothing to flush in synchronous mode
+    std::unique_lock<std::mutex> lock(m_pipelineMutex);
+    m_pipelineCv.wait(lock, [this] { return m_inFlight.empty() || !m_readoutRunning; });
 }
 
 void VaapiEncoder::Stop() {
+    // The readout thread drains the frames still in flight before it exits
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        m_readoutRunning = false;
+    }
+    m_pipelineCv.notify_all();
+    if (m_readoutThread.joinable()) {
+        m_readoutThread.join();
+    }
+
     Cleanup();
 }
 
 void VaapiEncoder::Cleanup() {
-    if (m_codedBuf != VA_INVALID_ID && m_vaDisplay) {
-        vaDestroyBuffer(m_vaDisplay, m_codedBuf);
-        m_codedBuf = VA_INVALID_ID;
+    for (auto& codedBuf : m_codedBufs) {
+        if (codedBuf != VA_INVALID_ID && m_vaDisplay) {
+            vaDestroyBuffer(m_vaDisplay, codedBuf);
+        }
     }
+    m_codedBufs.clear();
 
     if (m_contextId != VA_INVALID_ID && m_vaDisplay) {
         vaDestroyContext(m_vaDisplay, m_contextId);
         m_contextId = VA_INVALID_ID;
     }
 
+    if (m_vaDisplay) {
+        DestroyUploadImages();
+    }
+
     for (auto& surface : m_surfaces) {
         if (surface != VA_INVALID_SURFACE && m_vaDisplay) {
             vaDestroySurfaces(m_vaDisplay, &surface, 1);
@@ -621,6 +835,13 @@ void VaapiEncoder::Cleanup() {
     }
     m_surfaces.clear();
 
+    for (auto& surface : m_reconSurfaces) {
+        if (surface != VA_INVALID_SURFACE && m_vaDisplay) {
+            vaDestroySurfaces(m_vaDisplay, &surface, 1);
+        }
+    }
+    m_reconSurfaces.clear();
+
     if (m_configId != VA_INVALID_ID && m_vaDisplay) {
         vaDestroyConfig(m_vaDisplay, m_configId);
         m_configId = VA_INVALID_ID;
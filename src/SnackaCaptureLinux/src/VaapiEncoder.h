@@ -1,5 +1,8 @@
 #pragma once
 
+#include "LatencyHistogram.h"
+#include "VideoEncoder.h"
+
 #include <va/va.h>
 #include <va/va_drm.h>
 #include <va/va_enc_h264.h>
@@ -7,8 +10,13 @@
 #include <functional>
 #include <vector>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 
 namespace snacka {
 
@@ -51,39 +59,43 @@ struct ValidationResult {
     std::vector<std::string> h264Entrypoints;
 };
 
-/// Callback for encoded H.264 data
-/// @param data Pointer to encoded NAL unit data (AVCC format with 4-byte length prefix)
-/// @param size Size of the data
-/// @param isKeyframe True if this is a keyframe (IDR)
-using EncodedCallback = std::function<void(const uint8_t* data, size_t size, bool isKeyframe)>;
-
 /// Hardware H.264 encoder using VAAPI.
 /// Works with Intel, AMD, and some NVIDIA GPUs via mesa/nouveau.
 /// Outputs H.264 NAL units in AVCC format (4-byte big-endian length prefix).
-class VaapiEncoder {
+/// Frames can be passed as NV12 buffers (EncodeNV12) or written straight into
+/// the encoder's mapped surfaces through the NV12SurfaceProvider interface.
+/// Encoding is pipelined: submission returns once the frame is queued on the GPU,
+/// and a readout thread waits for each frame and invokes the callback in order.
+class VaapiEncoder : public VideoEncoder {
 public:
     VaapiEncoder(int width, int height, int fps, int bitrateMbps = 6);
-    ~VaapiEncoder();
+    ~VaapiEncoder() override;
 
     /// Initialize the encoder
     /// @return true if initialization succeeded
-    bool Initialize();
+    bool Initialize() override;
+
+    /// Map the next input surface for writing (see NV12SurfaceProvider).
+    /// Blocks while all surfaces are in flight.
+    bool AcquireSurface(NV12Surface& surface) override;
+
+    /// Unmap the acquired surface and queue it for encoding
+    bool SubmitSurface(int64_t timestampMs) override;
 
-    /// Encode raw NV12 data
-    /// @param nv12Data Pointer to NV12 frame data
-    /// @param size Size of the data
-    /// @param timestampMs Presentation timestamp in milliseconds
-    /// @return true if the frame was submitted for encoding
-    bool EncodeNV12(const uint8_t* nv12Data, size_t size, int64_t timestampMs);
+    /// Unmap the acquired surface without encoding it
+    void ReleaseSurface() override;
 
-    /// Flush any pending frames
-    void Flush();
+    /// Make the next submitted frame an IDR frame
+    void RequestKeyframe() override { m_keyframeRequested = true; }
+
+    /// Wait until every submitted frame has been read out
+    void Flush() override;
 
     /// Stop the encoder and release resources
-    void Stop();
+    void Stop() override;
 
-    /// Set the callback for encoded data
-    void SetCallback(EncodedCallback callback) { m_callback = callback; }
+    /// Set the callback for encoded data (called on the readout thread)
+    void SetCallback(EncodedCallback callback) override { m_callback = callback; }
 
     /// Check if a hardware H.264 encoder is available on this system
     static bool IsHardwareEncoderAvailable();
@@ -92,21 +104,30 @@ public:
     static ValidationResult Validate();
 
     /// Get the name of the encoder being used
-    const char* GetEncoderName() const { return m_encoderName.c_str(); }
+    const char* GetEncoderName() const override { return m_encoderName.c_str(); }
 
     /// Check if the encoder is initialized
-    bool IsInitialized() const { return m_initialized; }
+    bool IsInitialized() const override { return m_initialized; }
+
+    /// Get the frame size
+    int GetWidth() const override { return m_width; }
+    int GetHeight() const override { return m_height; }
 
 private:
     bool OpenDrmDevice();
     bool CreateConfig();
     bool CreateSurfaces();
     bool CreateContext();
-    bool CreateCodedBuffer();
+    bool CreateCodedBuffers();
+    bool CreateUploadImages();
+    void DestroyUploadImages();
+    bool EncodeCurrentSurface(int64_t timestampMs);
     bool EncodeFrame(int64_t timestampMs, bool forceKeyframe);
-    bool RenderPicture(VASurfaceID surface, bool isIdr);
-    bool GetEncodedData(bool isKeyframe);
-    void ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size, bool isKeyframe);
+    bool RenderPicture(VASurfaceID reconSurface, bool isIdr);
+    void ReadoutLoop();
+    bool GetEncodedData(VABufferID codedBuf, bool isKeyframe);
+    void ConvertAnnexBToAVCC(const uint8_t* annexB, size_t size);
+    void LogLatencyStats();
     void Cleanup();
 
     // Configuration
@@ -119,6 +140,7 @@ private:
     // State
     bool m_initialized = false;
     int64_t m_frameCount = 0;
+    std::atomic<bool> m_keyframeRequested{false};
     std::string m_encoderName = "VAAPI";
 
     // DRM and VAAPI objects
@@ -128,17 +150,56 @@ private:
     VAContextID m_contextId = VA_INVALID_ID;
     VAProfile m_profile = VAProfileH264ConstrainedBaseline;
 
-    // Surfaces for encoding (double buffered)
+    // Input surfaces, one per frame in flight. The encoder writes its reconstructed
+    // pictures to separate surfaces, so input surfaces keep the frame they were given.
+    // One extra reconstructed surface keeps the previous frame's reference alive until
+    // every frame using it has completed.
     static constexpr int NUM_SURFACES = 4;
+    static constexpr int NUM_RECON_SURFACES = NUM_SURFACES + 1;
     std::vector<VASurfaceID> m_surfaces;
+    std::vector<VASurfaceID> m_reconSurfaces;
     int m_currentSurface = 0;
-
-    // Reference frame for P-frames
+    int m_currentRecon = 0;
+
+    // CPU-visible images for writing frames. When the driver can derive an NV12 image
+    // from each surface, writes land in the surface itself; otherwise a single staging
+    // image is uploaded with vaPutImage on submit.
+    struct UploadImage {
+        VAImage image = {};
+        int64_t writtenFrame = -1;  // m_submittedFrames when last written (-1 = undefined)
+    };
+    std::vector<UploadImage> m_uploadImages;
+    bool m_derivedImages = false;
+    int m_mappedImage = -1;  // Index into m_uploadImages while a surface is acquired
+    int64_t m_submittedFrames = 0;
+
+    // Reference frame for P-frames (a reconstructed surface)
     VASurfaceID m_refSurface = VA_INVALID_SURFACE;
-    int m_refSurfaceIndex = 0;
 
-    // Coded buffer for output
-    VABufferID m_codedBuf = VA_INVALID_ID;
+    // Coded buffer per input surface, so every frame in flight has its own
+    std::vector<VABufferID> m_codedBufs;
+
+    // Pipeline between submission (caller's thread) and readout
+    using Clock = std::chrono::steady_clock;
+    struct InFlightFrame {
+        int surfaceIndex = 0;
+        bool isKeyframe = false;
+        Clock::time_point acquired;   // Surface handed out for writing
+        Clock::time_point submitted;  // Written surface handed back
+        Clock::time_point queued;     // vaEndPicture returned
+    };
+    std::mutex m_vaMutex;  // Serializes VA calls made from the two threads
+    std::mutex m_pipelineMutex;
+    std::condition_variable m_pipelineCv;
+    std::deque<InFlightFrame> m_inFlight;  // Oldest first; popped once read out
+    bool m_readoutRunning = false;
+    std::thread m_readoutThread;
+    Clock::time_point m_acquireTime;
+
+    // Per-stage latency, owned by the readout thread and logged every few hundred frames
+    enum Stage { STAGE_WRITE, STAGE_SUBMIT, STAGE_ENCODE, STAGE_READOUT, STAGE_TOTAL, STAGE_COUNT };
+    LatencyHistogram m_stageLatency[STAGE_COUNT];
+    uint64_t m_readoutFrames = 0;
 
     // Sequence and picture parameter buffers
     VABufferID m_seqParamBuf = VA_INVALID_ID;
@@ -150,7 +211,7 @@ private:
     std::vector<uint8_t> m_pps;
     bool m_haveSpsPs = false;
 
-    // Output buffers
+    // Output buffers (readout thread)
     std::vector<uint8_t> m_avccBuffer;
 
     // Callback
@@ -0,0 +1,110 @@
+#include "VideoEncoder.h"
+#include "VaapiEncoder.h"
+#ifdef SNACKA_HAVE_X264
+#include "SoftwareEncoder.h"
+#endif
+
+#include <cstring>
+#include <iostream>
+
+namespace snacka {
+
+bool ParseEncoderBackend(const std::string& name, EncoderBackend& backend) {
+    if (name == "auto") {
+        backend = EncoderBackend::Auto;
+    } else if (name == "vaapi") {
+        backend = EncoderBackend::Vaapi;
+    } else if (name == "software") {
+        backend = EncoderBackend::Software;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* EncoderBackendName(EncoderBackend backend) {
+    switch (backend) {
+        case EncoderBackend::Auto: return "auto";
+        case EncoderBackend::Vaapi: return "vaapi";
+        case EncoderBackend::Software: return "software";
+    }
+    return "unknown";
+}
+
+bool VideoEncoder::EncodeNV12(const uint8_t* nv12Data, size_t size, int64_t timestampMs) {
+    const int width = GetWidth();
+    const int height = GetHeight();
+
+    if (!IsInitialized()) {
+        return false;
+    }
+
+    if (size < static_cast<size_t>(width) * height * 3 / 2) {
+        std::cerr << "SnackaCaptureLinux: NV12 frame too small (" << size << " bytes)\n";
+        return false;
+    }
+
+    NV12Surface surface;
+    if (!AcquireSurface(surface)) {
+        return false;
+    }
+
+    // Copy Y plane
+    const uint8_t* src = nv12Data;
+    uint8_t* dst = surface.yPlane;
+    for (int y = 0; y < height; y++) {
+        memcpy(dst, src, width);
+        dst += surface.yStride;
+        src += width;
+    }
+
+    // Copy UV plane
+    dst = surface.uvPlane;
+    for (int y = 0; y < height / 2; y++) {
+        memcpy(dst, src, width);
+        dst += surface.uvStride;
+        src += width;
+    }
+
+    return SubmitSurface(timestampMs);
+}
+
+bool IsSoftwareEncoderAvailable() {
+#ifdef SNACKA_HAVE_X264
+    return SoftwareEncoder::IsAvailable();
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<VideoEncoder> CreateVideoEncoder(EncoderBackend backend, int width, int height,
+                                                 int fps, int bitrateMbps) {
+    if (backend != EncoderBackend::Software) {
+        if (VaapiEncoder::IsHardwareEncoderAvailable()) {
+            auto encoder = std::make_unique<VaapiEncoder>(width, height, fps, bitrateMbps);
+            if (encoder->Initialize()) {
+                return encoder;
+            }
+            std::cerr << "SnackaCaptureLinux: Failed to initialize VAAPI encoder\n";
+        } else {
+            std::cerr << "SnackaCaptureLinux: No VAAPI H.264 encoder available\n";
+        }
+
+        if (backend == EncoderBackend::Vaapi) {
+            return nullptr;
+        }
+    }
+
+#ifdef SNACKA_HAVE_X264
+    auto encoder = std::make_unique<SoftwareEncoder>(width, height, fps, bitrateMbps);
+    if (encoder->Initialize()) {
+        return encoder;
+    }
+    std::cerr << "SnackaCaptureLinux: Failed to initialize software encoder\n";
+#else
+    std::cerr << "SnackaCaptureLinux: Software encoder not available (built without x264)\n";
+#endif
+    return nullptr;
+}
+
+}  // namespace snacka
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "NV12SurfaceProvider.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace snacka {
+
+/// Callback for encoded H.264 data
+/// @param data Pointer to encoded NAL unit data (AVCC format with 4-byte length prefix)
+/// @param size Size of the data
+/// @param isKeyframe True if this is a keyframe (IDR)
+using EncodedCallback = std::function<void(const uint8_t* data, size_t size, bool isKeyframe)>;
+
+/// H.264 encoder implementation selected with --encoder
+enum class EncoderBackend {
+    Auto,     // VAAPI if available, otherwise software
+    Vaapi,    // GPU encoding through VAAPI
+    Software  // CPU encoding (x264)
+};
+
+/// Parse an --encoder value ("auto", "vaapi" or "software")
+/// @return false if the name is not recognized
+bool ParseEncoderBackend(const std::string& name, EncoderBackend& backend);
+
+/// Get the command line name of a backend
+const char* EncoderBackendName(EncoderBackend backend);
+
+/// Common interface of the H.264 encoders.
+/// Output is AVCC (4-byte big-endian length prefix per NAL unit), with SPS/PPS
+/// in front of every keyframe. Frames are either passed as NV12 buffers or
+/// written into the encoder's own surfaces through NV12SurfaceProvider.
+class VideoEncoder : public NV12SurfaceProvider {
+public:
+    ~VideoEncoder() override = default;
+
+    /// Initialize the encoder
+    /// @return true if initialization succeeded
+    virtual bool Initialize() = 0;
+
+    /// Encode raw NV12 data (copied into the next surface)
+    /// @param nv12Data Pointer to NV12 frame data (width * height * 3 / 2 bytes)
+    /// @param size Size of the data
+    /// @param timestampMs Presentation timestamp in milliseconds
+    /// @return true if the frame was submitted for encoding
+    bool EncodeNV12(const uint8_t* nv12Data, size_t size, int64_t timestampMs);
+
+    /// Make the next submitted frame an IDR frame, e.g. after encoded output was
+    /// dropped downstream. Safe to call from any thread.
+    virtual void RequestKeyframe() = 0;
+
+    /// Wait until every submitted frame has been delivered to the callback
+    virtual void Flush() = 0;
+
+    /// Stop the encoder and release resources
+    virtual void Stop() = 0;
+
+    /// Set the callback for encoded data
+    virtual void SetCallback(EncodedCallback callback) = 0;
+
+    /// Get the name of the encoder being used
+    virtual const char* GetEncoderName() const = 0;
+
+    /// Check if the encoder is initialized
+    virtual bool IsInitialized() const = 0;
+
+    /// Get the frame width in pixels
+    virtual int GetWidth() const = 0;
+
+    /// Get the frame height in pixels
+    virtual int GetHeight() const = 0;
+};
+
+/// Check whether the software backend was compiled in and libx264 loads
+bool IsSoftwareEncoderAvailable();
+
+/// Create and initialize an encoder.
+/// Auto tries VAAPI first and falls back to the software encoder.
+/// @return The initialized encoder, or null if the backend is unavailable
+std::unique_ptr<VideoEncoder> CreateVideoEncoder(EncoderBackend backend, int width, int height,
+                                                 int fps, int bitrateMbps);
+
+}  // namespace snacka
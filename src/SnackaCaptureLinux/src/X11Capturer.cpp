@@ -8,12 +8,27 @@
 
 namespace snacka {
 
-X11Capturer::X11Capturer() {
+namespace {
+
+// Above this many damage rectangles (or this share of the screen) a full grab is cheaper
+constexpr size_t MAX_DIRTY_RECTS = 64;
+constexpr int MAX_DIRTY_PERCENT = 60;
+
+// Frames of changed-rectangle history kept for output surfaces that are several frames old
+constexpr int MAX_CONVERT_HISTORY = 8;
+
+}  // namespace
+
+X11Capturer::X11Capturer(const X11CaptureOptions& options)
+    : m_options(options) {
+    m_options.convertThreads = std::max(1, m_options.convertThreads);
 }
 
 X11Capturer::~X11Capturer() {
     Stop();
 
+    CleanupDamage();
+
     if (m_image) {
         XDestroyImage(m_image);
         m_image = nullptr;
@@ -112,8 +127,61 @@ bool X11Capturer::Initialize(int displayIndex, int width, int height, int fps) {
 
     m_shmAttached = true;
 
-    // Allocate NV12 buffer for output
-    m_nv12Buffer.resize(CalculateNV12FrameSize(m_width, m_height));
+    // The conversion kernels read 4 bytes per pixel in B, G, R, X order
+    if (m_image->bits_per_pixel != 32) {
+        std::cerr << "SnackaCaptureLinux: Unsupported screen format (" << m_image->bits_per_pixel
+                  << " bits per pixel, need 32)\n";
+        return false;
+    }
+
+    // Allocate NV12 buffer for output, unless frames go straight into provider surfaces
+    if (m_surfaceProvider) {
+        std::cerr << "SnackaCaptureLinux: Converting frames directly into encoder surfaces\n";
+    } else {
+        m_nv12Buffer.resize(CalculateNV12FrameSize(m_width, m_height));
+    }
+    m_convertHistory.resize(MAX_CONVERT_HISTORY);
+
+    // Pick the fastest color conversion kernel for this CPU
+    ColorConverterIsa isa = ColorConverterIsa::Scalar;
+    m_convertKernel = SelectBGRAToNV12Kernel(&isa);
+
+    // Worker pool for row-striped conversion; each stripe converts an even number of rows
+    m_convertPool = std::make_unique<StripeWorkerPool>(std::min(m_options.convertThreads, std::max(1, m_height / 2)));
+    m_convertJob = [this](int stripeIndex) {
+        int rowBegin = 0;
+        int rowEnd = 0;
+        m_convertPool->GetStripeRows(m_height, stripeIndex, rowBegin, rowEnd);
+        ConvertBGRAtoNV12(reinterpret_cast<const uint8_t*>(m_image->data), rowBegin, rowEnd, stripeIndex);
+    };
+    m_convertDirtyJob = [this](int stripeIndex) { ConvertDirtyStripe(stripeIndex); };
+    m_stripeTimeTotalsUs.assign(m_convertPool->GetThreadCount(), 0);
+
+    // Resample when the output size differs from the screen
+    if (m_width != m_screenWidth || m_height != m_screenHeight) {
+        m_scaler = std::make_unique<FrameScaler>(m_screenWidth, m_screenHeight, m_width, m_height,
+                                                 m_options.scaleFilter, m_convertPool->GetThreadCount());
+        m_scaledBuffer.resize(static_cast<size_t>(m_width) * m_height * 4);
+        std::cerr << "SnackaCaptureLinux: Scaling " << m_screenWidth << "x" << m_screenHeight
+                  << " -> " << m_width << "x" << m_height << " (" << m_scaler->GetKernelName() << ")\n";
+    }
+
+    std::cerr << "SnackaCaptureLinux: Using " << ColorConverterIsaName(isa) << " BGRA->NV12 conversion on "
+              << m_convertPool->GetThreadCount() << " thread(s)\n";
+
+    if (m_options.damageTracking && !InitializeDamage()) {
+        std::cerr << "SnackaCaptureLinux: XDamage not available, capturing full frames\n";
+    }
+
+    // Tile hashes catch unchanged frames that XDamage cannot (or is not asked to) filter out
+    if (m_options.tileHashing) {
+        m_tileHasher = std::make_unique<TileHasher>(m_screenWidth, m_screenHeight);
+        std::cerr << "SnackaCaptureLinux: Tile hash change detection enabled ("
+                  << TileHasher::DEFAULT_TILE_SIZE << "x" << TileHasher::DEFAULT_TILE_SIZE << " tiles)\n";
+    }
+    if (m_options.idleFps > 0 && m_options.idleFps < m_fps) {
+        std::cerr << "SnackaCaptureLinux: Unchanged screen is sent at " << m_options.idleFps << "fps\n";
+    }
 
     std::cerr << "SnackaCaptureLinux: X11 capture initialized for output "
               << m_width << "x" << m_height << " @ " << m_fps << "fps\n";
@@ -138,36 +206,242 @@ void X11Capturer::Stop() {
     }
 }
 
+bool X11Capturer::InitializeDamage() {
+    int eventBase = 0;
+    int errorBase = 0;
+    if (!XDamageQueryExtension(m_display, &eventBase, &errorBase) ||
+        !XFixesQueryExtension(m_display, &eventBase, &errorBase)) {
+        return false;
+    }
+
+    // Both extensions must be version-negotiated before their requests can be used
+    int major = 1;
+    int minor = 1;
+    if (!XDamageQueryVersion(m_display, &major, &minor)) {
+        return false;
+    }
+    major = 2;
+    minor = 0;
+    if (!XFixesQueryVersion(m_display, &major, &minor)) {
+        return false;
+    }
+
+    // NonEmpty reports once per empty -> damaged transition; the region itself is
+    // fetched with XDamageSubtract every frame, so we never depend on event contents
+    m_damage = XDamageCreate(m_display, m_rootWindow, XDamageReportNonEmpty);
+    m_damageRegion = XFixesCreateRegion(m_display, nullptr, 0);
+    if (!m_damage || !m_damageRegion) {
+        CleanupDamage();
+        return false;
+    }
+
+    std::cerr << "SnackaCaptureLinux: XDamage tracking enabled\n";
+    return true;
+}
+
+void X11Capturer::CleanupDamage() {
+    if (!m_display) {
+        return;
+    }
+    if (m_damage) {
+        XDamageDestroy(m_display, m_damage);
+        m_damage = 0;
+    }
+    if (m_damageRegion) {
+        XFixesDestroyRegion(m_display, m_damageRegion);
+        m_damageRegion = 0;
+    }
+}
+
+bool X11Capturer::CollectDamage() {
+    // Drain DamageNotify events so the queue does not grow; the region is what matters
+    while (XPending(m_display) > 0) {
+        XEvent event;
+        XNextEvent(m_display, &event);
+    }
+
+    // Move the accumulated damage into our region and reset it on the server
+    XDamageSubtract(m_display, m_damage, None, m_damageRegion);
+
+    int count = 0;
+    XRectangle* rects = XFixesFetchRegion(m_display, m_damageRegion, &count);
+
+    m_dirtyRects.clear();
+    for (int i = 0; i < count; i++) {
+        PixelRect rect;
+        rect.x0 = std::max(0, static_cast<int>(rects[i].x)) & ~1;
+        rect.y0 = std::max(0, static_cast<int>(rects[i].y)) & ~1;
+        rect.x1 = std::min(m_screenWidth, (rects[i].x + rects[i].width + 1) & ~1);
+        rect.y1 = std::min(m_screenHeight, (rects[i].y + rects[i].height + 1) & ~1);
+        if (rect.x0 < rect.x1 && rect.y0 < rect.y1) {
+            m_dirtyRects.push_back(rect);
+        }
+    }
+    if (rects) {
+        XFree(rects);
+    }
+
+    return AcceptDirtyRects();
+}
+
+bool X11Capturer::AcceptDirtyRects() {
+    int64_t dirtyArea = 0;
+    for (const auto& rect : m_dirtyRects) {
+        dirtyArea += static_cast<int64_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+    }
+
+    // Too fragmented or too large: not worth tracking, redo the whole frame
+    int64_t screenArea = static_cast<int64_t>(m_screenWidth) * m_screenHeight;
+    if (m_dirtyRects.size() > MAX_DIRTY_RECTS || dirtyArea * 100 > screenArea * MAX_DIRTY_PERCENT) {
+        return false;
+    }
+
+    // Merge rectangles into full-width row bands for XShmGetImage
+    std::vector<PixelRect> sorted = m_dirtyRects;
+    std::sort(sorted.begin(), sorted.end(), [](const PixelRect& a, const PixelRect& b) { return a.y0 < b.y0; });
+    m_dirtyBands.clear();
+    for (const auto& rect : sorted) {
+        if (!m_dirtyBands.empty() && rect.y0 <= m_dirtyBands.back().y1) {
+            m_dirtyBands.back().y1 = std::max(m_dirtyBands.back().y1, rect.y1);
+        } else {
+            m_dirtyBands.push_back({0, rect.y0, m_screenWidth, rect.y1});
+        }
+    }
+
+    // When scaling, each source band affects the output rows whose filter taps reach into it.
+    // Pad by one row for the filter footprint and keep even boundaries for chroma.
+    m_dirtyOutputRows.clear();
+    if (m_scaler) {
+        for (const auto& band : m_dirtyBands) {
+            int64_t rowBegin = static_cast<int64_t>(band.y0) * m_height / m_screenHeight - 1;
+            int64_t rowEnd = (static_cast<int64_t>(band.y1) * m_height + m_screenHeight - 1) / m_screenHeight + 1;
+            int y0 = static_cast<int>(std::max<int64_t>(0, rowBegin)) & ~1;
+            int y1 = static_cast<int>(std::min<int64_t>(m_height, (rowEnd + 1) & ~1));
+            if (!m_dirtyOutputRows.empty() && y0 <= m_dirtyOutputRows.back().y1) {
+                m_dirtyOutputRows.back().y1 = std::max(m_dirtyOutputRows.back().y1, y1);
+            } else {
+                m_dirtyOutputRows.push_back({0, y0, m_width, y1});
+            }
+        }
+    }
+
+    return true;
+}
+
+bool X11Capturer::GrabRows(int rowBegin, int rowEnd) {
+    if (rowBegin == 0 && rowEnd == m_screenHeight) {
+        return XShmGetImage(m_display, m_rootWindow, m_image, 0, 0, AllPlanes);
+    }
+
+    // XShmGetImage writes at (image->data - shmaddr), so a band image that points into
+    // the middle of the segment lands the rows at their place in the full frame
+    char* data = m_image->data;
+    int height = m_image->height;
+    m_image->data = data + static_cast<size_t>(rowBegin) * m_image->bytes_per_line;
+    m_image->height = rowEnd - rowBegin;
+
+    Bool ok = XShmGetImage(m_display, m_rootWindow, m_image, 0, rowBegin, AllPlanes);
+
+    m_image->data = data;
+    m_image->height = height;
+    return ok;
+}
+
+bool X11Capturer::GrabDirtyRegions() {
+    for (const auto& band : m_dirtyBands) {
+        if (!GrabRows(band.y0, band.y1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool X11Capturer::DetectTileChanges() {
+    m_dirtyRects.clear();
+    size_t changedTiles = m_tileHasher->FindChangedTiles(
+        reinterpret_cast<const uint8_t*>(m_image->data), m_image->bytes_per_line, m_dirtyRects);
+
+    if (changedTiles == 0) {
+        return true;
+    }
+    return AcceptDirtyRects();
+}
+
 void X11Capturer::CaptureLoop() {
     auto frameInterval = std::chrono::microseconds(1000000 / m_fps);
     auto nextFrameTime = std::chrono::steady_clock::now();
 
+    // Unchanged frames are only emitted at the idle rate (0 = every tick)
+    const bool idlePacing = m_options.idleFps > 0 && m_options.idleFps < m_fps;
+    const auto idleInterval = std::chrono::microseconds(idlePacing ? 1000000 / m_options.idleFps : 0);
+    auto lastEmitTime = std::chrono::steady_clock::time_point{};
+
     while (m_running) {
-        auto startTime = std::chrono::steady_clock::now();
+        enum class FrameUpdate { Full, Partial, Unchanged };
+        FrameUpdate update = FrameUpdate::Full;
+
+        // With damage tracking, only grab what changed since the last frame.
+        // Damage is always consumed before grabbing, so a change racing with the grab
+        // is picked up again on the next frame.
+        if (m_damage && CollectDamage() && m_haveFrame) {
+            update = m_dirtyRects.empty() ? FrameUpdate::Unchanged : FrameUpdate::Partial;
+        }
 
-        // Capture screen using XShm
-        if (!XShmGetImage(m_display, m_rootWindow, m_image, 0, 0, AllPlanes)) {
-            std::cerr << "SnackaCaptureLinux: XShmGetImage failed\n";
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
+        if (update == FrameUpdate::Partial) {
+            if (!GrabDirtyRegions()) {
+                std::cerr << "SnackaCaptureLinux: XShmGetImage failed\n";
+                m_haveFrame = false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            // The hasher did not see these pixels; make sure it does not trust old hashes
+            if (m_tileHasher) {
+                for (const auto& rect : m_dirtyRects) {
+                    m_tileHasher->Invalidate(rect);
+                }
+            }
+        } else if (update == FrameUpdate::Full) {
+            // Capture screen using XShm
+            if (!XShmGetImage(m_display, m_rootWindow, m_image, 0, 0, AllPlanes)) {
+                std::cerr << "SnackaCaptureLinux: XShmGetImage failed\n";
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            // Software change detection on the full grab
+            if (m_tileHasher && DetectTileChanges() && m_haveFrame) {
+                update = m_dirtyRects.empty() ? FrameUpdate::Unchanged : FrameUpdate::Partial;
+            }
+            m_haveFrame = true;
+        }
+
+        if (update == FrameUpdate::Partial) {
+            m_partialFrames++;
+        } else if (update == FrameUpdate::Unchanged) {
+            m_staticFrames++;
+        }
+
+        // Convert to NV12 and hand the frame on. Changes go out immediately; a static
+        // screen only repeats its last frame at the idle rate, as a keepalive.
+        auto now = std::chrono::steady_clock::now();
+        bool emit = update != FrameUpdate::Unchanged || !idlePacing || now - lastEmitTime >= idleInterval;
+        if (emit) {
+            if (EmitFrame(update == FrameUpdate::Full, update != FrameUpdate::Unchanged, GetTimestampMs())) {
+                lastEmitTime = now;
+                m_emittedFrames++;
+            } else {
+                // This frame's changes never reached an output; start over with a full frame
+                m_haveFrame = false;
+            }
         }
 
-        // Convert BGRA to NV12
-        ConvertBGRAtoNV12(
-            reinterpret_cast<const uint8_t*>(m_image->data),
-            m_screenWidth,
-            m_screenHeight
-        );
-
-        // Invoke callback with NV12 data
-        if (m_callback) {
-            uint64_t timestamp = GetTimestampMs();
-            m_callback(m_nv12Buffer.data(), m_nv12Buffer.size(), timestamp);
+        if (++m_capturedFrames % 300 == 0) {
+            LogConvertStats();
         }
 
         // Frame rate control
         nextFrameTime += frameInterval;
-        auto now = std::chrono::steady_clock::now();
+        now = std::chrono::steady_clock::now();
         if (nextFrameTime > now) {
             std::this_thread::sleep_until(nextFrameTime);
         } else {
@@ -177,78 +451,176 @@ void X11Capturer::CaptureLoop() {
     }
 }
 
-void X11Capturer::ConvertBGRAtoNV12(const uint8_t* bgra, int srcWidth, int srcHeight) {
-    // Simple conversion with scaling if needed
-    // For now, we'll do nearest-neighbor scaling if dimensions differ
+bool X11Capturer::EmitFrame(bool fullUpdate, bool frameChanged, uint64_t timestamp) {
+    if (!AcquireTarget()) {
+        return false;
+    }
 
-    float scaleX = static_cast<float>(srcWidth) / m_width;
-    float scaleY = static_cast<float>(srcHeight) / m_height;
+    // Bring the target up to date: everything, or only what changed since it last held a frame
+    if (fullUpdate || !CollectConvertRects(frameChanged)) {
+        ConvertFrame(m_convertJob);
+        fullUpdate = true;
+    } else if (!m_convertRects.empty()) {
+        ConvertFrame(m_convertDirtyJob);
+    }
+    RecordConvertHistory(fullUpdate, frameChanged);
 
-    uint8_t* yPlane = m_nv12Buffer.data();
-    uint8_t* uvPlane = m_nv12Buffer.data() + m_width * m_height;
+    return SubmitTarget(timestamp);
+}
 
-    int srcBytesPerPixel = m_image->bits_per_pixel / 8;
-    int srcStride = m_image->bytes_per_line;
+bool X11Capturer::AcquireTarget() {
+    if (m_surfaceProvider) {
+        return m_surfaceProvider->AcquireSurface(m_target);
+    }
+
+    m_target.yPlane = m_nv12Buffer.data();
+    m_target.uvPlane = m_nv12Buffer.data() + static_cast<size_t>(m_width) * m_height;
+    m_target.yStride = m_width;
+    m_target.uvStride = m_width;
+    m_target.age = m_nv12BufferWritten ? 1 : 0;
+    return true;
+}
+
+bool X11Capturer::SubmitTarget(uint64_t timestamp) {
+    if (m_surfaceProvider) {
+        // A rejected frame (e.g. encode error) was still written, so it counts as emitted
+        m_surfaceProvider->SubmitSurface(static_cast<int64_t>(timestamp));
+        return true;
+    }
 
-    // Convert to Y plane (full resolution)
-    for (int y = 0; y < m_height; y++) {
-        int srcY = static_cast<int>(y * scaleY);
-        srcY = std::min(srcY, srcHeight - 1);
+    m_nv12BufferWritten = true;
+    if (m_callback) {
+        m_callback(m_nv12Buffer.data(), m_nv12Buffer.size(), timestamp);
+    }
+    return true;
+}
 
-        for (int x = 0; x < m_width; x++) {
-            int srcX = static_cast<int>(x * scaleX);
-            srcX = std::min(srcX, srcWidth - 1);
+bool X11Capturer::CollectConvertRects(bool frameChanged) {
+    // The target misses this frame's changes plus those of the (age - 1) frames before it
+    const int age = m_target.age;
+    if (age <= 0 || age - 1 > m_convertHistoryCount) {
+        return false;
+    }
 
-            const uint8_t* pixel = bgra + srcY * srcStride + srcX * srcBytesPerPixel;
-            uint8_t b = pixel[0];
-            uint8_t g = pixel[1];
-            uint8_t r = pixel[2];
+    m_convertRects.clear();
+    if (frameChanged) {
+        const auto& rects = m_scaler ? m_dirtyOutputRows : m_dirtyRects;
+        m_convertRects.insert(m_convertRects.end(), rects.begin(), rects.end());
+    }
+    for (int i = 1; i < age; i++) {
+        const auto& past = m_convertHistory[(m_convertHistoryNext + MAX_CONVERT_HISTORY - i) % MAX_CONVERT_HISTORY];
+        m_convertRects.insert(m_convertRects.end(), past.begin(), past.end());
+    }
 
-            // BT.601 conversion
-            int yVal = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
-            yPlane[y * m_width + x] = static_cast<uint8_t>(std::clamp(yVal, 0, 255));
-        }
+    // Overlaps are counted twice, which only errs towards a full conversion
+    int64_t area = 0;
+    for (const auto& rect : m_convertRects) {
+        area += static_cast<int64_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
     }
+    return area * 100 <= static_cast<int64_t>(m_width) * m_height * MAX_DIRTY_PERCENT;
+}
 
-    // Convert to UV plane (half resolution, interleaved)
-    for (int y = 0; y < m_height / 2; y++) {
-        int srcY = static_cast<int>(y * 2 * scaleY);
-        srcY = std::min(srcY, srcHeight - 1);
+void X11Capturer::RecordConvertHistory(bool fullUpdate, bool frameChanged) {
+    if (fullUpdate) {
+        m_convertHistoryCount = 0;
+        return;
+    }
+
+    auto& entry = m_convertHistory[m_convertHistoryNext];
+    entry.clear();
+    if (frameChanged) {
+        const auto& rects = m_scaler ? m_dirtyOutputRows : m_dirtyRects;
+        entry.assign(rects.begin(), rects.end());
+    }
+    m_convertHistoryNext = (m_convertHistoryNext + 1) % MAX_CONVERT_HISTORY;
+    m_convertHistoryCount = std::min(m_convertHistoryCount + 1, MAX_CONVERT_HISTORY);
+}
 
-        for (int x = 0; x < m_width / 2; x++) {
-            int srcX = static_cast<int>(x * 2 * scaleX);
-            srcX = std::min(srcX, srcWidth - 1);
+void X11Capturer::ConvertFrame(const StripeWorkerPool::StripeJob& job) {
+    auto start = std::chrono::steady_clock::now();
 
-            // Sample 2x2 block and average
-            int rSum = 0, gSum = 0, bSum = 0;
-            int count = 0;
+    m_convertPool->Run(job);
 
-            for (int dy = 0; dy < 2; dy++) {
-                for (int dx = 0; dx < 2; dx++) {
-                    int px = std::min(static_cast<int>((x * 2 + dx) * scaleX), srcWidth - 1);
-                    int py = std::min(static_cast<int>((y * 2 + dy) * scaleY), srcHeight - 1);
+    m_convertTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    const auto& stripeTimes = m_convertPool->GetStripeTimesUs();
+    for (size_t i = 0; i < stripeTimes.size(); i++) {
+        m_stripeTimeTotalsUs[i] += stripeTimes[i];
+    }
 
-                    const uint8_t* pixel = bgra + py * srcStride + px * srcBytesPerPixel;
-                    bSum += pixel[0];
-                    gSum += pixel[1];
-                    rSum += pixel[2];
-                    count++;
-                }
-            }
+    m_convertedFrames++;
+}
+
+void X11Capturer::LogConvertStats() {
+    uint64_t converted = std::max<uint64_t>(1, m_convertedFrames);
+    std::cerr << "SnackaCaptureLinux: Convert avg " << (m_convertTimeUs / converted) << "us/frame, stripes [";
+    for (size_t i = 0; i < m_stripeTimeTotalsUs.size(); i++) {
+        if (i > 0) std::cerr << ", ";
+        std::cerr << (m_stripeTimeTotalsUs[i] / converted) << "us";
+    }
+    std::cerr << "] over " << m_convertedFrames << " converted frames";
+    if (m_damage || m_tileHasher) {
+        std::cerr << " (" << m_partialFrames << " partial, " << m_staticFrames << " unchanged, "
+                  << m_emittedFrames << " emitted of " << m_capturedFrames << ")";
+    }
+    std::cerr << "\n";
+}
 
-            int r = rSum / count;
-            int g = gSum / count;
-            int b = bSum / count;
+void X11Capturer::ConvertDirtyStripe(int stripeIndex) {
+    int stripeBegin = 0;
+    int stripeEnd = 0;
+    m_convertPool->GetStripeRows(m_height, stripeIndex, stripeBegin, stripeEnd);
+    const uint8_t* bgra = reinterpret_cast<const uint8_t*>(m_image->data);
+
+    if (m_scaler) {
+        // Scaled output: the rectangles are full-width output row ranges
+        for (const auto& rows : m_convertRects) {
+            int rowBegin = std::max(rows.y0, stripeBegin);
+            int rowEnd = std::min(rows.y1, stripeEnd);
+            if (rowBegin < rowEnd) {
+                ConvertBGRAtoNV12(bgra, rowBegin, rowEnd, stripeIndex);
+            }
+        }
+        return;
+    }
 
-            // BT.601 conversion
-            int u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
-            int v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    // Same size: convert exactly the damaged rectangles (all edges even except at the screen edge)
+    const int srcStride = m_image->bytes_per_line;
 
-            int uvIndex = y * m_width + x * 2;
-            uvPlane[uvIndex] = static_cast<uint8_t>(std::clamp(u, 0, 255));
-            uvPlane[uvIndex + 1] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+    for (const auto& rect : m_convertRects) {
+        int rowBegin = std::max(rect.y0, stripeBegin);
+        int rowEnd = std::min(rect.y1, stripeEnd);
+        if (rowBegin >= rowEnd) {
+            continue;
         }
+
+        m_convertKernel(bgra + static_cast<size_t>(rowBegin) * srcStride + rect.x0 * 4, srcStride,
+                        m_target.yPlane + static_cast<size_t>(rowBegin) * m_target.yStride + rect.x0,
+                        m_target.yStride,
+                        m_target.uvPlane + static_cast<size_t>(rowBegin / 2) * m_target.uvStride + rect.x0,
+                        m_target.uvStride,
+                        rect.x1 - rect.x0, rowEnd - rowBegin);
+    }
+}
+
+void X11Capturer::ConvertBGRAtoNV12(const uint8_t* bgra, int rowBegin, int rowEnd, int stripeIndex) {
+    // rowBegin is always even, so the stripe owns whole chroma rows
+    const uint8_t* src = bgra;
+    int srcStride = m_image->bytes_per_line;
+
+    // Resample the stripe into the output-sized BGRA buffer first
+    if (m_scaler) {
+        int scaledStride = m_width * 4;
+        m_scaler->ScaleRows(bgra, srcStride, m_scaledBuffer.data(), scaledStride,
+                            rowBegin, rowEnd, stripeIndex);
+        src = m_scaledBuffer.data();
+        srcStride = scaledStride;
     }
+
+    m_convertKernel(src + static_cast<size_t>(rowBegin) * srcStride, srcStride,
+                    m_target.yPlane + static_cast<size_t>(rowBegin) * m_target.yStride, m_target.yStride,
+                    m_target.uvPlane + static_cast<size_t>(rowBegin / 2) * m_target.uvStride, m_target.uvStride,
+                    m_width, rowEnd - rowBegin);
 }
 
 uint64_t X11Capturer::GetTimestampMs() const {
@@ -1,14 +1,23 @@
 #pragma once
 
+#include "ColorConverter.h"
+#include "FrameScaler.h"
+#include "NV12SurfaceProvider.h"
+#include "StripeWorkerPool.h"
+#include "TileHasher.h"
+
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
 #include <sys/shm.h>
 
 #include <functional>
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <memory>
 #include <cstdint>
 
 namespace snacka {
@@ -19,10 +28,19 @@ namespace snacka {
 /// @param timestamp Timestamp in milliseconds
 using FrameCallback = std::function<void(const uint8_t* data, size_t size, uint64_t timestamp)>;
 
+/// Tuning options for X11 capture
+struct X11CaptureOptions {
+    int convertThreads = 1;                      // Color conversion threads (frame split into row stripes)
+    ScaleFilter scaleFilter = ScaleFilter::Box;  // Filter used when the output size differs from the screen
+    bool damageTracking = true;                  // Only re-read and re-convert regions reported by XDamage
+    bool tileHashing = false;                    // Detect changes by hashing 64x64 tiles of full grabs
+    int idleFps = 0;                             // Frame rate while the screen is unchanged (0 = full rate)
+};
+
 /// X11 screen capturer using XShm for efficient capture
 class X11Capturer {
 public:
-    X11Capturer();
+    explicit X11Capturer(const X11CaptureOptions& options = {});
     ~X11Capturer();
 
     /// Initialize the capturer
@@ -33,8 +51,13 @@ public:
     /// @return true if initialization succeeded
     bool Initialize(int displayIndex, int width, int height, int fps);
 
+    /// Write frames straight into surfaces handed out by the provider (e.g. the encoder)
+    /// instead of passing an NV12 buffer to the frame callback. Call before Start().
+    /// @param provider Surface provider for output-sized frames, or null to use the callback
+    void SetSurfaceProvider(NV12SurfaceProvider* provider) { m_surfaceProvider = provider; }
+
     /// Start capturing
-    /// @param callback Callback to receive captured frames
+    /// @param callback Callback to receive captured frames (unused with a surface provider)
     void Start(FrameCallback callback);
 
     /// Stop capturing
@@ -49,9 +72,31 @@ public:
     /// Get the screen height
     int GetScreenHeight() const { return m_screenHeight; }
 
+    /// Get the time each conversion stripe took for the last frame, in microseconds.
+    /// Only valid from the frame callback (it is updated on the capture thread).
+    const std::vector<uint32_t>& GetStripeTimesUs() const { return m_convertPool->GetStripeTimesUs(); }
+
+    /// Get the number of frames handed to the callback or surface provider (read after Stop())
+    uint64_t GetEmittedFrameCount() const { return m_emittedFrames; }
+
 private:
     void CaptureLoop();
-    void ConvertBGRAtoNV12(const uint8_t* bgra, int srcWidth, int srcHeight);
+    bool InitializeDamage();
+    void CleanupDamage();
+    bool CollectDamage();
+    bool DetectTileChanges();
+    bool AcceptDirtyRects();
+    bool GrabRows(int rowBegin, int rowEnd);
+    bool GrabDirtyRegions();
+    bool EmitFrame(bool fullUpdate, bool frameChanged, uint64_t timestamp);
+    bool AcquireTarget();
+    bool SubmitTarget(uint64_t timestamp);
+    bool CollectConvertRects(bool frameChanged);
+    void RecordConvertHistory(bool fullUpdate, bool frameChanged);
+    void ConvertFrame(const StripeWorkerPool::StripeJob& job);
+    void ConvertBGRAtoNV12(const uint8_t* bgra, int rowBegin, int rowEnd, int stripeIndex);
+    void ConvertDirtyStripe(int stripeIndex);
+    void LogConvertStats();
     uint64_t GetTimestampMs() const;
 
     // X11 objects
@@ -62,6 +107,7 @@ private:
     bool m_shmAttached = false;
 
     // Configuration
+    X11CaptureOptions m_options;
     int m_displayIndex = 0;
     int m_width = 0;
     int m_height = 0;
@@ -78,8 +124,56 @@ private:
     // Callback
     FrameCallback m_callback;
 
-    // NV12 output buffer
+    // NV12 output buffer (used when there is no surface provider)
     std::vector<uint8_t> m_nv12Buffer;
+    bool m_nv12BufferWritten = false;
+
+    // Zero-copy output into provider surfaces
+    NV12SurfaceProvider* m_surfaceProvider = nullptr;
+
+    // Where the current frame is converted to: a provider surface or m_nv12Buffer
+    NV12Surface m_target;
+
+    // SIMD BGRA->NV12 kernel picked at runtime
+    BGRAToNV12Fn m_convertKernel = ConvertBGRAToNV12Scalar;
+
+    // Resampling to the output size (null when the screen already matches)
+    std::unique_ptr<FrameScaler> m_scaler;
+    std::vector<uint8_t> m_scaledBuffer;
+
+    // Row-striped parallel conversion
+    std::unique_ptr<StripeWorkerPool> m_convertPool;
+    StripeWorkerPool::StripeJob m_convertJob;       // Whole frame
+    StripeWorkerPool::StripeJob m_convertDirtyJob;  // Damaged regions only
+
+    // XDamage tracking: the XShm image persists between frames and only damaged parts are re-read
+    Damage m_damage = 0;
+    XserverRegion m_damageRegion = 0;
+    bool m_haveFrame = false;  // m_image holds a complete grab
+
+    // Dirty rectangles have an even origin, so they map onto whole NV12 chroma blocks
+    std::vector<PixelRect> m_dirtyRects;       // Screen coordinates of this frame's changes
+    std::vector<PixelRect> m_dirtyBands;       // Merged full-width row ranges of m_dirtyRects
+    std::vector<PixelRect> m_dirtyOutputRows;  // m_dirtyBands mapped to output rows (when scaling)
+
+    // Output rectangles changed by each of the last emitted frames, so a target that is
+    // several frames old (rotating encoder surfaces) can be brought up to date
+    std::vector<std::vector<PixelRect>> m_convertHistory;
+    size_t m_convertHistoryNext = 0;
+    int m_convertHistoryCount = 0;         // Valid entries since the last full conversion
+    std::vector<PixelRect> m_convertRects;  // Output rectangles to convert into m_target
+
+    // Software change detection (optional)
+    std::unique_ptr<TileHasher> m_tileHasher;
+
+    // Conversion timing, accumulated between stats log lines
+    uint64_t m_capturedFrames = 0;
+    uint64_t m_convertedFrames = 0;
+    uint64_t m_partialFrames = 0;
+    uint64_t m_staticFrames = 0;
+    uint64_t m_emittedFrames = 0;
+    uint64_t m_convertTimeUs = 0;
+    std::vector<uint64_t> m_stripeTimeTotalsUs;
 };
 
 }  // namespace snacka
@@ -1,8 +1,11 @@
 #include "Protocol.h"
+#include "FrameRing.h"
+#include "PipeWriter.h"
 #include "SourceLister.h"
 #include "X11Capturer.h"
 #include "V4L2Capturer.h"
 #include "VaapiEncoder.h"
+#include "VideoEncoder.h"
 #include "PulseAudioCapturer.h"
 #include "PulseMicrophoneCapturer.h"
 
@@ -13,21 +16,31 @@
 #include <csignal>
 #include <unistd.h>
 #include <ctime>
-#include <mutex>
+#include <sys/uio.h>
+#include <thread>
 
 using namespace snacka;
 
 // Global flag for clean shutdown
 std::atomic<bool> g_running{true};
+std::atomic<bool> g_shutdownSignaled{false};
 
 // Signal handler for clean shutdown
 void SignalHandler(int signal) {
     if (signal == SIGINT || signal == SIGTERM || signal == SIGPIPE) {
-        std::cerr << "\nSnackaCaptureLinux: Received shutdown signal\n";
+        // Logged by the main thread: std::cerr goes through the stderr writer's mutex
+        g_shutdownSignaled = true;
         g_running = false;
     }
 }
 
+// Log a shutdown signal received while waiting
+void ReportShutdownSignal() {
+    if (g_shutdownSignaled.exchange(false)) {
+        std::cerr << "\nSnackaCaptureLinux: Received shutdown signal\n";
+    }
+}
+
 void PrintUsage() {
     std::cerr << R"(
 SnackaCaptureLinux - Screen, camera, and microphone capture tool for Linux with VAAPI encoding
@@ -51,7 +64,17 @@ OPTIONS:
     --audio               Capture system audio (via PulseAudio/PipeWire)
     --encode              Output H.264 encoded video (instead of raw NV12)
     --bitrate <mbps>      Encoding bitrate in Mbps (default: 6, camera: 2)
+    --encoder <name>      H.264 encoder: auto, vaapi or software (default: auto = VAAPI, else software)
+    --convert-threads <n> Threads used for screen color conversion (default: 1)
+    --scale-filter <name> Screen scaling filter: box, bilinear or nearest (default: box)
+    --no-damage-tracking  Re-capture the whole screen every frame instead of only changed regions
+    --tile-hash           Detect unchanged screen areas by hashing 64x64 tiles
+    --idle-fps <rate>     Frame rate while the screen is unchanged (default: 0 = same as --fps)
+    --queue-frames <n>    Video frames buffered between capture and stdout (default: 4)
+    --drop-policy <name>  When the queue is full: oldest, newest or block (default: oldest)
     --noise-suppression   Enable AI noise suppression for microphone (default)
+    --noise-suppression=<mode> Microphone noise suppression: auto, mono, linked, dual or off
+                          (default: auto = denoise once while both channels are identical)
     --no-noise-suppression Disable AI noise suppression for microphone
     --json                Output source list as JSON (with 'list' command)
     --help                Show this help message
@@ -61,8 +84,11 @@ EXAMPLES:
     SnackaCaptureLinux --display 0 --width 1920 --height 1080 --fps 30
     SnackaCaptureLinux --display 0 --encode --bitrate 8 --audio
     SnackaCaptureLinux --camera 0 --encode --bitrate 2
+    SnackaCaptureLinux --display 0 --encode --encoder software
+    SnackaCaptureLinux --display 0 --queue-frames 2 --drop-policy newest
     SnackaCaptureLinux --camera /dev/video0 --width 640 --height 480 --fps 15
     SnackaCaptureLinux --microphone 0
+    SnackaCaptureLinux --microphone 0 --noise-suppression=linked
 
 OUTPUT:
     Video: H.264 NAL units in AVCC format (4-byte length prefix) to stdout
@@ -237,17 +263,29 @@ int ValidateEnvironment(bool asJson) {
     return 0;
 }
 
-// Mutex for stderr output (shared between video preview and audio)
-std::mutex g_stderrMutex;
+// Writer for stderr, shared by audio packets and log lines (std::cerr is routed through it)
+PipeWriter g_stderrWriter(STDERR_FILENO, "stderr");
+
+// Log the counters of an output pipe
+void LogPipeStats(const PipeWriter& writer) {
+    PipeWriterStats stats = writer.GetStats();
+    std::cerr << "SnackaCaptureLinux: " << writer.GetName() << " wrote " << stats.bytesWritten
+              << " bytes (" << stats.packets << " packets, " << stats.syscalls << " writes), blocked "
+              << stats.blockedUs / 1000 << " ms, " << stats.stalls << " stall(s)";
+    if (stats.stalls > 0) {
+        std::cerr << " (longest " << stats.longestStallMs << " ms)";
+    }
+    std::cerr << ", max " << stats.maxBytesInFlight << " bytes in flight\n";
+}
 
-int CaptureMicrophone(const std::string& microphoneId, bool noiseSuppression) {
+int CaptureMicrophone(const std::string& microphoneId, NoiseSuppressionMode noiseSuppression) {
     // Set up signal handlers for clean shutdown
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
     signal(SIGPIPE, SignalHandler);
 
     std::cerr << "SnackaCaptureLinux: Starting microphone capture (audio only, noise suppression: "
-              << (noiseSuppression ? "enabled" : "disabled") << ")\n";
+              << NoiseSuppressionModeName(noiseSuppression) << ")\n";
 
     uint64_t audioPacketCount = 0;
 
@@ -258,9 +296,12 @@ int CaptureMicrophone(const std::string& microphoneId, bool noiseSuppression) {
         // Create MCAP audio packet header
         AudioPacketHeader header(static_cast<uint32_t>(sampleCount), timestamp);
 
-        // Write header + audio data to stderr
-        write(STDERR_FILENO, &header, sizeof(header));
-        write(STDERR_FILENO, data, sampleCount * 4);  // 2 channels * 2 bytes
+        // Write header + audio data to stderr as one packet
+        iovec parts[2] = {
+            {&header, sizeof(header)},
+            {const_cast<int16_t*>(data), sampleCount * 4}  // 2 channels * 2 bytes
+        };
+        if (!g_stderrWriter.WritePacket(parts, 2)) return;
 
         audioPacketCount++;
         if (audioPacketCount <= 5 || audioPacketCount % 100 == 0) {
@@ -282,15 +323,17 @@ int CaptureMicrophone(const std::string& microphoneId, bool noiseSuppression) {
     while (g_running && capturer.IsRunning()) {
         usleep(100000);  // 100ms
     }
+    ReportShutdownSignal();
 
     capturer.Stop();
 
     std::cerr << "SnackaCaptureLinux: Microphone capture stopped (audio packets: " << audioPacketCount << ")\n";
+    LogPipeStats(g_stderrWriter);
 
     return 0;
 }
 
-int Capture(int displayIndex, const std::string& cameraId, int width, int height, int fps, bool encodeH264, int bitrateMbps, bool captureAudio) {
+int Capture(int displayIndex, const std::string& cameraId, int width, int height, int fps, bool encodeH264, EncoderBackend encoderBackend, int bitrateMbps, bool captureAudio, const X11CaptureOptions& screenOptions, int queueFrames, DropPolicy dropPolicy) {
     // Set up signal handlers for clean shutdown
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
@@ -305,55 +348,74 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
 
     // Frame statistics
     uint64_t frameCount = 0;
-    uint64_t encodedFrameCount = 0;
+    uint64_t encodedFrameCount = 0;  // Written by the writer thread, read after it exits
 
     // Initialize H.264 encoder if requested
-    std::unique_ptr<VaapiEncoder> encoder;
+    std::unique_ptr<VideoEncoder> encoder;
     if (encodeH264) {
-        if (!VaapiEncoder::IsHardwareEncoderAvailable()) {
-            std::cerr << "SnackaCaptureLinux: WARNING - No VAAPI H.264 encoder available, falling back to raw NV12\n";
+        encoder = CreateVideoEncoder(encoderBackend, width, height, fps, bitrateMbps);
+        if (!encoder) {
+            std::cerr << "SnackaCaptureLinux: WARNING - No " << EncoderBackendName(encoderBackend)
+                      << " H.264 encoder available, falling back to raw NV12\n";
             encodeH264 = false;
         } else {
-            encoder = std::make_unique<VaapiEncoder>(width, height, fps, bitrateMbps);
-
-            if (!encoder->Initialize()) {
-                std::cerr << "SnackaCaptureLinux: WARNING - Failed to initialize VAAPI encoder, falling back to raw NV12\n";
-                encoder.reset();
-                encodeH264 = false;
-            } else {
-                std::cerr << "SnackaCaptureLinux: Using " << encoder->GetEncoderName() << " encoder\n";
-            }
+            std::cerr << "SnackaCaptureLinux: Using " << encoder->GetEncoderName() << " encoder\n";
         }
     }
 
+    // Frames are queued for a writer thread, so a slow stdout reader never stalls
+    // the capture loop or the encoder's readout. Encoded frames after a drop are
+    // skipped up to the next keyframe, which is requested from the encoder.
+    // Slots are sized for the requested frame size, so the ring does not allocate
+    // while capturing; an H.264 frame stays well under twice the raw NV12 size.
+    // The capturer may still deliver larger frames (a camera can negotiate a
+    // bigger format), and the ring grows a slot for those rather than drop them.
+    const size_t frameSize = static_cast<size_t>(width) * height * 3 / 2;
+    FrameRing outputRing(static_cast<size_t>(queueFrames),
+                         encodeH264 ? frameSize * 2 : frameSize,
+                         dropPolicy, encodeH264);
+
     if (encodeH264 && encoder) {
-        // Set callback for encoded data
+        // Set callback for encoded data (may run on an encoder thread)
         encoder->SetCallback([&](const uint8_t* data, size_t size, bool isKeyframe) {
             if (!g_running) return;
 
-            size_t written = 0;
-            while (written < size && g_running) {
-                ssize_t result = write(STDOUT_FILENO, data + written, size - written);
-                if (result < 0) {
-                    if (errno == EPIPE) {
-                        std::cerr << "SnackaCaptureLinux: Pipe closed\n";
-                    } else {
-                        std::cerr << "SnackaCaptureLinux: Error writing encoded frame\n";
-                    }
-                    g_running = false;
-                    return;
-                }
-                written += result;
-            }
-
-            encodedFrameCount++;
-            if (encodedFrameCount <= 5 || encodedFrameCount % 100 == 0) {
-                std::cerr << "SnackaCaptureLinux: Encoded frame " << encodedFrameCount
-                          << " (" << size << " bytes" << (isKeyframe ? ", keyframe" : "") << ")\n";
+            if (!outputRing.Push(data, size, 0, isKeyframe)) {
+                encoder->RequestKeyframe();
             }
         });
     }
 
+    PipeWriter stdoutWriter(STDOUT_FILENO, "stdout");
+    std::thread writerThread([&]() {
+        uint64_t writtenFrames = 0;
+        while (const RingFrame* frame = outputRing.Pop()) {
+            if (!g_running) continue;  // Drain without writing
+
+            if (!stdoutWriter.WritePacket(frame->data.get(), frame->size)) {
+                g_running = false;
+                continue;
+            }
+
+            writtenFrames++;
+            if (writtenFrames <= 5 || writtenFrames % 100 == 0) {
+                FrameRingStats stats = outputRing.GetStats();
+                if (encodeH264) {
+                    std::cerr << "SnackaCaptureLinux: Encoded frame " << writtenFrames
+                              << " (" << frame->size << " bytes" << (frame->isKeyframe ? ", keyframe" : "")
+                              << ", queued " << stats.depth << ", dropped " << stats.dropped + stats.skipped << ")\n";
+                } else {
+                    std::cerr << "SnackaCaptureLinux: Video frame " << writtenFrames
+                              << " (" << width << "x" << height << " NV12, " << frame->size << " bytes"
+                              << ", queued " << stats.depth << ", dropped " << stats.dropped << ")\n";
+                }
+            }
+        }
+        if (encodeH264) {
+            encodedFrameCount = writtenFrames;
+        }
+    });
+
     // Initialize audio capture if requested
     std::unique_ptr<PulseAudioCapturer> audioCapturer;
     uint64_t audioPacketCount = 0;
@@ -365,7 +427,7 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         }
     }
 
-    // Frame callback
+    // Frame callback (capture thread)
     auto frameCallback = [&](const uint8_t* data, size_t size, uint64_t timestamp) {
         if (!g_running) return;
 
@@ -379,26 +441,8 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
                 }
             }
         } else {
-            // Output raw NV12
-            size_t written = 0;
-            while (written < size && g_running) {
-                ssize_t result = write(STDOUT_FILENO, data + written, size - written);
-                if (result < 0) {
-                    if (errno == EPIPE) {
-                        std::cerr << "SnackaCaptureLinux: Pipe closed\n";
-                    } else {
-                        std::cerr << "SnackaCaptureLinux: Error writing video frame\n";
-                    }
-                    g_running = false;
-                    return;
-                }
-                written += result;
-            }
-
-            if (frameCount <= 5 || frameCount % 100 == 0) {
-                std::cerr << "SnackaCaptureLinux: Video frame " << frameCount
-                          << " (" << width << "x" << height << " NV12, " << size << " bytes)\n";
-            }
+            // Queue raw NV12 for the writer thread
+            outputRing.Push(data, size, timestamp);
         }
     };
 
@@ -409,12 +453,13 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         // Create MCAP audio packet header
         AudioPacketHeader header(static_cast<uint32_t>(sampleCount), timestamp);
 
-        // Write header + audio data to stderr (with mutex for thread safety)
-        {
-            std::lock_guard<std::mutex> lock(g_stderrMutex);
-            write(STDERR_FILENO, &header, sizeof(header));
-            write(STDERR_FILENO, data, sampleCount * 4);  // 2 channels * 2 bytes
-        }
+        // Write header + audio data to stderr as one packet. Packets arriving while
+        // the pipe is busy are batched into the next write.
+        iovec parts[2] = {
+            {&header, sizeof(header)},
+            {const_cast<int16_t*>(data), sampleCount * 4}  // 2 channels * 2 bytes
+        };
+        if (!g_stderrWriter.WritePacket(parts, 2)) return;
 
         audioPacketCount++;
         if (audioPacketCount <= 5 || audioPacketCount % 100 == 0) {
@@ -435,6 +480,13 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         // Camera capture using V4L2
         V4L2Capturer capturer;
         if (capturer.Initialize(cameraId, width, height, fps)) {
+            // Write frames straight into encoder surfaces when the camera delivers the encoder's size
+            bool zeroCopy = encodeH264 && encoder &&
+                            capturer.GetWidth() == width && capturer.GetHeight() == height;
+            if (zeroCopy) {
+                capturer.SetSurfaceProvider(encoder.get());
+            }
+
             capturer.Start(frameCallback);
             captureStarted = true;
 
@@ -442,14 +494,23 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
             while (g_running && capturer.IsRunning()) {
                 usleep(100000);  // 100ms
             }
+            ReportShutdownSignal();
 
             capturer.Stop();
+            if (zeroCopy) {
+                frameCount = capturer.GetFrameCount();
+            }
         } else {
             std::cerr << "SnackaCaptureLinux: Failed to initialize V4L2 camera capture\n";
         }
     } else {
         // Display capture using X11
-        X11Capturer capturer;
+        X11Capturer capturer(screenOptions);
+        bool zeroCopy = encodeH264 && encoder;
+        if (zeroCopy) {
+            // Convert frames straight into encoder surfaces
+            capturer.SetSurfaceProvider(encoder.get());
+        }
         if (capturer.Initialize(displayIndex, width, height, fps)) {
             capturer.Start(frameCallback);
             captureStarted = true;
@@ -458,13 +519,26 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
             while (g_running && capturer.IsRunning()) {
                 usleep(100000);  // 100ms
             }
+            ReportShutdownSignal();
 
             capturer.Stop();
+            if (zeroCopy) {
+                frameCount = capturer.GetEmittedFrameCount();
+            }
         } else {
             std::cerr << "SnackaCaptureLinux: Failed to initialize X11 capture\n";
         }
     }
 
+    // Stop encoder (delivers the remaining frames to the queue)
+    if (encoder) {
+        encoder->Stop();
+    }
+
+    // Let the writer drain the queue
+    outputRing.Close();
+    writerThread.join();
+
     if (!captureStarted) {
         if (audioCapturer) {
             audioCapturer->Stop();
@@ -472,11 +546,6 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
         return 1;
     }
 
-    // Stop encoder
-    if (encoder) {
-        encoder->Stop();
-    }
-
     // Stop audio capture
     if (audioCapturer) {
         audioCapturer->Stop();
@@ -486,6 +555,18 @@ int Capture(int displayIndex, const std::string& cameraId, int width, int height
               << ", encoded: " << encodedFrameCount
               << ", audio packets: " << audioPacketCount << ")\n";
 
+    FrameRingStats queueStats = outputRing.GetStats();
+    std::cerr << "SnackaCaptureLinux: Output queue (" << queueFrames << " frames, drop "
+              << DropPolicyName(dropPolicy) << "): dropped " << queueStats.dropped
+              << ", skipped to keyframe " << queueStats.skipped
+              << ", max depth " << queueStats.maxDepth
+              << ", slots grown " << queueStats.grown
+              << ", capture blocked " << queueStats.blockedUs / 1000 << " ms\n";
+    LogPipeStats(stdoutWriter);
+    if (audioCapturer) {
+        LogPipeStats(g_stderrWriter);
+    }
+
     return 0;
 }
 
@@ -493,6 +574,9 @@ int main(int argc, char* argv[]) {
     // Parse command line arguments
     std::vector<std::string> args(argv, argv + argc);
 
+    // Send log lines through the stderr writer so they never split an audio packet
+    PipeLineBuffer logBuffer(g_stderrWriter, std::cerr);
+
     // Check for help
     for (const auto& arg : args) {
         if (arg == "--help" || arg == "-h") {
@@ -533,8 +617,12 @@ int main(int argc, char* argv[]) {
     int fps = -1;
     bool encodeH264 = false;
     int bitrateMbps = -1;
+    EncoderBackend encoderBackend = EncoderBackend::Auto;
     bool captureAudio = false;
-    bool noiseSuppression = true;  // Enabled by default
+    NoiseSuppressionMode noiseSuppression = NoiseSuppressionMode::Auto;
+    X11CaptureOptions screenOptions;
+    int queueFrames = 4;
+    DropPolicy dropPolicy = DropPolicy::DropOldest;
 
     for (size_t i = 1; i < args.size(); i++) {
         if (args[i] == "--display" && i + 1 < args.size()) {
@@ -554,12 +642,42 @@ int main(int argc, char* argv[]) {
             encodeH264 = true;
         } else if (args[i] == "--bitrate" && i + 1 < args.size()) {
             bitrateMbps = std::stoi(args[++i]);
+        } else if (args[i] == "--convert-threads" && i + 1 < args.size()) {
+            screenOptions.convertThreads = std::stoi(args[++i]);
+        } else if (args[i] == "--encoder" && i + 1 < args.size()) {
+            if (!ParseEncoderBackend(args[++i], encoderBackend)) {
+                std::cerr << "SnackaCaptureLinux: Invalid encoder (must be auto, vaapi or software)\n";
+                return 1;
+            }
+        } else if (args[i] == "--scale-filter" && i + 1 < args.size()) {
+            if (!ParseScaleFilter(args[++i], screenOptions.scaleFilter)) {
+                std::cerr << "SnackaCaptureLinux: Invalid scale filter (must be box, bilinear or nearest)\n";
+                return 1;
+            }
+        } else if (args[i] == "--no-damage-tracking") {
+            screenOptions.damageTracking = false;
+        } else if (args[i] == "--tile-hash") {
+            screenOptions.tileHashing = true;
+        } else if (args[i] == "--idle-fps" && i + 1 < args.size()) {
+            screenOptions.idleFps = std::stoi(args[++i]);
+        } else if (args[i] == "--queue-frames" && i + 1 < args.size()) {
+            queueFrames = std::stoi(args[++i]);
+        } else if (args[i] == "--drop-policy" && i + 1 < args.size()) {
+            if (!ParseDropPolicy(args[++i], dropPolicy)) {
+                std::cerr << "SnackaCaptureLinux: Invalid drop policy (must be oldest, newest or block)\n";
+                return 1;
+            }
         } else if (args[i] == "--audio") {
             captureAudio = true;
         } else if (args[i] == "--noise-suppression") {
-            noiseSuppression = true;
+            noiseSuppression = NoiseSuppressionMode::Auto;
+        } else if (args[i].rfind("--noise-suppression=", 0) == 0) {
+            if (!ParseNoiseSuppressionMode(args[i].substr(20), noiseSuppression)) {
+                std::cerr << "SnackaCaptureLinux: Invalid noise suppression mode (must be auto, mono, linked, dual or off)\n";
+                return 1;
+            }
         } else if (args[i] == "--no-noise-suppression") {
-            noiseSuppression = false;
+            noiseSuppression = NoiseSuppressionMode::Off;
         }
     }
 
@@ -592,6 +710,19 @@ int main(int argc, char* argv[]) {
         std::cerr << "SnackaCaptureLinux: Invalid bitrate (must be 1-100 Mbps)\n";
         return 1;
     }
+    if (screenOptions.convertThreads <= 0 || screenOptions.convertThreads > 16) {
+        std::cerr << "SnackaCaptureLinux: Invalid convert threads (must be 1-16)\n";
+        return 1;
+    }
+    if (screenOptions.idleFps < 0 || screenOptions.idleFps > fps) {
+        std::cerr << "SnackaCaptureLinux: Invalid idle fps (must be 0-" << fps << ")\n";
+        return 1;
+    }
+
+    if (queueFrames <= 0 || queueFrames > 64) {
+        std::cerr << "SnackaCaptureLinux: Invalid queue frames (must be 1-64)\n";
+        return 1;
+    }
 
-    return Capture(displayIndex, cameraId, width, height, fps, encodeH264, bitrateMbps, captureAudio);
+    return Capture(displayIndex, cameraId, width, height, fps, encodeH264, encoderBackend, bitrateMbps, captureAudio, screenOptions, queueFrames, dropPolicy);
 }
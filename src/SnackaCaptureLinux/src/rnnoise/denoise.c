@@ -155,6 +155,7 @@ static void interp_band_gain(float *g, const float *bandE) {
 
 extern const float rnn_dct_table[];
 extern const kiss_fft_state rnn_kfft;
+extern const kiss_fft_state rnn_kfft_half;
 extern const float rnn_half_window[];
 
 static void dct(float *out, const float *in) {
@@ -183,36 +184,63 @@ static void idct(float *out, const float *in) {
 }
 #endif
 
+/* The window is real, so both transforms run a half-length complex FFT over
+   the even samples (real part) and odd samples (imaginary part). The spectra
+   of the two halves are separated and recombined with the twiddles of the
+   full-length FFT (the half FFT uses every other one of them). */
 static void forward_transform(kiss_fft_cpx *out, const float *in) {
   int i;
-  kiss_fft_cpx x[WINDOW_SIZE];
-  kiss_fft_cpx y[WINDOW_SIZE];
-  for (i=0;i<WINDOW_SIZE;i++) {
-    x[i].r = in[i];
-    x[i].i = 0;
+  kiss_fft_cpx x[WINDOW_SIZE/2];
+  kiss_fft_cpx z[WINDOW_SIZE/2];
+  const kiss_twiddle_cpx *w = rnn_kfft.twiddles;
+  for (i=0;i<WINDOW_SIZE/2;i++) {
+    x[i].r = in[2*i];
+    x[i].i = in[2*i+1];
   }
-  rnn_fft(&rnn_kfft, x, y, 0);
-  for (i=0;i<FREQ_SIZE;i++) {
-    out[i] = y[i];
+  rnn_fft(&rnn_kfft_half, x, z, 0);
+  /* z is scaled by 2/WINDOW_SIZE, the full FFT by 1/WINDOW_SIZE. */
+  out[0].r = .5f*(z[0].r + z[0].i);
+  out[0].i = 0;
+  out[FREQ_SIZE-1].r = .5f*(z[0].r - z[0].i);
+  out[FREQ_SIZE-1].i = 0;
+  for (i=1;i<WINDOW_SIZE/2;i++) {
+    kiss_fft_cpx a = z[i];
+    kiss_fft_cpx b = z[WINDOW_SIZE/2 - i];
+    /* Twice the even spectrum, and twice the odd spectrum before its twiddle. */
+    float er = a.r + b.r;
+    float ei = a.i - b.i;
+    float odr = a.i + b.i;
+    float odi = b.r - a.r;
+    float tr = odr*w[i].r - odi*w[i].i;
+    float ti = odr*w[i].i + odi*w[i].r;
+    out[i].r = .25f*(er + tr);
+    out[i].i = .25f*(ei + ti);
   }
 }
 
 static void inverse_transform(float *out, const kiss_fft_cpx *in) {
   int i;
-  kiss_fft_cpx x[WINDOW_SIZE];
-  kiss_fft_cpx y[WINDOW_SIZE];
-  for (i=0;i<FREQ_SIZE;i++) {
-    x[i] = in[i];
-  }
-  for (;i<WINDOW_SIZE;i++) {
-    x[i].r = x[WINDOW_SIZE - i].r;
-    x[i].i = -x[WINDOW_SIZE - i].i;
+  kiss_fft_cpx x[WINDOW_SIZE/2];
+  kiss_fft_cpx y[WINDOW_SIZE/2];
+  const kiss_twiddle_cpx *w = rnn_kfft.twiddles;
+  /* Rebuild (twice) the spectrum of the even + j*odd samples, conjugated so
+     the forward FFT computes the inverse. */
+  for (i=0;i<WINDOW_SIZE/2;i++) {
+    kiss_fft_cpx a = in[i];
+    kiss_fft_cpx b = in[WINDOW_SIZE/2 - i];
+    float sr = a.r + b.r;
+    float si = a.i - b.i;
+    float dr = a.r - b.r;
+    float di = a.i + b.i;
+    float tr = dr*w[i].r + di*w[i].i;
+    float ti = di*w[i].r - dr*w[i].i;
+    x[i].r = sr - ti;
+    x[i].i = -(si + tr);
   }
-  rnn_fft(&rnn_kfft, x, y, 0);
-  /* output in reverse order for IFFT. */
-  out[0] = WINDOW_SIZE*y[0].r;
-  for (i=1;i<WINDOW_SIZE;i++) {
-    out[i] = WINDOW_SIZE*y[WINDOW_SIZE - i].r;
+  rnn_fft(&rnn_kfft_half, x, y, 0);
+  for (i=0;i<WINDOW_SIZE/2;i++) {
+    out[2*i] = (WINDOW_SIZE/2)*y[i].r;
+    out[2*i+1] = -(WINDOW_SIZE/2)*y[i].i;
   }
 }
 
@@ -454,27 +482,33 @@ void rnn_pitch_filter(kiss_fft_cpx *X, const kiss_fft_cpx *P, const float *Ex, c
   }
 }
 
-float rnnoise_process_frame(DenoiseState *st, float *out, const float *in) {
-  int i;
+/* Analysis of one frame, up to the network input. */
+typedef struct {
   kiss_fft_cpx X[FREQ_SIZE];
   kiss_fft_cpx P[FREQ_SIZE];
-  float x[FRAME_SIZE];
   float Ex[NB_BANDS], Ep[NB_BANDS];
   float Exp[NB_BANDS];
   float features[NB_FEATURES];
   float g[NB_BANDS];
-  float gf[FREQ_SIZE]={1};
-  float vad_prob = 0;
+  float vad_prob;
   int silence;
+} FrameAnalysis;
+
+static void frame_begin(DenoiseState *st, FrameAnalysis *a, const float *in) {
+  float x[FRAME_SIZE];
   static const float a_hp[2] = {-1.99599, 0.99600};
   static const float b_hp[2] = {-2, 1};
   rnn_biquad(x, st->mem_hp_x, in, b_hp, a_hp, FRAME_SIZE);
-  silence = rnn_compute_frame_features(st, X, P, Ex, Ep, Exp, features, x);
+  a->vad_prob = 0;
+  a->silence = rnn_compute_frame_features(st, a->X, a->P, a->Ex, a->Ep, a->Exp, a->features, x);
+}
 
-  if (!silence) {
-#if !TRAINING
-    compute_rnn(&st->model, &st->rnn, g, &vad_prob, features, st->arch);
-#endif
+/* Applies the gains in a->g (computed by the network unless the frame is silent). */
+static void frame_end(DenoiseState *st, FrameAnalysis *a, float *out) {
+  int i;
+  float *g = a->g;
+  float gf[FREQ_SIZE]={1};
+  if (!a->silence) {
     rnn_pitch_filter(st->delayed_X, st->delayed_P, st->delayed_Ex, st->delayed_Ep, st->delayed_Exp, g);
     for (i=0;i<NB_BANDS;i++) {
       float alpha = .6f;
@@ -483,7 +517,7 @@ float rnnoise_process_frame(DenoiseState *st, float *out, const float *in) {
       g[i] = MAX16(g[i], alpha*st->lastg[i]);
       /* Compensate for energy change across frame when computing the threshold gain.
          Avoids leaking noise when energy increases (e.g. transient noise). */
-      st->lastg[i] = MIN16(1.f, g[i]*(st->delayed_Ex[i]+1e-3)/(Ex[i]+1e-3));
+      st->lastg[i] = MIN16(1.f, g[i]*(st->delayed_Ex[i]+1e-3)/(a->Ex[i]+1e-3));
     }
     interp_band_gain(gf, g);
 #if 1
@@ -495,11 +529,119 @@ float rnnoise_process_frame(DenoiseState *st, float *out, const float *in) {
   }
   frame_synthesis(st, out, st->delayed_X);
 
-  RNN_COPY(st->delayed_X, X, FREQ_SIZE);
-  RNN_COPY(st->delayed_P, P, FREQ_SIZE);
+  RNN_COPY(st->delayed_X, a->X, FREQ_SIZE);
+  RNN_COPY(st->delayed_P, a->P, FREQ_SIZE);
+  RNN_COPY(st->delayed_Ex, a->Ex, NB_BANDS);
+  RNN_COPY(st->delayed_Ep, a->Ep, NB_BANDS);
+  RNN_COPY(st->delayed_Exp, a->Exp, NB_BANDS);
+}
+
+float rnnoise_process_frame(DenoiseState *st, float *out, const float *in) {
+  FrameAnalysis a;
+  frame_begin(st, &a, in);
+#if !TRAINING
+  if (!a.silence) {
+    compute_rnn(&st->model, &st->rnn, a.g, &a.vad_prob, a.features, st->arch);
+  }
+#endif
+  frame_end(st, &a, out);
+  return a.vad_prob;
+}
+
+void rnnoise_process_frames(DenoiseState **st, int n, float **out, const float **in, float *vad_prob) {
+  int base;
+  for (base=0;base<n;base+=NNET_MAX_BATCH) {
+    int i, count;
+    FrameAnalysis a[NNET_MAX_BATCH];
+    count = IMIN(NNET_MAX_BATCH, n-base);
+    for (i=0;i<count;i++) frame_begin(st[base+i], &a[i], in[base+i]);
+#if !TRAINING
+    {
+      /* Batch the states that need the network and share the first one's
+         weights; any others run on their own. */
+      int nb = 0;
+      const DenoiseState *first = NULL;
+      RNNState *rnn[NNET_MAX_BATCH];
+      float *g[NNET_MAX_BATCH], *vad[NNET_MAX_BATCH];
+      const float *features[NNET_MAX_BATCH];
+      for (i=0;i<count;i++) {
+        DenoiseState *s = st[base+i];
+        if (a[i].silence) continue;
+        if (!first) first = s;
+        if (s->arch == first->arch && memcmp(&s->model, &first->model, sizeof(s->model)) == 0) {
+          rnn[nb] = &s->rnn;
+          g[nb] = a[i].g;
+          vad[nb] = &a[i].vad_prob;
+          features[nb] = a[i].features;
+          nb++;
+        } else {
+          compute_rnn(&s->model, &s->rnn, a[i].g, &a[i].vad_prob, a[i].features, s->arch);
+        }
+      }
+      if (nb > 0) compute_rnn_batch(&first->model, rnn, g, vad, features, nb, first->arch);
+    }
+#endif
+    for (i=0;i<count;i++) {
+      frame_end(st[base+i], &a[i], out[base+i]);
+      if (vad_prob) vad_prob[base+i] = a[i].vad_prob;
+    }
+  }
+}
+
+float rnnoise_process_frame_linked(DenoiseState *st, DenoiseState **channel_st, float **out,
+                                   const float **in, int channels) {
+  int i, c;
+  kiss_fft_cpx X[FREQ_SIZE];
+  kiss_fft_cpx P[FREQ_SIZE];
+  kiss_fft_cpx Y[FREQ_SIZE];
+  float x[FRAME_SIZE];
+  float Ex[NB_BANDS], Ep[NB_BANDS];
+  float Exp[NB_BANDS];
+  float Ey[NB_BANDS];
+  float features[NB_FEATURES];
+  float g[NB_BANDS];
+  float gf[FREQ_SIZE]={1};
+  float vad_prob = 0;
+  int silence;
+  static const float a_hp[2] = {-1.99599, 0.99600};
+  static const float b_hp[2] = {-2, 1};
+  /* The gains come from the average of the channels, so the network runs once. */
+  for (i=0;i<FRAME_SIZE;i++) {
+    float sum = 0;
+    for (c=0;c<channels;c++) sum += in[c][i];
+    x[i] = sum/channels;
+  }
+  rnn_biquad(x, st->mem_hp_x, x, b_hp, a_hp, FRAME_SIZE);
+  silence = rnn_compute_frame_features(st, X, P, Ex, Ep, Exp, features, x);
+
+  if (!silence) {
+#if !TRAINING
+    compute_rnn(&st->model, &st->rnn, g, &vad_prob, features, st->arch);
+#endif
+    for (i=0;i<NB_BANDS;i++) {
+      float alpha = .6f;
+      g[i] = MAX16(g[i], alpha*st->lastg[i]);
+      st->lastg[i] = MIN16(1.f, g[i]*(st->delayed_Ex[i]+1e-3)/(Ex[i]+1e-3));
+    }
+    interp_band_gain(gf, g);
+  }
+
+  /* Each channel keeps its own transform state and gets the shared gains
+     (without the pitch filter, which would need a pitch analysis per channel). */
+  for (c=0;c<channels;c++) {
+    DenoiseState *cst = channel_st[c];
+    rnn_biquad(x, cst->mem_hp_x, in[c], b_hp, a_hp, FRAME_SIZE);
+    rnn_frame_analysis(cst, Y, Ey, x);
+    if (!silence) {
+      for (i=0;i<FREQ_SIZE;i++) {
+        cst->delayed_X[i].r *= gf[i];
+        cst->delayed_X[i].i *= gf[i];
+      }
+    }
+    frame_synthesis(cst, out[c], cst->delayed_X);
+    RNN_COPY(cst->delayed_X, Y, FREQ_SIZE);
+  }
+
   RNN_COPY(st->delayed_Ex, Ex, NB_BANDS);
-  RNN_COPY(st->delayed_Ep, Ep, NB_BANDS);
-  RNN_COPY(st->delayed_Exp, Exp, NB_BANDS);
   return vad_prob;
 }
-
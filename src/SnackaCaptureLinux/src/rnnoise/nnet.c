@@ -121,3 +121,69 @@ void compute_generic_conv1d(const LinearLayer *layer, float *output, float *mem,
    compute_activation(output, output, layer->nb_outputs, activation, arch);
    if (layer->nb_inputs!=input_size) RNN_COPY(mem, &tmp[input_size], layer->nb_inputs-input_size);
 }
+
+void compute_generic_dense_batch(const LinearLayer *layer, float **output, const float **input, int n, int activation, int arch)
+{
+   int b;
+   celt_assert(n <= NNET_MAX_BATCH);
+   compute_linear_batch(layer, output, input, n, arch);
+   for (b=0;b<n;b++)
+      compute_activation(output[b], output[b], layer->nb_outputs, activation, arch);
+}
+
+void compute_generic_gru_batch(const LinearLayer *input_weights, const LinearLayer *recurrent_weights, float **state, const float **in, int n, int arch)
+{
+  int i, b;
+  int N;
+  float zrh[NNET_MAX_BATCH][3*MAX_RNN_NEURONS_ALL];
+  float recur[NNET_MAX_BATCH][3*MAX_RNN_NEURONS_ALL];
+  float *zrh_out[NNET_MAX_BATCH];
+  float *recur_out[NNET_MAX_BATCH];
+  celt_assert(n <= NNET_MAX_BATCH);
+  celt_assert(3*recurrent_weights->nb_inputs == recurrent_weights->nb_outputs);
+  celt_assert(input_weights->nb_outputs == recurrent_weights->nb_outputs);
+  N = recurrent_weights->nb_inputs;
+  celt_assert(recurrent_weights->nb_outputs <= 3*MAX_RNN_NEURONS_ALL);
+  for (b=0;b<n;b++) {
+    celt_assert(in[b] != state[b]);
+    zrh_out[b] = zrh[b];
+    recur_out[b] = recur[b];
+  }
+  compute_linear_batch(input_weights, zrh_out, in, n, arch);
+  compute_linear_batch(recurrent_weights, recur_out, (const float **)state, n, arch);
+  for (b=0;b<n;b++) {
+    float *z = zrh[b];
+    float *r = &zrh[b][N];
+    float *h = &zrh[b][2*N];
+    for (i=0;i<2*N;i++)
+       zrh[b][i] += recur[b][i];
+    compute_activation(zrh[b], zrh[b], 2*N, ACTIVATION_SIGMOID, arch);
+    for (i=0;i<N;i++)
+       h[i] += recur[b][2*N+i]*r[i];
+    compute_activation(h, h, N, ACTIVATION_TANH, arch);
+    for (i=0;i<N;i++)
+       h[i] = z[i]*state[b][i] + (1-z[i])*h[i];
+    for (i=0;i<N;i++)
+       state[b][i] = h[i];
+  }
+}
+
+void compute_generic_conv1d_batch(const LinearLayer *layer, float **output, float **mem, const float **input, int n, int input_size, int activation, int arch)
+{
+   int b;
+   float tmp[NNET_MAX_BATCH][MAX_CONV_INPUTS_ALL];
+   const float *tmp_in[NNET_MAX_BATCH];
+   celt_assert(n <= NNET_MAX_BATCH);
+   celt_assert(layer->nb_inputs <= MAX_CONV_INPUTS_ALL);
+   for (b=0;b<n;b++) {
+      celt_assert(input[b] != output[b]);
+      if (layer->nb_inputs!=input_size) RNN_COPY(tmp[b], mem[b], layer->nb_inputs-input_size);
+      RNN_COPY(&tmp[b][layer->nb_inputs-input_size], input[b], input_size);
+      tmp_in[b] = tmp[b];
+   }
+   compute_linear_batch(layer, output, tmp_in, n, arch);
+   for (b=0;b<n;b++) {
+      compute_activation(output[b], output[b], layer->nb_outputs, activation, arch);
+      if (layer->nb_inputs!=input_size) RNN_COPY(mem[b], &tmp[b][input_size], layer->nb_inputs-input_size);
+   }
+}
@@ -92,16 +92,22 @@ typedef struct {
 #define compute_generic_gru rnn_compute_generic_gru
 #define compute_generic_conv1d rnn_compute_generic_conv1d
 #define compute_glu rnn_compute_glu
+#define compute_generic_dense_batch rnn_compute_generic_dense_batch
+#define compute_generic_gru_batch rnn_compute_generic_gru_batch
+#define compute_generic_conv1d_batch rnn_compute_generic_conv1d_batch
 
 #define parse_weights rnn_parse_weights
 
 #define compute_linear_c rnn_compute_linear_c
+#define compute_linear_batch_c rnn_compute_linear_batch_c
 #define compute_activation_c rnn_compute_activation_c
 #define compute_conv2d_c rnn_compute_conv2d_c
 #define compute_linear_sse4_1 rnn_compute_linear_sse4_1
+#define compute_linear_batch_sse4_1 rnn_compute_linear_batch_sse4_1
 #define compute_activation_sse4_1 rnn_compute_activation_sse4_1
 #define compute_conv2d_sse4_1 rnn_compute_conv2d_sse4_1
 #define compute_linear_avx2 rnn_compute_linear_avx2
+#define compute_linear_batch_avx2 rnn_compute_linear_batch_avx2
 #define compute_activation_avx2 rnn_compute_activation_avx2
 #define compute_conv2d_avx2 rnn_compute_conv2d_avx2
 
@@ -109,6 +115,15 @@ typedef struct {
 void compute_generic_dense(const LinearLayer *layer, float *output, const float *input, int activation, int arch);
 void compute_generic_gru(const LinearLayer *input_weights, const LinearLayer *recurrent_weights, float *state, const float *in, int arch);
 void compute_generic_conv1d(const LinearLayer *layer, float *output, float *mem, const float *input, int input_size, int activation, int arch);
+
+/* Largest number of inputs the batched layers take at once. The batched
+   versions give the same results as calling the single versions in turn,
+   but read the weights once for all inputs. */
+#define NNET_MAX_BATCH 4
+
+void compute_generic_dense_batch(const LinearLayer *layer, float **output, const float **input, int n, int activation, int arch);
+void compute_generic_gru_batch(const LinearLayer *input_weights, const LinearLayer *recurrent_weights, float **state, const float **in, int n, int arch);
+void compute_generic_conv1d_batch(const LinearLayer *layer, float **output, float **mem, const float **input, int n, int input_size, int activation, int arch);
 void compute_glu(const LinearLayer *layer, float *output, const float *input, int arch);
 
 
@@ -137,6 +152,7 @@ int conv2d_init(Conv2dLayer *layer, const WeightArray *arrays,
 
 
 void compute_linear_c(const LinearLayer *linear, float *out, const float *in);
+void compute_linear_batch_c(const LinearLayer *linear, float **out, const float **in, int n);
 void compute_activation_c(float *output, const float *input, int N, int activation);
 void compute_conv2d_c(const Conv2dLayer *conv, float *out, float *mem, const float *in, int height, int hstride, int activation);
 
@@ -148,6 +164,10 @@ void compute_conv2d_c(const Conv2dLayer *conv, float *out, float *mem, const flo
 #define compute_linear(linear, out, in, arch) ((void)(arch),compute_linear_c(linear, out, in))
 #endif
 
+#ifndef OVERRIDE_COMPUTE_LINEAR_BATCH
+#define compute_linear_batch(linear, out, in, n, arch) ((void)(arch),compute_linear_batch_c(linear, out, in, n))
+#endif
+
 #ifndef OVERRIDE_COMPUTE_ACTIVATION
 #define compute_activation(output, input, N, activation, arch) ((void)(arch),compute_activation_c(output, input, N, activation))
 #endif
@@ -127,9 +127,28 @@ void RTCD_SUF(compute_activation_)(float *output, const float *input, int N, int
 }
 
 
-void RTCD_SUF(compute_linear_) (const LinearLayer *linear, float *out, const float *in)
+static OPUS_INLINE void linear_add_bias(const LinearLayer *linear, const float *bias, float *out, const float *in)
 {
    int i, M, N;
+   M = linear->nb_inputs;
+   N = linear->nb_outputs;
+   if (bias != NULL) {
+      for (i=0;i<N;i++) out[i] += bias[i];
+   }
+   if (linear->diag) {
+      /* Diag is only used for GRU recurrent weights. */
+      celt_assert(3*M == N);
+      for (i=0;i<M;i++) {
+         out[i] += linear->diag[i]*in[i];
+         out[i+M] += linear->diag[i+M]*in[i];
+         out[i+2*M] += linear->diag[i+2*M]*in[i];
+      }
+   }
+}
+
+void RTCD_SUF(compute_linear_) (const LinearLayer *linear, float *out, const float *in)
+{
+   int M, N;
    const float *bias;
    celt_assert(in != out);
    bias = linear->bias;
@@ -147,18 +166,36 @@ void RTCD_SUF(compute_linear_) (const LinearLayer *linear, float *out, const flo
 #endif
    }
    else RNN_CLEAR(out, N);
-   if (bias != NULL) {
-      for (i=0;i<N;i++) out[i] += bias[i];
-   }
-   if (linear->diag) {
-      /* Diag is only used for GRU recurrent weights. */
-      celt_assert(3*M == N);
-      for (i=0;i<M;i++) {
-         out[i] += linear->diag[i]*in[i];
-         out[i+M] += linear->diag[i+M]*in[i];
-         out[i+2*M] += linear->diag[i+2*M]*in[i];
-      }
+   linear_add_bias(linear, bias, out, in);
+}
+
+void RTCD_SUF(compute_linear_batch_) (const LinearLayer *linear, float **out, const float **in, int n)
+{
+   int b;
+#ifdef HAVE_CGEMV8X4_BATCH
+   if (linear->float_weights == NULL && linear->weights != NULL) {
+     int M, N;
+     const float *bias;
+     bias = linear->bias;
+     M = linear->nb_inputs;
+     N = linear->nb_outputs;
+#ifdef USE_SU_BIAS
+     bias = linear->subias;
+#endif
+     for (b=0;b<n;b+=CGEMV_BATCH) {
+       int nb = IMIN(CGEMV_BATCH, n-b);
+       int k;
+       if (linear->weights_idx != NULL) sparse_cgemv8x4_batch(&out[b], linear->weights, linear->weights_idx, linear->scale, N, M, &in[b], nb);
+       else cgemv8x4_batch(&out[b], linear->weights, linear->scale, N, M, &in[b], nb);
+       for (k=0;k<nb;k++) {
+         celt_assert(in[b+k] != out[b+k]);
+         linear_add_bias(linear, bias, out[b+k], in[b+k]);
+       }
+     }
+     return;
    }
+#endif
+   for (b=0;b<n;b++) RTCD_SUF(compute_linear_)(linear, out[b], in[b]);
 }
 
 /* Computes non-padded convolution for input [ ksize1 x in_channels x (len2+ksize2) ],
@@ -58,3 +58,34 @@ void compute_rnn(const RNNoise *model, RNNState *rnn, float *gains, float *vad,
   /*for (int i=0;i<22;i++) printf("%f ", gains[i]);printf("\n");*/
   /*printf("%f\n", *vad);*/
 }
+
+void compute_rnn_batch(const RNNoise *model, RNNState **rnn, float **gains, float **vad, const float **input, int n, int arch) {
+  int b;
+  float tmp[NNET_MAX_BATCH][MAX_NEURONS];
+  float cat[NNET_MAX_BATCH][CONV2_OUT_SIZE + GRU1_OUT_SIZE + GRU2_OUT_SIZE + GRU3_OUT_SIZE];
+  float *tmp_p[NNET_MAX_BATCH], *cat_p[NNET_MAX_BATCH];
+  float *conv1_state[NNET_MAX_BATCH], *conv2_state[NNET_MAX_BATCH];
+  float *gru1_state[NNET_MAX_BATCH], *gru2_state[NNET_MAX_BATCH], *gru3_state[NNET_MAX_BATCH];
+  celt_assert(n <= NNET_MAX_BATCH);
+  for (b=0;b<n;b++) {
+    tmp_p[b] = tmp[b];
+    cat_p[b] = cat[b];
+    conv1_state[b] = rnn[b]->conv1_state;
+    conv2_state[b] = rnn[b]->conv2_state;
+    gru1_state[b] = rnn[b]->gru1_state;
+    gru2_state[b] = rnn[b]->gru2_state;
+    gru3_state[b] = rnn[b]->gru3_state;
+  }
+  compute_generic_conv1d_batch(&model->conv1, tmp_p, conv1_state, input, n, CONV1_IN_SIZE, ACTIVATION_TANH, arch);
+  compute_generic_conv1d_batch(&model->conv2, cat_p, conv2_state, (const float **)tmp_p, n, CONV2_IN_SIZE, ACTIVATION_TANH, arch);
+  compute_generic_gru_batch(&model->gru1_input, &model->gru1_recurrent, gru1_state, (const float **)cat_p, n, arch);
+  compute_generic_gru_batch(&model->gru2_input, &model->gru2_recurrent, gru2_state, (const float **)gru1_state, n, arch);
+  compute_generic_gru_batch(&model->gru3_input, &model->gru3_recurrent, gru3_state, (const float **)gru2_state, n, arch);
+  for (b=0;b<n;b++) {
+    RNN_COPY(&cat[b][CONV2_OUT_SIZE], rnn[b]->gru1_state, GRU1_OUT_SIZE);
+    RNN_COPY(&cat[b][CONV2_OUT_SIZE+GRU1_OUT_SIZE], rnn[b]->gru2_state, GRU2_OUT_SIZE);
+    RNN_COPY(&cat[b][CONV2_OUT_SIZE+GRU1_OUT_SIZE+GRU2_OUT_SIZE], rnn[b]->gru3_state, GRU3_OUT_SIZE);
+  }
+  compute_generic_dense_batch(&model->dense_out, gains, (const float **)cat_p, n, ACTIVATION_SIGMOID, arch);
+  compute_generic_dense_batch(&model->vad_dense, vad, (const float **)cat_p, n, ACTIVATION_SIGMOID, arch);
+}
@@ -46,4 +46,8 @@ typedef struct {
 } RNNState;
 void compute_rnn(const RNNoise *model, RNNState *rnn, float *gains, float *vad, const float *input, int arch);
 
+/* Same as compute_rnn() for n <= NNET_MAX_BATCH states sharing one model, with
+   the weights read once for all of them. */
+void compute_rnn_batch(const RNNoise *model, RNNState **rnn, float **gains, float **vad, const float **input, int n, int arch);
+
 #endif /* RNN_H_ */
@@ -93,6 +93,26 @@ RNNOISE_EXPORT void rnnoise_destroy(DenoiseState *st);
  */
 RNNOISE_EXPORT float rnnoise_process_frame(DenoiseState *st, float *out, const float *in);
 
+/**
+ * Denoise one frame for each of n states
+ *
+ * The result is the same as calling rnnoise_process_frame() for each state,
+ * but states that share a model run the network together, reading its
+ * weights once per group of up to four. The states must be distinct; vad_prob
+ * receives the n voice probabilities and may be NULL.
+ */
+RNNOISE_EXPORT void rnnoise_process_frames(DenoiseState **st, int n, float **out, const float **in, float *vad_prob);
+
+/**
+ * Denoise a frame of several channels with one set of gains
+ *
+ * The network runs once, on the average of the channels, using st. Each
+ * channel has its own state in channel_st for the transforms. out[c] may be
+ * the same buffer as in[c].
+ */
+RNNOISE_EXPORT float rnnoise_process_frame_linked(DenoiseState *st, DenoiseState **channel_st, float **out,
+                                                  const float **in, int channels);
+
 /**
  * Load a model from a memory buffer
  *
@@ -876,6 +876,95 @@ static inline void cgemv8x4(float *_out, const opus_int8 *w, const float *scale,
    }
 }
 
+/* Batched versions of the int8 products above: NB inputs share each weight
+   load. The integer accumulation and the final scaling are the same as for a
+   single input, so each output is bit-identical to sparse_cgemv8x4() and
+   cgemv8x4(). One function per batch size keeps the accumulators in
+   registers. */
+#define HAVE_CGEMV8X4_BATCH
+#define CGEMV_BATCH 4
+
+#define DEFINE_CGEMV8X4_BATCH(NB) \
+static inline void sparse_cgemv8x4_batch##NB(float **_out, const opus_int8 *w, const int *idx, const float *scale, int rows, int cols, const float **_x) \
+{ \
+   int i, j, k; \
+   unsigned char x[NB][MAX_INPUTS]; \
+   for (k=0;k<NB;k++) vector_ps_to_epi8(x[k], _x[k], cols); \
+   for (i=0;i<rows;i+=8) \
+   { \
+      int colblocks; \
+      __m256i vy[NB]; \
+      colblocks = *idx++; \
+      for (k=0;k<NB;k++) vy[k] = _mm256_setzero_si256(); \
+      for (j=0;j<colblocks;j++) \
+      { \
+         int pos; \
+         __m256i vw; \
+         pos = *idx++; \
+         vw = _mm256_loadu_si256((const __m256i *)(void*)w); \
+         for (k=0;k<NB;k++) \
+            vy[k] = opus_mm256_dpbusds_epi32(vy[k], _mm256_broadcastd_epi32(_mm_loadu_si32(&x[k][pos])), vw); \
+         w += 32; \
+      } \
+      for (k=0;k<NB;k++) { \
+         __m256 vout; \
+         vout = _mm256_cvtepi32_ps(vy[k]); \
+         vout = _mm256_mul_ps(vout, _mm256_loadu_ps(&scale[i])); \
+         _mm256_storeu_ps(&_out[k][i], vout); \
+      } \
+   } \
+} \
+\
+static inline void cgemv8x4_batch##NB(float **_out, const opus_int8 *w, const float *scale, int rows, int cols, const float **_x) \
+{ \
+   int i, j, k; \
+   unsigned char x[NB][MAX_INPUTS]; \
+   for (k=0;k<NB;k++) vector_ps_to_epi8(x[k], _x[k], cols); \
+   for (i=0;i<rows;i+=8) \
+   { \
+      __m256i vy[NB]; \
+      for (k=0;k<NB;k++) vy[k] = _mm256_setzero_si256(); \
+      for (j=0;j<cols;j+=4) \
+      { \
+         __m256i vw; \
+         vw = _mm256_loadu_si256((const __m256i *)(void*)w); \
+         for (k=0;k<NB;k++) \
+            vy[k] = opus_mm256_dpbusds_epi32(vy[k], _mm256_broadcastd_epi32(_mm_loadu_si32(&x[k][j])), vw); \
+         w += 32; \
+      } \
+      for (k=0;k<NB;k++) { \
+         __m256 vout; \
+         vout = _mm256_cvtepi32_ps(vy[k]); \
+         vout = _mm256_mul_ps(vout, _mm256_loadu_ps(&scale[i])); \
+         _mm256_storeu_ps(&_out[k][i], vout); \
+      } \
+   } \
+}
+
+DEFINE_CGEMV8X4_BATCH(2)
+DEFINE_CGEMV8X4_BATCH(3)
+DEFINE_CGEMV8X4_BATCH(4)
+
+static inline void sparse_cgemv8x4_batch(float **_out, const opus_int8 *w, const int *idx, const float *scale, int rows, int cols, const float **_x, int n)
+{
+   switch (n) {
+      case 1: sparse_cgemv8x4(_out[0], w, idx, scale, rows, cols, _x[0]); break;
+      case 2: sparse_cgemv8x4_batch2(_out, w, idx, scale, rows, cols, _x); break;
+      case 3: sparse_cgemv8x4_batch3(_out, w, idx, scale, rows, cols, _x); break;
+      default: celt_assert(n == 4); sparse_cgemv8x4_batch4(_out, w, idx, scale, rows, cols, _x); break;
+   }
+}
+
+static inline void cgemv8x4_batch(float **_out, const opus_int8 *w, const float *scale, int rows, int cols, const float **_x, int n)
+{
+   switch (n) {
+      case 1: cgemv8x4(_out[0], w, scale, rows, cols, _x[0]); break;
+      case 2: cgemv8x4_batch2(_out, w, scale, rows, cols, _x); break;
+      case 3: cgemv8x4_batch3(_out, w, scale, rows, cols, _x); break;
+      default: celt_assert(n == 4); cgemv8x4_batch4(_out, w, scale, rows, cols, _x); break;
+   }
+}
+
 #define SCALE (128.f*127.f)
 #define SCALE_1 (1.f/128.f/127.f)
 #define USE_SU_BIAS
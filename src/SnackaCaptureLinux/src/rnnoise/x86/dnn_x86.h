@@ -32,10 +32,12 @@
 #include "opus_types.h"
 
 void compute_linear_sse4_1(const LinearLayer *linear, float *out, const float *in);
+void compute_linear_batch_sse4_1(const LinearLayer *linear, float **out, const float **in, int n);
 void compute_activation_sse4_1(float *output, const float *input, int N, int activation);
 void compute_conv2d_sse4_1(const Conv2dLayer *conv, float *out, float *mem, const float *in, int height, int hstride, int activation);
 
 void compute_linear_avx2(const LinearLayer *linear, float *out, const float *in);
+void compute_linear_batch_avx2(const LinearLayer *linear, float **out, const float **in, int n);
 void compute_activation_avx2(float *output, const float *input, int N, int activation);
 void compute_conv2d_avx2(const Conv2dLayer *conv, float *out, float *mem, const float *in, int height, int hstride, int activation);
 
@@ -53,6 +55,17 @@ extern void (*const RNN_COMPUTE_LINEAR_IMPL[OPUS_ARCHMASK + 1])(
     ((*RNN_COMPUTE_LINEAR_IMPL[(arch) & OPUS_ARCHMASK])(linear, out, in))
 
 
+extern void (*const RNN_COMPUTE_LINEAR_BATCH_IMPL[OPUS_ARCHMASK + 1])(
+                    const LinearLayer *linear,
+                    float **out,
+                    const float **in,
+                    int n
+                    );
+#define OVERRIDE_COMPUTE_LINEAR_BATCH
+#define compute_linear_batch(linear, out, in, n, arch) \
+    ((*RNN_COMPUTE_LINEAR_BATCH_IMPL[(arch) & OPUS_ARCHMASK])(linear, out, in, n))
+
+
 extern void (*const RNN_COMPUTE_ACTIVATION_IMPL[OPUS_ARCHMASK + 1])(
                     float *output,
                     const float *input,
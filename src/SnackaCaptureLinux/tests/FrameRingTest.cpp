@@ -0,0 +1,92 @@
+// Checks that FrameRing queues frames larger than the size its slots were
+// preallocated at (a camera may negotiate a bigger format than requested):
+// the slot grows, the frame arrives intact, and a slot is only grown once.
+
+#include "FrameRing.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace snacka;
+
+namespace {
+
+std::vector<uint8_t> MakeFrame(size_t size, uint8_t seed) {
+    std::vector<uint8_t> frame(size);
+    for (size_t i = 0; i < size; i++) {
+        frame[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+    return frame;
+}
+
+bool PopMatches(FrameRing& ring, const std::vector<uint8_t>& expected, uint64_t timestamp) {
+    const RingFrame* frame = ring.Pop();
+    return frame && frame->size == expected.size() && frame->timestamp == timestamp &&
+           std::memcmp(frame->data.get(), expected.data(), expected.size()) == 0;
+}
+
+}  // namespace
+
+int main() {
+    constexpr size_t kCapacity = 3;
+    constexpr size_t kSlotSize = 640 * 480 * 3 / 2;  // As requested
+    constexpr size_t kLargeSize = 1280 * 720 * 3 / 2;  // As negotiated
+
+    int failures = 0;
+    FrameRing ring(kCapacity, kSlotSize, DropPolicy::DropOldest, false);
+
+    // Frames of the configured size, then larger ones, round and round the
+    // slots so every buffer (including the one the consumer holds) is grown
+    uint64_t timestamp = 0;
+    for (int round = 0; round < 4; round++) {
+        size_t size = round == 0 ? kSlotSize : kLargeSize;
+        for (size_t i = 0; i < kCapacity; i++) {
+            std::vector<uint8_t> frame = MakeFrame(size, static_cast<uint8_t>(timestamp));
+            if (!ring.Push(frame.data(), frame.size(), timestamp)) {
+                std::printf("FAIL push of a %zu byte frame was dropped\n", size);
+                failures++;
+            }
+            if (!PopMatches(ring, frame, timestamp)) {
+                std::printf("FAIL %zu byte frame %llu did not come out intact\n",
+                            size, static_cast<unsigned long long>(timestamp));
+                failures++;
+            }
+            timestamp++;
+        }
+    }
+
+    // A full ring of large frames, dropping the oldest
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t i = 0; i < kCapacity + 2; i++) {
+        frames.push_back(MakeFrame(kLargeSize * 2, static_cast<uint8_t>(100 + i)));
+        ring.Push(frames.back().data(), frames.back().size(), 100 + i);
+    }
+    for (size_t i = 2; i < kCapacity + 2; i++) {
+        if (!PopMatches(ring, frames[i], 100 + i)) {
+            std::printf("FAIL queued large frame %zu did not come out intact\n", i);
+            failures++;
+        }
+    }
+
+    FrameRingStats stats = ring.GetStats();
+    // Each of the capacity + 1 buffers grows at most twice (to the large and
+    // then to the doubled size), never for a frame that already fits
+    if (stats.grown == 0 || stats.grown > 2 * (kCapacity + 1)) {
+        std::printf("FAIL %llu slots grown\n", static_cast<unsigned long long>(stats.grown));
+        failures++;
+    }
+    if (stats.dropped != 2) {
+        std::printf("FAIL %llu frames dropped, expected the 2 overwritten ones\n",
+                    static_cast<unsigned long long>(stats.dropped));
+        failures++;
+    }
+
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    std::printf("frame ring: %llu frames, %llu slots grown\n",
+                static_cast<unsigned long long>(stats.popped), static_cast<unsigned long long>(stats.grown));
+    return 0;
+}
@@ -0,0 +1,159 @@
+// Feeds odd-sized fragments through PulseMicrophoneCapturer's RNNoise path,
+// as PulseAudio delivers them, and checks that:
+// - the 480-sample framing carries over between fragments, so the output is
+//   the same as for the same audio in whole frames;
+// - the capture path never allocates (operator new is replaced to count).
+// No PulseAudio server is needed; fragments go straight to ProcessWithRNNoise.
+
+#include "PulseMicrophoneCapturer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <vector>
+
+namespace {
+
+std::atomic<bool> g_counting{false};
+std::atomic<size_t> g_allocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace snacka {
+
+class MicrophoneFramingTest {
+public:
+    explicit MicrophoneFramingTest(NoiseSuppressionMode mode)
+        : m_capturer(mode) {
+        // Room for everything up front, so collecting the output does not allocate
+        m_output.reserve(kTotalFrames * 2);
+        m_capturer.m_callback = [this](const int16_t* data, size_t sampleCount, uint64_t) {
+            m_output.insert(m_output.end(), data, data + sampleCount * 2);
+            m_calls++;
+        };
+    }
+
+    void Feed(const int16_t* samples, size_t sampleCount) {
+        m_capturer.ProcessWithRNNoise(samples, sampleCount, 0);
+    }
+
+    const std::vector<int16_t>& Output() const { return m_output; }
+    int Calls() const { return m_calls; }
+
+    static constexpr size_t kTotalFrames = 48000 * 2;
+
+private:
+    PulseMicrophoneCapturer m_capturer;
+    std::vector<int16_t> m_output;
+    int m_calls = 0;
+};
+
+}  // namespace snacka
+
+using namespace snacka;
+
+namespace {
+
+constexpr size_t kFrameSize = 480;
+
+// Stereo test signal: a tone with noise; the right channel copies the left
+// for the first half (mono microphone), then differs (switches auto mode)
+std::vector<int16_t> MakeSignal(size_t frames) {
+    std::vector<int16_t> samples(frames * 2);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < frames; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = static_cast<float>(static_cast<int>(seed >> 20) - 2048);
+        float left = 6000.0f * std::sin(static_cast<float>(i) * 0.03f) + noise;
+        float right = i < frames / 2 ? left : 4000.0f * std::sin(static_cast<float>(i) * 0.05f) - noise;
+        samples[i * 2] = static_cast<int16_t>(left);
+        samples[i * 2 + 1] = static_cast<int16_t>(right);
+    }
+    return samples;
+}
+
+bool CheckMode(NoiseSuppressionMode mode, const std::vector<int16_t>& signal) {
+    const char* name = NoiseSuppressionModeName(mode);
+    size_t totalFrames = signal.size() / 2;
+
+    MicrophoneFramingTest whole(mode);
+    MicrophoneFramingTest fragmented(mode);
+
+    // Reference: whole RNNoise frames only
+    for (size_t offset = 0; offset + kFrameSize <= totalFrames; offset += kFrameSize) {
+        whole.Feed(signal.data() + offset * 2, kFrameSize);
+    }
+
+    // Odd sizes below, around and well above a frame (more than the 100 ms
+    // the output buffer holds), as PulseAudio may deliver
+    static const size_t kFragments[] = {1, 7, 479, 481, 13, 960 + 17, 3, 5000, 241, 719};
+    g_allocations = 0;
+    g_counting = true;
+    size_t offset = 0;
+    for (size_t i = 0; offset < totalFrames; i++) {
+        size_t count = std::min(kFragments[i % std::size(kFragments)], totalFrames - offset);
+        fragmented.Feed(signal.data() + offset * 2, count);
+        offset += count;
+    }
+    g_counting = false;
+
+    bool ok = true;
+    if (g_allocations != 0) {
+        std::printf("FAIL %s: %zu allocations while processing\n", name, g_allocations.load());
+        ok = false;
+    }
+    size_t expectedFrames = totalFrames / kFrameSize * kFrameSize;
+    if (fragmented.Output().size() != expectedFrames * 2 || whole.Output().size() != expectedFrames * 2) {
+        std::printf("FAIL %s: %zu frames out of fragments, %zu out of whole frames, expected %zu\n",
+                    name, fragmented.Output().size() / 2, whole.Output().size() / 2, expectedFrames);
+        ok = false;
+    } else if (fragmented.Output() != whole.Output()) {
+        std::printf("FAIL %s: fragmented output differs from whole frames\n", name);
+        ok = false;
+    }
+    if (ok) {
+        std::printf("%s: %zu frames in %d callbacks, no allocations\n", name, expectedFrames, fragmented.Calls());
+    }
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    // Not a multiple of 480, so a partial frame is left over at the end
+    std::vector<int16_t> signal = MakeSignal(MicrophoneFramingTest::kTotalFrames - 123);
+
+    int failures = 0;
+    for (NoiseSuppressionMode mode : {NoiseSuppressionMode::Auto, NoiseSuppressionMode::Mono,
+                                      NoiseSuppressionMode::Linked, NoiseSuppressionMode::Dual}) {
+        failures += !CheckMode(mode, signal);
+    }
+
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
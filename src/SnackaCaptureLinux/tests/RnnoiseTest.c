@@ -0,0 +1,232 @@
+// Checks the changes to the vendored RNNoise: the half-length FFT transforms
+// against the 960-point complex FFT they replaced, batched denoising
+// (rnnoise_process_frames) against one rnnoise_process_frame call per state,
+// bit for bit, and each x86 network kernel variant the CPU supports against
+// the portable C kernels, within tolerance.
+//
+// denoise.c is included rather than linked, so its static transforms can be
+// called directly.
+
+#include "denoise.c"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_STATES 6            // A group of four and a remainder
+#define NUM_FRAMES 100
+#define ISA_TOLERANCE 2e-2         // Of the output peak; AVX2+FMA measured 2.8e-3
+#define ISA_VAD_TOLERANCE 0.05     // Measured 5.8e-3
+
+static unsigned int s_seed = 1;
+
+static float random_sample(void) {
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (float)((int)(s_seed >> 16) - 32768);
+}
+
+// The transforms as they were, with the full complex FFT
+static void reference_forward(kiss_fft_cpx *out, const float *in) {
+    kiss_fft_cpx x[WINDOW_SIZE];
+    kiss_fft_cpx y[WINDOW_SIZE];
+    for (int i = 0; i < WINDOW_SIZE; i++) {
+        x[i].r = in[i];
+        x[i].i = 0;
+    }
+    rnn_fft(&rnn_kfft, x, y, 0);
+    for (int i = 0; i < FREQ_SIZE; i++) {
+        out[i] = y[i];
+    }
+}
+
+static void reference_inverse(float *out, const kiss_fft_cpx *in) {
+    kiss_fft_cpx x[WINDOW_SIZE];
+    kiss_fft_cpx y[WINDOW_SIZE];
+    for (int i = 0; i < FREQ_SIZE; i++) {
+        x[i] = in[i];
+    }
+    for (int i = FREQ_SIZE; i < WINDOW_SIZE; i++) {
+        x[i].r = x[WINDOW_SIZE - i].r;
+        x[i].i = -x[WINDOW_SIZE - i].i;
+    }
+    rnn_fft(&rnn_kfft, x, y, 0);
+    out[0] = WINDOW_SIZE * y[0].r;
+    for (int i = 1; i < WINDOW_SIZE; i++) {
+        out[i] = WINDOW_SIZE * y[WINDOW_SIZE - i].r;
+    }
+}
+
+// Errors are measured relative to the largest magnitude, as float rounding
+// grows with it
+static int check_transforms(void) {
+    int failures = 0;
+    double worst_forward = 0;
+    double worst_inverse = 0;
+
+    for (int round = 0; round < 50; round++) {
+        float in[WINDOW_SIZE];
+        for (int i = 0; i < WINDOW_SIZE; i++) {
+            in[i] = random_sample();
+        }
+        // A pure tone and a DC offset put everything in a few bins
+        if (round == 0) {
+            for (int i = 0; i < WINDOW_SIZE; i++) {
+                in[i] = 1000.f * cosf(2 * (float)M_PI * 7 * i / WINDOW_SIZE) + 300.f;
+            }
+        }
+
+        kiss_fft_cpx expected[FREQ_SIZE];
+        kiss_fft_cpx actual[FREQ_SIZE];
+        reference_forward(expected, in);
+        forward_transform(actual, in);
+        double peak = 0;
+        double error = 0;
+        for (int i = 0; i < FREQ_SIZE; i++) {
+            peak = fmax(peak, hypot(expected[i].r, expected[i].i));
+            error = fmax(error, hypot(actual[i].r - expected[i].r, actual[i].i - expected[i].i));
+        }
+        worst_forward = fmax(worst_forward, error / peak);
+
+        float expected_samples[WINDOW_SIZE];
+        float actual_samples[WINDOW_SIZE];
+        reference_inverse(expected_samples, expected);
+        inverse_transform(actual_samples, expected);
+        peak = 0;
+        error = 0;
+        for (int i = 0; i < WINDOW_SIZE; i++) {
+            peak = fmax(peak, fabs(expected_samples[i]));
+            error = fmax(error, fabs(actual_samples[i] - expected_samples[i]));
+        }
+        worst_inverse = fmax(worst_inverse, error / peak);
+    }
+
+    printf("transforms: largest relative error %.2g forward, %.2g inverse\n", worst_forward, worst_inverse);
+    if (worst_forward > 1e-5 || worst_inverse > 1e-5) {
+        printf("FAIL transforms differ from the full complex FFT\n");
+        failures++;
+    }
+    return failures;
+}
+
+static int check_batch(void) {
+    DenoiseState *single[NUM_STATES];
+    DenoiseState *batched[NUM_STATES];
+    for (int s = 0; s < NUM_STATES; s++) {
+        single[s] = rnnoise_create(NULL);
+        batched[s] = rnnoise_create(NULL);
+    }
+
+    // Each state gets its own mix of a tone and noise
+    static float in[NUM_STATES][FRAME_SIZE];
+    static float out_single[NUM_STATES][FRAME_SIZE];
+    static float out_batched[NUM_STATES][FRAME_SIZE];
+    const float *in_ptrs[NUM_STATES];
+    float *out_ptrs[NUM_STATES];
+    for (int s = 0; s < NUM_STATES; s++) {
+        in_ptrs[s] = in[s];
+        out_ptrs[s] = out_batched[s];
+    }
+
+    int failures = 0;
+    for (int frame = 0; frame < NUM_FRAMES && failures == 0; frame++) {
+        for (int s = 0; s < NUM_STATES; s++) {
+            for (int i = 0; i < FRAME_SIZE; i++) {
+                int t = frame * FRAME_SIZE + i;
+                in[s][i] = 8000.f * sinf(t * 0.01f * (s + 1)) * (frame % 20 < 10) + 0.1f * s * random_sample();
+            }
+        }
+
+        float vad_single[NUM_STATES];
+        float vad_batched[NUM_STATES];
+        for (int s = 0; s < NUM_STATES; s++) {
+            vad_single[s] = rnnoise_process_frame(single[s], out_single[s], in[s]);
+        }
+        rnnoise_process_frames(batched, NUM_STATES, out_ptrs, in_ptrs, vad_batched);
+
+        for (int s = 0; s < NUM_STATES; s++) {
+            if (memcmp(out_single[s], out_batched[s], sizeof(out_single[s])) != 0 ||
+                memcmp(&vad_single[s], &vad_batched[s], sizeof(float)) != 0) {
+                printf("FAIL batched state %d differs at frame %d\n", s, frame);
+                failures++;
+            }
+        }
+    }
+    if (failures == 0) {
+        printf("batch: %d states x %d frames identical\n", NUM_STATES, NUM_FRAMES);
+    }
+
+    for (int s = 0; s < NUM_STATES; s++) {
+        rnnoise_destroy(single[s]);
+        rnnoise_destroy(batched[s]);
+    }
+    return failures;
+}
+
+// The ISA kernels approximate the activations differently and round the
+// int8 products in their own order, and the differences feed back through
+// the recurrent state, so outputs are compared relative to the signal peak
+static int check_isas(void) {
+#ifdef RNN_ENABLE_X86_RTCD
+    static const char *names[] = {"c", "sse4.1", "avx2+fma"};
+    static float expected[NUM_FRAMES][FRAME_SIZE];
+    static float expected_vad[NUM_FRAMES];
+    int highest = rnn_select_arch();
+    int failures = 0;
+
+    for (int arch = 0; arch < (int)(sizeof(names) / sizeof(names[0])); arch++) {
+        if (arch > highest) {
+            printf("isa %s: not supported by this CPU, skipped\n", names[arch]);
+            continue;
+        }
+
+        DenoiseState *st = rnnoise_create(NULL);
+        st->arch = arch;
+        s_seed = 1;
+        double peak = 0;
+        double error = 0;
+        double vad_error = 0;
+        for (int frame = 0; frame < NUM_FRAMES; frame++) {
+            float in[FRAME_SIZE];
+            float out[FRAME_SIZE];
+            for (int i = 0; i < FRAME_SIZE; i++) {
+                int t = frame * FRAME_SIZE + i;
+                in[i] = 8000.f * sinf(t * 0.02f) * (frame % 20 < 10) + 0.2f * random_sample();
+            }
+            float vad = rnnoise_process_frame(st, out, in);
+            if (arch == 0) {
+                memcpy(expected[frame], out, sizeof(out));
+                expected_vad[frame] = vad;
+                continue;
+            }
+            for (int i = 0; i < FRAME_SIZE; i++) {
+                peak = fmax(peak, fabs(expected[frame][i]));
+                error = fmax(error, fabs(out[i] - expected[frame][i]));
+            }
+            vad_error = fmax(vad_error, fabs(vad - expected_vad[frame]));
+        }
+        rnnoise_destroy(st);
+
+        if (arch == 0) {
+            continue;
+        }
+        printf("isa %s: largest relative error %.2g, VAD %.2g\n", names[arch], error / peak, vad_error);
+        if (error / peak > ISA_TOLERANCE || vad_error > ISA_VAD_TOLERANCE) {
+            printf("FAIL isa %s differs from the C kernels\n", names[arch]);
+            failures++;
+        }
+    }
+    return failures;
+#else
+    printf("isa: no runtime kernel selection in this build, nothing to compare\n");
+    return 0;
+#endif
+}
+
+int main(void) {
+    int failures = check_transforms() + check_batch() + check_isas();
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Encodes a few NV12 frames with SoftwareEncoder (x264, no GPU) and checks the
+// output the receiver relies on:
+// - each frame is delivered before SubmitSurface() returns, as one packet of
+//   AVCC NAL units whose 4-byte lengths add up to the packet exactly;
+// - SPS and PPS come before the first IDR slice;
+// - RequestKeyframe() makes the next frame an IDR (with SPS/PPS again), and
+//   the frames around it are not.
+// Skipped (exit code 77) when libx264 cannot be loaded.
+
+#include "SoftwareEncoder.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace snacka;
+
+namespace {
+
+constexpr int kWidth = 320;
+constexpr int kHeight = 240;
+constexpr int kFps = 30;
+constexpr int kFrames = 10;
+constexpr int kKeyframeRequestedAt = 6;
+
+// NAL unit types of the AVCC NAL units in a packet, or empty if the framing
+// is broken
+std::vector<int> ParseAvcc(const std::vector<uint8_t>& packet) {
+    std::vector<int> types;
+    size_t offset = 0;
+    while (offset + 4 <= packet.size()) {
+        size_t length = (static_cast<size_t>(packet[offset]) << 24) | (packet[offset + 1] << 16) |
+                        (packet[offset + 2] << 8) | packet[offset + 3];
+        offset += 4;
+        if (length == 0 || length > packet.size() - offset || (packet[offset] & 0x80)) {
+            return {};
+        }
+        types.push_back(packet[offset] & 0x1f);
+        offset += length;
+    }
+    if (offset != packet.size()) {
+        return {};
+    }
+    return types;
+}
+
+// Check that a packet is an IDR access unit with SPS and PPS before the slice
+bool IsIdrWithHeaders(const std::vector<int>& types) {
+    bool sps = false;
+    bool pps = false;
+    for (int type : types) {
+        if (type == 7) {
+            sps = true;
+        } else if (type == 8) {
+            pps = true;
+        } else if (type == 5) {
+            return sps && pps;
+        } else if (type == 1) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool HasIdrSlice(const std::vector<int>& types) {
+    for (int type : types) {
+        if (type == 5) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A gradient that moves each frame, so P frames have something to code
+void WriteFrame(const NV12Surface& surface, int frame) {
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            surface.yPlane[y * surface.yStride + x] = static_cast<uint8_t>(x + y + frame * 4);
+        }
+    }
+    for (int y = 0; y < kHeight / 2; y++) {
+        for (int x = 0; x < kWidth; x += 2) {
+            surface.uvPlane[y * surface.uvStride + x] = static_cast<uint8_t>(128 + x / 4 - frame);
+            surface.uvPlane[y * surface.uvStride + x + 1] = static_cast<uint8_t>(128 - y / 2 + frame);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    if (!SoftwareEncoder::IsAvailable()) {
+        std::printf("libx264 not available, skipping\n");
+        return 77;
+    }
+
+    SoftwareEncoder encoder(kWidth, kHeight, kFps, 2);
+    struct Packet {
+        std::vector<uint8_t> data;
+        bool isKeyframe;
+    };
+    std::vector<Packet> packets;
+    encoder.SetCallback([&](const uint8_t* data, size_t size, bool isKeyframe) {
+        packets.push_back({std::vector<uint8_t>(data, data + size), isKeyframe});
+    });
+    if (!encoder.Initialize()) {
+        std::printf("FAIL x264 encoder did not initialize\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (int frame = 0; frame < kFrames; frame++) {
+        if (frame == kKeyframeRequestedAt) {
+            encoder.RequestKeyframe();
+        }
+        NV12Surface surface;
+        if (!encoder.AcquireSurface(surface)) {
+            std::printf("FAIL no surface for frame %d\n", frame);
+            return 1;
+        }
+        WriteFrame(surface, frame);
+        if (!encoder.SubmitSurface(frame * 1000 / kFps)) {
+            std::printf("FAIL frame %d was not encoded\n", frame);
+            failures++;
+        }
+        if (packets.size() != static_cast<size_t>(frame + 1)) {
+            std::printf("FAIL %zu packets after frame %d, expected one per frame\n", packets.size(), frame);
+            return 1;
+        }
+    }
+    encoder.Stop();
+
+    for (int frame = 0; frame < kFrames; frame++) {
+        const Packet& packet = packets[frame];
+        std::vector<int> types = ParseAvcc(packet.data);
+        if (types.empty()) {
+            std::printf("FAIL frame %d: broken AVCC framing (%zu bytes)\n", frame, packet.data.size());
+            failures++;
+            continue;
+        }
+
+        bool expectIdr = frame == 0 || frame == kKeyframeRequestedAt;
+        if (expectIdr && !IsIdrWithHeaders(types)) {
+            std::printf("FAIL frame %d: expected SPS and PPS before an IDR slice\n", frame);
+            failures++;
+        }
+        if (!expectIdr && HasIdrSlice(types)) {
+            std::printf("FAIL frame %d: unexpected IDR slice\n", frame);
+            failures++;
+        }
+        if (packet.isKeyframe != expectIdr) {
+            std::printf("FAIL frame %d: keyframe flag %d, expected %d\n", frame, packet.isKeyframe, expectIdr);
+            failures++;
+        }
+    }
+
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    std::printf("software encoder: %d frames, IDR at 0 and %d\n", kFrames, kKeyframeRequestedAt);
+    return 0;
+}
@@ -0,0 +1,743 @@
+// renderer_bench: replay an H.264 capture through a headless decoder and report
+// decode throughput, per-frame latency and memory.
+//
+// The capture is a raw AVCC stream (4-byte big-endian length before each NAL
+// unit, SPS and PPS in band), such as the video SnackaCaptureLinux writes. No
+// GPU is needed: without VA-API the software decoder is used, so the tool runs
+// under Xvfb with Mesa llvmpipe.
+//
+// With --decoders, several decoders share the process-wide VA/EGL device and
+// decode the capture side by side; --churn then replaces them one at a time to
+// check that creating and destroying decoders leaks nothing.
+//
+// With --contention, threads decode on their own decoders while another thread
+// creates and destroys decoders, through the C API's handle slot table and then
+// behind a global mutex and instance list as the API used to validate handles.
+
+#include "capi.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// Largest frame the read-back buffer holds
+#define MAX_FRAME_WIDTH 4096
+#define MAX_FRAME_HEIGHT 4096
+
+typedef struct NalUnit {
+    const uint8_t* data;
+    int length;
+} NalUnit;
+
+typedef struct Options {
+    const char* path;
+    int repeat;
+    bool software;
+    int threads;
+    int threading;
+    int decoders;               // Stress mode if above 0
+    int churn;
+    int contention;             // Contention mode: decoding threads
+} Options;
+
+// A decoder of the stress mode and its position in the capture
+typedef struct StressDecoder {
+    VaDecoderHandle handle;
+    int next_nal;
+    int frames;
+} StressDecoder;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void print_usage(void) {
+    fprintf(stderr,
+        "Usage: renderer_bench [OPTIONS] <capture.h264>\n"
+        "\n"
+        "Decodes an AVCC H.264 capture without a window and reports frames per\n"
+        "second, per-frame latency percentiles and peak memory.\n"
+        "\n"
+        "OPTIONS:\n"
+        "    --repeat <n>        Replay the capture n times (default: 1)\n"
+        "    --software          Decode with libavcodec even if VA-API is available\n"
+        "    --threads <n>       Software decoding threads (default: 0, one per CPU)\n"
+        "    --frame-threading   Software frame threading instead of slice threading\n"
+        "    --decoders <n>      Stress mode: n decoders decode the capture side by side\n"
+        "                        and memory per decoder is reported\n"
+        "    --churn <n>         Then destroy and recreate a decoder n times, one at a\n"
+        "                        time, and fail if memory keeps growing\n"
+        "    --contention <n>    Contention mode: n threads decode the capture while\n"
+        "                        another creates and destroys decoders, with the handle\n"
+        "                        slot table and then a global mutex\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    memset(options, 0, sizeof(*options));
+    options->repeat = 1;
+    options->threading = VA_SOFTWARE_THREADING_SLICE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            options->repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--software") == 0) {
+            options->software = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options->threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frame-threading") == 0) {
+            options->threading = VA_SOFTWARE_THREADING_FRAME;
+        } else if (strcmp(argv[i], "--decoders") == 0 && i + 1 < argc) {
+            options->decoders = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--churn") == 0 && i + 1 < argc) {
+            options->churn = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--contention") == 0 && i + 1 < argc) {
+            options->contention = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && !options->path) {
+            options->path = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return options->path && options->repeat > 0 && options->threads >= 0 &&
+           options->decoders >= 0 && options->churn >= 0 && (options->churn == 0 || options->decoders > 0) &&
+           options->contention >= 0 && (options->contention == 0 || options->decoders == 0);
+}
+
+static uint8_t* read_file(const char* path, long* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "renderer_bench: Cannot open %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* data = (uint8_t*)malloc(*size > 0 ? *size : 1);
+    if (data && fread(data, 1, *size, file) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// Split an AVCC stream into NAL units
+static NalUnit* split_nal_units(const uint8_t* data, long size, int* count) {
+    int capacity = 1024;
+    NalUnit* units = (NalUnit*)malloc(capacity * sizeof(NalUnit));
+    *count = 0;
+
+    long offset = 0;
+    while (units && offset + 4 <= size) {
+        uint32_t length = ((uint32_t)data[offset] << 24) | ((uint32_t)data[offset + 1] << 16) |
+                          ((uint32_t)data[offset + 2] << 8) | (uint32_t)data[offset + 3];
+        offset += 4;
+        if (length == 0 || length > (uint32_t)(size - offset)) {
+            fprintf(stderr, "renderer_bench: Truncated NAL unit at byte %ld\n", offset - 4);
+            break;
+        }
+
+        if (*count == capacity) {
+            capacity *= 2;
+            NalUnit* grown = (NalUnit*)realloc(units, capacity * sizeof(NalUnit));
+            if (!grown) {
+                free(units);
+                return NULL;
+            }
+            units = grown;
+        }
+        units[*count].data = data + offset;
+        units[*count].length = (int)length;
+        (*count)++;
+        offset += length;
+    }
+    return units;
+}
+
+static const NalUnit* find_nal_unit(const NalUnit* units, int count, int type) {
+    for (int i = 0; i < count; i++) {
+        if ((units[i].data[0] & 0x1f) == type) {
+            return &units[i];
+        }
+    }
+    return NULL;
+}
+
+// Check if a NAL unit is a slice that starts a picture: first_mb_in_slice is
+// 0 (a leading 1 bit) on a picture's first slice
+static bool starts_picture(const NalUnit* nal) {
+    int type = nal->data[0] & 0x1f;
+    return (type == 1 || type == 5) && nal->length > 1 && (nal->data[1] & 0x80);
+}
+
+// Check if a slice is the last NAL unit of its access unit: the stream ends,
+// or a non-VCL NAL unit or the next picture follows
+static bool ends_access_unit(const NalUnit* units, int count, int index) {
+    if (index + 1 == count) {
+        return true;
+    }
+    int next_type = units[index + 1].data[0] & 0x1f;
+    return next_type < 1 || next_type > 5 || starts_picture(&units[index + 1]);
+}
+
+static VaDecoderHandle open_decoder(const Options* options, const NalUnit* sps, const NalUnit* pps) {
+    VaDecoderHandle decoder = va_decoder_create();
+    if (!decoder) {
+        return NULL;
+    }
+    if (!va_decoder_set_headless(decoder) ||
+        !va_decoder_configure_software(decoder, options->threads, options->threading, options->software) ||
+        !va_decoder_initialize(decoder, 0, 0, sps->data, sps->length, pps->data, pps->length)) {
+        va_decoder_destroy(decoder);
+        return NULL;
+    }
+    return decoder;
+}
+
+// Current resident memory (ru_maxrss only gives the peak)
+static long resident_kb(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    long pages = 0;
+    long resident = 0;
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(file);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, int count, double p) {
+    if (count == 0) {
+        return 0.0;
+    }
+    int index = (int)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+// Feed a stress decoder its next access unit (with any parameter sets before
+// it) and read back the frame
+// Returns false once the capture is used up
+static bool step_decoder(StressDecoder* decoder, const NalUnit* units, int count, uint8_t* frame,
+                         int frame_stride, int frame_size) {
+    while (decoder->next_nal < count) {
+        int index = decoder->next_nal++;
+        int type = units[index].data[0] & 0x1f;
+        va_decoder_decode_and_render(decoder->handle, units[index].data, units[index].length, type == 5);
+        if (type >= 1 && type <= 5 && ends_access_unit(units, count, index)) {
+            va_decoder_end_access_unit(decoder->handle);
+            if (va_decoder_read_frame(decoder->handle, frame, frame_stride, frame_size, NULL, NULL, NULL)) {
+                decoder->frames++;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stress mode: options->decoders decoders on the shared device, then
+// options->churn replacements
+static int run_stress(const Options* options, const NalUnit* units, int count,
+                      const NalUnit* sps, const NalUnit* pps) {
+    int num_decoders = options->decoders;
+    StressDecoder* decoders = (StressDecoder*)calloc(num_decoders, sizeof(StressDecoder));
+    int frame_stride = MAX_FRAME_WIDTH;
+    int frame_size = frame_stride * (MAX_FRAME_HEIGHT + MAX_FRAME_HEIGHT / 2);
+    uint8_t* frame = (uint8_t*)malloc(frame_size);
+    if (!decoders || !frame) {
+        return 1;
+    }
+    int failures = 0;
+
+    long base_kb = resident_kb();
+    double begin = now_seconds();
+    for (int i = 0; i < num_decoders; i++) {
+        decoders[i].handle = open_decoder(options, sps, pps);
+        if (!decoders[i].handle) {
+            fprintf(stderr, "renderer_bench: Failed to create headless decoder %d\n", i + 1);
+            return 1;
+        }
+    }
+    double create_ms = (now_seconds() - begin) * 1000.0 / num_decoders;
+    long created_kb = resident_kb();
+
+    // Round robin, an access unit each, so all decoders hold their surfaces
+    // and reference frames at once
+    begin = now_seconds();
+    bool active = true;
+    while (active) {
+        active = false;
+        for (int i = 0; i < num_decoders; i++) {
+            active |= step_decoder(&decoders[i], units, count, frame, frame_stride, frame_size);
+        }
+    }
+    double elapsed = now_seconds() - begin;
+    long decoded_kb = resident_kb();
+
+    int total_frames = 0;
+    for (int i = 0; i < num_decoders; i++) {
+        total_frames += decoders[i].frames;
+        if (decoders[i].frames == 0) {
+            fprintf(stderr, "renderer_bench: Decoder %d output no frames\n", i + 1);
+            failures++;
+        }
+    }
+    bool hardware = va_decoder_is_hardware_accelerated(decoders[0].handle);
+    double per_decoder_kb = (double)(decoded_kb - base_kb) / num_decoders;
+
+    // Replace one decoder at a time, so the device stays open and shared. The
+    // first replacement warms up the allocator; growth is measured after it.
+    long first_churn_kb = 0;
+    double destroy_ms = 0;
+    double recreate_ms = 0;
+    for (int c = 0; c < options->churn; c++) {
+        StressDecoder* decoder = &decoders[c % num_decoders];
+        double t = now_seconds();
+        va_decoder_destroy(decoder->handle);
+        destroy_ms += (now_seconds() - t) * 1000.0;
+
+        t = now_seconds();
+        memset(decoder, 0, sizeof(*decoder));
+        decoder->handle = open_decoder(options, sps, pps);
+        recreate_ms += (now_seconds() - t) * 1000.0;
+        if (!decoder->handle) {
+            fprintf(stderr, "renderer_bench: Failed to recreate a decoder (cycle %d)\n", c + 1);
+            return 1;
+        }
+        while (step_decoder(decoder, units, count, frame, frame_stride, frame_size)) {
+        }
+        if (decoder->frames == 0) {
+            fprintf(stderr, "renderer_bench: Recreated decoder output no frames (cycle %d)\n", c + 1);
+            failures++;
+        }
+        if (c == 0) {
+            first_churn_kb = resident_kb();
+        }
+    }
+    long churned_kb = resident_kb();
+
+    for (int i = 0; i < num_decoders; i++) {
+        va_decoder_destroy(decoders[i].handle);
+    }
+    long destroyed_kb = resident_kb();
+
+    printf("\n");
+    printf("Decoder:       %s, %d sharing one device\n", hardware ? "VA-API" : "software (libavcodec)",
+           num_decoders);
+    printf("Frames:        %d read back in %.3f s (%.1f fps in total)\n",
+           total_frames, elapsed, elapsed > 0 ? total_frames / elapsed : 0.0);
+    printf("Create:        %.2f ms per decoder\n", create_ms);
+    printf("Memory (MB):   %.1f before, %.1f created, %.1f decoding, %.1f destroyed\n",
+           base_kb / 1024.0, created_kb / 1024.0, decoded_kb / 1024.0, destroyed_kb / 1024.0);
+    printf("Per decoder:   %.1f MB resident while decoding\n", per_decoder_kb / 1024.0);
+    if (options->churn > 0) {
+        long growth_kb = churned_kb - first_churn_kb;
+        printf("Churn:         %d replacements, %.2f ms destroy, %.2f ms create, %+.1f MB after the first\n",
+               options->churn, destroy_ms / options->churn, recreate_ms / options->churn,
+               growth_kb / 1024.0);
+        // A leak grows with the replacements; allocator noise stays within a
+        // megabyte plus half a decoder's memory
+        if (options->churn > 1 && growth_kb > 1024 + per_decoder_kb / 2) {
+            fprintf(stderr, "renderer_bench: Memory grew by %.1f MB over %d replacements\n",
+                    growth_kb / 1024.0, options->churn - 1);
+            failures++;
+        }
+    }
+
+    free(frame);
+    free(decoders);
+    return failures > 0 ? 1 : 0;
+}
+
+// The C API before the slot table: a list of live handles, walked under a
+// global mutex to validate the handle of every call
+typedef struct HandleNode {
+    VaDecoderHandle handle;
+    struct HandleNode* next;
+} HandleNode;
+
+// State shared by the threads of the contention mode
+typedef struct Contention {
+    const Options* options;
+    const NalUnit* units;
+    int count;
+    const NalUnit* sps;
+    const NalUnit* pps;
+    bool global_mutex;          // Validate handles as the API used to
+    pthread_mutex_t mutex;
+    HandleNode* handles;
+    VaDecoderHandle _Atomic churn_handle; // The churning thread's current decoder
+    atomic_bool stop;
+    int churn_cycles;
+    int stale_calls;            // Calls with a destroyed handle, all rejected
+} Contention;
+
+typedef struct ContentionWorker {
+    pthread_t thread;
+    Contention* contention;
+    VaDecoderHandle decoder;
+    double* latencies;          // Per decode call, in microseconds
+    int num_latencies;
+    int stats_calls;
+    int stats_rejected;
+} ContentionWorker;
+
+static void add_handle(Contention* contention, VaDecoderHandle handle) {
+    HandleNode* node = (HandleNode*)malloc(sizeof(HandleNode));
+    if (!node) {
+        return;
+    }
+    pthread_mutex_lock(&contention->mutex);
+    node->handle = handle;
+    node->next = contention->handles;
+    contention->handles = node;
+    pthread_mutex_unlock(&contention->mutex);
+}
+
+static void remove_handle(Contention* contention, VaDecoderHandle handle) {
+    pthread_mutex_lock(&contention->mutex);
+    for (HandleNode** pp = &contention->handles; *pp; pp = &(*pp)->next) {
+        if ((*pp)->handle == handle) {
+            HandleNode* node = *pp;
+            *pp = node->next;
+            free(node);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&contention->mutex);
+}
+
+// Validate a handle before a call, in global mutex mode
+static bool check_handle(Contention* contention, VaDecoderHandle handle) {
+    if (!contention->global_mutex) {
+        return true;
+    }
+    pthread_mutex_lock(&contention->mutex);
+    HandleNode* node = contention->handles;
+    while (node && node->handle != handle) {
+        node = node->next;
+    }
+    pthread_mutex_unlock(&contention->mutex);
+    return node != NULL;
+}
+
+static void* contention_decode_thread(void* arg) {
+    ContentionWorker* worker = (ContentionWorker*)arg;
+    Contention* contention = worker->contention;
+    const NalUnit* units = contention->units;
+    int count = contention->count;
+    int frame_stride = MAX_FRAME_WIDTH;
+    int frame_size = frame_stride * (MAX_FRAME_HEIGHT + MAX_FRAME_HEIGHT / 2);
+    uint8_t* frame = (uint8_t*)malloc(frame_size);
+    if (!frame) {
+        return NULL;
+    }
+
+    for (int pass = 0; pass < contention->options->repeat; pass++) {
+        for (int i = 0; i < count; i++) {
+            int type = units[i].data[0] & 0x1f;
+            double start = now_seconds();
+            if (check_handle(contention, worker->decoder)) {
+                va_decoder_decode_and_render(worker->decoder, units[i].data, units[i].length, type == 5);
+            }
+            worker->latencies[worker->num_latencies++] = (now_seconds() - start) * 1e6;
+
+            if (type >= 1 && type <= 5 && ends_access_unit(units, count, i)) {
+                if (check_handle(contention, worker->decoder)) {
+                    va_decoder_end_access_unit(worker->decoder);
+                }
+                if (check_handle(contention, worker->decoder)) {
+                    va_decoder_read_frame(worker->decoder, frame, frame_stride, frame_size, NULL, NULL, NULL);
+                }
+
+                // Poll the decoder being churned, as a UI polling statistics
+                // of a stream that is going away would
+                VaDecoderHandle other = atomic_load(&contention->churn_handle);
+                if (other) {
+                    VaDecoderStats stats;
+                    worker->stats_calls++;
+                    if (!check_handle(contention, other) || !va_decoder_get_stats(other, &stats)) {
+                        worker->stats_rejected++;
+                    }
+                }
+            }
+        }
+    }
+
+    free(frame);
+    return NULL;
+}
+
+static void* contention_churn_thread(void* arg) {
+    Contention* contention = (Contention*)arg;
+    while (!atomic_load(&contention->stop)) {
+        VaDecoderHandle decoder = open_decoder(contention->options, contention->sps, contention->pps);
+        if (!decoder) {
+            break;
+        }
+        add_handle(contention, decoder);
+        atomic_store(&contention->churn_handle, decoder);
+        sched_yield();
+
+        // Destroyed with the handle still published: calls with it must
+        // fail rather than touch the freed decoder
+        remove_handle(contention, decoder);
+        va_decoder_destroy(decoder);
+        VaDecoderStats stats;
+        if (!va_decoder_get_stats(decoder, &stats)) {
+            contention->stale_calls++;
+        }
+        atomic_store(&contention->churn_handle, NULL);
+        contention->churn_cycles++;
+    }
+    return NULL;
+}
+
+// One contention run; prints a row of results
+// Returns the number of failures
+static int run_contention_mode(Contention* contention) {
+    int num_workers = contention->options->contention;
+    int calls_per_worker = contention->count * contention->options->repeat;
+    ContentionWorker* workers = (ContentionWorker*)calloc(num_workers, sizeof(ContentionWorker));
+    if (!workers) {
+        return 1;
+    }
+    contention->handles = NULL;
+    contention->churn_cycles = 0;
+    contention->stale_calls = 0;
+    atomic_store(&contention->churn_handle, NULL);
+    atomic_store(&contention->stop, false);
+
+    int failures = 0;
+    for (int i = 0; i < num_workers && failures == 0; i++) {
+        workers[i].contention = contention;
+        workers[i].decoder = open_decoder(contention->options, contention->sps, contention->pps);
+        workers[i].latencies = (double*)malloc(calls_per_worker * sizeof(double));
+        if (!workers[i].decoder || !workers[i].latencies) {
+            fprintf(stderr, "renderer_bench: Failed to create headless decoder %d\n", i + 1);
+            failures++;
+            break;
+        }
+        add_handle(contention, workers[i].decoder);
+    }
+
+    pthread_t churn;
+    double begin = now_seconds();
+    int started = 0;
+    if (failures == 0 && pthread_create(&churn, NULL, contention_churn_thread, contention) == 0) {
+        while (started < num_workers &&
+               pthread_create(&workers[started].thread, NULL, contention_decode_thread, &workers[started]) == 0) {
+            started++;
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        atomic_store(&contention->stop, true);
+        pthread_join(churn, NULL);
+        failures += started < num_workers;
+    }
+    double elapsed = now_seconds() - begin;
+
+    int total_calls = 0;
+    int stats_calls = 0;
+    int stats_rejected = 0;
+    for (int i = 0; i < num_workers; i++) {
+        total_calls += workers[i].num_latencies;
+        stats_calls += workers[i].stats_calls;
+        stats_rejected += workers[i].stats_rejected;
+    }
+    double* latencies = (double*)malloc((total_calls > 0 ? total_calls : 1) * sizeof(double));
+    int num_latencies = 0;
+    for (int i = 0; latencies && i < num_workers; i++) {
+        memcpy(latencies + num_latencies, workers[i].latencies, workers[i].num_latencies * sizeof(double));
+        num_latencies += workers[i].num_latencies;
+    }
+    if (latencies) {
+        qsort(latencies, num_latencies, sizeof(double), compare_doubles);
+    }
+
+    printf("%-13s  %9.0f  %8.1f  %8.1f  %8.1f  %8.0f  %d/%d\n",
+           contention->global_mutex ? "global mutex" : "slot table",
+           elapsed > 0 ? total_calls / elapsed : 0.0,
+           latencies ? percentile(latencies, num_latencies, 50) : 0.0,
+           latencies ? percentile(latencies, num_latencies, 99) : 0.0,
+           latencies && num_latencies ? latencies[num_latencies - 1] : 0.0,
+           elapsed > 0 ? contention->churn_cycles / elapsed : 0.0,
+           stats_rejected, stats_calls);
+    if (contention->stale_calls != contention->churn_cycles) {
+        fprintf(stderr, "renderer_bench: %d calls with a destroyed handle were accepted\n",
+                contention->churn_cycles - contention->stale_calls);
+        failures++;
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        if (workers[i].decoder) {
+            remove_handle(contention, workers[i].decoder);
+            va_decoder_destroy(workers[i].decoder);
+        }
+        free(workers[i].latencies);
+    }
+    free(latencies);
+    free(workers);
+    return failures;
+}
+
+// Contention mode: the same load with the slot table, then with a global mutex
+static int run_contention(const Options* options, const NalUnit* units, int count,
+                          const NalUnit* sps, const NalUnit* pps) {
+    Contention contention;
+    memset(&contention, 0, sizeof(contention));
+    contention.options = options;
+    contention.units = units;
+    contention.count = count;
+    contention.sps = sps;
+    contention.pps = pps;
+    pthread_mutex_init(&contention.mutex, NULL);
+
+    printf("\n");
+    printf("%d decoding threads, %d NAL units x %d passes each, one thread creating and destroying\n",
+           options->contention, count, options->repeat);
+    printf("%-13s  %9s  %8s  %8s  %8s  %8s  %s\n",
+           "Handles", "calls/s", "p50 us", "p99 us", "max us", "churn/s", "polls rejected");
+
+    int failures = 0;
+    contention.global_mutex = false;
+    failures += run_contention_mode(&contention);
+    contention.global_mutex = true;
+    failures += run_contention_mode(&contention);
+
+    pthread_mutex_destroy(&contention.mutex);
+    return failures > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage();
+        return 1;
+    }
+
+    long size;
+    uint8_t* data = read_file(options.path, &size);
+    if (!data) {
+        return 1;
+    }
+
+    int count;
+    NalUnit* units = split_nal_units(data, size, &count);
+    const NalUnit* sps = units ? find_nal_unit(units, count, 7) : NULL;
+    const NalUnit* pps = units ? find_nal_unit(units, count, 8) : NULL;
+    if (!sps || !pps) {
+        fprintf(stderr, "renderer_bench: No SPS/PPS in %s\n", options.path);
+        return 1;
+    }
+
+    if (options.decoders > 0 || options.contention > 0) {
+        int result = options.decoders > 0 ? run_stress(&options, units, count, sps, pps)
+                                          : run_contention(&options, units, count, sps, pps);
+        free(units);
+        free(data);
+        return result;
+    }
+
+    VaDecoderHandle decoder = open_decoder(&options, sps, pps);
+    if (!decoder) {
+        fprintf(stderr, "renderer_bench: Failed to create a headless decoder\n");
+        return 1;
+    }
+
+    int frame_stride = MAX_FRAME_WIDTH;
+    int frame_size = frame_stride * (MAX_FRAME_HEIGHT + MAX_FRAME_HEIGHT / 2);
+    uint8_t* frame = (uint8_t*)malloc(frame_size);
+
+    // Start times of pictures waiting for output (first slice fed to output read)
+    int max_latencies = count * options.repeat;
+    double* latencies = (double*)malloc(max_latencies * sizeof(double));
+    double* starts = (double*)malloc(max_latencies * sizeof(double));
+    if (!frame || !latencies || !starts) {
+        return 1;
+    }
+    int num_latencies = 0;
+    int num_starts = 0;
+    int next_start = 0;
+    int nals_rejected = 0;
+    int width = 0;
+    int height = 0;
+
+    double begin = now_seconds();
+    for (int pass = 0; pass < options.repeat; pass++) {
+        for (int i = 0; i < count; i++) {
+            const NalUnit* nal = &units[i];
+            int type = nal->data[0] & 0x1f;
+
+            if (starts_picture(nal)) {
+                starts[num_starts++] = now_seconds();
+            }
+
+            if (!va_decoder_decode_and_render(decoder, nal->data, nal->length, type == 5)) {
+                nals_rejected++;
+            }
+
+            // As a receiver that gets whole frames would
+            if (type >= 1 && type <= 5 && ends_access_unit(units, count, i)) {
+                va_decoder_end_access_unit(decoder);
+            }
+
+            // Output order matches decode order for the low-latency streams
+            // this is meant for
+            if (va_decoder_read_frame(decoder, frame, frame_stride, frame_size, &width, &height, NULL) &&
+                next_start < num_starts) {
+                latencies[num_latencies++] = (now_seconds() - starts[next_start++]) * 1000.0;
+            }
+        }
+    }
+    double elapsed = now_seconds() - begin;
+
+    VaDecoderStats stats;
+    va_decoder_get_stats(decoder, &stats);
+    bool hardware = va_decoder_is_hardware_accelerated(decoder);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    qsort(latencies, num_latencies, sizeof(double), compare_doubles);
+
+    printf("\n");
+    printf("Decoder:       %s\n", hardware ? "VA-API" : "software (libavcodec)");
+    printf("Stream:        %dx%d, %d NAL units x %d passes (%d rejected)\n",
+           width, height, count, options.repeat, nals_rejected);
+    printf("Frames:        %llu decoded, %d read back in %.3f s\n",
+           (unsigned long long)stats.framesDecoded, num_latencies, elapsed);
+    printf("Throughput:    %.1f fps\n", elapsed > 0 ? num_latencies / elapsed : 0.0);
+    printf("Latency (ms):  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+           percentile(latencies, num_latencies, 50),
+           percentile(latencies, num_latencies, 90),
+           percentile(latencies, num_latencies, 99),
+           num_latencies ? latencies[num_latencies - 1] : 0.0);
+    printf("Peak memory:   %.1f MB resident\n", usage.ru_maxrss / 1024.0);
+
+    va_decoder_destroy(decoder);
+    free(starts);
+    free(latencies);
+    free(frame);
+    free(units);
+    free(data);
+    return num_latencies > 0 ? 0 : 1;
+}
@@ -1,76 +1,162 @@
 #include "capi.h"
 #include "vaapi_decoder.h"
-#include <stdlib.h>
+#include "gallery_compositor.h"
+#include <stdio.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <sched.h>
 
-// Simple linked list for instance tracking
-typedef struct InstanceNode {
-    VaDecoderHandle handle;
-    VaapiDecoder* decoder;
-    struct InstanceNode* next;
-} InstanceNode;
+// Handles index a fixed slot table. Each slot's state packs a generation
+// (bumped on destroy) with the number of API calls using the object, so a call
+// validates its handle with one compare-and-swap and no lock. Destroy retires
+// the generation, then waits for calls in flight before freeing the object.
+// Handle bits: generation << 32 | (slot index + 1)
+#define MAX_INSTANCES 1024
 
-static InstanceNode* s_instances = NULL;
+_Static_assert(sizeof(void*) >= sizeof(uint64_t), "handles need 64-bit pointers");
+
+typedef struct InstanceSlot {
+    _Atomic uint64_t state;         // Generation << 32 | calls in flight
+    void* _Atomic object;
+    int next_free;                  // Index + 1, or 0 at the end of the list
+} InstanceSlot;
+
+typedef struct InstanceTable {
+    InstanceSlot slots[MAX_INSTANCES];
+    int free_head;                  // Index + 1 of the first free slot, or 0
+    int used;                       // Slots handed out at least once
+} InstanceTable;
+
+static InstanceTable s_decoders;
+static InstanceTable s_galleries;
+
+// Serializes create and destroy only
 static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static VaapiDecoder* find_decoder(VaDecoderHandle handle) {
-    InstanceNode* node = s_instances;
-    while (node) {
-        if (node->handle == handle) {
-            return node->decoder;
-        }
-        node = node->next;
+static void* add_instance(InstanceTable* table, void* object) {
+    pthread_mutex_lock(&s_mutex);
+    int index;
+    if (table->free_head) {
+        index = table->free_head - 1;
+        table->free_head = table->slots[index].next_free;
+    } else if (table->used < MAX_INSTANCES) {
+        index = table->used++;
+    } else {
+        pthread_mutex_unlock(&s_mutex);
+        fprintf(stderr, "SnackaLinuxRenderer: Too many instances\n");
+        return NULL;
     }
-    return NULL;
-}
 
-static void add_instance(VaDecoderHandle handle, VaapiDecoder* decoder) {
-    InstanceNode* node = (InstanceNode*)malloc(sizeof(InstanceNode));
-    if (!node) return;
+    InstanceSlot* slot = &table->slots[index];
+    atomic_store_explicit(&slot->object, object, memory_order_release);
+    uint64_t generation = atomic_load_explicit(&slot->state, memory_order_relaxed) >> 32;
+    pthread_mutex_unlock(&s_mutex);
+
+    return (void*)(uintptr_t)((generation << 32) | (uint64_t)(index + 1));
+}
 
-    node->handle = handle;
-    node->decoder = decoder;
-    node->next = s_instances;
-    s_instances = node;
+static InstanceSlot* find_slot(InstanceTable* table, void* handle, uint32_t* generation) {
+    uint64_t value = (uint64_t)(uintptr_t)handle;
+    uint64_t index = (value & 0xffffffffu) - 1;
+    if (index >= MAX_INSTANCES) {
+        return NULL;
+    }
+    *generation = (uint32_t)(value >> 32);
+    return &table->slots[index];
 }
 
-static VaapiDecoder* remove_instance(VaDecoderHandle handle) {
-    InstanceNode** pp = &s_instances;
-    while (*pp) {
-        if ((*pp)->handle == handle) {
-            InstanceNode* node = *pp;
-            VaapiDecoder* decoder = node->decoder;
-            *pp = node->next;
-            free(node);
-            return decoder;
+// Validate a handle and hold its object until release_instance
+// Returns: The object, or NULL if the handle is stale or invalid
+static void* acquire_instance(InstanceTable* table, void* handle, InstanceSlot** out_slot) {
+    uint32_t generation;
+    InstanceSlot* slot = find_slot(table, handle, &generation);
+    if (!slot) {
+        return NULL;
+    }
+
+    uint64_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    do {
+        if ((uint32_t)(state >> 32) != generation) {
+            return NULL;
         }
-        pp = &(*pp)->next;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &slot->state, &state, state + 1, memory_order_acquire, memory_order_relaxed));
+
+    // Slots that were never created have no object
+    void* object = atomic_load_explicit(&slot->object, memory_order_acquire);
+    if (!object) {
+        atomic_fetch_sub_explicit(&slot->state, 1, memory_order_release);
+        return NULL;
     }
-    return NULL;
+
+    *out_slot = slot;
+    return object;
 }
 
-SNACKA_API VaDecoderHandle va_decoder_create(void) {
-    VaapiDecoder* decoder = vaapi_decoder_create();
-    if (!decoder) {
+static void release_instance(InstanceSlot* slot) {
+    atomic_fetch_sub_explicit(&slot->state, 1, memory_order_release);
+}
+
+// Invalidate a handle and wait until no call uses its object
+// Returns: The object to destroy, or NULL if the handle is stale or invalid
+static void* retire_instance(InstanceTable* table, void* handle, int* out_index) {
+    uint32_t generation;
+    InstanceSlot* slot = find_slot(table, handle, &generation);
+    if (!slot) {
         return NULL;
     }
 
+    // Generations only change under the lock
     pthread_mutex_lock(&s_mutex);
-    add_instance(decoder, decoder);
+    uint64_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    void* object = atomic_load_explicit(&slot->object, memory_order_relaxed);
+    if ((uint32_t)(state >> 32) != generation || !object) {
+        pthread_mutex_unlock(&s_mutex);
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&slot->state, (uint64_t)1 << 32, memory_order_relaxed);
     pthread_mutex_unlock(&s_mutex);
 
-    return decoder;
-}
+    // New calls now fail validation; let the ones in flight finish
+    while ((atomic_load_explicit(&slot->state, memory_order_acquire) & 0xffffffffu) != 0) {
+        sched_yield();
+    }
 
-SNACKA_API void va_decoder_destroy(VaDecoderHandle handle) {
-    if (!handle) return;
+    *out_index = (int)(slot - table->slots);
+    return object;
+}
 
+// Return a retired slot once its object is destroyed
+static void free_instance(InstanceTable* table, int index) {
     pthread_mutex_lock(&s_mutex);
-    VaapiDecoder* decoder = remove_instance(handle);
+    InstanceSlot* slot = &table->slots[index];
+    atomic_store_explicit(&slot->object, NULL, memory_order_relaxed);
+    slot->next_free = table->free_head;
+    table->free_head = index + 1;
     pthread_mutex_unlock(&s_mutex);
+}
+
+SNACKA_API VaDecoderHandle va_decoder_create(void) {
+    VaapiDecoder* decoder = vaapi_decoder_create();
+    if (!decoder) {
+        return NULL;
+    }
 
+    VaDecoderHandle handle = add_instance(&s_decoders, decoder);
+    if (!handle) {
+        vaapi_decoder_destroy(decoder);
+    }
+    return handle;
+}
+
+SNACKA_API void va_decoder_destroy(VaDecoderHandle handle) {
+    if (!handle) return;
+
+    int index;
+    VaapiDecoder* decoder = retire_instance(&s_decoders, handle, &index);
     if (decoder) {
         vaapi_decoder_destroy(decoder);
+        free_instance(&s_decoders, index);
     }
 }
 
@@ -85,13 +171,13 @@ SNACKA_API bool va_decoder_initialize(
 ) {
     if (!handle) return false;
 
-    pthread_mutex_lock(&s_mutex);
-    VaapiDecoder* decoder = find_decoder(handle);
-    pthread_mutex_unlock(&s_mutex);
-
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
     if (!decoder) return false;
 
-    return vaapi_decoder_initialize(decoder, width, height, spsData, spsLength, ppsData, ppsLength);
+    bool result = vaapi_decoder_initialize(decoder, width, height, spsData, spsLength, ppsData, ppsLength);
+    release_instance(slot);
+    return result;
 }
 
 SNACKA_API bool va_decoder_decode_and_render(
@@ -102,25 +188,169 @@ SNACKA_API bool va_decoder_decode_and_render(
 ) {
     if (!handle) return false;
 
-    pthread_mutex_lock(&s_mutex);
-    VaapiDecoder* decoder = find_decoder(handle);
-    pthread_mutex_unlock(&s_mutex);
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_decode_and_render(decoder, nalData, nalLength, isKeyframe);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_end_access_unit(VaDecoderHandle handle) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_end_access_unit(decoder);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_decode_and_render_timed(
+    VaDecoderHandle handle,
+    const uint8_t* nalData,
+    int nalLength,
+    bool isKeyframe,
+    int64_t captureTimeUs
+) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_decode_and_render_timed(decoder, nalData, nalLength, isKeyframe, captureTimeUs);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_set_presentation(VaDecoderHandle handle, int targetLatencyMs) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_set_presentation(decoder, targetLatencyMs);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_configure_software(
+    VaDecoderHandle handle,
+    int threadCount,
+    int threading,
+    bool forceSoftware
+) {
+    if (!handle) return false;
 
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
     if (!decoder) return false;
 
-    return vaapi_decoder_decode_and_render(decoder, nalData, nalLength, isKeyframe);
+    bool result = vaapi_decoder_configure_software(decoder, threadCount, threading, forceSoftware);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_is_hardware_accelerated(VaDecoderHandle handle) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_is_hardware(decoder);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_start_async(VaDecoderHandle handle, int queueCapacity) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_start_async(decoder, queueCapacity);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_get_stats(VaDecoderHandle handle, VaDecoderStats* stats) {
+    if (!handle || !stats) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    VaapiDecoderStats native;
+    vaapi_decoder_get_stats(decoder, &native);
+    release_instance(slot);
+
+    stats->queueDepth = native.queue_depth;
+    stats->maxQueueDepth = native.max_queue_depth;
+    stats->nalsQueued = native.nals_queued;
+    stats->nalsDropped = native.nals_dropped;
+    stats->resyncs = native.resyncs;
+    stats->framesDecoded = native.frames_decoded;
+    stats->framesPresented = native.frames_presented;
+    stats->framesSkipped = native.frames_skipped;
+    stats->displayLatencyUs = native.timing.last_latency_us;
+    stats->averageDisplayLatencyUs = native.timing.average_latency_us;
+    stats->maxDisplayLatencyUs = native.timing.max_latency_us;
+    stats->vsyncPeriodUs = native.timing.vsync_period_us;
+    stats->framesTimed = native.timing.frames_timed;
+    stats->framesLate = native.timing.frames_late;
+    stats->vsyncsMissed = native.timing.vsyncs_missed;
+    return true;
+}
+
+SNACKA_API bool va_decoder_set_headless(VaDecoderHandle handle) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_set_headless(decoder);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API bool va_decoder_read_frame(
+    VaDecoderHandle handle,
+    uint8_t* buffer,
+    int stride,
+    int bufferSize,
+    int* width,
+    int* height,
+    int64_t* captureTimeUs
+) {
+    if (!handle) return false;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    bool result = vaapi_decoder_read_frame(decoder, buffer, stride, bufferSize, width, height, captureTimeUs);
+    release_instance(slot);
+    return result;
 }
 
 SNACKA_API void* va_decoder_get_view(VaDecoderHandle handle) {
     if (!handle) return NULL;
 
-    pthread_mutex_lock(&s_mutex);
-    VaapiDecoder* decoder = find_decoder(handle);
-    pthread_mutex_unlock(&s_mutex);
-
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
     if (!decoder) return NULL;
 
-    return vaapi_decoder_get_view(decoder);
+    void* result = vaapi_decoder_get_view(decoder);
+    release_instance(slot);
+    return result;
 }
 
 SNACKA_API void va_decoder_set_display_size(
@@ -130,13 +360,101 @@ SNACKA_API void va_decoder_set_display_size(
 ) {
     if (!handle) return;
 
-    pthread_mutex_lock(&s_mutex);
-    VaapiDecoder* decoder = find_decoder(handle);
-    pthread_mutex_unlock(&s_mutex);
-
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
     if (!decoder) return;
 
     vaapi_decoder_set_display_size(decoder, width, height);
+    release_instance(slot);
+}
+
+SNACKA_API VaGalleryHandle va_gallery_create(int width, int height) {
+    GalleryCompositor* gallery = gallery_compositor_create(width, height);
+    if (!gallery) {
+        return NULL;
+    }
+
+    VaGalleryHandle handle = add_instance(&s_galleries, gallery);
+    if (!handle) {
+        gallery_compositor_release(gallery);
+    }
+    return handle;
+}
+
+SNACKA_API void va_gallery_destroy(VaGalleryHandle handle) {
+    if (!handle) return;
+
+    int index;
+    GalleryCompositor* gallery = retire_instance(&s_galleries, handle, &index);
+    if (gallery) {
+        gallery_compositor_release(gallery);
+        free_instance(&s_galleries, index);
+    }
+}
+
+SNACKA_API void* va_gallery_get_view(VaGalleryHandle handle) {
+    if (!handle) return NULL;
+
+    InstanceSlot* slot;
+    GalleryCompositor* gallery = acquire_instance(&s_galleries, handle, &slot);
+    if (!gallery) return NULL;
+
+    void* result = gallery_compositor_get_view(gallery);
+    release_instance(slot);
+    return result;
+}
+
+SNACKA_API void va_gallery_set_display_size(
+    VaGalleryHandle handle,
+    int width,
+    int height
+) {
+    if (!handle) return;
+
+    InstanceSlot* slot;
+    GalleryCompositor* gallery = acquire_instance(&s_galleries, handle, &slot);
+    if (!gallery) return;
+
+    gallery_compositor_set_display_size(gallery, width, height);
+    release_instance(slot);
+}
+
+SNACKA_API bool va_decoder_attach_gallery(VaDecoderHandle handle, VaGalleryHandle galleryHandle) {
+    if (!handle || !galleryHandle) return false;
+
+    // Holding both slots keeps the gallery alive until the decoder has taken
+    // its own reference
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return false;
+
+    InstanceSlot* gallery_slot;
+    GalleryCompositor* gallery = acquire_instance(&s_galleries, galleryHandle, &gallery_slot);
+    bool attached = false;
+    if (gallery) {
+        attached = vaapi_decoder_use_gallery(decoder, gallery);
+        release_instance(gallery_slot);
+    }
+
+    release_instance(slot);
+    return attached;
+}
+
+SNACKA_API void va_decoder_set_tile(
+    VaDecoderHandle handle,
+    int x,
+    int y,
+    int width,
+    int height
+) {
+    if (!handle) return;
+
+    InstanceSlot* slot;
+    VaapiDecoder* decoder = acquire_instance(&s_decoders, handle, &slot);
+    if (!decoder) return;
+
+    vaapi_decoder_set_tile(decoder, x, y, width, height);
+    release_instance(slot);
 }
 
 SNACKA_API bool va_decoder_is_available(void) {
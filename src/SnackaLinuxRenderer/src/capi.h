@@ -38,9 +38,12 @@ SNACKA_API bool va_decoder_initialize(
 );
 
 // Decode an H264 NAL unit and render to the display surface
-// nalData: NAL unit bytes (without Annex B start code)
+// nalData: NAL unit bytes (without Annex B start code). Slices of a picture are
+// passed one per call; SPS/PPS units update the parameter sets.
 // isKeyframe: true if this is an IDR frame
-// Returns: true on successful decode and render
+// Returns: true if the NAL unit was accepted (a picture is rendered in output
+// order once the next picture starts, or at an access unit delimiter or
+// va_decoder_end_access_unit)
 SNACKA_API bool va_decoder_decode_and_render(
     VaDecoderHandle decoder,
     const uint8_t* nalData,
@@ -48,6 +51,111 @@ SNACKA_API bool va_decoder_decode_and_render(
     bool isKeyframe
 );
 
+// Mark the end of an access unit: every NAL unit of the frame was passed, so
+// its picture is decoded without waiting for the first slice of the next one
+// Returns: true on success
+SNACKA_API bool va_decoder_end_access_unit(VaDecoderHandle decoder);
+
+// Like va_decoder_decode_and_render, with the time the frame was captured
+// captureTimeUs: capture time in microseconds on the sender's clock (any
+// origin; negative if unknown). Used to schedule presentation and measure
+// display latency.
+SNACKA_API bool va_decoder_decode_and_render_timed(
+    VaDecoderHandle decoder,
+    const uint8_t* nalData,
+    int nalLength,
+    bool isKeyframe,
+    int64_t captureTimeUs
+);
+
+// Schedule presentation (needs capture times and the worker thread). Frames
+// are held until targetLatencyMs after the earliest they could have arrived
+// and shown once per vsync, so network jitter does not become judder.
+// targetLatencyMs: jitter buffer delay (0 shows frames as soon as they are decoded)
+// Returns: true on success
+SNACKA_API bool va_decoder_set_presentation(VaDecoderHandle decoder, int targetLatencyMs);
+
+// Threading of the software decoder (see va_decoder_configure_software)
+typedef enum VaSoftwareThreading {
+    VA_SOFTWARE_THREADING_SLICE = 0,    // Slices of a picture in parallel (no added latency)
+    VA_SOFTWARE_THREADING_FRAME = 1,    // Pictures in parallel (a frame of latency per thread)
+    VA_SOFTWARE_THREADING_BOTH = 2,
+} VaSoftwareThreading;
+
+// Configure software decoding, used when VA-API cannot decode H264
+// Call before va_decoder_initialize.
+// threadCount: decoding threads (0 for one per CPU)
+// threading: VaSoftwareThreading
+// forceSoftware: decode in software even if VA-API is available
+// Returns: true on success
+SNACKA_API bool va_decoder_configure_software(
+    VaDecoderHandle decoder,
+    int threadCount,
+    int threading,
+    bool forceSoftware
+);
+
+// Check if an initialized decoder uses VA-API
+// Returns: false for software decoding
+SNACKA_API bool va_decoder_is_hardware_accelerated(VaDecoderHandle decoder);
+
+// Decoder counters (see va_decoder_get_stats)
+typedef struct VaDecoderStats {
+    uint32_t queueDepth;        // NAL units waiting for the decode thread
+    uint32_t maxQueueDepth;
+    uint64_t nalsQueued;
+    uint64_t nalsDropped;       // Rejected (queue full, waiting for an IDR) or skipped for an IDR
+    uint64_t resyncs;           // Queue overflows that dropped input up to an IDR
+    uint64_t framesDecoded;
+    uint64_t framesPresented;
+    uint64_t framesSkipped;     // Replaced by a newer frame before they were presented
+    // Display latency of frames with capture times: from the earliest the
+    // frame could have arrived (the fastest transit seen) to the screen
+    int64_t displayLatencyUs;   // Latest frame
+    int64_t averageDisplayLatencyUs;
+    int64_t maxDisplayLatencyUs;
+    int64_t vsyncPeriodUs;      // Measured refresh period (60 Hz until known)
+    uint64_t framesTimed;
+    uint64_t framesLate;        // Shown one or more refreshes after they were due
+    uint64_t vsyncsMissed;      // Refreshes missed by late frames in total
+} VaDecoderStats;
+
+// Decode and present on a worker thread (call after va_decoder_initialize).
+// Afterwards va_decoder_decode_and_render only queues the NAL unit and returns
+// false if it was dropped; when the queue overflows, input is dropped until
+// the next IDR frame.
+// queueCapacity: NAL units that may wait (0 for the default)
+// Returns: true if the worker thread started
+SNACKA_API bool va_decoder_start_async(VaDecoderHandle decoder, int queueCapacity);
+
+// Get a snapshot of the decoder counters
+// Returns: true on success
+SNACKA_API bool va_decoder_get_stats(VaDecoderHandle decoder, VaDecoderStats* stats);
+
+// Decode without a window (call before va_decoder_initialize), e.g. for tests
+// and benchmarks. Frames are not shown; read them with va_decoder_read_frame.
+// Headless decoders decode synchronously (va_decoder_start_async fails).
+// Returns: true on success
+SNACKA_API bool va_decoder_set_headless(VaDecoderHandle decoder);
+
+// Copy the latest decoded frame of a headless decoder as NV12
+// buffer: receives the Y plane (height rows of stride bytes), then the
+// interleaved UV plane ((height + 1) / 2 rows of stride bytes)
+// stride: bytes per row (at least the frame width rounded up to even)
+// bufferSize: size of buffer in bytes
+// width, height, captureTimeUs: receive the frame's size and capture time
+// (may be NULL)
+// Returns: true if a frame that was not read before was copied
+SNACKA_API bool va_decoder_read_frame(
+    VaDecoderHandle decoder,
+    uint8_t* buffer,
+    int stride,
+    int bufferSize,
+    int* width,
+    int* height,
+    int64_t* captureTimeUs
+);
+
 // Get the native window handle for embedding
 // Returns: X11 Window ID (XID) as pointer-sized integer
 SNACKA_API void* va_decoder_get_view(VaDecoderHandle decoder);
@@ -59,7 +167,46 @@ SNACKA_API void va_decoder_set_display_size(
     int height
 );
 
-// Check if VA-API H264 decoding is available
+// Opaque handle to a gallery: one window compositing many decoders
+typedef void* VaGalleryHandle;
+
+// Create a gallery window. Its tiles are drawn in one pass with one swap per
+// vsync.
+// Returns: Handle to gallery, or NULL on failure
+SNACKA_API VaGalleryHandle va_gallery_create(int width, int height);
+
+// Destroy a gallery (its window stays until attached decoders are destroyed)
+SNACKA_API void va_gallery_destroy(VaGalleryHandle gallery);
+
+// Get the gallery's native window handle for embedding
+// Returns: X11 Window ID (XID) as pointer-sized integer
+SNACKA_API void* va_gallery_get_view(VaGalleryHandle gallery);
+
+// Set the gallery window size
+SNACKA_API void va_gallery_set_display_size(
+    VaGalleryHandle gallery,
+    int width,
+    int height
+);
+
+// Show a decoder as a tile of a gallery instead of in its own window
+// Call before va_decoder_initialize; the tile starts at the top-left corner
+// at the video size.
+// Returns: true on success
+SNACKA_API bool va_decoder_attach_gallery(VaDecoderHandle decoder, VaGalleryHandle gallery);
+
+// Place a decoder's gallery tile in gallery window pixels (top-left origin)
+// width/height: 0 hides the tile
+SNACKA_API void va_decoder_set_tile(
+    VaDecoderHandle decoder,
+    int x,
+    int y,
+    int width,
+    int height
+);
+
+// Check if H264 decoding is available (VA-API, or software decoding when
+// built with libavcodec)
 SNACKA_API bool va_decoder_is_available(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,36 @@
+#ifndef COLOR_SPACE_H
+#define COLOR_SPACE_H
+
+#include <stdbool.h>
+
+// YUV to RGB matrix of a stream
+typedef enum ColorMatrix {
+    COLOR_MATRIX_BT601 = 0,
+    COLOR_MATRIX_BT709 = 1,
+} ColorMatrix;
+
+// How decoded frames convert to RGB
+typedef struct ColorSpace {
+    ColorMatrix matrix;
+    bool full_range;            // 0-255 levels instead of 16-235 (chroma 16-240)
+} ColorSpace;
+
+// Pick the conversion for an ITU-T H.273 matrix_coefficients code, as signalled
+// in the H.264 VUI (libavcodec uses the same codes). Streams that leave it
+// unspecified get BT.601 whatever their size: the capture side converts with
+// BT.601, and its VA-API encoder cannot signal that.
+static inline ColorSpace color_space_from_vui(int matrix_coefficients, bool full_range) {
+    ColorSpace color;
+    switch (matrix_coefficients) {
+        case 1:     // BT.709
+            color.matrix = COLOR_MATRIX_BT709;
+            break;
+        default:    // 5 and 6 (BT.601), 2 (unspecified) and the rest
+            color.matrix = COLOR_MATRIX_BT601;
+            break;
+    }
+    color.full_range = full_range;
+    return color;
+}
+
+#endif // COLOR_SPACE_H
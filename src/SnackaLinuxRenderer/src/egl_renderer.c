@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // NV12 to RGB vertex shader (GLSL ES 2.0)
 static const char* s_vertex_shader_src =
@@ -15,26 +16,49 @@ static const char* s_vertex_shader_src =
     "    v_texCoord = a_texCoord;\n"
     "}\n";
 
-// NV12 to RGB fragment shader (GLSL ES 2.0)
+// NV12 to RGB fragment shader (GLSL ES 2.0), after a TAPS line that sets the
+// filter: 1 samples once (bilinear), N averages an NxN grid of bilinear taps
+// spread over the area of the frame that one output pixel covers
 static const char* s_fragment_shader_src =
-    "#version 100\n"
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "#else\n"
     "precision mediump float;\n"
+    "#endif\n"
     "varying vec2 v_texCoord;\n"
     "uniform sampler2D y_texture;\n"
     "uniform sampler2D uv_texture;\n"
+    "uniform mat3 yuv_matrix;\n"
+    "uniform vec3 yuv_offset;\n"
+    "uniform vec2 tap_step;\n"
+    "vec3 sample_yuv(vec2 coord) {\n"
+    "    return vec3(texture2D(y_texture, coord).r, texture2D(uv_texture, coord).rg);\n"
+    "}\n"
     "void main() {\n"
-    "    float y = texture2D(y_texture, v_texCoord).r;\n"
-    "    vec2 uv = texture2D(uv_texture, v_texCoord).rg;\n"
-    "    // BT.601 video range conversion\n"
-    "    y = (y - 0.0625) * 1.164;\n"
-    "    float u = uv.r - 0.5;\n"
-    "    float v = uv.g - 0.5;\n"
-    "    float r = y + 1.596 * v;\n"
-    "    float g = y - 0.391 * u - 0.813 * v;\n"
-    "    float b = y + 2.018 * u;\n"
-    "    gl_FragColor = vec4(clamp(r, 0.0, 1.0), clamp(g, 0.0, 1.0), clamp(b, 0.0, 1.0), 1.0);\n"
+    "#if TAPS == 1\n"
+    "    vec3 yuv = sample_yuv(v_texCoord);\n"
+    "#else\n"
+    "    vec3 yuv = vec3(0.0);\n"
+    "    for (int i = 0; i < TAPS; i++) {\n"
+    "        for (int j = 0; j < TAPS; j++) {\n"
+    "            vec2 tap = vec2(float(i), float(j)) - 0.5 * float(TAPS - 1);\n"
+    "            yuv += sample_yuv(v_texCoord + tap * tap_step);\n"
+    "        }\n"
+    "    }\n"
+    "    yuv /= float(TAPS * TAPS);\n"
+    "#endif\n"
+    "    vec3 rgb = yuv_matrix * (yuv - yuv_offset);\n"
+    "    gl_FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
     "}\n";
 
+// Taps per axis of each program (a bilinear tap reaches 2 texels, so N taps
+// cover a 2N times downscale)
+static const int s_program_taps[EGL_RENDERER_NUM_PROGRAMS] = { 1, 2, 4 };
+
+// Vertex attribute locations, shared by all programs
+#define ATTRIB_POSITION 0
+#define ATTRIB_TEX_COORD 1
+
 // Fullscreen quad vertices
 static const float s_quad_vertices[] = {
     // position    // texCoord
@@ -48,10 +72,18 @@ static const float s_quad_vertices[] = {
 typedef EGLImageKHR (EGLAPIENTRYP PFNEGLCREATEIMAGEKHRPROC)(EGLDisplay, EGLContext, EGLenum, EGLClientBuffer, const EGLint*);
 typedef EGLBoolean (EGLAPIENTRYP PFNEGLDESTROYIMAGEKHRPROC)(EGLDisplay, EGLImageKHR);
 typedef void (GL_APIENTRYP PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)(GLenum, void*);
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLGETSYNCVALUESCHROMIUMPROC)(EGLDisplay, EGLSurface, EGLuint64KHR*, EGLuint64KHR*, EGLuint64KHR*);
 
 static PFNEGLCREATEIMAGEKHRPROC s_eglCreateImageKHR = NULL;
 static PFNEGLDESTROYIMAGEKHRPROC s_eglDestroyImageKHR = NULL;
 static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC s_glEGLImageTargetTexture2DOES = NULL;
+static PFNEGLGETSYNCVALUESCHROMIUMPROC s_eglGetSyncValuesCHROMIUM = NULL;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 static GLuint compile_shader(GLenum type, const char* source) {
     GLuint shader = glCreateShader(type);
@@ -71,6 +103,17 @@ static GLuint compile_shader(GLenum type, const char* source) {
     return shader;
 }
 
+static GLuint create_texture(void) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
 static GLuint create_program(const char* vertex_src, const char* fragment_src) {
     GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_src);
     if (!vs) return 0;
@@ -84,6 +127,8 @@ static GLuint create_program(const char* vertex_src, const char* fragment_src) {
     GLuint program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    glBindAttribLocation(program, ATTRIB_POSITION, "a_position");
+    glBindAttribLocation(program, ATTRIB_TEX_COORD, "a_texCoord");
     glLinkProgram(program);
 
     glDeleteShader(vs);
@@ -102,13 +147,73 @@ static GLuint create_program(const char* vertex_src, const char* fragment_src) {
     return program;
 }
 
-EglRenderer* egl_renderer_create(Display* x_display) {
+// Build the program with the given number of taps per axis
+static bool create_yuv_program(EglYuvProgram* yuv, int taps) {
+    char header[64];
+    snprintf(header, sizeof(header), "#version 100\n#define TAPS %d\n", taps);
+
+    size_t length = strlen(header) + strlen(s_fragment_shader_src) + 1;
+    char* fragment_src = (char*)malloc(length);
+    if (!fragment_src) {
+        return false;
+    }
+    snprintf(fragment_src, length, "%s%s", header, s_fragment_shader_src);
+
+    yuv->program = create_program(s_vertex_shader_src, fragment_src);
+    free(fragment_src);
+    if (!yuv->program) {
+        return false;
+    }
+
+    yuv->matrix_loc = glGetUniformLocation(yuv->program, "yuv_matrix");
+    yuv->offset_loc = glGetUniformLocation(yuv->program, "yuv_offset");
+    yuv->tap_step_loc = glGetUniformLocation(yuv->program, "tap_step");
+
+    glUseProgram(yuv->program);
+    glUniform1i(glGetUniformLocation(yuv->program, "y_texture"), 0);
+    glUniform1i(glGetUniformLocation(yuv->program, "uv_texture"), 1);
+    return true;
+}
+
+// Fill the conversion uniforms: rgb = matrix * (yuv - offset), with the level
+// scaling folded into the matrix (column-major)
+static void get_yuv_conversion(ColorSpace color, GLfloat matrix[9], GLfloat offset[3]) {
+    float kr = color.matrix == COLOR_MATRIX_BT709 ? 0.2126f : 0.299f;
+    float kb = color.matrix == COLOR_MATRIX_BT709 ? 0.0722f : 0.114f;
+    float kg = 1.0f - kr - kb;
+
+    // Limited range: luma 16-235, chroma 16-240
+    float y_scale = color.full_range ? 1.0f : 255.0f / 219.0f;
+    float c_scale = color.full_range ? 1.0f : 255.0f / 224.0f;
+    offset[0] = color.full_range ? 0.0f : 16.0f / 255.0f;
+    offset[1] = 128.0f / 255.0f;
+    offset[2] = 128.0f / 255.0f;
+
+    // Y column
+    matrix[0] = y_scale;
+    matrix[1] = y_scale;
+    matrix[2] = y_scale;
+    // U (Cb) column
+    matrix[3] = 0.0f;
+    matrix[4] = -c_scale * 2.0f * kb * (1.0f - kb) / kg;
+    matrix[5] = c_scale * 2.0f * (1.0f - kb);
+    // V (Cr) column
+    matrix[6] = c_scale * 2.0f * (1.0f - kr);
+    matrix[7] = -c_scale * 2.0f * kr * (1.0f - kr) / kg;
+    matrix[8] = 0.0f;
+}
+
+static void release_upload(EglRenderer* renderer);
+
+EglRenderer* egl_renderer_create(Display* x_display, EGLDisplay egl_display, EGLConfig egl_config) {
     EglRenderer* renderer = (EglRenderer*)calloc(1, sizeof(EglRenderer));
     if (!renderer) {
         return NULL;
     }
 
     renderer->x_display = x_display;
+    renderer->egl_display = egl_display;
+    renderer->egl_config = egl_config;
     return renderer;
 }
 
@@ -121,15 +226,16 @@ void egl_renderer_destroy(EglRenderer* renderer) {
                        renderer->egl_surface, renderer->egl_context);
 
         // Delete GL resources
-        if (renderer->gl_program) glDeleteProgram(renderer->gl_program);
-        if (renderer->y_texture) glDeleteTextures(1, &renderer->y_texture);
-        if (renderer->uv_texture) glDeleteTextures(1, &renderer->uv_texture);
+        egl_renderer_invalidate_surfaces(renderer);
+        release_upload(renderer);
+        for (int i = 0; i < EGL_RENDERER_NUM_PROGRAMS; i++) {
+            if (renderer->programs[i].program) glDeleteProgram(renderer->programs[i].program);
+        }
 
         // Destroy EGL resources
         eglMakeCurrent(renderer->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
         if (renderer->egl_surface) eglDestroySurface(renderer->egl_display, renderer->egl_surface);
         if (renderer->egl_context) eglDestroyContext(renderer->egl_display, renderer->egl_context);
-        eglTerminate(renderer->egl_display);
     }
 
     // Destroy X11 window
@@ -137,6 +243,7 @@ void egl_renderer_destroy(EglRenderer* renderer) {
         x11_destroy_overlay_window(renderer->x_display, renderer->x_window);
     }
 
+    free(renderer->imports);
     free(renderer);
 }
 
@@ -147,6 +254,8 @@ bool egl_renderer_initialize(EglRenderer* renderer, int width, int height) {
 
     renderer->width = width;
     renderer->height = height;
+    renderer->frame_width = width;
+    renderer->frame_height = height;
 
     // Create overlay window
     renderer->x_window = x11_create_overlay_window(renderer->x_display, width, height);
@@ -155,46 +264,18 @@ bool egl_renderer_initialize(EglRenderer* renderer, int width, int height) {
         return false;
     }
 
-    // Get EGL display
-    renderer->egl_display = eglGetDisplay((EGLNativeDisplayType)renderer->x_display);
-    if (renderer->egl_display == EGL_NO_DISPLAY) {
-        fprintf(stderr, "EglRenderer: eglGetDisplay failed\n");
-        return false;
-    }
-
-    // Initialize EGL
-    EGLint major, minor;
-    if (!eglInitialize(renderer->egl_display, &major, &minor)) {
-        fprintf(stderr, "EglRenderer: eglInitialize failed\n");
-        return false;
-    }
-
-    printf("EglRenderer: EGL version %d.%d\n", major, minor);
-
-    // Choose config
-    EGLint config_attribs[] = {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RED_SIZE, 8,
-        EGL_GREEN_SIZE, 8,
-        EGL_BLUE_SIZE, 8,
-        EGL_ALPHA_SIZE, 8,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_NONE
-    };
+    // Create context (GLES 3 if possible, for uploads through pixel buffer objects)
+    for (renderer->gles_version = 3; renderer->gles_version >= 2; renderer->gles_version--) {
+        EGLint context_attribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, renderer->gles_version,
+            EGL_NONE
+        };
 
-    EGLint num_configs;
-    if (!eglChooseConfig(renderer->egl_display, config_attribs, &renderer->egl_config, 1, &num_configs) || num_configs == 0) {
-        fprintf(stderr, "EglRenderer: eglChooseConfig failed\n");
-        return false;
+        renderer->egl_context = eglCreateContext(renderer->egl_display, renderer->egl_config, EGL_NO_CONTEXT, context_attribs);
+        if (renderer->egl_context != EGL_NO_CONTEXT) {
+            break;
+        }
     }
-
-    // Create context
-    EGLint context_attribs[] = {
-        EGL_CONTEXT_CLIENT_VERSION, 2,
-        EGL_NONE
-    };
-
-    renderer->egl_context = eglCreateContext(renderer->egl_display, renderer->egl_config, EGL_NO_CONTEXT, context_attribs);
     if (renderer->egl_context == EGL_NO_CONTEXT) {
         fprintf(stderr, "EglRenderer: eglCreateContext failed\n");
         return false;
@@ -224,33 +305,19 @@ bool egl_renderer_initialize(EglRenderer* renderer, int width, int height) {
         // Continue anyway - we'll fall back to vaPutSurface
     }
 
-    // Create shader program
-    renderer->gl_program = create_program(s_vertex_shader_src, s_fragment_shader_src);
-    if (!renderer->gl_program) {
-        fprintf(stderr, "EglRenderer: Failed to create shader program\n");
-        return false;
+    // Vertical blank timestamps, for presentation feedback
+    const char* extensions = eglQueryString(renderer->egl_display, EGL_EXTENSIONS);
+    if (extensions && strstr(extensions, "EGL_CHROMIUM_sync_control")) {
+        s_eglGetSyncValuesCHROMIUM = (PFNEGLGETSYNCVALUESCHROMIUMPROC)eglGetProcAddress("eglGetSyncValuesCHROMIUM");
     }
 
-    // Get uniform locations
-    renderer->y_texture_loc = glGetUniformLocation(renderer->gl_program, "y_texture");
-    renderer->uv_texture_loc = glGetUniformLocation(renderer->gl_program, "uv_texture");
-
-    // Create textures
-    glGenTextures(1, &renderer->y_texture);
-    glGenTextures(1, &renderer->uv_texture);
-
-    // Setup textures
-    glBindTexture(GL_TEXTURE_2D, renderer->y_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glBindTexture(GL_TEXTURE_2D, renderer->uv_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Create shader programs, one per downscale filter
+    for (int i = 0; i < EGL_RENDERER_NUM_PROGRAMS; i++) {
+        if (!create_yuv_program(&renderer->programs[i], s_program_taps[i])) {
+            fprintf(stderr, "EglRenderer: Failed to create shader program\n");
+            return false;
+        }
+    }
 
     // Show window
     x11_show_window(renderer->x_display, renderer->x_window);
@@ -260,21 +327,132 @@ bool egl_renderer_initialize(EglRenderer* renderer, int width, int height) {
     return true;
 }
 
-bool egl_renderer_render_surface(
+static void release_import(EglRenderer* renderer, EglSurfaceImport* import) {
+    if (import->y_texture) glDeleteTextures(1, &import->y_texture);
+    if (import->uv_texture) glDeleteTextures(1, &import->uv_texture);
+    if (import->y_image) s_eglDestroyImageKHR(renderer->egl_display, import->y_image);
+    if (import->uv_image) s_eglDestroyImageKHR(renderer->egl_display, import->uv_image);
+    memset(import, 0, sizeof(*import));
+    import->surface = VA_INVALID_SURFACE;
+}
+
+void egl_renderer_invalidate_surfaces(EglRenderer* renderer) {
+    if (!renderer) return;
+
+    for (int i = 0; i < renderer->num_imports; i++) {
+        release_import(renderer, &renderer->imports[i]);
+    }
+    renderer->num_imports = 0;
+    renderer->next_eviction = 0;
+}
+
+void egl_renderer_forget_surfaces(EglRenderer* renderer, const VASurfaceID* surfaces, int count) {
+    if (!renderer || !renderer->initialized) return;
+
+    eglMakeCurrent(renderer->egl_display, renderer->egl_surface, renderer->egl_surface, renderer->egl_context);
+    for (int i = 0; i < renderer->num_imports; ) {
+        bool forget = false;
+        for (int j = 0; j < count; j++) {
+            if (renderer->imports[i].surface == surfaces[j]) {
+                forget = true;
+                break;
+            }
+        }
+
+        if (forget) {
+            release_import(renderer, &renderer->imports[i]);
+            renderer->imports[i] = renderer->imports[--renderer->num_imports];
+        } else {
+            i++;
+        }
+    }
+    renderer->next_eviction = 0;
+}
+
+static EGLImageKHR import_plane(
+    EglRenderer* renderer,
+    const VADRMPRIMESurfaceDescriptor* prime_desc,
+    int plane,
+    uint32_t fourcc,
+    int width,
+    int height
+) {
+    EGLint attribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_LINUX_DRM_FOURCC_EXT, (EGLint)fourcc,
+        EGL_DMA_BUF_PLANE0_FD_EXT, prime_desc->objects[prime_desc->layers[0].object_index[plane]].fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, (EGLint)prime_desc->layers[0].offset[plane],
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, (EGLint)prime_desc->layers[0].pitch[plane],
+        EGL_NONE
+    };
+
+    return s_eglCreateImageKHR(
+        renderer->egl_display,
+        EGL_NO_CONTEXT,
+        EGL_LINUX_DMA_BUF_EXT,
+        NULL,
+        attribs
+    );
+}
+
+// Get a slot for a new import, growing the cache up to its limit and then
+// reusing the oldest slots
+static EglSurfaceImport* allocate_import(EglRenderer* renderer) {
+    if (renderer->num_imports == renderer->import_capacity &&
+        renderer->import_capacity < EGL_RENDERER_MAX_CACHED_SURFACES) {
+        int capacity = renderer->import_capacity ? renderer->import_capacity * 2 : 32;
+        if (capacity > EGL_RENDERER_MAX_CACHED_SURFACES) {
+            capacity = EGL_RENDERER_MAX_CACHED_SURFACES;
+        }
+        EglSurfaceImport* imports = (EglSurfaceImport*)realloc(
+            renderer->imports, capacity * sizeof(EglSurfaceImport));
+        if (imports) {
+            renderer->imports = imports;
+            renderer->import_capacity = capacity;
+        }
+    }
+
+    if (renderer->num_imports < renderer->import_capacity) {
+        EglSurfaceImport* import = &renderer->imports[renderer->num_imports++];
+        memset(import, 0, sizeof(*import));
+        return import;
+    }
+    if (renderer->num_imports == 0) {
+        return NULL;
+    }
+
+    EglSurfaceImport* import = &renderer->imports[renderer->next_eviction % renderer->num_imports];
+    renderer->next_eviction = (renderer->next_eviction + 1) % renderer->num_imports;
+    release_import(renderer, import);
+    return import;
+}
+
+// Find a surface's import, exporting it as DMA-BUF and creating its EGL images
+// and textures the first time it is shown at this size
+static EglSurfaceImport* get_import(
     EglRenderer* renderer,
     VADisplay va_display,
-    VASurfaceID surface
+    VASurfaceID surface,
+    int width,
+    int height
 ) {
-    if (!renderer || !renderer->initialized) {
-        return false;
+    EglSurfaceImport* import = NULL;
+    for (int i = 0; i < renderer->num_imports; i++) {
+        if (renderer->imports[i].surface == surface) {
+            import = &renderer->imports[i];
+            if (import->width == width && import->height == height) {
+                return import;
+            }
+            release_import(renderer, import);
+            break;
+        }
     }
 
-    // Make context current
-    if (!eglMakeCurrent(renderer->egl_display, renderer->egl_surface, renderer->egl_surface, renderer->egl_context)) {
-        return false;
+    if (!s_eglCreateImageKHR || !s_eglDestroyImageKHR || !s_glEGLImageTargetTexture2DOES) {
+        return NULL;
     }
 
-    // Try DMA-BUF export for zero-copy rendering
     VADRMPRIMESurfaceDescriptor prime_desc;
     VAStatus status = vaExportSurfaceHandle(
         va_display,
@@ -283,104 +461,334 @@ bool egl_renderer_render_surface(
         VA_EXPORT_SURFACE_READ_ONLY | VA_EXPORT_SURFACE_COMPOSED_LAYERS,
         &prime_desc
     );
+    if (status != VA_STATUS_SUCCESS) {
+        return NULL;
+    }
 
-    if (status == VA_STATUS_SUCCESS && s_eglCreateImageKHR && s_glEGLImageTargetTexture2DOES) {
-        // Create EGL images from DMA-BUF
-
-        // Y plane
-        EGLint y_attribs[] = {
-            EGL_WIDTH, renderer->width,
-            EGL_HEIGHT, renderer->height,
-            EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_R8,
-            EGL_DMA_BUF_PLANE0_FD_EXT, prime_desc.objects[0].fd,
-            EGL_DMA_BUF_PLANE0_OFFSET_EXT, prime_desc.layers[0].offset[0],
-            EGL_DMA_BUF_PLANE0_PITCH_EXT, prime_desc.layers[0].pitch[0],
-            EGL_NONE
-        };
+    if (!import) {
+        import = allocate_import(renderer);
+    }
+    if (import) {
+        import->surface = surface;
+        import->width = width;
+        import->height = height;
+        import->y_image = import_plane(renderer, &prime_desc, 0, DRM_FORMAT_R8, width, height);
+        import->uv_image = import_plane(renderer, &prime_desc, 1, DRM_FORMAT_GR88, width / 2, height / 2);
+    }
 
-        EGLImageKHR y_image = s_eglCreateImageKHR(
-            renderer->egl_display,
-            EGL_NO_CONTEXT,
-            EGL_LINUX_DMA_BUF_EXT,
-            NULL,
-            y_attribs
-        );
-
-        // UV plane
-        EGLint uv_attribs[] = {
-            EGL_WIDTH, renderer->width / 2,
-            EGL_HEIGHT, renderer->height / 2,
-            EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_GR88,
-            EGL_DMA_BUF_PLANE0_FD_EXT, prime_desc.objects[0].fd,
-            EGL_DMA_BUF_PLANE0_OFFSET_EXT, prime_desc.layers[0].offset[1],
-            EGL_DMA_BUF_PLANE0_PITCH_EXT, prime_desc.layers[0].pitch[1],
-            EGL_NONE
-        };
+    // The images keep the buffer alive; the fds are not needed after the import
+    for (uint32_t i = 0; i < prime_desc.num_objects; i++) {
+        close(prime_desc.objects[i].fd);
+    }
 
-        EGLImageKHR uv_image = s_eglCreateImageKHR(
-            renderer->egl_display,
-            EGL_NO_CONTEXT,
-            EGL_LINUX_DMA_BUF_EXT,
-            NULL,
-            uv_attribs
-        );
+    if (!import) {
+        return NULL;
+    }
+    if (!import->y_image || !import->uv_image) {
+        fprintf(stderr, "EglRenderer: Failed to import surface %u\n", surface);
+        release_import(renderer, import);
+        return NULL;
+    }
+
+    import->y_texture = create_texture();
+    s_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, import->y_image);
+    import->uv_texture = create_texture();
+    s_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, import->uv_image);
+    return import;
+}
+
+// Draw Y and UV textures of a frame_width x frame_height frame into a
+// rectangle of the window (top-left origin)
+static void draw_textures(
+    EglRenderer* renderer,
+    GLuint y_texture,
+    GLuint uv_texture,
+    int frame_width,
+    int frame_height,
+    ColorSpace color,
+    int x,
+    int y,
+    int width,
+    int height
+) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
 
-        if (y_image && uv_image) {
-            // Bind to textures
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, renderer->y_texture);
-            s_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, y_image);
+    // Plain bilinear sampling is exact enough up to a 2x downscale; smaller
+    // tiles average more taps instead of skipping texels, and every program
+    // only runs for the pixels of its rectangle
+    float scale_x = (float)frame_width / width;
+    float scale_y = (float)frame_height / height;
+    float scale = scale_x > scale_y ? scale_x : scale_y;
+    int index = scale > 4.0f ? 2 : scale > 2.0f ? 1 : 0;
+    const EglYuvProgram* yuv = &renderer->programs[index];
 
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, renderer->uv_texture);
-            s_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, uv_image);
+    glUseProgram(yuv->program);
 
-            // Render
-            glViewport(0, 0, renderer->width, renderer->height);
-            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT);
+    GLfloat matrix[9];
+    GLfloat offset[3];
+    get_yuv_conversion(color, matrix, offset);
+    glUniformMatrix3fv(yuv->matrix_loc, 1, GL_FALSE, matrix);
+    glUniform3fv(yuv->offset_loc, 1, offset);
 
-            glUseProgram(renderer->gl_program);
-            glUniform1i(renderer->y_texture_loc, 0);
-            glUniform1i(renderer->uv_texture_loc, 1);
+    // One output pixel covers 1 / width of the texture; the taps split it evenly
+    int taps = s_program_taps[index];
+    glUniform2f(yuv->tap_step_loc, 1.0f / ((float)width * taps), 1.0f / ((float)height * taps));
 
-            // Draw fullscreen quad
-            GLint pos_loc = glGetAttribLocation(renderer->gl_program, "a_position");
-            GLint tex_loc = glGetAttribLocation(renderer->gl_program, "a_texCoord");
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, y_texture);
 
-            glVertexAttribPointer(pos_loc, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), s_quad_vertices);
-            glEnableVertexAttribArray(pos_loc);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, uv_texture);
 
-            glVertexAttribPointer(tex_loc, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), s_quad_vertices + 2);
-            glEnableVertexAttribArray(tex_loc);
+    // GL's origin is the bottom-left corner
+    glViewport(x, renderer->height - y - height, width, height);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+bool egl_renderer_begin_frame(EglRenderer* renderer) {
+    if (!renderer || !renderer->initialized) {
+        return false;
+    }
 
-            eglSwapBuffers(renderer->egl_display, renderer->egl_surface);
-        }
+    // Make context current
+    if (!eglMakeCurrent(renderer->egl_display, renderer->egl_surface, renderer->egl_surface, renderer->egl_context)) {
+        return false;
+    }
+
+    glViewport(0, 0, renderer->width, renderer->height);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Fullscreen quad, placed by the viewport
+    glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), s_quad_vertices);
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+
+    glVertexAttribPointer(ATTRIB_TEX_COORD, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), s_quad_vertices + 2);
+    glEnableVertexAttribArray(ATTRIB_TEX_COORD);
+    return true;
+}
 
-        // Cleanup
-        if (y_image) s_eglDestroyImageKHR(renderer->egl_display, y_image);
-        if (uv_image) s_eglDestroyImageKHR(renderer->egl_display, uv_image);
+bool egl_renderer_draw_surface(
+    EglRenderer* renderer,
+    VADisplay va_display,
+    VASurfaceID surface,
+    int frame_width,
+    int frame_height,
+    ColorSpace color,
+    int x,
+    int y,
+    int width,
+    int height
+) {
+    // Zero-copy rendering from the surface's DMA-BUF
+    EglSurfaceImport* import = get_import(renderer, va_display, surface, frame_width, frame_height);
+    if (!import) {
+        return false;
+    }
 
-        // Close DMA-BUF fds
-        for (uint32_t i = 0; i < prime_desc.num_objects; i++) {
-            close(prime_desc.objects[i].fd);
+    draw_textures(renderer, import->y_texture, import->uv_texture, frame_width, frame_height, color,
+                  x, y, width, height);
+    return true;
+}
+
+static void release_upload(EglRenderer* renderer) {
+    if (renderer->y_texture) glDeleteTextures(1, &renderer->y_texture);
+    if (renderer->uv_texture) glDeleteTextures(1, &renderer->uv_texture);
+    if (renderer->upload_buffers[0]) glDeleteBuffers(2, renderer->upload_buffers);
+    renderer->y_texture = 0;
+    renderer->uv_texture = 0;
+    renderer->upload_buffers[0] = 0;
+    renderer->upload_buffers[1] = 0;
+    renderer->upload_width = 0;
+    renderer->upload_height = 0;
+}
+
+// Create the textures and pixel buffer objects for frames of a size
+static bool prepare_upload(EglRenderer* renderer, int width, int height) {
+    if (renderer->y_texture && renderer->upload_width == width && renderer->upload_height == height) {
+        return true;
+    }
+    if (renderer->gles_version < 3) {
+        fprintf(stderr, "EglRenderer: Uploading frames needs GLES 3\n");
+        return false;
+    }
+
+    release_upload(renderer);
+
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+
+    renderer->y_texture = create_texture();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    renderer->uv_texture = create_texture();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, chroma_width, chroma_height, 0, GL_RG, GL_UNSIGNED_BYTE, NULL);
+
+    // Y plane followed by the interleaved UV plane (NV12)
+    GLsizeiptr size = (GLsizeiptr)width * height + (GLsizeiptr)chroma_width * chroma_height * 2;
+    glGenBuffers(2, renderer->upload_buffers);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->upload_buffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    renderer->upload_width = width;
+    renderer->upload_height = height;
+    return true;
+}
+
+// Copy a frame into the next pixel buffer object and start the texture uploads
+static bool upload_frame(
+    EglRenderer* renderer,
+    const uint8_t* const planes[3],
+    const int strides[3],
+    int width,
+    int height
+) {
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    GLsizeiptr y_size = (GLsizeiptr)width * height;
+    GLsizeiptr size = y_size + (GLsizeiptr)chroma_width * chroma_height * 2;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->upload_buffers[renderer->upload_index]);
+    renderer->upload_index ^= 1;
+
+    uint8_t* data = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!data) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    for (int row = 0; row < height; row++) {
+        memcpy(data + (size_t)row * width, planes[0] + (size_t)row * strides[0], width);
+    }
+
+    uint8_t* uv = data + y_size;
+    for (int row = 0; row < chroma_height; row++) {
+        const uint8_t* u = planes[1] + (size_t)row * strides[1];
+        const uint8_t* v = planes[2] + (size_t)row * strides[2];
+        for (int col = 0; col < chroma_width; col++) {
+            *uv++ = u[col];
+            *uv++ = v[col];
         }
+    }
+
+    bool mapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
 
+    // Offsets into the bound pixel buffer object
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, renderer->y_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, (const void*)0);
+    glBindTexture(GL_TEXTURE_2D, renderer->uv_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, chroma_width, chroma_height, GL_RG, GL_UNSIGNED_BYTE,
+                    (const void*)(uintptr_t)y_size);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return mapped;
+}
+
+bool egl_renderer_render_frame(
+    EglRenderer* renderer,
+    const uint8_t* const planes[3],
+    const int strides[3],
+    int width,
+    int height
+) {
+    if (!egl_renderer_begin_frame(renderer)) {
+        return false;
+    }
+
+    if (!prepare_upload(renderer, width, height) ||
+        !upload_frame(renderer, planes, strides, width, height)) {
+        return false;
+    }
+
+    draw_textures(renderer, renderer->y_texture, renderer->uv_texture, width, height, renderer->color,
+                  0, 0, renderer->width, renderer->height);
+    egl_renderer_end_frame(renderer);
+    return true;
+}
+
+// Estimate when the swap submitted at submit_us reaches the screen
+static void record_present(EglRenderer* renderer, int64_t submit_us) {
+    int64_t returned_us = now_us();
+
+    EGLuint64KHR ust, msc, sbc;
+    if (!s_eglGetSyncValuesCHROMIUM ||
+        !s_eglGetSyncValuesCHROMIUM(renderer->egl_display, renderer->egl_surface, &ust, &msc, &sbc)) {
+        // Without feedback, a swap that waits for vsync returns about when the
+        // frame is shown
+        renderer->present_us = returned_us;
+        return;
+    }
+
+    // The counters give the latest vertical blank and, over time, the refresh
+    // period; the frame is shown at the first blank after it was submitted
+    if (renderer->have_sync_values && (int64_t)msc > renderer->last_msc && (int64_t)ust > renderer->last_ust) {
+        renderer->vsync_period_us = ((int64_t)ust - renderer->last_ust) / ((int64_t)msc - renderer->last_msc);
+    }
+    renderer->have_sync_values = true;
+    renderer->last_ust = (int64_t)ust;
+    renderer->last_msc = (int64_t)msc;
+
+    int64_t period = renderer->vsync_period_us;
+    int64_t present = (int64_t)ust;
+    if (period > 0 && present < submit_us) {
+        present += ((submit_us - present) / period + 1) * period;
+    }
+    renderer->present_us = present;
+}
+
+void egl_renderer_end_frame(EglRenderer* renderer) {
+    int64_t submit_us = now_us();
+    eglSwapBuffers(renderer->egl_display, renderer->egl_surface);
+    record_present(renderer, submit_us);
+}
+
+void egl_renderer_get_present_timing(EglRenderer* renderer, int64_t* present_us, int64_t* period_us) {
+    *present_us = renderer ? renderer->present_us : 0;
+    *period_us = renderer ? renderer->vsync_period_us : 0;
+}
+
+void egl_renderer_set_swap_interval(EglRenderer* renderer, int interval) {
+    if (!renderer || !renderer->initialized) {
+        return;
+    }
+
+    eglMakeCurrent(renderer->egl_display, renderer->egl_surface, renderer->egl_surface, renderer->egl_context);
+    eglSwapInterval(renderer->egl_display, interval);
+}
+
+bool egl_renderer_render_surface(
+    EglRenderer* renderer,
+    VADisplay va_display,
+    VASurfaceID surface
+) {
+    if (!egl_renderer_begin_frame(renderer)) {
+        return false;
+    }
+
+    if (egl_renderer_draw_surface(renderer, va_display, surface,
+                                  renderer->frame_width, renderer->frame_height, renderer->color,
+                                  0, 0, renderer->width, renderer->height)) {
+        egl_renderer_end_frame(renderer);
         return true;
     }
 
     // Fallback: Use vaPutSurface (not zero-copy, but works everywhere)
-    status = vaPutSurface(
+    VAStatus status = vaPutSurface(
         va_display,
         surface,
         renderer->x_window,
-        0, 0, renderer->width, renderer->height,
+        0, 0, renderer->frame_width, renderer->frame_height,
         0, 0, renderer->width, renderer->height,
         NULL, 0,
         VA_FRAME_PICTURE
     );
+    renderer->present_us = now_us();
 
     return status == VA_STATUS_SUCCESS;
 }
@@ -390,6 +798,20 @@ Window egl_renderer_get_window(EglRenderer* renderer) {
     return renderer->x_window;
 }
 
+void egl_renderer_release_context(EglRenderer* renderer) {
+    if (!renderer || !renderer->initialized) {
+        return;
+    }
+
+    eglMakeCurrent(renderer->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void egl_renderer_set_frame_size(EglRenderer* renderer, int width, int height) {
+    if (!renderer) return;
+    renderer->frame_width = width;
+    renderer->frame_height = height;
+}
+
 void egl_renderer_set_display_size(EglRenderer* renderer, int width, int height) {
     if (!renderer || (renderer->width == width && renderer->height == height)) {
         return;
@@ -402,3 +824,8 @@ void egl_renderer_set_display_size(EglRenderer* renderer, int width, int height)
         x11_set_window_geometry(renderer->x_display, renderer->x_window, 0, 0, width, height);
     }
 }
+
+void egl_renderer_set_color_space(EglRenderer* renderer, ColorSpace color) {
+    if (!renderer) return;
+    renderer->color = color;
+}
@@ -6,13 +6,40 @@
 #include <unistd.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 #include <GLES2/gl2ext.h>
 #include <X11/Xlib.h>
 #include <va/va.h>
 #include <va/va_x11.h>
 #include <va/va_drmcommon.h>
 #include <drm_fourcc.h>
+#include "color_space.h"
+
+// VA surfaces whose EGL imports are kept (a gallery shows the pools of many
+// decoders)
+#define EGL_RENDERER_MAX_CACHED_SURFACES 512
+
+// Shader programs: bilinear, and 2x2 and 4x4 taps for downscaling
+#define EGL_RENDERER_NUM_PROGRAMS 3
+
+// NV12 to RGB program
+typedef struct EglYuvProgram {
+    GLuint program;
+    GLint matrix_loc;
+    GLint offset_loc;
+    GLint tap_step_loc;
+} EglYuvProgram;
+
+// A VA surface imported as Y and UV textures
+typedef struct EglSurfaceImport {
+    VASurfaceID surface;
+    int width;                  // Imported frame size
+    int height;
+    EGLImageKHR y_image;
+    EGLImageKHR uv_image;
+    GLuint y_texture;
+    GLuint uv_texture;
+} EglSurfaceImport;
 
 // EGL renderer structure
 typedef struct EglRenderer {
@@ -21,47 +48,125 @@ typedef struct EglRenderer {
     Window x_window;
 
     // EGL
-    EGLDisplay egl_display;
+    EGLDisplay egl_display;     // Shared, owned by the caller
     EGLContext egl_context;
     EGLSurface egl_surface;
     EGLConfig egl_config;
 
     // OpenGL resources
-    GLuint gl_program;
+    EglYuvProgram programs[EGL_RENDERER_NUM_PROGRAMS];
+    int gles_version;           // 3 when available (needed for uploads), else 2
+
+    // Uploaded frames (software decoding): two pixel buffer objects are filled
+    // alternately so the CPU copy never waits for the previous transfer
     GLuint y_texture;
     GLuint uv_texture;
+    GLuint upload_buffers[2];
+    int upload_index;
+    int upload_width;
+    int upload_height;
+
+    // Imported surfaces, reused every time a surface is shown again
+    EglSurfaceImport* imports;
+    int num_imports;
+    int import_capacity;
+    int next_eviction;
 
-    // Shader uniform locations
-    GLint y_texture_loc;
-    GLint uv_texture_loc;
+    // Presentation timing (UST/MSC from EGL_CHROMIUM_sync_control when the
+    // platform has it, else the time each swap returns)
+    bool have_sync_values;
+    int64_t last_ust;           // Microseconds, CLOCK_MONOTONIC
+    int64_t last_msc;           // Vertical blank counter at last_ust
+    int64_t present_us;         // When the latest swap reached the screen (estimated)
+    int64_t vsync_period_us;    // Measured refresh period (0 until known)
 
     // Dimensions
-    int width;
+    int width;                  // Window size
     int height;
+    int frame_width;            // Decoded frame size (size of the imported planes)
+    int frame_height;
+    ColorSpace color;           // Conversion of frames shown in the whole window
 
     // State
     bool initialized;
 } EglRenderer;
 
-// Create a new renderer
-EglRenderer* egl_renderer_create(Display* x_display);
+// Create a new renderer on an initialized EGL display (not owned by the renderer)
+EglRenderer* egl_renderer_create(Display* x_display, EGLDisplay egl_display, EGLConfig egl_config);
 
 // Destroy a renderer
 void egl_renderer_destroy(EglRenderer* renderer);
 
-// Initialize the renderer
+// Initialize the renderer for frames of the given size
 bool egl_renderer_initialize(EglRenderer* renderer, int width, int height);
 
-// Render a VA surface
+// Render a VA surface. The surface is imported on first use and the import is
+// kept until the renderer is destroyed or egl_renderer_invalidate_surfaces.
 bool egl_renderer_render_surface(
     EglRenderer* renderer,
     VADisplay va_display,
     VASurfaceID surface
 );
 
+// Drop all surface imports (call before destroying or recreating VA surfaces)
+void egl_renderer_invalidate_surfaces(EglRenderer* renderer);
+
+// Drop the imports of some surfaces (call on the rendering thread before they
+// are destroyed)
+void egl_renderer_forget_surfaces(EglRenderer* renderer, const VASurfaceID* surfaces, int count);
+
+// Upload and render an 8-bit 4:2:0 planar frame (Y, U, V). Needs GLES 3.
+bool egl_renderer_render_frame(
+    EglRenderer* renderer,
+    const uint8_t* const planes[3],
+    const int strides[3],
+    int width,
+    int height
+);
+
+// Composite several surfaces into one frame: begin, draw each, end (one swap)
+bool egl_renderer_begin_frame(EglRenderer* renderer);
+
+// Draw a surface whose frame is frame_width x frame_height into a rectangle
+// of the window (top-left origin). Only for surfaces that can be imported.
+// Downscaled frames are filtered over the area each pixel covers.
+bool egl_renderer_draw_surface(
+    EglRenderer* renderer,
+    VADisplay va_display,
+    VASurfaceID surface,
+    int frame_width,
+    int frame_height,
+    ColorSpace color,
+    int x,
+    int y,
+    int width,
+    int height
+);
+
+// Swap, then record when the frame reached the screen
+void egl_renderer_end_frame(EglRenderer* renderer);
+
+// Get the presentation time of the latest swap (CLOCK_MONOTONIC microseconds)
+// and the measured refresh period (0 if the platform does not report it)
+void egl_renderer_get_present_timing(EglRenderer* renderer, int64_t* present_us, int64_t* period_us);
+
+// Set the number of vertical blanks per swap (1 to present once per vsync)
+void egl_renderer_set_swap_interval(EglRenderer* renderer, int interval);
+
 // Get the X11 window handle
 Window egl_renderer_get_window(EglRenderer* renderer);
 
+// Release the EGL context from the calling thread so another thread can render
+void egl_renderer_release_context(EglRenderer* renderer);
+
+// Set the YUV to RGB conversion for egl_renderer_render_surface and
+// egl_renderer_render_frame (BT.601 limited range until set)
+void egl_renderer_set_color_space(EglRenderer* renderer, ColorSpace color);
+
+// Set the size of the frames egl_renderer_render_surface shows (when the
+// stream changes resolution)
+void egl_renderer_set_frame_size(EglRenderer* renderer, int width, int height);
+
 // Set display size
 void egl_renderer_set_display_size(EglRenderer* renderer, int width, int height);
 
@@ -0,0 +1,93 @@
+#include "frame_scheduler.h"
+#include <string.h>
+
+// Shortest refresh period taken from present-to-present deltas (500 Hz)
+#define MIN_PERIOD_US 2000
+
+void frame_scheduler_init(FrameScheduler* scheduler, int target_latency_ms) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->target_latency_us = target_latency_ms > 0 ? (int64_t)target_latency_ms * 1000 : 0;
+    scheduler->stats.vsync_period_us = FRAME_SCHEDULER_DEFAULT_PERIOD_US;
+}
+
+void frame_scheduler_add_arrival(FrameScheduler* scheduler, int64_t capture_us, int64_t arrival_us) {
+    if (capture_us < 0) {
+        return;
+    }
+
+    int64_t offset = arrival_us - capture_us;
+    if (!scheduler->have_offset || offset < scheduler->transit_offset_us) {
+        scheduler->transit_offset_us = offset;
+        scheduler->have_offset = true;
+    } else {
+        // Forget the minimum slowly, so that drift between the clocks (or a
+        // route that got longer) is followed: the time constant is 4096
+        // arrivals, about a minute at 60 frames per second. Faster would let
+        // ordinary jitter raise the minimum.
+        scheduler->transit_offset_us += (offset - scheduler->transit_offset_us) >> 12;
+    }
+}
+
+int64_t frame_scheduler_due_time(const FrameScheduler* scheduler, int64_t capture_us, int64_t now_us) {
+    if (capture_us < 0 || !scheduler->have_offset || scheduler->target_latency_us == 0) {
+        return now_us;
+    }
+    return capture_us + scheduler->transit_offset_us + scheduler->target_latency_us;
+}
+
+static void update_period(FrameScheduler* scheduler, int64_t present_us, int64_t period_us) {
+    FrameTimingStats* stats = &scheduler->stats;
+
+    if (period_us > 0) {
+        stats->vsync_period_us = period_us;
+    } else if (scheduler->last_present_us > 0) {
+        // Consecutive presents are a whole number of refreshes apart; only
+        // deltas close to the estimate refine it, a clearly shorter one replaces it
+        int64_t delta = present_us - scheduler->last_present_us;
+        int64_t estimate = stats->vsync_period_us;
+        if (delta >= MIN_PERIOD_US && delta < estimate * 3 / 4) {
+            stats->vsync_period_us = delta;
+        } else if (delta >= estimate * 3 / 4 && delta <= estimate * 5 / 4) {
+            stats->vsync_period_us += (delta - estimate) / 8;
+        }
+    }
+    scheduler->last_present_us = present_us;
+}
+
+void frame_scheduler_presented(
+    FrameScheduler* scheduler,
+    int64_t capture_us,
+    int64_t due_us,
+    int64_t present_us,
+    int64_t period_us
+) {
+    FrameTimingStats* stats = &scheduler->stats;
+    update_period(scheduler, present_us, period_us);
+
+    if (capture_us < 0 || !scheduler->have_offset) {
+        return;
+    }
+
+    int64_t latency = present_us - (capture_us + scheduler->transit_offset_us);
+    stats->last_latency_us = latency;
+    stats->average_latency_us = stats->frames_timed == 0
+        ? latency
+        : stats->average_latency_us + (latency - stats->average_latency_us) / 16;
+    if (latency > stats->max_latency_us) {
+        stats->max_latency_us = latency;
+    }
+    stats->frames_timed++;
+
+    // A frame on time reaches the screen at the first refresh after it was
+    // due; each further period is a missed vsync (an eighth of a period of
+    // slack absorbs timing noise)
+    int64_t period = stats->vsync_period_us;
+    int64_t late = present_us - due_us;
+    if (late > period) {
+        int64_t missed = (late - period / 8) / period;
+        if (missed > 0) {
+            stats->frames_late++;
+            stats->vsyncs_missed += (uint64_t)missed;
+        }
+    }
+}
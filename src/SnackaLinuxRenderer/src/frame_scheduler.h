@@ -0,0 +1,60 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Presentation timing for one decoder. Times are microseconds; capture times
+// come from the sender's clock (negative if unknown). The clocks need not be
+// synchronized: the scheduler tracks the smallest arrival - capture offset
+// (the fastest transit), so a frame is due target latency after the moment it
+// could have arrived at the earliest. Display latency is measured from the
+// same point and excludes the constant part of the network delay.
+
+// Refresh period assumed until one is measured (60 Hz)
+#define FRAME_SCHEDULER_DEFAULT_PERIOD_US 16667
+
+// Presentation statistics
+typedef struct FrameTimingStats {
+    int64_t last_latency_us;    // Display latency of the latest timed frame
+    int64_t average_latency_us; // Moving average over about 16 frames
+    int64_t max_latency_us;
+    int64_t vsync_period_us;    // Measured (or assumed) refresh period
+    uint64_t frames_timed;      // Frames shown that had a capture time
+    uint64_t frames_late;       // Shown one or more refreshes after they were due
+    uint64_t vsyncs_missed;     // Refreshes missed by late frames in total
+} FrameTimingStats;
+
+typedef struct FrameScheduler {
+    int64_t target_latency_us;  // 0: frames are due as soon as they are decoded
+    bool have_offset;
+    int64_t transit_offset_us;  // Smallest arrival - capture, rising slowly to follow clock drift
+    int64_t last_present_us;
+    FrameTimingStats stats;
+} FrameScheduler;
+
+// Reset the scheduler
+// target_latency_ms: delay after the fastest possible arrival (0 to show
+// frames immediately)
+void frame_scheduler_init(FrameScheduler* scheduler, int target_latency_ms);
+
+// Record that data captured at capture_us arrived at arrival_us (local
+// monotonic time)
+void frame_scheduler_add_arrival(FrameScheduler* scheduler, int64_t capture_us, int64_t arrival_us);
+
+// Get the local time a frame should be shown at
+// Returns: now_us if the capture time is unknown or scheduling is off
+int64_t frame_scheduler_due_time(const FrameScheduler* scheduler, int64_t capture_us, int64_t now_us);
+
+// Record that a frame reached the screen
+// period_us: refresh period measured by the platform, or 0 to estimate it
+// from consecutive presents
+void frame_scheduler_presented(
+    FrameScheduler* scheduler,
+    int64_t capture_us,
+    int64_t due_us,
+    int64_t present_us,
+    int64_t period_us
+);
+
+#endif // FRAME_SCHEDULER_H
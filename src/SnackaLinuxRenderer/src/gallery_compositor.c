@@ -0,0 +1,377 @@
+#include "gallery_compositor.h"
+#include "egl_renderer.h"
+#include "va_device.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void* gallery_thread(void* arg);
+
+GalleryCompositor* gallery_compositor_create(int width, int height) {
+    GalleryCompositor* gallery = (GalleryCompositor*)calloc(1, sizeof(GalleryCompositor));
+    if (!gallery) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&gallery->mutex, NULL);
+    pthread_cond_init(&gallery->cond, NULL);
+    gallery->refs = 1;
+
+    gallery->device = va_device_acquire();
+    if (!gallery->device || !gallery->device->va_display) {
+        fprintf(stderr, "GalleryCompositor: VA-API decoding unavailable\n");
+        gallery_compositor_release(gallery);
+        return NULL;
+    }
+
+    gallery->renderer = egl_renderer_create(
+        gallery->device->x_display,
+        gallery->device->egl_display,
+        gallery->device->egl_config
+    );
+    if (!gallery->renderer || !egl_renderer_initialize(gallery->renderer, width, height)) {
+        fprintf(stderr, "GalleryCompositor: Failed to create window\n");
+        gallery_compositor_release(gallery);
+        return NULL;
+    }
+
+    // The EGL context moves to the gallery thread
+    egl_renderer_release_context(gallery->renderer);
+
+    if (pthread_create(&gallery->thread, NULL, gallery_thread, gallery) != 0) {
+        fprintf(stderr, "GalleryCompositor: Failed to start thread\n");
+        gallery_compositor_release(gallery);
+        return NULL;
+    }
+    gallery->thread_started = true;
+
+    printf("GalleryCompositor: Created %dx%d\n", width, height);
+    return gallery;
+}
+
+void gallery_compositor_retain(GalleryCompositor* gallery) {
+    pthread_mutex_lock(&gallery->mutex);
+    gallery->refs++;
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+void gallery_compositor_release(GalleryCompositor* gallery) {
+    if (!gallery) return;
+
+    pthread_mutex_lock(&gallery->mutex);
+    bool last = --gallery->refs == 0;
+    if (last) {
+        gallery->stopping = true;
+        pthread_cond_broadcast(&gallery->cond);
+    }
+    pthread_mutex_unlock(&gallery->mutex);
+
+    if (!last) {
+        return;
+    }
+
+    if (gallery->thread_started) {
+        pthread_join(gallery->thread, NULL);
+    }
+    egl_renderer_destroy(gallery->renderer);
+    va_device_release(gallery->device);
+
+    free(gallery->draws);
+    pthread_cond_destroy(&gallery->cond);
+    pthread_mutex_destroy(&gallery->mutex);
+    free(gallery);
+}
+
+void* gallery_compositor_get_view(GalleryCompositor* gallery) {
+    if (!gallery || !gallery->renderer) {
+        return NULL;
+    }
+    return (void*)(uintptr_t)egl_renderer_get_window(gallery->renderer);
+}
+
+void gallery_compositor_set_display_size(GalleryCompositor* gallery, int width, int height) {
+    if (!gallery) return;
+
+    // Applied by the gallery thread, which owns the renderer
+    pthread_mutex_lock(&gallery->mutex);
+    gallery->requested_width = width;
+    gallery->requested_height = height;
+    gallery->resize_requested = true;
+    gallery->dirty = true;
+    pthread_cond_broadcast(&gallery->cond);
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+GalleryTile* gallery_compositor_add_tile(
+    GalleryCompositor* gallery,
+    int frame_width,
+    int frame_height,
+    const VASurfaceID* surfaces,
+    int num_surfaces
+) {
+    GalleryTile* tile = (GalleryTile*)calloc(1, sizeof(GalleryTile));
+    if (!tile) {
+        return NULL;
+    }
+
+    tile->width = frame_width;
+    tile->height = frame_height;
+    tile->frame_width = frame_width;
+    tile->frame_height = frame_height;
+    tile->posted = VA_INVALID_SURFACE;
+    tile->latched = VA_INVALID_SURFACE;
+    tile->surfaces = surfaces;
+    tile->num_surfaces = num_surfaces;
+
+    pthread_mutex_lock(&gallery->mutex);
+    tile->next = gallery->tiles;
+    gallery->tiles = tile;
+    pthread_mutex_unlock(&gallery->mutex);
+    return tile;
+}
+
+void gallery_compositor_remove_tile(GalleryCompositor* gallery, GalleryTile* tile) {
+    if (!gallery || !tile) return;
+
+    // The gallery thread unlinks the tile and drops its surface imports
+    pthread_mutex_lock(&gallery->mutex);
+    tile->removing = true;
+    gallery->dirty = true;
+    pthread_cond_broadcast(&gallery->cond);
+    while (!tile->removed) {
+        pthread_cond_wait(&gallery->cond, &gallery->mutex);
+    }
+    pthread_mutex_unlock(&gallery->mutex);
+
+    free(tile);
+}
+
+void gallery_compositor_detach_surfaces(GalleryCompositor* gallery, GalleryTile* tile) {
+    if (!gallery || !tile) return;
+
+    // The gallery thread stops drawing the tile and drops its surface imports
+    pthread_mutex_lock(&gallery->mutex);
+    tile->posted = VA_INVALID_SURFACE;
+    tile->detaching = true;
+    tile->detached = false;
+    gallery->dirty = true;
+    pthread_cond_broadcast(&gallery->cond);
+    while (!tile->detached) {
+        pthread_cond_wait(&gallery->cond, &gallery->mutex);
+    }
+    tile->surfaces = NULL;
+    tile->num_surfaces = 0;
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+void gallery_compositor_attach_surfaces(
+    GalleryCompositor* gallery,
+    GalleryTile* tile,
+    int frame_width,
+    int frame_height,
+    const VASurfaceID* surfaces,
+    int num_surfaces
+) {
+    if (!gallery || !tile) return;
+
+    pthread_mutex_lock(&gallery->mutex);
+    tile->frame_width = frame_width;
+    tile->frame_height = frame_height;
+    tile->surfaces = surfaces;
+    tile->num_surfaces = num_surfaces;
+    tile->detaching = false;
+    tile->detached = false;
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+void gallery_compositor_set_tile_rect(
+    GalleryCompositor* gallery,
+    GalleryTile* tile,
+    int x,
+    int y,
+    int width,
+    int height
+) {
+    if (!gallery || !tile) return;
+
+    pthread_mutex_lock(&gallery->mutex);
+    tile->x = x;
+    tile->y = y;
+    tile->width = width;
+    tile->height = height;
+    gallery->dirty = true;
+    pthread_cond_broadcast(&gallery->cond);
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+void gallery_compositor_set_tile_color(GalleryCompositor* gallery, GalleryTile* tile, ColorSpace color) {
+    if (!gallery || !tile) return;
+
+    pthread_mutex_lock(&gallery->mutex);
+    tile->color = color;
+    gallery->dirty = true;
+    pthread_cond_broadcast(&gallery->cond);
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+void gallery_compositor_post(GalleryCompositor* gallery, GalleryTile* tile, VASurfaceID surface) {
+    pthread_mutex_lock(&gallery->mutex);
+    tile->posted = surface;
+    gallery->dirty = true;
+    pthread_cond_broadcast(&gallery->cond);
+    pthread_mutex_unlock(&gallery->mutex);
+}
+
+bool gallery_compositor_uses_surface(GalleryCompositor* gallery, GalleryTile* tile, VASurfaceID surface) {
+    pthread_mutex_lock(&gallery->mutex);
+    bool used = tile->posted == surface || tile->latched == surface;
+    pthread_mutex_unlock(&gallery->mutex);
+    return used;
+}
+
+// Snapshot the visible tiles and latch their frames (called with the lock held)
+static int collect_draws(GalleryCompositor* gallery) {
+    int count = 0;
+    for (GalleryTile* tile = gallery->tiles; tile; tile = tile->next) {
+        tile->latched = VA_INVALID_SURFACE;
+        if (tile->posted == VA_INVALID_SURFACE || tile->detaching || tile->width <= 0 || tile->height <= 0) {
+            continue;
+        }
+
+        if (count == gallery->draw_capacity) {
+            int capacity = gallery->draw_capacity ? gallery->draw_capacity * 2 : 16;
+            GalleryDraw* draws = (GalleryDraw*)realloc(gallery->draws, capacity * sizeof(GalleryDraw));
+            if (!draws) {
+                break;
+            }
+            gallery->draws = draws;
+            gallery->draw_capacity = capacity;
+        }
+
+        tile->latched = tile->posted;
+        GalleryDraw* draw = &gallery->draws[count++];
+        draw->surface = tile->posted;
+        draw->frame_width = tile->frame_width;
+        draw->frame_height = tile->frame_height;
+        draw->color = tile->color;
+        draw->x = tile->x;
+        draw->y = tile->y;
+        draw->width = tile->width;
+        draw->height = tile->height;
+    }
+    return count;
+}
+
+static void* gallery_thread(void* arg) {
+    GalleryCompositor* gallery = (GalleryCompositor*)arg;
+    VADisplay va_display = gallery->device->va_display;
+
+    // Swaps wait for vsync, so posts that arrive meanwhile share the next frame
+    egl_renderer_set_swap_interval(gallery->renderer, 1);
+
+    pthread_mutex_lock(&gallery->mutex);
+    while (true) {
+        while (!gallery->stopping && !gallery->dirty) {
+            pthread_cond_wait(&gallery->cond, &gallery->mutex);
+        }
+        if (gallery->stopping) {
+            break;
+        }
+        gallery->dirty = false;
+
+        bool resize = gallery->resize_requested;
+        int width = gallery->requested_width;
+        int height = gallery->requested_height;
+        gallery->resize_requested = false;
+
+        // Unlink removed tiles; their decoders wait until the imports are gone
+        GalleryTile* removed = NULL;
+        for (GalleryTile** pp = &gallery->tiles; *pp; ) {
+            GalleryTile* tile = *pp;
+            if (tile->removing) {
+                *pp = tile->next;
+                tile->next = removed;
+                removed = tile;
+            } else {
+                pp = &tile->next;
+            }
+        }
+
+        // Tiles whose pools are about to be destroyed; only this thread unlinks
+        // tiles, so the list can be walked again after unlocking
+        GalleryTile* tiles = gallery->tiles;
+        bool detaching = false;
+        for (GalleryTile* tile = tiles; tile; tile = tile->next) {
+            tile->forgetting = tile->detaching && !tile->detached;
+            detaching = detaching || tile->forgetting;
+        }
+
+        int count = collect_draws(gallery);
+        pthread_mutex_unlock(&gallery->mutex);
+
+        if (detaching) {
+            // Their decoders wait in gallery_compositor_detach_surfaces, so the
+            // pools stay as they are until detached is set
+            for (GalleryTile* tile = tiles; tile; tile = tile->next) {
+                if (tile->forgetting) {
+                    egl_renderer_forget_surfaces(gallery->renderer, tile->surfaces, tile->num_surfaces);
+                }
+            }
+
+            pthread_mutex_lock(&gallery->mutex);
+            for (GalleryTile* tile = tiles; tile; tile = tile->next) {
+                if (tile->forgetting) {
+                    tile->forgetting = false;
+                    tile->detached = true;
+                }
+            }
+            pthread_cond_broadcast(&gallery->cond);
+            pthread_mutex_unlock(&gallery->mutex);
+        }
+
+        if (removed) {
+            for (GalleryTile* tile = removed; tile; tile = tile->next) {
+                egl_renderer_forget_surfaces(gallery->renderer, tile->surfaces, tile->num_surfaces);
+            }
+
+            pthread_mutex_lock(&gallery->mutex);
+            while (removed) {
+                GalleryTile* next = removed->next;
+                removed->removed = true;
+                removed = next;
+            }
+            pthread_cond_broadcast(&gallery->cond);
+            pthread_mutex_unlock(&gallery->mutex);
+        }
+
+        if (resize) {
+            egl_renderer_set_display_size(gallery->renderer, width, height);
+        }
+
+        // All tiles in one pass, one swap
+        if (egl_renderer_begin_frame(gallery->renderer)) {
+            for (int i = 0; i < count; i++) {
+                const GalleryDraw* draw = &gallery->draws[i];
+                egl_renderer_draw_surface(
+                    gallery->renderer,
+                    va_display,
+                    draw->surface,
+                    draw->frame_width,
+                    draw->frame_height,
+                    draw->color,
+                    draw->x,
+                    draw->y,
+                    draw->width,
+                    draw->height
+                );
+            }
+            egl_renderer_end_frame(gallery->renderer);
+        }
+
+        pthread_mutex_lock(&gallery->mutex);
+    }
+    pthread_mutex_unlock(&gallery->mutex);
+
+    // The releasing thread destroys the renderer
+    egl_renderer_release_context(gallery->renderer);
+    return NULL;
+}
@@ -0,0 +1,129 @@
+#ifndef GALLERY_COMPOSITOR_H
+#define GALLERY_COMPOSITOR_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <va/va.h>
+#include "color_space.h"
+
+// Forward declarations
+struct EglRenderer;
+struct VaDevice;
+
+// A decoder's place in a gallery. Decoders post their latest frame; the
+// gallery thread draws every tile in one pass and swaps once per vsync.
+typedef struct GalleryTile {
+    int x;                      // Position and size in the gallery window
+    int y;
+    int width;
+    int height;
+    int frame_width;            // Decoded frame size
+    int frame_height;
+    ColorSpace color;
+    VASurfaceID posted;         // Latest frame (VA_INVALID_SURFACE if none)
+    VASurfaceID latched;        // Frame the gallery thread is drawing
+    const VASurfaceID* surfaces; // Decoder's pool, forgotten when the tile is removed
+    int num_surfaces;
+    bool detaching;             // The pool is about to be destroyed
+    bool forgetting;            // The gallery thread is dropping its imports
+    bool detached;              // The gallery no longer uses the pool
+    bool removing;
+    bool removed;
+    struct GalleryTile* next;
+} GalleryTile;
+
+// Tile snapshot drawn outside the lock
+typedef struct GalleryDraw {
+    VASurfaceID surface;
+    int frame_width;
+    int frame_height;
+    ColorSpace color;
+    int x;
+    int y;
+    int width;
+    int height;
+} GalleryDraw;
+
+typedef struct GalleryCompositor {
+    struct VaDevice* device;
+    struct EglRenderer* renderer;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;      // Guards everything below
+    pthread_cond_t cond;
+    bool thread_started;
+    bool dirty;                 // Something changed since the last frame
+    bool stopping;
+    bool resize_requested;
+    int requested_width;
+    int requested_height;
+    GalleryTile* tiles;
+    int refs;                   // The owner and each attached decoder
+
+    // Gallery thread only
+    GalleryDraw* draws;
+    int draw_capacity;
+} GalleryCompositor;
+
+// Create a gallery window of the given size with its compositing thread
+GalleryCompositor* gallery_compositor_create(int width, int height);
+
+// Take a reference (for each attached decoder)
+void gallery_compositor_retain(GalleryCompositor* gallery);
+
+// Drop a reference; the window and thread go away with the last one
+void gallery_compositor_release(GalleryCompositor* gallery);
+
+// Get the X11 window handle
+void* gallery_compositor_get_view(GalleryCompositor* gallery);
+
+// Resize the gallery window
+void gallery_compositor_set_display_size(GalleryCompositor* gallery, int width, int height);
+
+// Add a tile for frames of the given size, drawn from surfaces in the pool
+GalleryTile* gallery_compositor_add_tile(
+    GalleryCompositor* gallery,
+    int frame_width,
+    int frame_height,
+    const VASurfaceID* surfaces,
+    int num_surfaces
+);
+
+// Remove a tile. Returns once the gallery no longer uses its surfaces.
+void gallery_compositor_remove_tile(GalleryCompositor* gallery, GalleryTile* tile);
+
+// Stop drawing a tile and drop the imports of its surfaces, keeping its place.
+// Returns once the gallery no longer uses them, so they can be destroyed.
+void gallery_compositor_detach_surfaces(GalleryCompositor* gallery, GalleryTile* tile);
+
+// Give a detached tile a new pool for frames of a new size
+void gallery_compositor_attach_surfaces(
+    GalleryCompositor* gallery,
+    GalleryTile* tile,
+    int frame_width,
+    int frame_height,
+    const VASurfaceID* surfaces,
+    int num_surfaces
+);
+
+// Place a tile (top-left origin; a zero width or height hides it)
+void gallery_compositor_set_tile_rect(
+    GalleryCompositor* gallery,
+    GalleryTile* tile,
+    int x,
+    int y,
+    int width,
+    int height
+);
+
+// Set how a tile's frames convert to RGB
+void gallery_compositor_set_tile_color(GalleryCompositor* gallery, GalleryTile* tile, ColorSpace color);
+
+// Post a decoded, synced frame to a tile
+void gallery_compositor_post(GalleryCompositor* gallery, GalleryTile* tile, VASurfaceID surface);
+
+// Check if the gallery holds a surface (posted or being drawn), so it must
+// not be decoded into
+bool gallery_compositor_uses_surface(GalleryCompositor* gallery, GalleryTile* tile, VASurfaceID surface);
+
+#endif // GALLERY_COMPOSITOR_H
@@ -0,0 +1,777 @@
+#include "h264_dpb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t max_frame_num(const H264SPS* sps) {
+    return 1u << (sps->log2_max_frame_num_minus4 + 4);
+}
+
+// MaxDpbMbs of a level (Table A-1), 0 if unknown
+static int level_max_dpb_mbs(const H264SPS* sps) {
+    switch (sps->level_idc) {
+        case 9:
+        case 10: return 396;
+        case 11: return (sps->constraint_flags & 0x10) && sps->profile_idc != 100 ? 396 : 900;  // Level 1b
+        case 12:
+        case 13:
+        case 20: return 2376;
+        case 21: return 4752;
+        case 22:
+        case 30: return 8100;
+        case 31: return 18000;
+        case 32: return 20480;
+        case 40:
+        case 41: return 32768;
+        case 42: return 34816;
+        case 50: return 110400;
+        case 51:
+        case 52: return 184320;
+        case 60:
+        case 61:
+        case 62: return 696320;
+        default: return 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Storage and output
+// ---------------------------------------------------------------------------
+
+static bool is_reference(const H264Picture* picture) {
+    return picture->short_term_ref || picture->long_term_ref;
+}
+
+static void output_picture(H264Dpb* dpb, H264Picture* picture) {
+    picture->needed_for_output = false;
+    dpb->last_output_poc = picture->pic_order_cnt;
+    dpb->output_since_idr = true;
+    if (dpb->output && !picture->non_existing) {
+        dpb->output(dpb->user_data, picture);
+    }
+}
+
+// Remove frames that are neither referenced nor waiting for output
+static void remove_unused(H264Dpb* dpb) {
+    int kept = 0;
+    for (int i = 0; i < dpb->num_frames; i++) {
+        if (dpb->frames[i].needed_for_output || is_reference(&dpb->frames[i])) {
+            dpb->frames[kept++] = dpb->frames[i];
+        }
+    }
+    dpb->num_frames = kept;
+}
+
+static int count_waiting(const H264Dpb* dpb) {
+    int count = 0;
+    for (int i = 0; i < dpb->num_frames; i++) {
+        if (dpb->frames[i].needed_for_output) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Output the waiting frame with the lowest picture order count (C.4.5.3)
+static bool bump(H264Dpb* dpb) {
+    H264Picture* next = NULL;
+    for (int i = 0; i < dpb->num_frames; i++) {
+        H264Picture* frame = &dpb->frames[i];
+        if (frame->needed_for_output && (!next || frame->pic_order_cnt < next->pic_order_cnt)) {
+            next = frame;
+        }
+    }
+    if (!next) {
+        return false;
+    }
+
+    output_picture(dpb, next);
+    remove_unused(dpb);
+    return true;
+}
+
+// Mark the short-term reference with the lowest FrameNumWrap as unused
+static bool drop_oldest_short_term(H264Dpb* dpb) {
+    H264Picture* oldest = NULL;
+    for (int i = 0; i < dpb->num_frames; i++) {
+        H264Picture* frame = &dpb->frames[i];
+        if (frame->short_term_ref && (!oldest || frame->frame_num_wrap < oldest->frame_num_wrap)) {
+            oldest = frame;
+        }
+    }
+    if (!oldest) {
+        return false;
+    }
+    oldest->short_term_ref = false;
+    return true;
+}
+
+static void store_picture(H264Dpb* dpb, const H264Picture* picture) {
+    while (dpb->num_frames >= dpb->max_frames) {
+        if (bump(dpb)) {
+            continue;
+        }
+
+        // Every frame is a reference: the stream uses more than the DPB allows
+        fprintf(stderr, "H264Dpb: DPB full of reference frames, dropping the oldest\n");
+        if (drop_oldest_short_term(dpb)) {
+            remove_unused(dpb);
+        } else {
+            memmove(&dpb->frames[0], &dpb->frames[1], (dpb->num_frames - 1) * sizeof(H264Picture));
+            dpb->num_frames--;
+        }
+    }
+
+    dpb->frames[dpb->num_frames++] = *picture;
+}
+
+// ---------------------------------------------------------------------------
+// Reference marking (8.2.5)
+// ---------------------------------------------------------------------------
+
+static void update_frame_num_wrap(H264Dpb* dpb, uint32_t frame_num, uint32_t max) {
+    for (int i = 0; i < dpb->num_frames; i++) {
+        H264Picture* frame = &dpb->frames[i];
+        frame->frame_num_wrap = frame->frame_num > frame_num
+            ? (int32_t)frame->frame_num - (int32_t)max
+            : (int32_t)frame->frame_num;
+    }
+}
+
+static void sliding_window(H264Dpb* dpb) {
+    int limit = dpb->max_num_ref_frames > 0 ? dpb->max_num_ref_frames : 1;
+    while (true) {
+        int num_refs = 0;
+        for (int i = 0; i < dpb->num_frames; i++) {
+            if (is_reference(&dpb->frames[i])) {
+                num_refs++;
+            }
+        }
+        if (num_refs < limit || !drop_oldest_short_term(dpb)) {
+            return;
+        }
+    }
+}
+
+static H264Picture* find_short_term(H264Dpb* dpb, int32_t pic_num) {
+    for (int i = 0; i < dpb->num_frames; i++) {
+        H264Picture* frame = &dpb->frames[i];
+        if (frame->short_term_ref && frame->frame_num_wrap == pic_num) {
+            return frame;
+        }
+    }
+    return NULL;
+}
+
+static H264Picture* find_long_term(H264Dpb* dpb, int32_t long_term_pic_num) {
+    for (int i = 0; i < dpb->num_frames; i++) {
+        H264Picture* frame = &dpb->frames[i];
+        if (frame->long_term_ref && frame->long_term_frame_idx == long_term_pic_num) {
+            return frame;
+        }
+    }
+    return NULL;
+}
+
+// Free a long-term frame index for reuse
+static void release_long_term_idx(H264Dpb* dpb, int32_t idx, const H264Picture* keep) {
+    for (int i = 0; i < dpb->num_frames; i++) {
+        H264Picture* frame = &dpb->frames[i];
+        if (frame != keep && frame->long_term_ref && frame->long_term_frame_idx == idx) {
+            frame->long_term_ref = false;
+        }
+    }
+}
+
+static void apply_mmco(H264Dpb* dpb, const H264SliceHeader* slice) {
+    H264Picture* current = &dpb->current;
+    int32_t curr_pic_num = (int32_t)current->frame_num;
+
+    for (int i = 0; i < slice->num_mmco; i++) {
+        const H264MMCO* mmco = &slice->mmco[i];
+        H264Picture* frame;
+
+        switch (mmco->op) {
+            case 1:  // Short-term to unused
+                frame = find_short_term(dpb, curr_pic_num - (int32_t)(mmco->difference_of_pic_nums_minus1 + 1));
+                if (frame) {
+                    frame->short_term_ref = false;
+                }
+                break;
+
+            case 2:  // Long-term to unused
+                frame = find_long_term(dpb, (int32_t)mmco->long_term_pic_num);
+                if (frame) {
+                    frame->long_term_ref = false;
+                }
+                break;
+
+            case 3:  // Short-term to long-term
+                frame = find_short_term(dpb, curr_pic_num - (int32_t)(mmco->difference_of_pic_nums_minus1 + 1));
+                if (frame) {
+                    release_long_term_idx(dpb, (int32_t)mmco->long_term_frame_idx, frame);
+                    frame->short_term_ref = false;
+                    frame->long_term_ref = true;
+                    frame->long_term_frame_idx = (int32_t)mmco->long_term_frame_idx;
+                }
+                break;
+
+            case 4:  // Limit long-term frame indices
+                dpb->max_long_term_frame_idx = (int32_t)mmco->max_long_term_frame_idx_plus1 - 1;
+                for (int j = 0; j < dpb->num_frames; j++) {
+                    frame = &dpb->frames[j];
+                    if (frame->long_term_ref && frame->long_term_frame_idx > dpb->max_long_term_frame_idx) {
+                        frame->long_term_ref = false;
+                    }
+                }
+                break;
+
+            case 5:  // Everything to unused
+                for (int j = 0; j < dpb->num_frames; j++) {
+                    dpb->frames[j].short_term_ref = false;
+                    dpb->frames[j].long_term_ref = false;
+                }
+                dpb->max_long_term_frame_idx = -1;
+                current->has_mmco5 = true;
+                break;
+
+            case 6:  // Current picture to long-term
+                release_long_term_idx(dpb, (int32_t)mmco->long_term_frame_idx, current);
+                current->long_term_ref = true;
+                current->long_term_frame_idx = (int32_t)mmco->long_term_frame_idx;
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Picture order count (8.2.1)
+// ---------------------------------------------------------------------------
+
+static int32_t frame_num_offset(const H264Dpb* dpb, const H264SPS* sps, const H264SliceHeader* slice) {
+    if (slice->idr_pic_flag) {
+        return 0;
+    }
+    if (dpb->prev_frame_num > slice->frame_num) {
+        return dpb->prev_frame_num_offset + (int32_t)max_frame_num(sps);
+    }
+    return dpb->prev_frame_num_offset;
+}
+
+static void compute_poc(H264Dpb* dpb, const H264SPS* sps, const H264SliceHeader* slice, H264Picture* picture) {
+    int32_t top = 0;
+    int32_t bottom = 0;
+
+    switch (sps->pic_order_cnt_type) {
+        case 0: {
+            int32_t max_lsb = 1 << (sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+            int32_t lsb = (int32_t)slice->pic_order_cnt_lsb;
+            int32_t msb = dpb->prev_poc_msb;
+            if (lsb < dpb->prev_poc_lsb && dpb->prev_poc_lsb - lsb >= max_lsb / 2) {
+                msb += max_lsb;
+            } else if (lsb > dpb->prev_poc_lsb && lsb - dpb->prev_poc_lsb > max_lsb / 2) {
+                msb -= max_lsb;
+            }
+            top = msb + lsb;
+            bottom = top + slice->delta_pic_order_cnt_bottom;
+            dpb->current_poc_msb = msb;
+            break;
+        }
+
+        case 1: {
+            int32_t offset = frame_num_offset(dpb, sps, slice);
+            int32_t cycle_length = sps->num_ref_frames_in_pic_order_cnt_cycle;
+            int32_t abs_frame_num = cycle_length != 0 ? offset + (int32_t)slice->frame_num : 0;
+            if (slice->nal_ref_idc == 0 && abs_frame_num > 0) {
+                abs_frame_num--;
+            }
+
+            int32_t expected = 0;
+            if (abs_frame_num > 0) {
+                int32_t expected_delta_per_cycle = 0;
+                for (int i = 0; i < cycle_length; i++) {
+                    expected_delta_per_cycle += sps->offset_for_ref_frame[i];
+                }
+                int32_t cycle_count = (abs_frame_num - 1) / cycle_length;
+                int32_t in_cycle = (abs_frame_num - 1) % cycle_length;
+                expected = cycle_count * expected_delta_per_cycle;
+                for (int i = 0; i <= in_cycle; i++) {
+                    expected += sps->offset_for_ref_frame[i];
+                }
+            }
+            if (slice->nal_ref_idc == 0) {
+                expected += sps->offset_for_non_ref_pic;
+            }
+
+            top = expected + slice->delta_pic_order_cnt[0];
+            bottom = top + sps->offset_for_top_to_bottom_field + slice->delta_pic_order_cnt[1];
+            dpb->current_frame_num_offset = offset;
+            break;
+        }
+
+        case 2: {
+            int32_t offset = frame_num_offset(dpb, sps, slice);
+            if (!slice->idr_pic_flag) {
+                top = 2 * (offset + (int32_t)slice->frame_num) - (slice->nal_ref_idc == 0 ? 1 : 0);
+            }
+            bottom = top;
+            dpb->current_frame_num_offset = offset;
+            break;
+        }
+    }
+
+    picture->top_field_order_cnt = top;
+    picture->bottom_field_order_cnt = bottom;
+    picture->pic_order_cnt = top < bottom ? top : bottom;
+}
+
+// Infer "non-existing" frames for skipped frame_num values (8.2.5.2). They have no
+// surface; slices that still refer to them decode with missing references.
+static void fill_frame_num_gap(H264Dpb* dpb, const H264SPS* sps, uint32_t frame_num) {
+    uint32_t max = max_frame_num(sps);
+    uint32_t unused = (dpb->prev_ref_frame_num + 1) % max;
+
+    if (!sps->gaps_in_frame_num_value_allowed_flag) {
+        fprintf(stderr, "H264Dpb: frame_num gap %u -> %u (lost pictures)\n",
+                dpb->prev_ref_frame_num, frame_num);
+    }
+
+    while (unused != frame_num) {
+        H264Picture gap;
+        memset(&gap, 0, sizeof(gap));
+        gap.surface = -1;
+        gap.frame_num = unused;
+        gap.non_existing = true;
+        gap.short_term_ref = true;
+
+        // POC types 1 and 2 count frames through the gap
+        if (dpb->prev_frame_num > unused) {
+            dpb->prev_frame_num_offset += (int32_t)max;
+        }
+        dpb->prev_frame_num = unused;
+
+        update_frame_num_wrap(dpb, unused, max);
+        sliding_window(dpb);
+        remove_unused(dpb);
+        store_picture(dpb, &gap);
+
+        dpb->prev_ref_frame_num = unused;
+        unused = (unused + 1) % max;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+void h264_dpb_init(H264Dpb* dpb, H264OutputCallback output, void* user_data) {
+    memset(dpb, 0, sizeof(*dpb));
+    dpb->max_frames = H264_DPB_MAX_FRAMES;
+    dpb->max_num_ref_frames = H264_DPB_MAX_FRAMES;
+    dpb->max_long_term_frame_idx = -1;
+    dpb->output = output;
+    dpb->user_data = user_data;
+}
+
+void h264_dpb_configure(H264Dpb* dpb, const H264SPS* sps) {
+    int frames = H264_DPB_MAX_FRAMES;
+    int max_dpb_mbs = level_max_dpb_mbs(sps);
+    if (max_dpb_mbs > 0) {
+        frames = max_dpb_mbs / (h264_get_width_in_mbs(sps) * h264_get_height_in_mbs(sps));
+    }
+    if (sps->bitstream_restriction_flag) {
+        frames = sps->max_dec_frame_buffering;
+    }
+
+    // Streams without VUI reordering info are output as soon as they are decoded;
+    // out-of-order pictures raise max_reorder later on
+    dpb->max_reorder = sps->bitstream_restriction_flag ? sps->max_num_reorder_frames : 0;
+    dpb->max_num_ref_frames = sps->max_num_ref_frames;
+
+    // Room for the references plus the frames held back for reordering, even if
+    // the stream announces less
+    if (frames < sps->max_num_ref_frames + dpb->max_reorder) {
+        frames = sps->max_num_ref_frames + dpb->max_reorder;
+    }
+    if (frames < 1) {
+        frames = 1;
+    }
+    if (frames > H264_DPB_MAX_FRAMES) {
+        frames = H264_DPB_MAX_FRAMES;
+    }
+    if (dpb->max_reorder > frames) {
+        dpb->max_reorder = frames;
+    }
+    dpb->max_frames = frames;
+}
+
+bool h264_dpb_start_picture(
+    H264Dpb* dpb,
+    const H264SPS* sps,
+    const H264SliceHeader* slice,
+    int surface
+) {
+    if (slice->field_pic_flag) {
+        fprintf(stderr, "H264Dpb: Field pictures are not supported\n");
+        return false;
+    }
+    if (dpb->has_current) {
+        h264_dpb_abort_picture(dpb);
+    }
+
+    uint32_t max = max_frame_num(sps);
+
+    if (slice->idr_pic_flag) {
+        // Prior pictures are output first unless the stream says otherwise (C.4.4)
+        if (slice->no_output_of_prior_pics_flag) {
+            dpb->num_frames = 0;
+        } else {
+            h264_dpb_flush(dpb);
+        }
+        dpb->prev_ref_frame_num = 0;
+        dpb->prev_frame_num = 0;
+        dpb->prev_frame_num_offset = 0;
+        dpb->prev_poc_msb = 0;
+        dpb->prev_poc_lsb = 0;
+        dpb->output_since_idr = false;
+    } else if (slice->frame_num != dpb->prev_ref_frame_num &&
+               slice->frame_num != (dpb->prev_ref_frame_num + 1) % max) {
+        fill_frame_num_gap(dpb, sps, slice->frame_num);
+    }
+
+    H264Picture* current = &dpb->current;
+    memset(current, 0, sizeof(*current));
+    current->surface = surface;
+    current->frame_num = slice->frame_num;
+    current->frame_num_wrap = (int32_t)slice->frame_num;
+    current->idr = slice->idr_pic_flag;
+    current->needed_for_output = true;
+    compute_poc(dpb, sps, slice, current);
+
+    update_frame_num_wrap(dpb, slice->frame_num, max);
+    dpb->has_current = true;
+    return true;
+}
+
+static int compare_pic_num_desc(const void* a, const void* b) {
+    const H264Picture* pa = *(const H264Picture* const*)a;
+    const H264Picture* pb = *(const H264Picture* const*)b;
+    return (pb->frame_num_wrap > pa->frame_num_wrap) - (pb->frame_num_wrap < pa->frame_num_wrap);
+}
+
+static int compare_long_term_idx_asc(const void* a, const void* b) {
+    const H264Picture* pa = *(const H264Picture* const*)a;
+    const H264Picture* pb = *(const H264Picture* const*)b;
+    return (pa->long_term_frame_idx > pb->long_term_frame_idx) - (pa->long_term_frame_idx < pb->long_term_frame_idx);
+}
+
+static int compare_poc_asc(const void* a, const void* b) {
+    const H264Picture* pa = *(const H264Picture* const*)a;
+    const H264Picture* pb = *(const H264Picture* const*)b;
+    return (pa->pic_order_cnt > pb->pic_order_cnt) - (pa->pic_order_cnt < pb->pic_order_cnt);
+}
+
+static int compare_poc_desc(const void* a, const void* b) {
+    return compare_poc_asc(b, a);
+}
+
+// Initial list of a B slice (8.2.4.2.3): short-term frames on one side of the
+// current POC, then the other side, then long-term frames
+static int init_b_list(
+    const H264Picture** list,
+    const H264Picture** short_term,
+    int num_short,
+    const H264Picture** long_term,
+    int num_long,
+    int32_t poc,
+    bool before_first
+) {
+    const H264Picture* before[H264_DPB_MAX_FRAMES];
+    const H264Picture* after[H264_DPB_MAX_FRAMES];
+    int num_before = 0;
+    int num_after = 0;
+
+    for (int i = 0; i < num_short; i++) {
+        if (short_term[i]->pic_order_cnt < poc) {
+            before[num_before++] = short_term[i];
+        } else {
+            after[num_after++] = short_term[i];
+        }
+    }
+    qsort(before, num_before, sizeof(before[0]), compare_poc_desc);
+    qsort(after, num_after, sizeof(after[0]), compare_poc_asc);
+
+    int count = 0;
+    if (before_first) {
+        memcpy(list + count, before, num_before * sizeof(before[0]));
+        count += num_before;
+        memcpy(list + count, after, num_after * sizeof(after[0]));
+        count += num_after;
+    } else {
+        memcpy(list + count, after, num_after * sizeof(after[0]));
+        count += num_after;
+        memcpy(list + count, before, num_before * sizeof(before[0]));
+        count += num_before;
+    }
+    memcpy(list + count, long_term, num_long * sizeof(long_term[0]));
+    return count + num_long;
+}
+
+// Reorder a list as coded in ref_pic_list_modification() (8.2.4.3)
+static void modify_list(
+    const H264Dpb* dpb,
+    const H264SPS* sps,
+    const H264SliceHeader* slice,
+    int list_index,
+    const H264Picture** list,
+    int count
+) {
+    const int32_t max_pic_num = (int32_t)max_frame_num(sps);
+    const int32_t curr_pic_num = (int32_t)slice->frame_num;
+    int32_t pic_num_pred = curr_pic_num;
+    int ref_idx = 0;
+
+    for (int m = 0; m < slice->num_ref_modifications[list_index] && ref_idx < count; m++) {
+        const H264RefModification* mod = &slice->ref_modifications[list_index][m];
+        const H264Picture* picture = NULL;
+        bool long_term = mod->idc == 2;
+        int32_t pic_num;
+
+        if (!long_term) {
+            int32_t abs_diff = (int32_t)mod->value + 1;
+            int32_t no_wrap;
+            if (mod->idc == 0) {
+                no_wrap = pic_num_pred - abs_diff;
+                if (no_wrap < 0) {
+                    no_wrap += max_pic_num;
+                }
+            } else {
+                no_wrap = pic_num_pred + abs_diff;
+                if (no_wrap >= max_pic_num) {
+                    no_wrap -= max_pic_num;
+                }
+            }
+            pic_num_pred = no_wrap;
+            pic_num = no_wrap > curr_pic_num ? no_wrap - max_pic_num : no_wrap;
+        } else {
+            pic_num = (int32_t)mod->value;
+        }
+
+        for (int i = 0; i < dpb->num_frames; i++) {
+            const H264Picture* frame = &dpb->frames[i];
+            if (long_term ? (frame->long_term_ref && frame->long_term_frame_idx == pic_num)
+                          : (frame->short_term_ref && frame->frame_num_wrap == pic_num)) {
+                picture = frame;
+                break;
+            }
+        }
+        if (!picture) {
+            fprintf(stderr, "H264Dpb: List modification refers to a missing %s picture %d\n",
+                    long_term ? "long-term" : "short-term", pic_num);
+        }
+
+        // Insert at ref_idx and remove the later duplicate (list has count + 1 entries)
+        for (int c = count; c > ref_idx; c--) {
+            list[c] = list[c - 1];
+        }
+        list[ref_idx++] = picture;
+        int n = ref_idx;
+        for (int c = ref_idx; c <= count; c++) {
+            if (list[c] != picture || !picture) {
+                list[n++] = list[c];
+            }
+        }
+    }
+}
+
+void h264_dpb_build_ref_lists(
+    const H264Dpb* dpb,
+    const H264SPS* sps,
+    const H264SliceHeader* slice,
+    const H264Picture* lists[2][H264_MAX_REFS]
+) {
+    memset(lists, 0, sizeof(const H264Picture*) * 2 * H264_MAX_REFS);
+    if (slice->slice_type == H264_SLICE_I || slice->slice_type == H264_SLICE_SI) {
+        return;
+    }
+
+    const H264Picture* short_term[H264_DPB_MAX_FRAMES];
+    const H264Picture* long_term[H264_DPB_MAX_FRAMES];
+    int num_short = 0;
+    int num_long = 0;
+    for (int i = 0; i < dpb->num_frames; i++) {
+        const H264Picture* frame = &dpb->frames[i];
+        if (frame->short_term_ref) {
+            short_term[num_short++] = frame;
+        } else if (frame->long_term_ref) {
+            long_term[num_long++] = frame;
+        }
+    }
+    qsort(long_term, num_long, sizeof(long_term[0]), compare_long_term_idx_asc);
+
+    const H264Picture* initial[2][H264_DPB_MAX_FRAMES * 2];
+    int initial_count[2] = { 0, 0 };
+    int num_lists = 1;
+
+    if (slice->slice_type == H264_SLICE_B) {
+        int32_t poc = dpb->current.pic_order_cnt;
+        initial_count[0] = init_b_list(initial[0], short_term, num_short, long_term, num_long, poc, true);
+        initial_count[1] = init_b_list(initial[1], short_term, num_short, long_term, num_long, poc, false);
+
+        // A second list identical to the first gets its first two entries swapped
+        if (initial_count[1] > 1 &&
+            memcmp(initial[0], initial[1], initial_count[1] * sizeof(initial[0][0])) == 0) {
+            const H264Picture* first = initial[1][0];
+            initial[1][0] = initial[1][1];
+            initial[1][1] = first;
+        }
+        num_lists = 2;
+    } else {
+        // P and SP: short-term by descending PicNum, then long-term
+        qsort(short_term, num_short, sizeof(short_term[0]), compare_pic_num_desc);
+        memcpy(initial[0], short_term, num_short * sizeof(short_term[0]));
+        memcpy(initial[0] + num_short, long_term, num_long * sizeof(long_term[0]));
+        initial_count[0] = num_short + num_long;
+    }
+
+    for (int l = 0; l < num_lists; l++) {
+        int count = (l == 0 ? slice->num_ref_idx_l0_active_minus1 : slice->num_ref_idx_l1_active_minus1) + 1;
+        const H264Picture* list[H264_MAX_REFS + 1];
+        for (int i = 0; i <= count; i++) {
+            list[i] = i < initial_count[l] && i < count ? initial[l][i] : NULL;
+        }
+
+        modify_list(dpb, sps, slice, l, list, count);
+        memcpy(lists[l], list, count * sizeof(list[0]));
+    }
+}
+
+void h264_dpb_finish_picture(H264Dpb* dpb, const H264SliceHeader* slice) {
+    if (!dpb->has_current) {
+        return;
+    }
+    H264Picture* current = &dpb->current;
+    dpb->has_current = false;
+
+    // Reference marking
+    if (slice->nal_ref_idc != 0) {
+        if (slice->idr_pic_flag) {
+            if (slice->long_term_reference_flag) {
+                current->long_term_ref = true;
+                current->long_term_frame_idx = 0;
+                dpb->max_long_term_frame_idx = 0;
+            } else {
+                dpb->max_long_term_frame_idx = -1;
+            }
+        } else if (slice->adaptive_ref_pic_marking_mode_flag) {
+            apply_mmco(dpb, slice);
+        }
+
+        if (!current->long_term_ref) {
+            // Also cleans up after streams whose MMCOs leave too many references
+            sliding_window(dpb);
+            current->short_term_ref = true;
+        }
+    }
+
+    if (current->has_mmco5) {
+        // Prior pictures are output before the current one (C.4.4); its POC restarts at 0
+        h264_dpb_flush(dpb);
+        int32_t temp = current->pic_order_cnt;
+        current->top_field_order_cnt -= temp;
+        current->bottom_field_order_cnt -= temp;
+        current->pic_order_cnt = 0;
+        current->frame_num = 0;
+        current->frame_num_wrap = 0;
+        dpb->output_since_idr = false;
+    }
+
+    // State for the next picture's POC and frame_num gap detection
+    if (slice->nal_ref_idc != 0) {
+        if (current->has_mmco5) {
+            dpb->prev_poc_msb = 0;
+            dpb->prev_poc_lsb = current->top_field_order_cnt;
+        } else {
+            dpb->prev_poc_msb = dpb->current_poc_msb;
+            dpb->prev_poc_lsb = (int32_t)slice->pic_order_cnt_lsb;
+        }
+        dpb->prev_ref_frame_num = current->frame_num;
+    }
+    dpb->prev_frame_num_offset = current->has_mmco5 ? 0 : dpb->current_frame_num_offset;
+    dpb->prev_frame_num = current->frame_num;
+
+    remove_unused(dpb);
+
+    // A picture that precedes one already output means the stream reorders more
+    // than announced
+    if (dpb->output_since_idr && current->pic_order_cnt < dpb->last_output_poc &&
+        dpb->max_reorder < H264_DPB_MAX_FRAMES - 1) {
+        dpb->max_reorder++;
+        if (dpb->max_frames < H264_DPB_MAX_FRAMES && dpb->max_frames < dpb->max_num_ref_frames + dpb->max_reorder) {
+            dpb->max_frames++;
+        }
+        fprintf(stderr, "H264Dpb: Out-of-order picture, reordering up to %d frames\n", dpb->max_reorder);
+    }
+
+    // A non-reference picture that would be output next anyway skips the DPB, as
+    // does one that only fits by evicting references (C.4.5.2)
+    if (!is_reference(current)) {
+        int waiting = count_waiting(dpb);
+        bool full = dpb->num_frames >= dpb->max_frames && waiting == 0;
+        bool lowest = true;
+        for (int i = 0; i < dpb->num_frames; i++) {
+            if (dpb->frames[i].needed_for_output && dpb->frames[i].pic_order_cnt < current->pic_order_cnt) {
+                lowest = false;
+                break;
+            }
+        }
+        if (full || (lowest && waiting >= dpb->max_reorder)) {
+            output_picture(dpb, current);
+            return;
+        }
+    }
+
+    store_picture(dpb, current);
+    while (count_waiting(dpb) > dpb->max_reorder && bump(dpb)) {
+    }
+}
+
+void h264_dpb_abort_picture(H264Dpb* dpb) {
+    dpb->has_current = false;
+}
+
+void h264_dpb_flush(H264Dpb* dpb) {
+    while (bump(dpb)) {
+    }
+    for (int i = 0; i < dpb->num_frames; i++) {
+        dpb->frames[i].short_term_ref = false;
+        dpb->frames[i].long_term_ref = false;
+    }
+    dpb->num_frames = 0;
+}
+
+int h264_dpb_get_references(const H264Dpb* dpb, const H264Picture* refs[H264_DPB_MAX_FRAMES]) {
+    int count = 0;
+    for (int i = 0; i < dpb->num_frames; i++) {
+        const H264Picture* frame = &dpb->frames[i];
+        if (is_reference(frame) && frame->surface >= 0) {
+            refs[count++] = frame;
+        }
+    }
+    return count;
+}
+
+bool h264_dpb_is_surface_used(const H264Dpb* dpb, int surface) {
+    if (dpb->has_current && dpb->current.surface == surface) {
+        return true;
+    }
+    for (int i = 0; i < dpb->num_frames; i++) {
+        if (dpb->frames[i].surface == surface) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,102 @@
+#ifndef H264_DPB_H
+#define H264_DPB_H
+
+#include "h264_parser.h"
+
+// H.264 decoded picture buffer: picture order counts (8.2.1), reference
+// picture lists (8.2.4), reference marking (8.2.5) and output order (C.4).
+// Only frame pictures are handled. Surfaces are opaque indices chosen by the
+// caller, so this has no VA-API dependency either.
+
+#define H264_DPB_MAX_FRAMES 16
+
+// A decoded frame
+typedef struct H264Picture {
+    int surface;                // Caller's surface index (-1 if none)
+    uint32_t frame_num;
+    int32_t frame_num_wrap;     // PicNum for frames
+    int32_t long_term_frame_idx;
+    int32_t top_field_order_cnt;
+    int32_t bottom_field_order_cnt;
+    int32_t pic_order_cnt;
+    bool short_term_ref;
+    bool long_term_ref;
+    bool needed_for_output;
+    bool non_existing;          // Inferred for a frame_num gap (8.2.5.2)
+    bool idr;
+    bool has_mmco5;
+} H264Picture;
+
+// Called for each frame in output order
+typedef void (*H264OutputCallback)(void* user_data, const H264Picture* picture);
+
+typedef struct H264Dpb {
+    H264Picture frames[H264_DPB_MAX_FRAMES];
+    int num_frames;
+    int max_frames;             // DPB size of the active SPS
+    int max_num_ref_frames;
+    int max_reorder;            // Frames held back for output ordering
+    int max_long_term_frame_idx; // -1: no long-term frame indices
+
+    // Picture being decoded
+    H264Picture current;
+    bool has_current;
+
+    // Picture order count state (8.2.1)
+    int32_t prev_poc_msb;
+    int32_t prev_poc_lsb;
+    int32_t prev_frame_num_offset;
+    uint32_t prev_frame_num;
+    uint32_t prev_ref_frame_num;
+    int32_t current_poc_msb;
+    int32_t current_frame_num_offset;
+    int32_t last_output_poc;
+    bool output_since_idr;
+
+    H264OutputCallback output;
+    void* user_data;
+} H264Dpb;
+
+// Initialize an empty DPB
+void h264_dpb_init(H264Dpb* dpb, H264OutputCallback output, void* user_data);
+
+// Size the DPB for an SPS (at an IDR picture)
+void h264_dpb_configure(H264Dpb* dpb, const H264SPS* sps);
+
+// Start a picture from its first slice: handles IDR flushing and frame_num gaps
+// and computes the picture order count. The surface must not be in use.
+bool h264_dpb_start_picture(
+    H264Dpb* dpb,
+    const H264SPS* sps,
+    const H264SliceHeader* slice,
+    int surface
+);
+
+// Build the reference picture lists of a slice of the current picture.
+// Entries past num_ref_idx_lX_active_minus1, or that refer to missing
+// pictures, are NULL.
+void h264_dpb_build_ref_lists(
+    const H264Dpb* dpb,
+    const H264SPS* sps,
+    const H264SliceHeader* slice,
+    const H264Picture* lists[2][H264_MAX_REFS]
+);
+
+// Finish the current picture: marks references, stores it and outputs any
+// frames that are due
+void h264_dpb_finish_picture(H264Dpb* dpb, const H264SliceHeader* slice);
+
+// Drop the current picture (e.g. when decoding it failed)
+void h264_dpb_abort_picture(H264Dpb* dpb);
+
+// Output every frame still waiting and clear the DPB
+void h264_dpb_flush(H264Dpb* dpb);
+
+// Get the frames in use for reference
+// @return Number of frames written to refs (at most H264_DPB_MAX_FRAMES)
+int h264_dpb_get_references(const H264Dpb* dpb, const H264Picture* refs[H264_DPB_MAX_FRAMES]);
+
+// Check if a surface holds a stored frame or the picture being decoded
+bool h264_dpb_is_surface_used(const H264Dpb* dpb, int surface);
+
+#endif // H264_DPB_H
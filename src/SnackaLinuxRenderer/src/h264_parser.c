@@ -0,0 +1,832 @@
+#include "h264_parser.h"
+#include <stdio.h>
+#include <string.h>
+
+// Default scaling lists (Table 7-3 and 7-4), in scan order
+static const uint8_t s_default_4x4_intra[16] = {
+    6, 13, 13, 20, 20, 20, 28, 28, 28, 28, 32, 32, 32, 37, 37, 42
+};
+
+static const uint8_t s_default_4x4_inter[16] = {
+    10, 14, 14, 20, 20, 20, 24, 24, 24, 24, 27, 27, 27, 30, 30, 34
+};
+
+static const uint8_t s_default_8x8_intra[64] = {
+    6, 10, 10, 13, 11, 13, 16, 16, 16, 16, 18, 18, 18, 18, 18, 23,
+    23, 23, 23, 23, 23, 25, 25, 25, 25, 25, 25, 25, 27, 27, 27, 27,
+    27, 27, 27, 27, 29, 29, 29, 29, 29, 29, 29, 31, 31, 31, 31, 31,
+    31, 33, 33, 33, 33, 33, 36, 36, 36, 36, 38, 38, 38, 40, 40, 42
+};
+
+static const uint8_t s_default_8x8_inter[64] = {
+    9, 13, 13, 15, 13, 15, 17, 17, 17, 17, 19, 19, 19, 19, 19, 21,
+    21, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 24, 24, 24, 24,
+    24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 27, 27, 27, 27, 27,
+    27, 28, 28, 28, 28, 28, 30, 30, 30, 30, 32, 32, 32, 33, 33, 35
+};
+
+// ---------------------------------------------------------------------------
+// Bit reader
+// ---------------------------------------------------------------------------
+
+void h264_br_init(H264BitReader* br, const uint8_t* data, size_t size) {
+    memset(br, 0, sizeof(*br));
+    br->data = data;
+    br->size = size;
+
+    // The stop bit is the last set bit (trailing zero bytes are cabac_zero_words)
+    size_t end = size;
+    while (end > 0 && data[end - 1] == 0) {
+        end--;
+    }
+    if (end > 0) {
+        br->stop_bit = end * 8 - (size_t)__builtin_ctz(data[end - 1]) - 1;
+    }
+}
+
+static inline int read_bit(H264BitReader* br) {
+    if (br->bits_left == 0) {
+        // Skip emulation prevention bytes (00 00 03)
+        if (br->pos < br->size && br->zero_run >= 2 && br->data[br->pos] == 0x03) {
+            br->pos++;
+            br->zero_run = 0;
+        }
+        if (br->pos >= br->size) {
+            br->error = true;
+            return 0;
+        }
+        br->current = br->data[br->pos++];
+        br->zero_run = br->current == 0 ? br->zero_run + 1 : 0;
+        br->bits_left = 8;
+    }
+
+    br->bits_left--;
+    br->bits_read++;
+    return (br->current >> br->bits_left) & 1;
+}
+
+uint32_t h264_br_read_bits(H264BitReader* br, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++) {
+        value = (value << 1) | (uint32_t)read_bit(br);
+    }
+    return value;
+}
+
+bool h264_br_read_flag(H264BitReader* br) {
+    return read_bit(br) != 0;
+}
+
+uint32_t h264_br_read_ue(H264BitReader* br) {
+    int leading_zeros = 0;
+    while (!read_bit(br)) {
+        if (br->error || ++leading_zeros > 31) {
+            br->error = true;
+            return 0;
+        }
+    }
+    if (leading_zeros == 0) {
+        return 0;
+    }
+    return ((1u << leading_zeros) - 1) + h264_br_read_bits(br, leading_zeros);
+}
+
+int32_t h264_br_read_se(H264BitReader* br) {
+    uint32_t code = h264_br_read_ue(br);
+    if (code & 1) {
+        return (int32_t)((code >> 1) + 1);
+    }
+    return -(int32_t)(code >> 1);
+}
+
+bool h264_br_more_rbsp_data(H264BitReader* br) {
+    size_t position = br->pos * 8 - (size_t)br->bits_left;
+    return !br->error && position < br->stop_bit;
+}
+
+// ---------------------------------------------------------------------------
+// Parameter sets
+// ---------------------------------------------------------------------------
+
+static bool read_nal_header(H264BitReader* br, uint8_t* nal_ref_idc, uint8_t* nal_unit_type) {
+    if (h264_br_read_flag(br)) {
+        return false;  // forbidden_zero_bit
+    }
+    *nal_ref_idc = (uint8_t)h264_br_read_bits(br, 2);
+    *nal_unit_type = (uint8_t)h264_br_read_bits(br, 5);
+    return !br->error;
+}
+
+// scaling_list() (7.3.2.1.1.1)
+static void parse_scaling_list(H264BitReader* br, uint8_t* list, int size, bool* use_default) {
+    int last_scale = 8;
+    int next_scale = 8;
+    *use_default = false;
+
+    for (int j = 0; j < size; j++) {
+        if (next_scale != 0) {
+            int32_t delta_scale = h264_br_read_se(br);
+            next_scale = (last_scale + delta_scale + 256) % 256;
+            *use_default = (j == 0 && next_scale == 0);
+        }
+        list[j] = (uint8_t)(next_scale == 0 ? last_scale : next_scale);
+        last_scale = list[j];
+    }
+}
+
+static void parse_scaling_matrix(
+    H264BitReader* br,
+    int count,
+    bool present[12],
+    bool use_default[12],
+    uint8_t lists_4x4[6][16],
+    uint8_t lists_8x8[6][64]
+) {
+    for (int i = 0; i < count; i++) {
+        present[i] = h264_br_read_flag(br);
+        if (!present[i]) {
+            continue;
+        }
+        if (i < 6) {
+            parse_scaling_list(br, lists_4x4[i], 16, &use_default[i]);
+        } else {
+            parse_scaling_list(br, lists_8x8[i - 6], 64, &use_default[i]);
+        }
+    }
+}
+
+// hrd_parameters() (E.1.2), only skipped over
+static void skip_hrd_parameters(H264BitReader* br) {
+    uint32_t cpb_cnt_minus1 = h264_br_read_ue(br);
+    if (cpb_cnt_minus1 > 31) {
+        br->error = true;
+        return;
+    }
+    h264_br_read_bits(br, 4);  // bit_rate_scale
+    h264_br_read_bits(br, 4);  // cpb_size_scale
+    for (uint32_t i = 0; i <= cpb_cnt_minus1; i++) {
+        h264_br_read_ue(br);    // bit_rate_value_minus1
+        h264_br_read_ue(br);    // cpb_size_value_minus1
+        h264_br_read_flag(br);  // cbr_flag
+    }
+    h264_br_read_bits(br, 5);  // initial_cpb_removal_delay_length_minus1
+    h264_br_read_bits(br, 5);  // cpb_removal_delay_length_minus1
+    h264_br_read_bits(br, 5);  // dpb_output_delay_length_minus1
+    h264_br_read_bits(br, 5);  // time_offset_length
+}
+
+// vui_parameters() (E.1.1)
+static void parse_vui(H264BitReader* br, H264SPS* sps) {
+    if (h264_br_read_flag(br)) {  // aspect_ratio_info_present_flag
+        uint8_t aspect_ratio_idc = (uint8_t)h264_br_read_bits(br, 8);
+        if (aspect_ratio_idc == 255) {  // Extended_SAR
+            h264_br_read_bits(br, 16);
+            h264_br_read_bits(br, 16);
+        }
+    }
+
+    if (h264_br_read_flag(br)) {  // overscan_info_present_flag
+        h264_br_read_flag(br);
+    }
+
+    if (h264_br_read_flag(br)) {  // video_signal_type_present_flag
+        h264_br_read_bits(br, 3);  // video_format
+        sps->video_full_range_flag = h264_br_read_flag(br);
+        sps->colour_description_present_flag = h264_br_read_flag(br);
+        if (sps->colour_description_present_flag) {
+            sps->colour_primaries = (uint8_t)h264_br_read_bits(br, 8);
+            sps->transfer_characteristics = (uint8_t)h264_br_read_bits(br, 8);
+            sps->matrix_coefficients = (uint8_t)h264_br_read_bits(br, 8);
+        }
+    }
+
+    if (h264_br_read_flag(br)) {  // chroma_loc_info_present_flag
+        h264_br_read_ue(br);
+        h264_br_read_ue(br);
+    }
+
+    if (h264_br_read_flag(br)) {  // timing_info_present_flag
+        h264_br_read_bits(br, 32);  // num_units_in_tick
+        h264_br_read_bits(br, 32);  // time_scale
+        h264_br_read_flag(br);      // fixed_frame_rate_flag
+    }
+
+    bool nal_hrd = h264_br_read_flag(br);
+    if (nal_hrd) {
+        skip_hrd_parameters(br);
+    }
+    bool vcl_hrd = h264_br_read_flag(br);
+    if (vcl_hrd) {
+        skip_hrd_parameters(br);
+    }
+    if (nal_hrd || vcl_hrd) {
+        h264_br_read_flag(br);  // low_delay_hrd_flag
+    }
+
+    h264_br_read_flag(br);  // pic_struct_present_flag
+
+    sps->bitstream_restriction_flag = h264_br_read_flag(br);
+    if (sps->bitstream_restriction_flag) {
+        h264_br_read_flag(br);  // motion_vectors_over_pic_boundaries_flag
+        h264_br_read_ue(br);    // max_bytes_per_pic_denom
+        h264_br_read_ue(br);    // max_bits_per_mb_denom
+        h264_br_read_ue(br);    // log2_max_mv_length_horizontal
+        h264_br_read_ue(br);    // log2_max_mv_length_vertical
+        sps->max_num_reorder_frames = (uint8_t)h264_br_read_ue(br);
+        sps->max_dec_frame_buffering = (uint8_t)h264_br_read_ue(br);
+    }
+}
+
+static void reset_vui(H264SPS* sps) {
+    sps->video_full_range_flag = false;
+    sps->colour_description_present_flag = false;
+    sps->colour_primaries = 2;  // Unspecified
+    sps->transfer_characteristics = 2;
+    sps->matrix_coefficients = 2;
+    sps->bitstream_restriction_flag = false;
+    sps->max_num_reorder_frames = 0;
+    sps->max_dec_frame_buffering = 0;
+}
+
+bool h264_parse_sps(H264ParamSets* sets, const uint8_t* nal, size_t size, int* sps_id) {
+    H264BitReader br;
+    h264_br_init(&br, nal, size);
+
+    uint8_t nal_ref_idc, nal_unit_type;
+    if (!read_nal_header(&br, &nal_ref_idc, &nal_unit_type) || nal_unit_type != H264_NAL_SPS) {
+        return false;
+    }
+
+    H264SPS sps;
+    memset(&sps, 0, sizeof(sps));
+
+    sps.profile_idc = (uint8_t)h264_br_read_bits(&br, 8);
+    sps.constraint_flags = (uint8_t)h264_br_read_bits(&br, 8);
+    sps.level_idc = (uint8_t)h264_br_read_bits(&br, 8);
+
+    uint32_t id = h264_br_read_ue(&br);
+    if (id >= H264_MAX_SPS) {
+        fprintf(stderr, "H264Parser: Invalid SPS id %u\n", id);
+        return false;
+    }
+    sps.sps_id = (uint8_t)id;
+
+    sps.chroma_format_idc = 1;
+    switch (sps.profile_idc) {
+        case 100: case 110: case 122: case 244: case 44:
+        case 83: case 86: case 118: case 128: case 138:
+        case 139: case 134: case 135: {
+            sps.chroma_format_idc = (uint8_t)h264_br_read_ue(&br);
+            if (sps.chroma_format_idc > 3) {
+                return false;
+            }
+            if (sps.chroma_format_idc == 3) {
+                sps.separate_colour_plane_flag = h264_br_read_flag(&br);
+            }
+            sps.bit_depth_luma_minus8 = (uint8_t)h264_br_read_ue(&br);
+            sps.bit_depth_chroma_minus8 = (uint8_t)h264_br_read_ue(&br);
+            sps.qpprime_y_zero_transform_bypass_flag = h264_br_read_flag(&br);
+            sps.seq_scaling_matrix_present_flag = h264_br_read_flag(&br);
+            if (sps.seq_scaling_matrix_present_flag) {
+                parse_scaling_matrix(&br, sps.chroma_format_idc != 3 ? 8 : 12,
+                                     sps.scaling_list_present, sps.use_default_scaling_list,
+                                     sps.scaling_list_4x4, sps.scaling_list_8x8);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    uint32_t log2_max_frame_num_minus4 = h264_br_read_ue(&br);
+    if (log2_max_frame_num_minus4 > 12) {
+        return false;
+    }
+    sps.log2_max_frame_num_minus4 = (uint8_t)log2_max_frame_num_minus4;
+
+    uint32_t poc_type = h264_br_read_ue(&br);
+    if (poc_type > 2) {
+        return false;
+    }
+    sps.pic_order_cnt_type = (uint8_t)poc_type;
+
+    if (poc_type == 0) {
+        uint32_t log2_max_poc_lsb_minus4 = h264_br_read_ue(&br);
+        if (log2_max_poc_lsb_minus4 > 12) {
+            return false;
+        }
+        sps.log2_max_pic_order_cnt_lsb_minus4 = (uint8_t)log2_max_poc_lsb_minus4;
+    } else if (poc_type == 1) {
+        sps.delta_pic_order_always_zero_flag = h264_br_read_flag(&br);
+        sps.offset_for_non_ref_pic = h264_br_read_se(&br);
+        sps.offset_for_top_to_bottom_field = h264_br_read_se(&br);
+        uint32_t cycle = h264_br_read_ue(&br);
+        if (cycle > 255) {
+            return false;
+        }
+        sps.num_ref_frames_in_pic_order_cnt_cycle = (uint8_t)cycle;
+        for (uint32_t i = 0; i < cycle; i++) {
+            sps.offset_for_ref_frame[i] = h264_br_read_se(&br);
+        }
+    }
+
+    uint32_t max_num_ref_frames = h264_br_read_ue(&br);
+    if (max_num_ref_frames > 16) {
+        return false;
+    }
+    sps.max_num_ref_frames = (uint8_t)max_num_ref_frames;
+    sps.gaps_in_frame_num_value_allowed_flag = h264_br_read_flag(&br);
+
+    uint32_t width_in_mbs_minus1 = h264_br_read_ue(&br);
+    uint32_t height_in_map_units_minus1 = h264_br_read_ue(&br);
+    if (width_in_mbs_minus1 > 1023 || height_in_map_units_minus1 > 1023) {
+        return false;
+    }
+    sps.pic_width_in_mbs_minus1 = (uint16_t)width_in_mbs_minus1;
+    sps.pic_height_in_map_units_minus1 = (uint16_t)height_in_map_units_minus1;
+
+    sps.frame_mbs_only_flag = h264_br_read_flag(&br);
+    if (!sps.frame_mbs_only_flag) {
+        sps.mb_adaptive_frame_field_flag = h264_br_read_flag(&br);
+    }
+    sps.direct_8x8_inference_flag = h264_br_read_flag(&br);
+
+    sps.frame_cropping_flag = h264_br_read_flag(&br);
+    if (sps.frame_cropping_flag) {
+        sps.frame_crop_left_offset = h264_br_read_ue(&br);
+        sps.frame_crop_right_offset = h264_br_read_ue(&br);
+        sps.frame_crop_top_offset = h264_br_read_ue(&br);
+        sps.frame_crop_bottom_offset = h264_br_read_ue(&br);
+    }
+
+    if (br.error) {
+        fprintf(stderr, "H264Parser: Truncated SPS\n");
+        return false;
+    }
+
+    // A damaged VUI only costs the colour and reordering hints
+    reset_vui(&sps);
+    sps.vui_parameters_present_flag = h264_br_read_flag(&br);
+    if (sps.vui_parameters_present_flag) {
+        parse_vui(&br, &sps);
+        if (br.error) {
+            fprintf(stderr, "H264Parser: Ignoring malformed VUI in SPS %u\n", sps.sps_id);
+            reset_vui(&sps);
+        }
+    }
+
+    sps.valid = true;
+    sets->sps[sps.sps_id] = sps;
+    if (sps_id) {
+        *sps_id = sps.sps_id;
+    }
+    return true;
+}
+
+bool h264_parse_pps(H264ParamSets* sets, const uint8_t* nal, size_t size, int* pps_id) {
+    H264BitReader br;
+    h264_br_init(&br, nal, size);
+
+    uint8_t nal_ref_idc, nal_unit_type;
+    if (!read_nal_header(&br, &nal_ref_idc, &nal_unit_type) || nal_unit_type != H264_NAL_PPS) {
+        return false;
+    }
+
+    H264PPS pps;
+    memset(&pps, 0, sizeof(pps));
+
+    uint32_t id = h264_br_read_ue(&br);
+    uint32_t sps_id = h264_br_read_ue(&br);
+    if (id >= H264_MAX_PPS || sps_id >= H264_MAX_SPS) {
+        fprintf(stderr, "H264Parser: Invalid PPS id %u (SPS %u)\n", id, sps_id);
+        return false;
+    }
+    const H264SPS* sps = &sets->sps[sps_id];
+    if (!sps->valid) {
+        fprintf(stderr, "H264Parser: PPS %u refers to unknown SPS %u\n", id, sps_id);
+        return false;
+    }
+    pps.pps_id = (uint8_t)id;
+    pps.sps_id = (uint8_t)sps_id;
+
+    pps.entropy_coding_mode_flag = h264_br_read_flag(&br);
+    pps.bottom_field_pic_order_in_frame_present_flag = h264_br_read_flag(&br);
+
+    uint32_t num_slice_groups_minus1 = h264_br_read_ue(&br);
+    if (num_slice_groups_minus1 > 0) {
+        // Flexible macroblock ordering (Extended profile) is not supported by VA-API
+        fprintf(stderr, "H264Parser: Slice groups are not supported\n");
+        return false;
+    }
+
+    uint32_t l0 = h264_br_read_ue(&br);
+    uint32_t l1 = h264_br_read_ue(&br);
+    if (l0 > 31 || l1 > 31) {
+        return false;
+    }
+    pps.num_ref_idx_l0_default_active_minus1 = (uint8_t)l0;
+    pps.num_ref_idx_l1_default_active_minus1 = (uint8_t)l1;
+
+    pps.weighted_pred_flag = h264_br_read_flag(&br);
+    pps.weighted_bipred_idc = (uint8_t)h264_br_read_bits(&br, 2);
+    pps.pic_init_qp_minus26 = (int8_t)h264_br_read_se(&br);
+    pps.pic_init_qs_minus26 = (int8_t)h264_br_read_se(&br);
+    pps.chroma_qp_index_offset = (int8_t)h264_br_read_se(&br);
+    pps.deblocking_filter_control_present_flag = h264_br_read_flag(&br);
+    pps.constrained_intra_pred_flag = h264_br_read_flag(&br);
+    pps.redundant_pic_cnt_present_flag = h264_br_read_flag(&br);
+
+    pps.second_chroma_qp_index_offset = pps.chroma_qp_index_offset;
+    if (h264_br_more_rbsp_data(&br)) {
+        pps.transform_8x8_mode_flag = h264_br_read_flag(&br);
+        pps.pic_scaling_matrix_present_flag = h264_br_read_flag(&br);
+        if (pps.pic_scaling_matrix_present_flag) {
+            int count = 6 + (sps->chroma_format_idc != 3 ? 2 : 6) * (pps.transform_8x8_mode_flag ? 1 : 0);
+            parse_scaling_matrix(&br, count, pps.scaling_list_present, pps.use_default_scaling_list,
+                                 pps.scaling_list_4x4, pps.scaling_list_8x8);
+        }
+        pps.second_chroma_qp_index_offset = (int8_t)h264_br_read_se(&br);
+    }
+
+    if (br.error) {
+        fprintf(stderr, "H264Parser: Truncated PPS\n");
+        return false;
+    }
+
+    pps.valid = true;
+    sets->pps[pps.pps_id] = pps;
+    if (pps_id) {
+        *pps_id = pps.pps_id;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Slice header
+// ---------------------------------------------------------------------------
+
+static bool parse_ref_pic_list_modification(H264BitReader* br, H264SliceHeader* slice, int list) {
+    slice->num_ref_modifications[list] = 0;
+    if (!h264_br_read_flag(br)) {  // ref_pic_list_modification_flag_lX
+        return true;
+    }
+
+    while (true) {
+        uint32_t idc = h264_br_read_ue(br);
+        if (idc == 3) {
+            return true;
+        }
+        if (idc > 3 || br->error || slice->num_ref_modifications[list] >= H264_MAX_REF_MODIFICATIONS) {
+            return false;
+        }
+        H264RefModification* mod = &slice->ref_modifications[list][slice->num_ref_modifications[list]++];
+        mod->idc = (uint8_t)idc;
+        mod->value = h264_br_read_ue(br);
+    }
+}
+
+static void parse_pred_weight_table(H264BitReader* br, const H264SPS* sps, H264SliceHeader* slice) {
+    int chroma_array_type = sps->separate_colour_plane_flag ? 0 : sps->chroma_format_idc;
+
+    slice->luma_log2_weight_denom = (uint8_t)(h264_br_read_ue(br) & 7);
+    if (chroma_array_type != 0) {
+        slice->chroma_log2_weight_denom = (uint8_t)(h264_br_read_ue(br) & 7);
+    }
+
+    int lists = slice->slice_type == H264_SLICE_B ? 2 : 1;
+    for (int list = 0; list < lists; list++) {
+        H264WeightTable* table = &slice->weights[list];
+        int count = (list == 0 ? slice->num_ref_idx_l0_active_minus1 : slice->num_ref_idx_l1_active_minus1) + 1;
+
+        for (int i = 0; i < count; i++) {
+            // Defaults are the implicit identity weights
+            table->luma_weight[i] = (int16_t)(1 << slice->luma_log2_weight_denom);
+            table->luma_offset[i] = 0;
+            table->luma_weight_flag[i] = h264_br_read_flag(br);
+            if (table->luma_weight_flag[i]) {
+                table->luma_weight[i] = (int16_t)h264_br_read_se(br);
+                table->luma_offset[i] = (int16_t)h264_br_read_se(br);
+            }
+
+            if (chroma_array_type == 0) {
+                continue;
+            }
+            for (int j = 0; j < 2; j++) {
+                table->chroma_weight[i][j] = (int16_t)(1 << slice->chroma_log2_weight_denom);
+                table->chroma_offset[i][j] = 0;
+            }
+            table->chroma_weight_flag[i] = h264_br_read_flag(br);
+            if (table->chroma_weight_flag[i]) {
+                for (int j = 0; j < 2; j++) {
+                    table->chroma_weight[i][j] = (int16_t)h264_br_read_se(br);
+                    table->chroma_offset[i][j] = (int16_t)h264_br_read_se(br);
+                }
+            }
+        }
+    }
+}
+
+static bool parse_dec_ref_pic_marking(H264BitReader* br, H264SliceHeader* slice) {
+    if (slice->idr_pic_flag) {
+        slice->no_output_of_prior_pics_flag = h264_br_read_flag(br);
+        slice->long_term_reference_flag = h264_br_read_flag(br);
+        return true;
+    }
+
+    slice->adaptive_ref_pic_marking_mode_flag = h264_br_read_flag(br);
+    if (!slice->adaptive_ref_pic_marking_mode_flag) {
+        return true;
+    }
+
+    while (true) {
+        uint32_t op = h264_br_read_ue(br);
+        if (op == 0) {
+            return true;
+        }
+        if (op > 6 || br->error || slice->num_mmco >= H264_MAX_MMCO) {
+            return false;
+        }
+
+        H264MMCO* mmco = &slice->mmco[slice->num_mmco++];
+        memset(mmco, 0, sizeof(*mmco));
+        mmco->op = (uint8_t)op;
+        if (op == 1 || op == 3) {
+            mmco->difference_of_pic_nums_minus1 = h264_br_read_ue(br);
+        }
+        if (op == 2) {
+            mmco->long_term_pic_num = h264_br_read_ue(br);
+        }
+        if (op == 3 || op == 6) {
+            mmco->long_term_frame_idx = h264_br_read_ue(br);
+        }
+        if (op == 4) {
+            mmco->max_long_term_frame_idx_plus1 = h264_br_read_ue(br);
+        }
+    }
+}
+
+bool h264_parse_slice_header(
+    const H264ParamSets* sets,
+    const uint8_t* nal,
+    size_t size,
+    H264SliceHeader* slice
+) {
+    H264BitReader br;
+    h264_br_init(&br, nal, size);
+    memset(slice, 0, sizeof(*slice));
+
+    if (!read_nal_header(&br, &slice->nal_ref_idc, &slice->nal_unit_type)) {
+        return false;
+    }
+    if (slice->nal_unit_type != H264_NAL_SLICE && slice->nal_unit_type != H264_NAL_IDR) {
+        return false;
+    }
+    slice->idr_pic_flag = slice->nal_unit_type == H264_NAL_IDR;
+
+    slice->first_mb_in_slice = h264_br_read_ue(&br);
+
+    uint32_t slice_type = h264_br_read_ue(&br);
+    if (slice_type > 9) {
+        return false;
+    }
+    slice->slice_type = (uint8_t)(slice_type % 5);
+
+    uint32_t pps_id = h264_br_read_ue(&br);
+    if (pps_id >= H264_MAX_PPS || !sets->pps[pps_id].valid) {
+        fprintf(stderr, "H264Parser: Slice refers to unknown PPS %u\n", pps_id);
+        return false;
+    }
+    slice->pps_id = (uint8_t)pps_id;
+    const H264PPS* pps = &sets->pps[pps_id];
+    const H264SPS* sps = &sets->sps[pps->sps_id];
+    if (!sps->valid) {
+        return false;
+    }
+
+    if (sps->separate_colour_plane_flag) {
+        slice->colour_plane_id = (uint8_t)h264_br_read_bits(&br, 2);
+    }
+
+    slice->frame_num = h264_br_read_bits(&br, sps->log2_max_frame_num_minus4 + 4);
+
+    if (!sps->frame_mbs_only_flag) {
+        slice->field_pic_flag = h264_br_read_flag(&br);
+        if (slice->field_pic_flag) {
+            slice->bottom_field_flag = h264_br_read_flag(&br);
+        }
+    }
+
+    if (slice->idr_pic_flag) {
+        slice->idr_pic_id = h264_br_read_ue(&br);
+    }
+
+    if (sps->pic_order_cnt_type == 0) {
+        slice->pic_order_cnt_lsb = h264_br_read_bits(&br, sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+        if (pps->bottom_field_pic_order_in_frame_present_flag && !slice->field_pic_flag) {
+            slice->delta_pic_order_cnt_bottom = h264_br_read_se(&br);
+        }
+    }
+
+    if (sps->pic_order_cnt_type == 1 && !sps->delta_pic_order_always_zero_flag) {
+        slice->delta_pic_order_cnt[0] = h264_br_read_se(&br);
+        if (pps->bottom_field_pic_order_in_frame_present_flag && !slice->field_pic_flag) {
+            slice->delta_pic_order_cnt[1] = h264_br_read_se(&br);
+        }
+    }
+
+    if (pps->redundant_pic_cnt_present_flag) {
+        slice->redundant_pic_cnt = h264_br_read_ue(&br);
+    }
+
+    if (slice->slice_type == H264_SLICE_B) {
+        slice->direct_spatial_mv_pred_flag = h264_br_read_flag(&br);
+    }
+
+    slice->num_ref_idx_l0_active_minus1 = pps->num_ref_idx_l0_default_active_minus1;
+    slice->num_ref_idx_l1_active_minus1 = pps->num_ref_idx_l1_default_active_minus1;
+    if (slice->slice_type == H264_SLICE_P || slice->slice_type == H264_SLICE_SP ||
+        slice->slice_type == H264_SLICE_B) {
+        if (h264_br_read_flag(&br)) {  // num_ref_idx_active_override_flag
+            uint32_t l0 = h264_br_read_ue(&br);
+            uint32_t l1 = slice->slice_type == H264_SLICE_B ? h264_br_read_ue(&br) : 0;
+            if (l0 > 31 || l1 > 31) {
+                return false;
+            }
+            slice->num_ref_idx_l0_active_minus1 = (uint8_t)l0;
+            slice->num_ref_idx_l1_active_minus1 = (uint8_t)l1;
+        }
+    }
+
+    if (slice->slice_type != H264_SLICE_I && slice->slice_type != H264_SLICE_SI) {
+        if (!parse_ref_pic_list_modification(&br, slice, 0)) {
+            return false;
+        }
+        if (slice->slice_type == H264_SLICE_B && !parse_ref_pic_list_modification(&br, slice, 1)) {
+            return false;
+        }
+    }
+
+    if ((pps->weighted_pred_flag &&
+         (slice->slice_type == H264_SLICE_P || slice->slice_type == H264_SLICE_SP)) ||
+        (pps->weighted_bipred_idc == 1 && slice->slice_type == H264_SLICE_B)) {
+        parse_pred_weight_table(&br, sps, slice);
+    }
+
+    if (slice->nal_ref_idc != 0 && !parse_dec_ref_pic_marking(&br, slice)) {
+        return false;
+    }
+
+    if (pps->entropy_coding_mode_flag &&
+        slice->slice_type != H264_SLICE_I && slice->slice_type != H264_SLICE_SI) {
+        uint32_t cabac_init_idc = h264_br_read_ue(&br);
+        if (cabac_init_idc > 2) {
+            return false;
+        }
+        slice->cabac_init_idc = (uint8_t)cabac_init_idc;
+    }
+
+    slice->slice_qp_delta = (int8_t)h264_br_read_se(&br);
+
+    if (slice->slice_type == H264_SLICE_SP || slice->slice_type == H264_SLICE_SI) {
+        if (slice->slice_type == H264_SLICE_SP) {
+            slice->sp_for_switch_flag = h264_br_read_flag(&br);
+        }
+        slice->slice_qs_delta = (int8_t)h264_br_read_se(&br);
+    }
+
+    if (pps->deblocking_filter_control_present_flag) {
+        uint32_t idc = h264_br_read_ue(&br);
+        if (idc > 2) {
+            return false;
+        }
+        slice->disable_deblocking_filter_idc = (uint8_t)idc;
+        if (idc != 1) {
+            slice->slice_alpha_c0_offset_div2 = (int8_t)h264_br_read_se(&br);
+            slice->slice_beta_offset_div2 = (int8_t)h264_br_read_se(&br);
+        }
+    }
+
+    if (br.error) {
+        fprintf(stderr, "H264Parser: Truncated slice header\n");
+        return false;
+    }
+
+    slice->header_bits = (uint32_t)br.bits_read;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Derived values
+// ---------------------------------------------------------------------------
+
+void h264_get_scaling_lists(
+    const H264SPS* sps,
+    const H264PPS* pps,
+    uint8_t lists_4x4[6][16],
+    uint8_t lists_8x8[6][64]
+) {
+    uint8_t seq_4x4[6][16];
+    uint8_t seq_8x8[6][64];
+
+    // Sequence level, fall-back rule A (Table 7-2)
+    if (!sps->seq_scaling_matrix_present_flag) {
+        memset(seq_4x4, 16, sizeof(seq_4x4));
+        memset(seq_8x8, 16, sizeof(seq_8x8));
+    } else {
+        for (int i = 0; i < 6; i++) {
+            const uint8_t* source;
+            if (sps->scaling_list_present[i]) {
+                source = sps->use_default_scaling_list[i]
+                    ? (i < 3 ? s_default_4x4_intra : s_default_4x4_inter)
+                    : sps->scaling_list_4x4[i];
+            } else if (i == 0 || i == 3) {
+                source = i == 0 ? s_default_4x4_intra : s_default_4x4_inter;
+            } else {
+                source = seq_4x4[i - 1];
+            }
+            memcpy(seq_4x4[i], source, 16);
+        }
+        for (int i = 0; i < 6; i++) {
+            const uint8_t* source;
+            if (sps->scaling_list_present[6 + i]) {
+                source = sps->use_default_scaling_list[6 + i]
+                    ? (i % 2 == 0 ? s_default_8x8_intra : s_default_8x8_inter)
+                    : sps->scaling_list_8x8[i];
+            } else if (i < 2) {
+                source = i == 0 ? s_default_8x8_intra : s_default_8x8_inter;
+            } else {
+                source = seq_8x8[i - 2];
+            }
+            memcpy(seq_8x8[i], source, 64);
+        }
+    }
+
+    if (!pps || !pps->pic_scaling_matrix_present_flag) {
+        memcpy(lists_4x4, seq_4x4, sizeof(seq_4x4));
+        memcpy(lists_8x8, seq_8x8, sizeof(seq_8x8));
+        return;
+    }
+
+    // Picture level, fall-back rule B
+    for (int i = 0; i < 6; i++) {
+        const uint8_t* source;
+        if (pps->scaling_list_present[i]) {
+            source = pps->use_default_scaling_list[i]
+                ? (i < 3 ? s_default_4x4_intra : s_default_4x4_inter)
+                : pps->scaling_list_4x4[i];
+        } else if (i == 0 || i == 3) {
+            source = seq_4x4[i];
+        } else {
+            source = lists_4x4[i - 1];
+        }
+        memcpy(lists_4x4[i], source, 16);
+    }
+    for (int i = 0; i < 6; i++) {
+        const uint8_t* source;
+        if (pps->scaling_list_present[6 + i]) {
+            source = pps->use_default_scaling_list[6 + i]
+                ? (i % 2 == 0 ? s_default_8x8_intra : s_default_8x8_inter)
+                : pps->scaling_list_8x8[i];
+        } else if (i < 2) {
+            source = seq_8x8[i];
+        } else {
+            source = lists_8x8[i - 2];
+        }
+        memcpy(lists_8x8[i], source, 64);
+    }
+}
+
+int h264_get_width_in_mbs(const H264SPS* sps) {
+    return sps->pic_width_in_mbs_minus1 + 1;
+}
+
+int h264_get_height_in_mbs(const H264SPS* sps) {
+    return (2 - (sps->frame_mbs_only_flag ? 1 : 0)) * (sps->pic_height_in_map_units_minus1 + 1);
+}
+
+void h264_get_display_size(const H264SPS* sps, int* width, int* height) {
+    int w = h264_get_width_in_mbs(sps) * 16;
+    int h = h264_get_height_in_mbs(sps) * 16;
+
+    if (sps->frame_cropping_flag) {
+        int chroma_array_type = sps->separate_colour_plane_flag ? 0 : sps->chroma_format_idc;
+        int crop_unit_x = 1;
+        int crop_unit_y = 2 - (sps->frame_mbs_only_flag ? 1 : 0);
+        if (chroma_array_type != 0) {
+            int sub_width_c = chroma_array_type == 3 ? 1 : 2;
+            int sub_height_c = chroma_array_type == 1 ? 2 : 1;
+            crop_unit_x = sub_width_c;
+            crop_unit_y *= sub_height_c;
+        }
+
+        int crop_w = crop_unit_x * (int)(sps->frame_crop_left_offset + sps->frame_crop_right_offset);
+        int crop_h = crop_unit_y * (int)(sps->frame_crop_top_offset + sps->frame_crop_bottom_offset);
+        if (crop_w < w && crop_h < h) {
+            w -= crop_w;
+            h -= crop_h;
+        }
+    }
+
+    *width = w;
+    *height = h;
+}
@@ -0,0 +1,244 @@
+#ifndef H264_PARSER_H
+#define H264_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// H.264 bitstream parsing (SPS, PPS and slice headers).
+// Pure C with no VA-API dependency, so it can be exercised on the CPU against
+// recorded streams.
+
+#define H264_MAX_SPS 32
+#define H264_MAX_PPS 256
+#define H264_MAX_REFS 32            // Entries per reference picture list
+#define H264_MAX_MMCO 66            // Memory management operations per slice header
+#define H264_MAX_REF_MODIFICATIONS 33
+
+// NAL unit types
+enum {
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9,
+};
+
+// Slice types (slice_type % 5)
+enum {
+    H264_SLICE_P = 0,
+    H264_SLICE_B = 1,
+    H264_SLICE_I = 2,
+    H264_SLICE_SP = 3,
+    H264_SLICE_SI = 4,
+};
+
+// Bit reader over an escaped NAL unit. Emulation prevention bytes (0x03 after
+// two zero bytes) are skipped on the fly, so bit counts refer to the RBSP.
+typedef struct H264BitReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;         // Next byte to load
+    uint8_t current;    // Byte being consumed
+    int bits_left;      // Unread bits in current
+    int zero_run;       // Consecutive zero bytes before pos
+    size_t bits_read;   // RBSP bits consumed
+    size_t stop_bit;    // Position of the rbsp_stop_one_bit in the escaped data (bits)
+    bool error;         // Read past the end
+} H264BitReader;
+
+void h264_br_init(H264BitReader* br, const uint8_t* data, size_t size);
+uint32_t h264_br_read_bits(H264BitReader* br, int count);
+bool h264_br_read_flag(H264BitReader* br);
+uint32_t h264_br_read_ue(H264BitReader* br);
+int32_t h264_br_read_se(H264BitReader* br);
+bool h264_br_more_rbsp_data(H264BitReader* br);
+
+// Sequence parameter set (only the fields a decoder needs)
+typedef struct H264SPS {
+    bool valid;
+    uint8_t profile_idc;
+    uint8_t constraint_flags;
+    uint8_t level_idc;
+    uint8_t sps_id;
+    uint8_t chroma_format_idc;
+    bool separate_colour_plane_flag;
+    uint8_t bit_depth_luma_minus8;
+    uint8_t bit_depth_chroma_minus8;
+    bool qpprime_y_zero_transform_bypass_flag;
+    bool seq_scaling_matrix_present_flag;
+    bool scaling_list_present[12];
+    bool use_default_scaling_list[12];
+    uint8_t scaling_list_4x4[6][16];    // Scan order, as coded
+    uint8_t scaling_list_8x8[6][64];
+    uint8_t log2_max_frame_num_minus4;
+    uint8_t pic_order_cnt_type;
+    uint8_t log2_max_pic_order_cnt_lsb_minus4;
+    bool delta_pic_order_always_zero_flag;
+    int32_t offset_for_non_ref_pic;
+    int32_t offset_for_top_to_bottom_field;
+    uint8_t num_ref_frames_in_pic_order_cnt_cycle;
+    int32_t offset_for_ref_frame[256];
+    uint8_t max_num_ref_frames;
+    bool gaps_in_frame_num_value_allowed_flag;
+    uint16_t pic_width_in_mbs_minus1;
+    uint16_t pic_height_in_map_units_minus1;
+    bool frame_mbs_only_flag;
+    bool mb_adaptive_frame_field_flag;
+    bool direct_8x8_inference_flag;
+    bool frame_cropping_flag;
+    uint32_t frame_crop_left_offset;
+    uint32_t frame_crop_right_offset;
+    uint32_t frame_crop_top_offset;
+    uint32_t frame_crop_bottom_offset;
+
+    // VUI
+    bool vui_parameters_present_flag;
+    bool video_full_range_flag;
+    bool colour_description_present_flag;
+    uint8_t colour_primaries;
+    uint8_t transfer_characteristics;
+    uint8_t matrix_coefficients;
+    bool bitstream_restriction_flag;
+    uint8_t max_num_reorder_frames;
+    uint8_t max_dec_frame_buffering;
+} H264SPS;
+
+// Picture parameter set
+typedef struct H264PPS {
+    bool valid;
+    uint8_t pps_id;
+    uint8_t sps_id;
+    bool entropy_coding_mode_flag;
+    bool bottom_field_pic_order_in_frame_present_flag;
+    uint8_t num_slice_groups_minus1;
+    uint8_t num_ref_idx_l0_default_active_minus1;
+    uint8_t num_ref_idx_l1_default_active_minus1;
+    bool weighted_pred_flag;
+    uint8_t weighted_bipred_idc;
+    int8_t pic_init_qp_minus26;
+    int8_t pic_init_qs_minus26;
+    int8_t chroma_qp_index_offset;
+    bool deblocking_filter_control_present_flag;
+    bool constrained_intra_pred_flag;
+    bool redundant_pic_cnt_present_flag;
+    bool transform_8x8_mode_flag;
+    bool pic_scaling_matrix_present_flag;
+    bool scaling_list_present[12];
+    bool use_default_scaling_list[12];
+    uint8_t scaling_list_4x4[6][16];
+    uint8_t scaling_list_8x8[6][64];
+    int8_t second_chroma_qp_index_offset;
+} H264PPS;
+
+// One ref_pic_list_modification() operation
+typedef struct H264RefModification {
+    uint8_t idc;                // modification_of_pic_nums_idc (0-2)
+    uint32_t value;             // abs_diff_pic_num_minus1 or long_term_pic_num
+} H264RefModification;
+
+// One dec_ref_pic_marking() memory management operation
+typedef struct H264MMCO {
+    uint8_t op;                 // memory_management_control_operation (1-6)
+    uint32_t difference_of_pic_nums_minus1;
+    uint32_t long_term_pic_num;
+    uint32_t long_term_frame_idx;
+    uint32_t max_long_term_frame_idx_plus1;
+} H264MMCO;
+
+// Explicit weighted prediction table of one list
+typedef struct H264WeightTable {
+    bool luma_weight_flag[H264_MAX_REFS];
+    int16_t luma_weight[H264_MAX_REFS];
+    int16_t luma_offset[H264_MAX_REFS];
+    bool chroma_weight_flag[H264_MAX_REFS];
+    int16_t chroma_weight[H264_MAX_REFS][2];
+    int16_t chroma_offset[H264_MAX_REFS][2];
+} H264WeightTable;
+
+// Slice header
+typedef struct H264SliceHeader {
+    uint8_t nal_ref_idc;
+    uint8_t nal_unit_type;
+    bool idr_pic_flag;
+
+    uint32_t first_mb_in_slice;
+    uint8_t slice_type;         // Reduced to 0-4
+    uint8_t pps_id;
+    uint8_t colour_plane_id;
+    uint32_t frame_num;
+    bool field_pic_flag;
+    bool bottom_field_flag;
+    uint32_t idr_pic_id;
+    uint32_t pic_order_cnt_lsb;
+    int32_t delta_pic_order_cnt_bottom;
+    int32_t delta_pic_order_cnt[2];
+    uint32_t redundant_pic_cnt;
+    bool direct_spatial_mv_pred_flag;
+    uint8_t num_ref_idx_l0_active_minus1;
+    uint8_t num_ref_idx_l1_active_minus1;
+
+    uint8_t num_ref_modifications[2];
+    H264RefModification ref_modifications[2][H264_MAX_REF_MODIFICATIONS];
+
+    uint8_t luma_log2_weight_denom;
+    uint8_t chroma_log2_weight_denom;
+    H264WeightTable weights[2];
+
+    bool no_output_of_prior_pics_flag;
+    bool long_term_reference_flag;
+    bool adaptive_ref_pic_marking_mode_flag;
+    uint8_t num_mmco;
+    H264MMCO mmco[H264_MAX_MMCO];
+
+    uint8_t cabac_init_idc;
+    int8_t slice_qp_delta;
+    bool sp_for_switch_flag;
+    int8_t slice_qs_delta;
+    uint8_t disable_deblocking_filter_idc;
+    int8_t slice_alpha_c0_offset_div2;
+    int8_t slice_beta_offset_div2;
+
+    // Bits from the start of the NAL unit (header byte included) to slice_data(),
+    // not counting emulation prevention bytes
+    uint32_t header_bits;
+} H264SliceHeader;
+
+// Parameter set store
+typedef struct H264ParamSets {
+    H264SPS sps[H264_MAX_SPS];
+    H264PPS pps[H264_MAX_PPS];
+} H264ParamSets;
+
+// Parse an SPS NAL unit (header byte included) and store it
+bool h264_parse_sps(H264ParamSets* sets, const uint8_t* nal, size_t size, int* sps_id);
+
+// Parse a PPS NAL unit (header byte included) and store it. Its SPS must be known.
+bool h264_parse_pps(H264ParamSets* sets, const uint8_t* nal, size_t size, int* pps_id);
+
+// Parse the header of a slice NAL unit (types 1 and 5)
+bool h264_parse_slice_header(
+    const H264ParamSets* sets,
+    const uint8_t* nal,
+    size_t size,
+    H264SliceHeader* slice
+);
+
+// Get the scaling lists in effect for a picture (flat when none are coded).
+// Lists are in scan order; 8x8 lists are intra Y, inter Y, then chroma (4:4:4).
+void h264_get_scaling_lists(
+    const H264SPS* sps,
+    const H264PPS* pps,
+    uint8_t lists_4x4[6][16],
+    uint8_t lists_8x8[6][64]
+);
+
+// Get the picture size in pixels after cropping
+void h264_get_display_size(const H264SPS* sps, int* width, int* height);
+
+// Get the coded picture size in macroblocks
+int h264_get_width_in_mbs(const H264SPS* sps);
+int h264_get_height_in_mbs(const H264SPS* sps);
+
+#endif // H264_PARSER_H
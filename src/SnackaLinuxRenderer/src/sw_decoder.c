@@ -0,0 +1,273 @@
+#include "sw_decoder.h"
+#include <libavcodec/avcodec.h>
+#include <libavcodec/version.h>
+#include <libavutil/version.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// libavcodec and libavutil are loaded at run time, so the renderer (and its
+// VA-API path) loads on machines without them. Only the major versions the
+// headers describe are accepted: the struct layouts change with them.
+#define SW_STRING(x) #x
+#define SW_VERSION_STRING(version) SW_STRING(version)
+#define SW_LIBAVCODEC "libavcodec.so." SW_VERSION_STRING(LIBAVCODEC_VERSION_MAJOR)
+#define SW_LIBAVUTIL "libavutil.so." SW_VERSION_STRING(LIBAVUTIL_VERSION_MAJOR)
+
+// The library functions the decoder uses
+typedef struct SwApi {
+    const AVCodec* (*find_decoder)(enum AVCodecID id);
+    AVCodecContext* (*alloc_context3)(const AVCodec* codec);
+    void (*free_context)(AVCodecContext** context);
+    int (*open2)(AVCodecContext* context, const AVCodec* codec, AVDictionary** options);
+    int (*send_packet)(AVCodecContext* context, const AVPacket* packet);
+    int (*receive_frame)(AVCodecContext* context, AVFrame* frame);
+    AVPacket* (*packet_alloc)(void);
+    void (*packet_free)(AVPacket** packet);
+    AVFrame* (*frame_alloc)(void);
+    void (*frame_free)(AVFrame** frame);
+    void (*frame_unref)(AVFrame* frame);
+    void (*frame_move_ref)(AVFrame* dst, AVFrame* src);
+} SwApi;
+
+static SwApi s_api;
+static bool s_api_loaded;
+static pthread_once_t s_api_once = PTHREAD_ONCE_INIT;
+
+static bool load_symbol(void* library, const char* library_name, const char* name, void** function) {
+    *function = dlsym(library, name);
+    if (!*function) {
+        fprintf(stderr, "SwDecoder: %s has no %s\n", library_name, name);
+    }
+    return *function != NULL;
+}
+
+static void load_api(void) {
+    void* avutil = dlopen(SW_LIBAVUTIL, RTLD_NOW | RTLD_LOCAL);
+    void* avcodec = avutil ? dlopen(SW_LIBAVCODEC, RTLD_NOW | RTLD_LOCAL) : NULL;
+    if (!avcodec) {
+        fprintf(stderr, "SwDecoder: Cannot load %s and %s, software decoding disabled\n",
+                SW_LIBAVCODEC, SW_LIBAVUTIL);
+        if (avutil) {
+            dlclose(avutil);
+        }
+        return;
+    }
+
+    SwApi api;
+    bool ok = load_symbol(avcodec, SW_LIBAVCODEC, "avcodec_find_decoder", (void**)&api.find_decoder) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "avcodec_alloc_context3", (void**)&api.alloc_context3) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "avcodec_free_context", (void**)&api.free_context) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "avcodec_open2", (void**)&api.open2) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "avcodec_send_packet", (void**)&api.send_packet) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "avcodec_receive_frame", (void**)&api.receive_frame) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "av_packet_alloc", (void**)&api.packet_alloc) &&
+              load_symbol(avcodec, SW_LIBAVCODEC, "av_packet_free", (void**)&api.packet_free) &&
+              load_symbol(avutil, SW_LIBAVUTIL, "av_frame_alloc", (void**)&api.frame_alloc) &&
+              load_symbol(avutil, SW_LIBAVUTIL, "av_frame_free", (void**)&api.frame_free) &&
+              load_symbol(avutil, SW_LIBAVUTIL, "av_frame_unref", (void**)&api.frame_unref) &&
+              load_symbol(avutil, SW_LIBAVUTIL, "av_frame_move_ref", (void**)&api.frame_move_ref);
+    if (!ok) {
+        dlclose(avcodec);
+        dlclose(avutil);
+        return;
+    }
+
+    // Both libraries stay loaded
+    s_api = api;
+    s_api_loaded = true;
+}
+
+bool sw_decoder_is_available(void) {
+    pthread_once(&s_api_once, load_api);
+    return s_api_loaded;
+}
+
+struct SwDecoder {
+    AVCodecContext* context;
+    AVPacket* packet;
+    AVFrame* frame;             // Receives frames from the codec
+    AVFrame* latest;            // Latest decoded frame
+    bool have_frame;
+
+    // Access unit being gathered (Annex B, padded for the bitstream reader)
+    uint8_t* au;
+    int au_length;
+    int au_capacity;
+    int au_slices;
+    int64_t au_timestamp;       // Of the first slice
+};
+
+static const uint8_t s_start_code[4] = { 0, 0, 0, 1 };
+
+SwDecoder* sw_decoder_create(int thread_count, SwThreading threading) {
+    if (!sw_decoder_is_available()) {
+        return NULL;
+    }
+
+    const AVCodec* codec = s_api.find_decoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        fprintf(stderr, "SwDecoder: No H.264 decoder in libavcodec\n");
+        return NULL;
+    }
+
+    SwDecoder* decoder = (SwDecoder*)calloc(1, sizeof(SwDecoder));
+    if (!decoder) {
+        return NULL;
+    }
+    decoder->au_timestamp = -1;
+
+    decoder->context = s_api.alloc_context3(codec);
+    decoder->packet = s_api.packet_alloc();
+    decoder->frame = s_api.frame_alloc();
+    decoder->latest = s_api.frame_alloc();
+    if (!decoder->context || !decoder->packet || !decoder->frame || !decoder->latest) {
+        sw_decoder_destroy(decoder);
+        return NULL;
+    }
+
+    decoder->context->thread_count = thread_count;
+    switch (threading) {
+        case SW_THREADING_FRAME:
+            decoder->context->thread_type = FF_THREAD_FRAME;
+            break;
+        case SW_THREADING_BOTH:
+            decoder->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            break;
+        default:
+            decoder->context->thread_type = FF_THREAD_SLICE;
+            decoder->context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+            break;
+    }
+
+    int result = s_api.open2(decoder->context, codec, NULL);
+    if (result < 0) {
+        fprintf(stderr, "SwDecoder: avcodec_open2 failed: %d\n", result);
+        sw_decoder_destroy(decoder);
+        return NULL;
+    }
+
+    printf("SwDecoder: Using %s (%d threads, %s threading)\n", codec->name, thread_count,
+           threading == SW_THREADING_FRAME ? "frame" : threading == SW_THREADING_BOTH ? "frame+slice" : "slice");
+    return decoder;
+}
+
+void sw_decoder_destroy(SwDecoder* decoder) {
+    if (!decoder) return;
+
+    // Only created once the libraries are loaded
+    s_api.free_context(&decoder->context);
+    s_api.packet_free(&decoder->packet);
+    s_api.frame_free(&decoder->frame);
+    s_api.frame_free(&decoder->latest);
+    free(decoder->au);
+    free(decoder);
+}
+
+static bool append_nal(SwDecoder* decoder, const uint8_t* nal_data, int nal_length) {
+    int needed = decoder->au_length + (int)sizeof(s_start_code) + nal_length + AV_INPUT_BUFFER_PADDING_SIZE;
+    if (needed > decoder->au_capacity) {
+        int capacity = decoder->au_capacity ? decoder->au_capacity : 64 * 1024;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        uint8_t* au = (uint8_t*)realloc(decoder->au, capacity);
+        if (!au) {
+            return false;
+        }
+        decoder->au = au;
+        decoder->au_capacity = capacity;
+    }
+
+    memcpy(decoder->au + decoder->au_length, s_start_code, sizeof(s_start_code));
+    decoder->au_length += sizeof(s_start_code);
+    memcpy(decoder->au + decoder->au_length, nal_data, nal_length);
+    decoder->au_length += nal_length;
+    return true;
+}
+
+// Decode the gathered access unit
+static int submit_au(SwDecoder* decoder) {
+    if (decoder->au_length == 0) {
+        return 0;
+    }
+
+    memset(decoder->au + decoder->au_length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    decoder->packet->data = decoder->au;
+    decoder->packet->size = decoder->au_length;
+    decoder->packet->pts = decoder->au_timestamp >= 0 ? decoder->au_timestamp : AV_NOPTS_VALUE;
+    int result = s_api.send_packet(decoder->context, decoder->packet);
+
+    decoder->au_length = 0;
+    decoder->au_slices = 0;
+    decoder->au_timestamp = -1;
+
+    if (result < 0 && result != AVERROR(EAGAIN)) {
+        fprintf(stderr, "SwDecoder: avcodec_send_packet failed: %d\n", result);
+        return -1;
+    }
+
+    int frames = 0;
+    while (s_api.receive_frame(decoder->context, decoder->frame) == 0) {
+        s_api.frame_unref(decoder->latest);
+        s_api.frame_move_ref(decoder->latest, decoder->frame);
+        decoder->have_frame = true;
+        frames++;
+    }
+    return frames;
+}
+
+int sw_decoder_decode(SwDecoder* decoder, const uint8_t* nal_data, int nal_length, int64_t timestamp) {
+    if (!decoder || !nal_data || nal_length < 2) {
+        return -1;
+    }
+
+    uint8_t type = nal_data[0] & 0x1f;
+    bool vcl = type >= 1 && type <= 5;
+
+    // The picture is complete at the first slice of the next one or at a
+    // non-VCL NAL unit (an access unit delimiter marks the end of an access
+    // unit); first_mb_in_slice is ue(v), so a leading 1 bit means 0
+    bool end_of_picture = decoder->au_slices > 0 && (!vcl || (nal_data[1] & 0x80) != 0);
+
+    int frames = 0;
+    bool failed = false;
+    if (end_of_picture) {
+        int submitted = submit_au(decoder);
+        failed = submitted < 0;
+        frames += submitted > 0 ? submitted : 0;
+    }
+
+    if (!append_nal(decoder, nal_data, nal_length)) {
+        return -1;
+    }
+    if (vcl && decoder->au_slices++ == 0) {
+        decoder->au_timestamp = timestamp;
+    }
+    return failed ? -1 : frames;
+}
+
+bool sw_decoder_get_frame(SwDecoder* decoder, SwFrame* frame) {
+    if (!decoder || !decoder->have_frame) {
+        return false;
+    }
+
+    AVFrame* latest = decoder->latest;
+    if (latest->format != AV_PIX_FMT_YUV420P && latest->format != AV_PIX_FMT_YUVJ420P) {
+        fprintf(stderr, "SwDecoder: Unsupported frame format %d\n", latest->format);
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        frame->planes[i] = latest->data[i];
+        frame->strides[i] = latest->linesize[i];
+    }
+    frame->width = latest->width;
+    frame->height = latest->height;
+    frame->timestamp = latest->pts != AV_NOPTS_VALUE ? latest->pts : -1;
+    frame->matrix_coefficients = latest->colorspace;
+    frame->full_range = latest->color_range == AVCOL_RANGE_JPEG || latest->format == AV_PIX_FMT_YUVJ420P;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef SW_DECODER_H
+#define SW_DECODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Software H.264 decoder (libavcodec), used when VA-API cannot decode.
+// NAL units are gathered into access units before they are decoded.
+// libavcodec and libavutil are loaded on first use; without them only this
+// fallback is unavailable.
+
+// How decoding is spread over threads
+typedef enum SwThreading {
+    SW_THREADING_SLICE = 0,     // Slices of one picture in parallel (no added latency)
+    SW_THREADING_FRAME = 1,     // Consecutive pictures in parallel (a frame of latency per thread)
+    SW_THREADING_BOTH = 2,
+} SwThreading;
+
+// A decoded 8-bit 4:2:0 planar frame
+typedef struct SwFrame {
+    const uint8_t* planes[3];   // Y, U, V
+    int strides[3];
+    int width;
+    int height;
+    int64_t timestamp;          // Of the access unit it was decoded from (-1 if unknown)
+    int matrix_coefficients;    // ITU-T H.273 code, as in the VUI (2 if unspecified)
+    bool full_range;
+} SwFrame;
+
+typedef struct SwDecoder SwDecoder;
+
+// Check that libavcodec and libavutil can be loaded (loads them once)
+bool sw_decoder_is_available(void);
+
+// Create a decoder
+// thread_count: 0 to use one thread per CPU
+SwDecoder* sw_decoder_create(int thread_count, SwThreading threading);
+
+// Destroy a decoder
+void sw_decoder_destroy(SwDecoder* decoder);
+
+// Decode a NAL unit (without start code). A picture is decoded once it is
+// complete: at the first slice of the next picture or a non-VCL NAL unit such
+// as an access unit delimiter.
+// timestamp: passed through to the frame (-1 if unknown); an access unit
+// takes the timestamp of its first slice
+// Returns the number of frames that became available, or -1 on error
+int sw_decoder_decode(SwDecoder* decoder, const uint8_t* nal_data, int nal_length, int64_t timestamp);
+
+// Get the latest decoded frame (valid until the next sw_decoder_decode)
+bool sw_decoder_get_frame(SwDecoder* decoder, SwFrame* frame);
+
+#endif // SW_DECODER_H
@@ -0,0 +1,213 @@
+#include "va_device.h"
+#include <va/va_x11.h>
+#include <va/va_drm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+static VaDevice* s_device = NULL;
+static pthread_mutex_t s_device_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool open_va_display(VaDevice* device) {
+    // Try X11 VA display
+    device->va_display = vaGetDisplay(device->x_display);
+    if (device->va_display == NULL) {
+        // Try DRM backend
+        device->drm_fd = open("/dev/dri/renderD128", O_RDWR);
+        if (device->drm_fd < 0) {
+            fprintf(stderr, "VaDevice: Cannot open DRM device\n");
+            return false;
+        }
+
+        device->va_display = vaGetDisplayDRM(device->drm_fd);
+        if (device->va_display == NULL) {
+            fprintf(stderr, "VaDevice: Cannot get VA display\n");
+            return false;
+        }
+    }
+
+    int major, minor;
+    VAStatus status = vaInitialize(device->va_display, &major, &minor);
+    if (status != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VaDevice: vaInitialize failed: %d\n", status);
+        vaTerminate(device->va_display);
+        device->va_display = NULL;
+        return false;
+    }
+
+    printf("VaDevice: VA-API version %d.%d\n", major, minor);
+    return true;
+}
+
+static bool create_va_config(VaDevice* device) {
+    // Find H.264 profile
+    VAProfile profile = VAProfileH264High;
+    VAConfigAttrib attrib;
+    attrib.type = VAConfigAttribRTFormat;
+
+    VAStatus status = vaGetConfigAttributes(
+        device->va_display,
+        profile,
+        VAEntrypointVLD,
+        &attrib, 1
+    );
+
+    if (status != VA_STATUS_SUCCESS) {
+        // Try other profiles
+        profile = VAProfileH264Main;
+        status = vaGetConfigAttributes(
+            device->va_display,
+            profile,
+            VAEntrypointVLD,
+            &attrib, 1
+        );
+    }
+
+    if (status != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VaDevice: vaGetConfigAttributes failed\n");
+        return false;
+    }
+
+    // Check for NV12 support
+    if (!(attrib.value & VA_RT_FORMAT_YUV420)) {
+        fprintf(stderr, "VaDevice: YUV420 format not supported\n");
+        return false;
+    }
+
+    // Create config
+    status = vaCreateConfig(
+        device->va_display,
+        profile,
+        VAEntrypointVLD,
+        &attrib, 1,
+        &device->va_config
+    );
+
+    if (status != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VaDevice: vaCreateConfig failed: %d\n", status);
+        device->va_config = VA_INVALID_ID;
+        return false;
+    }
+
+    device->profile = profile;
+    return true;
+}
+
+static bool open_egl_display(VaDevice* device) {
+    device->egl_display = eglGetDisplay((EGLNativeDisplayType)device->x_display);
+    if (device->egl_display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "VaDevice: eglGetDisplay failed\n");
+        return false;
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(device->egl_display, &major, &minor)) {
+        fprintf(stderr, "VaDevice: eglInitialize failed\n");
+        device->egl_display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    printf("VaDevice: EGL version %d.%d\n", major, minor);
+
+    // Choose config
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+
+    EGLint num_configs;
+    if (!eglChooseConfig(device->egl_display, config_attribs, &device->egl_config, 1, &num_configs) || num_configs == 0) {
+        fprintf(stderr, "VaDevice: eglChooseConfig failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void close_device(VaDevice* device) {
+    if (device->egl_display != EGL_NO_DISPLAY) {
+        eglTerminate(device->egl_display);
+    }
+    if (device->va_display) {
+        if (device->va_config != VA_INVALID_ID) {
+            vaDestroyConfig(device->va_display, device->va_config);
+        }
+        vaTerminate(device->va_display);
+    }
+    if (device->drm_fd >= 0) {
+        close(device->drm_fd);
+    }
+    if (device->x_display) {
+        XCloseDisplay(device->x_display);
+    }
+    free(device);
+}
+
+static VaDevice* open_device(void) {
+    VaDevice* device = (VaDevice*)calloc(1, sizeof(VaDevice));
+    if (!device) {
+        return NULL;
+    }
+
+    device->drm_fd = -1;
+    device->va_config = VA_INVALID_ID;
+    device->egl_display = EGL_NO_DISPLAY;
+
+    device->x_display = XOpenDisplay(NULL);
+    if (!device->x_display) {
+        fprintf(stderr, "VaDevice: Cannot open X11 display\n");
+        close_device(device);
+        return NULL;
+    }
+
+    if (!open_egl_display(device)) {
+        close_device(device);
+        return NULL;
+    }
+
+    // Without VA-API H.264 decoding, decoders fall back to software
+    if (!open_va_display(device) || !create_va_config(device)) {
+        fprintf(stderr, "VaDevice: VA-API H.264 decoding unavailable\n");
+        if (device->va_display) {
+            vaTerminate(device->va_display);
+            device->va_display = NULL;
+        }
+    }
+
+    printf("VaDevice: Opened shared device\n");
+    return device;
+}
+
+VaDevice* va_device_acquire(void) {
+    pthread_mutex_lock(&s_device_mutex);
+    if (!s_device) {
+        s_device = open_device();
+    }
+    VaDevice* device = s_device;
+    if (device) {
+        device->refs++;
+    }
+    pthread_mutex_unlock(&s_device_mutex);
+    return device;
+}
+
+void va_device_release(VaDevice* device) {
+    if (!device) return;
+
+    pthread_mutex_lock(&s_device_mutex);
+    if (--device->refs == 0) {
+        if (s_device == device) {
+            s_device = NULL;
+        }
+        close_device(device);
+        printf("VaDevice: Closed shared device\n");
+    }
+    pthread_mutex_unlock(&s_device_mutex);
+}
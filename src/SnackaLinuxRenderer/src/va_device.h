@@ -0,0 +1,30 @@
+#ifndef VA_DEVICE_H
+#define VA_DEVICE_H
+
+#include <stdbool.h>
+#include <EGL/egl.h>
+#include <X11/Xlib.h>
+#include <va/va.h>
+
+// Process-wide device shared by all decoders: the X connection, the VA display
+// (X11, or DRM as a fallback), the H.264 decode config and the EGL display.
+// Decoders only own their VA context, surfaces and renderer window.
+typedef struct VaDevice {
+    Display* x_display;
+    VADisplay va_display;       // NULL if VA-API cannot decode H.264
+    int drm_fd;                 // -1 unless using the DRM backend
+    VAProfile profile;
+    VAConfigID va_config;       // H.264 VLD decode config
+    EGLDisplay egl_display;
+    EGLConfig egl_config;       // RGBA8888 window config for GLES 2
+    int refs;
+} VaDevice;
+
+// Get the shared device, opening it on first use
+// Returns NULL if X11 or EGL is unavailable
+VaDevice* va_device_acquire(void);
+
+// Drop a reference; the device closes with the last one
+void va_device_release(VaDevice* device);
+
+#endif // VA_DEVICE_H
@@ -1,35 +1,100 @@
 #include "vaapi_decoder.h"
 #include "egl_renderer.h"
+#include "va_device.h"
+#include "gallery_compositor.h"
+#include "sw_decoder.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
-// Number of surfaces in the pool (H.264 max DPB size + extra)
-#define NUM_SURFACES 17
+// Number of surfaces in the pool (H.264 max DPB size + the picture being
+// decoded + the picture on screen + a picture still being drawn by a gallery +
+// decoded pictures waiting to be shown)
+#define NUM_SURFACES (H264_DPB_MAX_FRAMES + 3 + VAAPI_MAX_PENDING_FRAMES)
+
+// Longest a decoded frame waits for the input queue to drain before it is shown
+// (without scheduling)
+#define MAX_PRESENT_DELAY_US 50000
+
+static pthread_once_t s_x_threads_once = PTHREAD_ONCE_INIT;
+
+static void init_x_threads(void) {
+    // Decode threads and callers share one X connection
+    XInitThreads();
+}
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 VaapiDecoder* vaapi_decoder_create(void) {
+    pthread_once(&s_x_threads_once, init_x_threads);
+
     VaapiDecoder* decoder = (VaapiDecoder*)calloc(1, sizeof(VaapiDecoder));
     if (!decoder) {
         return NULL;
     }
 
-    decoder->drm_fd = -1;
+    decoder->va_context = VA_INVALID_ID;
+    decoder->active_sps_id = -1;
+    decoder->displayed_surface = -1;
+    decoder->nal_capture_us = -1;
+    decoder->download_image.image_id = VA_INVALID_ID;
+    frame_scheduler_init(&decoder->scheduler, 0);
+    pthread_mutex_init(&decoder->mutex, NULL);
+
+    // The decode thread sleeps until frames are due on the monotonic clock
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&decoder->queue_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
     return decoder;
 }
 
+static void release_picture_buffers(VaapiDecoder* decoder) {
+    for (int i = 0; i < decoder->num_picture_buffers; i++) {
+        vaDestroyBuffer(decoder->va_display, decoder->picture_buffers[i]);
+    }
+    decoder->num_picture_buffers = 0;
+}
+
 void vaapi_decoder_destroy(VaapiDecoder* decoder) {
     if (!decoder) return;
 
-    // Destroy renderer
+    // Stop the decode thread
+    if (decoder->async) {
+        pthread_mutex_lock(&decoder->mutex);
+        decoder->stopping = true;
+        pthread_cond_signal(&decoder->queue_cond);
+        pthread_mutex_unlock(&decoder->mutex);
+        pthread_join(decoder->worker, NULL);
+        decoder->async = false;
+    }
+
+    // Destroy renderer, or leave the gallery before the surfaces go away
     if (decoder->renderer) {
         egl_renderer_destroy(decoder->renderer);
         decoder->renderer = NULL;
     }
+    if (decoder->gallery) {
+        gallery_compositor_remove_tile(decoder->gallery, decoder->tile);
+        gallery_compositor_release(decoder->gallery);
+        decoder->tile = NULL;
+        decoder->gallery = NULL;
+    }
 
-    // Destroy VA-API resources
-    if (decoder->va_initialized) {
+    // Destroy this decoder's VA-API resources, then drop the shared device
+    if (decoder->device) {
+        if (decoder->picture_open) {
+            vaEndPicture(decoder->va_display, decoder->va_context);
+        }
+        release_picture_buffers(decoder);
         if (decoder->va_context != VA_INVALID_ID) {
             vaDestroyContext(decoder->va_display, decoder->va_context);
         }
@@ -37,30 +102,33 @@ void vaapi_decoder_destroy(VaapiDecoder* decoder) {
             vaDestroySurfaces(decoder->va_display, decoder->va_surfaces, decoder->num_surfaces);
             free(decoder->va_surfaces);
         }
-        if (decoder->va_config != VA_INVALID_ID) {
-            vaDestroyConfig(decoder->va_display, decoder->va_config);
+        free(decoder->capture_times);
+        if (decoder->download_image.image_id != VA_INVALID_ID) {
+            vaDestroyImage(decoder->va_display, decoder->download_image.image_id);
         }
-        vaTerminate(decoder->va_display);
+        va_device_release(decoder->device);
     }
 
-    // Close X11 display
-    if (decoder->x_display) {
-        XCloseDisplay(decoder->x_display);
-    }
+#ifdef SNACKA_HAVE_LIBAVCODEC
+    sw_decoder_destroy(decoder->software);
+#endif
 
-    // Close DRM fd
-    if (decoder->drm_fd >= 0) {
-        close(decoder->drm_fd);
-    }
+    free(decoder->param_sets);
+    free(decoder->picture_buffers);
 
-    // Free SPS/PPS
-    free(decoder->sps);
-    free(decoder->pps);
+    if (decoder->queue) {
+        for (int i = 0; i < decoder->queue_capacity; i++) {
+            free(decoder->queue[i].data);
+        }
+        free(decoder->queue);
+    }
+    pthread_cond_destroy(&decoder->queue_cond);
+    pthread_mutex_destroy(&decoder->mutex);
 
     free(decoder);
 }
 
-bool vaapi_decoder_is_available(void) {
+static bool is_vaapi_available(void) {
     // Try to open X11 display
     Display* display = XOpenDisplay(NULL);
     if (!display) {
@@ -161,103 +229,37 @@ bool vaapi_decoder_is_available(void) {
     return has_h264;
 }
 
-static bool init_va_display(VaapiDecoder* decoder) {
-    // Open X11 display
-    decoder->x_display = XOpenDisplay(NULL);
-    if (!decoder->x_display) {
-        fprintf(stderr, "VaapiDecoder: Cannot open X11 display\n");
-        return false;
-    }
-
-    // Try X11 VA display
-    decoder->va_display = vaGetDisplay(decoder->x_display);
-    if (decoder->va_display == NULL) {
-        // Try DRM backend
-        decoder->drm_fd = open("/dev/dri/renderD128", O_RDWR);
-        if (decoder->drm_fd < 0) {
-            fprintf(stderr, "VaapiDecoder: Cannot open DRM device\n");
-            return false;
-        }
+bool vaapi_decoder_is_available(void) {
+    pthread_once(&s_x_threads_once, init_x_threads);
 
-        decoder->va_display = vaGetDisplayDRM(decoder->drm_fd);
-        if (decoder->va_display == NULL) {
-            fprintf(stderr, "VaapiDecoder: Cannot get VA display\n");
-            return false;
-        }
+    if (is_vaapi_available()) {
+        return true;
     }
 
-    int major, minor;
-    VAStatus status = vaInitialize(decoder->va_display, &major, &minor);
-    if (status != VA_STATUS_SUCCESS) {
-        fprintf(stderr, "VaapiDecoder: vaInitialize failed: %d\n", status);
-        return false;
+#ifdef SNACKA_HAVE_LIBAVCODEC
+    // Software decoding only needs the libraries and a display to render to
+    Display* display = sw_decoder_is_available() ? XOpenDisplay(NULL) : NULL;
+    if (display) {
+        XCloseDisplay(display);
+        return true;
     }
-
-    decoder->va_initialized = true;
-    printf("VaapiDecoder: VA-API version %d.%d\n", major, minor);
-    return true;
+#endif
+    return false;
 }
 
 static bool create_decoder_context(VaapiDecoder* decoder) {
-    // Find H.264 profile
-    VAProfile profile = VAProfileH264High;
-    VAConfigAttrib attrib;
-    attrib.type = VAConfigAttribRTFormat;
-
-    VAStatus status = vaGetConfigAttributes(
-        decoder->va_display,
-        profile,
-        VAEntrypointVLD,
-        &attrib, 1
-    );
-
-    if (status != VA_STATUS_SUCCESS) {
-        // Try other profiles
-        profile = VAProfileH264Main;
-        status = vaGetConfigAttributes(
-            decoder->va_display,
-            profile,
-            VAEntrypointVLD,
-            &attrib, 1
-        );
-    }
-
-    if (status != VA_STATUS_SUCCESS) {
-        fprintf(stderr, "VaapiDecoder: vaGetConfigAttributes failed\n");
-        return false;
-    }
-
-    // Check for NV12 support
-    if (!(attrib.value & VA_RT_FORMAT_YUV420)) {
-        fprintf(stderr, "VaapiDecoder: YUV420 format not supported\n");
-        return false;
-    }
-
-    // Create config
-    status = vaCreateConfig(
-        decoder->va_display,
-        profile,
-        VAEntrypointVLD,
-        &attrib, 1,
-        &decoder->va_config
-    );
-
-    if (status != VA_STATUS_SUCCESS) {
-        fprintf(stderr, "VaapiDecoder: vaCreateConfig failed: %d\n", status);
-        return false;
-    }
-
     // Create surfaces
     decoder->num_surfaces = NUM_SURFACES;
     decoder->va_surfaces = (VASurfaceID*)malloc(decoder->num_surfaces * sizeof(VASurfaceID));
-    if (!decoder->va_surfaces) {
+    decoder->capture_times = (int64_t*)malloc(decoder->num_surfaces * sizeof(int64_t));
+    if (!decoder->va_surfaces || !decoder->capture_times) {
         return false;
     }
 
-    status = vaCreateSurfaces(
+    VAStatus status = vaCreateSurfaces(
         decoder->va_display,
         VA_RT_FORMAT_YUV420,
-        decoder->width, decoder->height,
+        decoder->coded_width, decoder->coded_height,
         decoder->va_surfaces,
         decoder->num_surfaces,
         NULL, 0
@@ -273,8 +275,8 @@ static bool create_decoder_context(VaapiDecoder* decoder) {
     // Create context
     status = vaCreateContext(
         decoder->va_display,
-        decoder->va_config,
-        decoder->width, decoder->height,
+        decoder->device->va_config,
+        decoder->coded_width, decoder->coded_height,
         VA_PROGRESSIVE,
         decoder->va_surfaces,
         decoder->num_surfaces,
@@ -289,6 +291,223 @@ static bool create_decoder_context(VaapiDecoder* decoder) {
     return true;
 }
 
+static void present_surface(VaapiDecoder* decoder, int index) {
+    VASurfaceID surface = decoder->va_surfaces[index];
+
+    VAStatus status = vaSyncSurface(decoder->va_display, surface);
+    if (status != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VaapiDecoder: vaSyncSurface failed: %d\n", status);
+        return;
+    }
+
+    if (decoder->tile) {
+        gallery_compositor_post(decoder->gallery, decoder->tile, surface);
+    } else if (decoder->renderer) {
+        egl_renderer_render_surface(decoder->renderer, decoder->va_display, surface);
+    }
+    decoder->displayed_surface = index;
+}
+
+#ifdef SNACKA_HAVE_LIBAVCODEC
+static void present_software_frame(VaapiDecoder* decoder) {
+    if (!decoder->renderer) {
+        return;
+    }
+
+    SwFrame frame;
+    if (!sw_decoder_get_frame(decoder->software, &frame)) {
+        return;
+    }
+
+    egl_renderer_set_color_space(
+        decoder->renderer,
+        color_space_from_vui(frame.matrix_coefficients, frame.full_range)
+    );
+    egl_renderer_render_frame(decoder->renderer, frame.planes, frame.strides, frame.width, frame.height);
+}
+#endif
+
+// Show a decoded frame and record its timing
+static void present_frame(VaapiDecoder* decoder, const VaapiPendingFrame* frame) {
+    if (frame->surface >= 0) {
+        present_surface(decoder, frame->surface);
+    }
+#ifdef SNACKA_HAVE_LIBAVCODEC
+    else {
+        present_software_frame(decoder);
+    }
+#endif
+
+    // Gallery tiles reach the screen with the gallery's next swap
+    int64_t present_us = now_us();
+    int64_t period_us = 0;
+    if (decoder->renderer) {
+        egl_renderer_get_present_timing(decoder->renderer, &present_us, &period_us);
+    }
+    frame_scheduler_presented(&decoder->scheduler, frame->capture_us, frame->due_us, present_us, period_us);
+
+    if (decoder->headless) {
+        decoder->frame_unread = true;
+        decoder->output_capture_us = frame->capture_us;
+    }
+
+    pthread_mutex_lock(&decoder->mutex);
+    decoder->stats.frames_presented++;
+    decoder->stats.timing = decoder->scheduler.stats;
+    pthread_mutex_unlock(&decoder->mutex);
+}
+
+// Hand a decoded frame to presentation: shown now when decoding synchronously,
+// else queued for the decode thread
+static void add_output_frame(VaapiDecoder* decoder, int surface, int64_t capture_us) {
+    int64_t now = now_us();
+    VaapiPendingFrame frame = {
+        surface,
+        capture_us,
+        frame_scheduler_due_time(&decoder->scheduler, capture_us, now)
+    };
+
+    if (!decoder->async) {
+        present_frame(decoder, &frame);
+        return;
+    }
+
+    // The software decoder keeps only its latest frame, which replaces the
+    // queued one; when the queue is full the oldest frame gives way
+    int skipped = 0;
+    if (surface < 0) {
+        for (int i = 0; i < decoder->num_pending; i++) {
+            if (decoder->pending[i].surface < 0) {
+                memmove(&decoder->pending[i], &decoder->pending[i + 1],
+                        (decoder->num_pending - i - 1) * sizeof(VaapiPendingFrame));
+                decoder->num_pending--;
+                skipped++;
+                break;
+            }
+        }
+    }
+    if (decoder->num_pending == VAAPI_MAX_PENDING_FRAMES) {
+        memmove(&decoder->pending[0], &decoder->pending[1],
+                (VAAPI_MAX_PENDING_FRAMES - 1) * sizeof(VaapiPendingFrame));
+        decoder->num_pending--;
+        skipped++;
+    }
+    decoder->pending[decoder->num_pending++] = frame;
+
+    if (skipped > 0) {
+        pthread_mutex_lock(&decoder->mutex);
+        decoder->stats.frames_skipped += skipped;
+        pthread_mutex_unlock(&decoder->mutex);
+    }
+}
+
+#ifdef SNACKA_HAVE_LIBAVCODEC
+static bool init_software(
+    VaapiDecoder* decoder,
+    const uint8_t* sps,
+    int sps_length,
+    const uint8_t* pps,
+    int pps_length
+) {
+    if (decoder->gallery) {
+        fprintf(stderr, "VaapiDecoder: Gallery tiles need VA-API decoding\n");
+        return false;
+    }
+
+    decoder->software = sw_decoder_create(decoder->software_threads, (SwThreading)decoder->software_threading);
+    if (!decoder->software) {
+        return false;
+    }
+
+    // The parameter sets go out with the first picture
+    return sw_decoder_decode(decoder->software, sps, sps_length, -1) >= 0 &&
+           sw_decoder_decode(decoder->software, pps, pps_length, -1) >= 0;
+}
+
+static bool decode_software(VaapiDecoder* decoder, const uint8_t* nal_data, int nal_length) {
+    int frames = sw_decoder_decode(decoder->software, nal_data, nal_length, decoder->nal_capture_us);
+    if (frames <= 0) {
+        return frames == 0;
+    }
+
+    // Only the latest frame is kept
+    pthread_mutex_lock(&decoder->mutex);
+    decoder->stats.frames_decoded += frames;
+    decoder->stats.frames_skipped += frames - 1;
+    pthread_mutex_unlock(&decoder->mutex);
+
+    SwFrame frame;
+    if (sw_decoder_get_frame(decoder->software, &frame)) {
+        add_output_frame(decoder, -1, frame.timestamp);
+    }
+    return true;
+}
+#else
+static bool init_software(
+    VaapiDecoder* decoder,
+    const uint8_t* sps,
+    int sps_length,
+    const uint8_t* pps,
+    int pps_length
+) {
+    (void)decoder;
+    (void)sps;
+    (void)sps_length;
+    (void)pps;
+    (void)pps_length;
+    fprintf(stderr, "VaapiDecoder: VA-API unavailable and built without software decoding\n");
+    return false;
+}
+#endif
+
+// Check if a surface waits to be presented
+static bool is_pending_surface(const VaapiDecoder* decoder, int surface) {
+    for (int i = 0; i < decoder->num_pending; i++) {
+        if (decoder->pending[i].surface == surface) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Present the newest frame that is due by deadline_us; older ones are skipped
+// Returns: false if no frame is due yet
+static bool present_due_frame(VaapiDecoder* decoder, int64_t deadline_us) {
+    int due = -1;
+    for (int i = 0; i < decoder->num_pending; i++) {
+        if (decoder->pending[i].due_us <= deadline_us) {
+            due = i;
+        }
+    }
+    if (due < 0) {
+        return false;
+    }
+
+    VaapiPendingFrame frame = decoder->pending[due];
+    decoder->num_pending -= due + 1;
+    memmove(&decoder->pending[0], &decoder->pending[due + 1], decoder->num_pending * sizeof(VaapiPendingFrame));
+
+    if (due > 0) {
+        pthread_mutex_lock(&decoder->mutex);
+        decoder->stats.frames_skipped += due;
+        pthread_mutex_unlock(&decoder->mutex);
+    }
+
+    present_frame(decoder, &frame);
+    return true;
+}
+
+// Called by the DPB for each finished frame, in output order
+static void output_frame(void* user_data, const H264Picture* picture) {
+    VaapiDecoder* decoder = (VaapiDecoder*)user_data;
+
+    pthread_mutex_lock(&decoder->mutex);
+    decoder->stats.frames_decoded++;
+    pthread_mutex_unlock(&decoder->mutex);
+
+    add_output_frame(decoder, picture->surface, decoder->capture_times[picture->surface]);
+}
+
 bool vaapi_decoder_initialize(
     VaapiDecoder* decoder,
     int width,
@@ -298,133 +517,1095 @@ bool vaapi_decoder_initialize(
     const uint8_t* pps,
     int pps_length
 ) {
-    if (!decoder || decoder->initialized) {
+    if (!decoder || decoder->initialized || !sps || !pps || sps_length <= 0 || pps_length <= 0) {
         return false;
     }
 
-    decoder->width = width;
-    decoder->height = height;
-
-    // Copy SPS/PPS
-    decoder->sps = (uint8_t*)malloc(sps_length);
-    decoder->pps = (uint8_t*)malloc(pps_length);
-    if (!decoder->sps || !decoder->pps) {
+    // Parse SPS/PPS
+    decoder->param_sets = (H264ParamSets*)calloc(1, sizeof(H264ParamSets));
+    if (!decoder->param_sets) {
         return false;
     }
-    memcpy(decoder->sps, sps, sps_length);
-    memcpy(decoder->pps, pps, pps_length);
-    decoder->sps_length = sps_length;
-    decoder->pps_length = pps_length;
 
-    // Initialize VA display
-    if (!init_va_display(decoder)) {
+    int sps_id;
+    if (!h264_parse_sps(decoder->param_sets, sps, sps_length, &sps_id) ||
+        !h264_parse_pps(decoder->param_sets, pps, pps_length, NULL)) {
+        fprintf(stderr, "VaapiDecoder: Invalid SPS/PPS\n");
         return false;
     }
 
-    // Create decoder context
-    if (!create_decoder_context(decoder)) {
-        return false;
+    // The stream decides the size, not the caller
+    const H264SPS* active_sps = &decoder->param_sets->sps[sps_id];
+    decoder->coded_width = h264_get_width_in_mbs(active_sps) * 16;
+    decoder->coded_height = h264_get_height_in_mbs(active_sps) * 16;
+    h264_get_display_size(active_sps, &decoder->width, &decoder->height);
+    if (decoder->width != width || decoder->height != height) {
+        printf("VaapiDecoder: Stream is %dx%d (expected %dx%d)\n",
+               decoder->width, decoder->height, width, height);
     }
 
-    // Create EGL renderer
-    decoder->renderer = egl_renderer_create(decoder->x_display);
-    if (!decoder->renderer) {
-        fprintf(stderr, "VaapiDecoder: Failed to create EGL renderer\n");
+    // Share the process-wide VA/EGL device
+    decoder->device = va_device_acquire();
+    if (!decoder->device) {
         return false;
     }
+    decoder->va_display = decoder->device->va_display;
 
-    if (!egl_renderer_initialize(decoder->renderer, width, height)) {
-        fprintf(stderr, "VaapiDecoder: Failed to initialize EGL renderer\n");
+    if (!decoder->va_display || decoder->force_software) {
+        if (!init_software(decoder, sps, sps_length, pps, pps_length)) {
+            return false;
+        }
+    } else if (!create_decoder_context(decoder)) {
         return false;
     }
 
+    if (decoder->gallery) {
+        // Frames go to the gallery's window
+        decoder->tile = gallery_compositor_add_tile(
+            decoder->gallery,
+            decoder->width,
+            decoder->height,
+            decoder->va_surfaces,
+            decoder->num_surfaces
+        );
+        if (!decoder->tile) {
+            return false;
+        }
+    } else if (!decoder->headless) {
+        // Create EGL renderer
+        decoder->renderer = egl_renderer_create(
+            decoder->device->x_display,
+            decoder->device->egl_display,
+            decoder->device->egl_config
+        );
+        if (!decoder->renderer) {
+            fprintf(stderr, "VaapiDecoder: Failed to create EGL renderer\n");
+            return false;
+        }
+
+        if (!egl_renderer_initialize(decoder->renderer, decoder->width, decoder->height)) {
+            fprintf(stderr, "VaapiDecoder: Failed to initialize EGL renderer\n");
+            return false;
+        }
+    }
+
+    h264_dpb_init(&decoder->dpb, output_frame, decoder);
     decoder->current_surface = 0;
+    decoder->displayed_surface = -1;
+    decoder->active_sps_id = -1;
+    decoder->waiting_for_idr = true;
     decoder->initialized = true;
 
-    printf("VaapiDecoder: Initialized %dx%d\n", width, height);
+    printf("VaapiDecoder: Initialized %dx%d (surfaces %dx%d)\n",
+           decoder->width, decoder->height, decoder->coded_width, decoder->coded_height);
     return true;
 }
 
-bool vaapi_decoder_decode_and_render(
+// Create a buffer that is destroyed once the picture is finished
+static bool create_buffer(
     VaapiDecoder* decoder,
+    VABufferType type,
+    unsigned int size,
+    const void* data,
+    VABufferID* buffer
+) {
+    if (decoder->num_picture_buffers == decoder->picture_buffer_capacity) {
+        int capacity = decoder->picture_buffer_capacity ? decoder->picture_buffer_capacity * 2 : 16;
+        VABufferID* buffers = (VABufferID*)realloc(decoder->picture_buffers, capacity * sizeof(VABufferID));
+        if (!buffers) {
+            return false;
+        }
+        decoder->picture_buffers = buffers;
+        decoder->picture_buffer_capacity = capacity;
+    }
+
+    VAStatus status = vaCreateBuffer(
+        decoder->va_display,
+        decoder->va_context,
+        type,
+        size,
+        1,
+        (void*)data,
+        buffer
+    );
+
+    if (status != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VaapiDecoder: vaCreateBuffer failed: %d\n", status);
+        return false;
+    }
+
+    decoder->picture_buffers[decoder->num_picture_buffers++] = *buffer;
+    return true;
+}
+
+static bool render_buffers(VaapiDecoder* decoder, VABufferID* buffers, int count) {
+    VAStatus status = vaRenderPicture(decoder->va_display, decoder->va_context, buffers, count);
+    if (status != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VaapiDecoder: vaRenderPicture failed: %d\n", status);
+        return false;
+    }
+    return true;
+}
+
+static void fill_va_picture(const VaapiDecoder* decoder, const H264Picture* picture, VAPictureH264* va_picture) {
+    memset(va_picture, 0, sizeof(*va_picture));
+    if (!picture || picture->surface < 0) {
+        va_picture->picture_id = VA_INVALID_SURFACE;
+        va_picture->flags = VA_PICTURE_H264_INVALID;
+        return;
+    }
+
+    va_picture->picture_id = decoder->va_surfaces[picture->surface];
+    va_picture->frame_idx = picture->long_term_ref ? (uint32_t)picture->long_term_frame_idx : picture->frame_num;
+    if (picture->long_term_ref) {
+        va_picture->flags = VA_PICTURE_H264_LONG_TERM_REFERENCE;
+    } else if (picture->short_term_ref) {
+        va_picture->flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE;
+    }
+    va_picture->TopFieldOrderCnt = picture->top_field_order_cnt;
+    va_picture->BottomFieldOrderCnt = picture->bottom_field_order_cnt;
+}
+
+static bool submit_picture_parameters(
+    VaapiDecoder* decoder,
+    const H264SPS* sps,
+    const H264PPS* pps,
+    const H264SliceHeader* slice
+) {
+    VAPictureParameterBufferH264 pic_param;
+    memset(&pic_param, 0, sizeof(pic_param));
+
+    fill_va_picture(decoder, &decoder->dpb.current, &pic_param.CurrPic);
+    pic_param.CurrPic.flags = 0;
+
+    const H264Picture* refs[H264_DPB_MAX_FRAMES];
+    int num_refs = h264_dpb_get_references(&decoder->dpb, refs);
+    for (int i = 0; i < 16; i++) {
+        fill_va_picture(decoder, i < num_refs ? refs[i] : NULL, &pic_param.ReferenceFrames[i]);
+    }
+
+    pic_param.picture_width_in_mbs_minus1 = (unsigned short)(h264_get_width_in_mbs(sps) - 1);
+    pic_param.picture_height_in_mbs_minus1 = (unsigned short)(h264_get_height_in_mbs(sps) - 1);
+    pic_param.bit_depth_luma_minus8 = sps->bit_depth_luma_minus8;
+    pic_param.bit_depth_chroma_minus8 = sps->bit_depth_chroma_minus8;
+    pic_param.num_ref_frames = sps->max_num_ref_frames;
+
+    pic_param.seq_fields.bits.chroma_format_idc = sps->chroma_format_idc;
+    pic_param.seq_fields.bits.residual_colour_transform_flag = sps->separate_colour_plane_flag;
+    pic_param.seq_fields.bits.gaps_in_frame_num_value_allowed_flag = sps->gaps_in_frame_num_value_allowed_flag;
+    pic_param.seq_fields.bits.frame_mbs_only_flag = sps->frame_mbs_only_flag;
+    pic_param.seq_fields.bits.mb_adaptive_frame_field_flag = sps->mb_adaptive_frame_field_flag;
+    pic_param.seq_fields.bits.direct_8x8_inference_flag = sps->direct_8x8_inference_flag;
+    pic_param.seq_fields.bits.MinLumaBiPredSize8x8 = sps->level_idc >= 31;
+    pic_param.seq_fields.bits.log2_max_frame_num_minus4 = sps->log2_max_frame_num_minus4;
+    pic_param.seq_fields.bits.pic_order_cnt_type = sps->pic_order_cnt_type;
+    pic_param.seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 = sps->log2_max_pic_order_cnt_lsb_minus4;
+    pic_param.seq_fields.bits.delta_pic_order_always_zero_flag = sps->delta_pic_order_always_zero_flag;
+
+    pic_param.pic_init_qp_minus26 = pps->pic_init_qp_minus26;
+    pic_param.pic_init_qs_minus26 = pps->pic_init_qs_minus26;
+    pic_param.chroma_qp_index_offset = pps->chroma_qp_index_offset;
+    pic_param.second_chroma_qp_index_offset = pps->second_chroma_qp_index_offset;
+
+    pic_param.pic_fields.bits.entropy_coding_mode_flag = pps->entropy_coding_mode_flag;
+    pic_param.pic_fields.bits.weighted_pred_flag = pps->weighted_pred_flag;
+    pic_param.pic_fields.bits.weighted_bipred_idc = pps->weighted_bipred_idc;
+    pic_param.pic_fields.bits.transform_8x8_mode_flag = pps->transform_8x8_mode_flag;
+    pic_param.pic_fields.bits.field_pic_flag = slice->field_pic_flag;
+    pic_param.pic_fields.bits.constrained_intra_pred_flag = pps->constrained_intra_pred_flag;
+    pic_param.pic_fields.bits.pic_order_present_flag = pps->bottom_field_pic_order_in_frame_present_flag;
+    pic_param.pic_fields.bits.deblocking_filter_control_present_flag = pps->deblocking_filter_control_present_flag;
+    pic_param.pic_fields.bits.redundant_pic_cnt_present_flag = pps->redundant_pic_cnt_present_flag;
+    pic_param.pic_fields.bits.reference_pic_flag = slice->nal_ref_idc != 0;
+
+    pic_param.frame_num = (unsigned short)slice->frame_num;
+
+    // Scaling lists in effect for this picture
+    VAIQMatrixBufferH264 iq_matrix;
+    uint8_t lists_8x8[6][64];
+    h264_get_scaling_lists(sps, pps, iq_matrix.ScalingList4x4, lists_8x8);
+    memcpy(iq_matrix.ScalingList8x8, lists_8x8, sizeof(iq_matrix.ScalingList8x8));
+
+    VABufferID buffers[2];
+    return create_buffer(decoder, VAPictureParameterBufferType, sizeof(pic_param), &pic_param, &buffers[0]) &&
+           create_buffer(decoder, VAIQMatrixBufferType, sizeof(iq_matrix), &iq_matrix, &buffers[1]) &&
+           render_buffers(decoder, buffers, 2);
+}
+
+static bool submit_slice(
+    VaapiDecoder* decoder,
+    const H264SPS* sps,
+    const H264PPS* pps,
+    const H264SliceHeader* slice,
     const uint8_t* nal_data,
-    int nal_length,
-    bool is_keyframe
+    int nal_length
 ) {
-    if (!decoder || !decoder->initialized) {
+    VASliceParameterBufferH264 slice_param;
+    memset(&slice_param, 0, sizeof(slice_param));
+
+    // The slice data buffer holds the whole NAL unit; the bit offset skips its
+    // header (counted without emulation prevention bytes)
+    slice_param.slice_data_size = nal_length;
+    slice_param.slice_data_offset = 0;
+    slice_param.slice_data_flag = VA_SLICE_DATA_FLAG_ALL;
+    slice_param.slice_data_bit_offset = (unsigned short)slice->header_bits;
+    slice_param.first_mb_in_slice = (unsigned short)slice->first_mb_in_slice;
+    slice_param.slice_type = slice->slice_type;
+    slice_param.direct_spatial_mv_pred_flag = slice->direct_spatial_mv_pred_flag;
+    slice_param.num_ref_idx_l0_active_minus1 = slice->num_ref_idx_l0_active_minus1;
+    slice_param.num_ref_idx_l1_active_minus1 = slice->num_ref_idx_l1_active_minus1;
+    slice_param.cabac_init_idc = slice->cabac_init_idc;
+    slice_param.slice_qp_delta = slice->slice_qp_delta;
+    slice_param.disable_deblocking_filter_idc = slice->disable_deblocking_filter_idc;
+    slice_param.slice_alpha_c0_offset_div2 = slice->slice_alpha_c0_offset_div2;
+    slice_param.slice_beta_offset_div2 = slice->slice_beta_offset_div2;
+
+    const H264Picture* lists[2][H264_MAX_REFS];
+    h264_dpb_build_ref_lists(&decoder->dpb, sps, slice, lists);
+    for (int i = 0; i < H264_MAX_REFS; i++) {
+        fill_va_picture(decoder, lists[0][i], &slice_param.RefPicList0[i]);
+        fill_va_picture(decoder, lists[1][i], &slice_param.RefPicList1[i]);
+    }
+
+    // Explicit weighted prediction
+    if ((pps->weighted_pred_flag &&
+         (slice->slice_type == H264_SLICE_P || slice->slice_type == H264_SLICE_SP)) ||
+        (pps->weighted_bipred_idc == 1 && slice->slice_type == H264_SLICE_B)) {
+        const H264WeightTable* l0 = &slice->weights[0];
+        const H264WeightTable* l1 = &slice->weights[1];
+        slice_param.luma_log2_weight_denom = slice->luma_log2_weight_denom;
+        slice_param.chroma_log2_weight_denom = slice->chroma_log2_weight_denom;
+
+        for (int i = 0; i <= slice->num_ref_idx_l0_active_minus1; i++) {
+            slice_param.luma_weight_l0_flag |= l0->luma_weight_flag[i];
+            slice_param.chroma_weight_l0_flag |= l0->chroma_weight_flag[i];
+            slice_param.luma_weight_l0[i] = l0->luma_weight[i];
+            slice_param.luma_offset_l0[i] = l0->luma_offset[i];
+            for (int j = 0; j < 2; j++) {
+                slice_param.chroma_weight_l0[i][j] = l0->chroma_weight[i][j];
+                slice_param.chroma_offset_l0[i][j] = l0->chroma_offset[i][j];
+            }
+        }
+
+        if (slice->slice_type == H264_SLICE_B) {
+            for (int i = 0; i <= slice->num_ref_idx_l1_active_minus1; i++) {
+                slice_param.luma_weight_l1_flag |= l1->luma_weight_flag[i];
+                slice_param.chroma_weight_l1_flag |= l1->chroma_weight_flag[i];
+                slice_param.luma_weight_l1[i] = l1->luma_weight[i];
+                slice_param.luma_offset_l1[i] = l1->luma_offset[i];
+                for (int j = 0; j < 2; j++) {
+                    slice_param.chroma_weight_l1[i][j] = l1->chroma_weight[i][j];
+                    slice_param.chroma_offset_l1[i][j] = l1->chroma_offset[i][j];
+                }
+            }
+        }
+    }
+
+    VABufferID buffers[2];
+    return create_buffer(decoder, VASliceParameterBufferType, sizeof(slice_param), &slice_param, &buffers[0]) &&
+           create_buffer(decoder, VASliceDataBufferType, nal_length, nal_data, &buffers[1]) &&
+           render_buffers(decoder, buffers, 2);
+}
+
+// Check if a slice starts a new picture (7.4.1.2.4)
+static bool is_new_picture(const VaapiDecoder* decoder, const H264SPS* sps, const H264SliceHeader* slice) {
+    const H264SliceHeader* prev = &decoder->first_slice;
+    if (!decoder->have_picture || slice->first_mb_in_slice == 0) {
+        return true;
+    }
+
+    return slice->frame_num != prev->frame_num ||
+           slice->pps_id != prev->pps_id ||
+           slice->field_pic_flag != prev->field_pic_flag ||
+           slice->bottom_field_flag != prev->bottom_field_flag ||
+           (slice->nal_ref_idc == 0) != (prev->nal_ref_idc == 0) ||
+           (sps->pic_order_cnt_type == 0 &&
+            (slice->pic_order_cnt_lsb != prev->pic_order_cnt_lsb ||
+             slice->delta_pic_order_cnt_bottom != prev->delta_pic_order_cnt_bottom)) ||
+           (sps->pic_order_cnt_type == 1 &&
+            (slice->delta_pic_order_cnt[0] != prev->delta_pic_order_cnt[0] ||
+             slice->delta_pic_order_cnt[1] != prev->delta_pic_order_cnt[1])) ||
+           slice->idr_pic_flag != prev->idr_pic_flag ||
+           (slice->idr_pic_flag && slice->idr_pic_id != prev->idr_pic_id);
+}
+
+// Pick a surface that holds no stored frame and is not on screen
+static int find_free_surface(const VaapiDecoder* decoder) {
+    for (int i = 1; i <= decoder->num_surfaces; i++) {
+        int index = (decoder->current_surface + i) % decoder->num_surfaces;
+        if (index != decoder->displayed_surface && !is_pending_surface(decoder, index) &&
+            !h264_dpb_is_surface_used(&decoder->dpb, index) &&
+            !(decoder->tile && gallery_compositor_uses_surface(
+                decoder->gallery, decoder->tile, decoder->va_surfaces[index]))) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+// Destroy the surfaces and context (nothing may show them any more)
+static void destroy_decoder_context(VaapiDecoder* decoder) {
+    if (decoder->download_image.image_id != VA_INVALID_ID) {
+        vaDestroyImage(decoder->va_display, decoder->download_image.image_id);
+        decoder->download_image.image_id = VA_INVALID_ID;
+    }
+    if (decoder->va_context != VA_INVALID_ID) {
+        vaDestroyContext(decoder->va_display, decoder->va_context);
+        decoder->va_context = VA_INVALID_ID;
+    }
+    if (decoder->va_surfaces) {
+        vaDestroySurfaces(decoder->va_display, decoder->va_surfaces, decoder->num_surfaces);
+        free(decoder->va_surfaces);
+        decoder->va_surfaces = NULL;
+    }
+    free(decoder->capture_times);
+    decoder->capture_times = NULL;
+    decoder->num_surfaces = 0;
+}
+
+// Recreate the surfaces and context for a new coded size (the sender switched
+// resolution). Called at an IDR picture, so older frames are not needed.
+static bool resize_decoder_context(VaapiDecoder* decoder, int coded_width, int coded_height,
+                                   int display_width, int display_height) {
+    printf("VaapiDecoder: Stream changed to %dx%d surfaces (was %dx%d)\n",
+           coded_width, coded_height, decoder->coded_width, decoder->coded_height);
+
+    // Frames of the old size still waiting are shown now (synchronous) or
+    // dropped (async), then the DPB is empty
+    h264_dpb_flush(&decoder->dpb);
+    if (decoder->num_pending > 0) {
+        pthread_mutex_lock(&decoder->mutex);
+        decoder->stats.frames_skipped += decoder->num_pending;
+        pthread_mutex_unlock(&decoder->mutex);
+        decoder->num_pending = 0;
+    }
+    decoder->frame_unread = false;
+
+    if (decoder->tile) {
+        gallery_compositor_detach_surfaces(decoder->gallery, decoder->tile);
+    } else if (decoder->renderer) {
+        // Surface IDs are reused, so stale imports would show old frames
+        egl_renderer_forget_surfaces(decoder->renderer, decoder->va_surfaces, decoder->num_surfaces);
+    }
+    decoder->displayed_surface = -1;
+    destroy_decoder_context(decoder);
+    decoder->coded_width = coded_width;
+    decoder->coded_height = coded_height;
+    if (!create_decoder_context(decoder)) {
+        // Retried at the next IDR picture
+        destroy_decoder_context(decoder);
+        decoder->coded_width = 0;
+        decoder->coded_height = 0;
         return false;
     }
 
-    // Get current surface
-    VASurfaceID surface = decoder->va_surfaces[decoder->current_surface];
+    if (decoder->tile) {
+        gallery_compositor_attach_surfaces(decoder->gallery, decoder->tile, display_width, display_height,
+                                           decoder->va_surfaces, decoder->num_surfaces);
+    }
+    return true;
+}
 
-    // Note: Proper H.264 decoding requires parsing the NAL unit to fill
-    // VAPictureParameterBufferH264 and VASliceParameterBufferH264.
-    // This is a simplified implementation that relies on the decoder
-    // to handle the NAL unit directly.
+// Make an IDR picture's SPS the active one
+static bool activate_sps(VaapiDecoder* decoder, const H264SPS* sps) {
+    if (sps->chroma_format_idc != 1 || sps->bit_depth_luma_minus8 != 0 || sps->bit_depth_chroma_minus8 != 0) {
+        fprintf(stderr, "VaapiDecoder: Only 8-bit 4:2:0 streams are supported\n");
+        return false;
+    }
 
-    VAStatus status = vaBeginPicture(decoder->va_display, decoder->va_context, surface);
+    int display_width, display_height;
+    h264_get_display_size(sps, &display_width, &display_height);
+    int coded_width = h264_get_width_in_mbs(sps) * 16;
+    int coded_height = h264_get_height_in_mbs(sps) * 16;
+    if ((coded_width != decoder->coded_width || coded_height != decoder->coded_height) &&
+        !resize_decoder_context(decoder, coded_width, coded_height, display_width, display_height)) {
+        return false;
+    }
+
+    // Set after the resize, which still shows the old frames
+    if (display_width != decoder->width || display_height != decoder->height) {
+        decoder->width = display_width;
+        decoder->height = display_height;
+        egl_renderer_set_frame_size(decoder->renderer, display_width, display_height);
+    }
+
+    h264_dpb_configure(&decoder->dpb, sps);
+    decoder->active_sps_id = sps->sps_id;
+
+    // The VUI says how the pictures convert to RGB
+    decoder->color = color_space_from_vui(sps->matrix_coefficients, sps->video_full_range_flag);
+    if (decoder->tile) {
+        gallery_compositor_set_tile_color(decoder->gallery, decoder->tile, decoder->color);
+    } else {
+        egl_renderer_set_color_space(decoder->renderer, decoder->color);
+    }
+    return true;
+}
+
+static bool begin_picture(
+    VaapiDecoder* decoder,
+    const H264SPS* sps,
+    const H264PPS* pps,
+    const H264SliceHeader* slice
+) {
+    if (slice->idr_pic_flag && !activate_sps(decoder, sps)) {
+        return false;
+    }
+
+    int surface = find_free_surface(decoder);
+    if (surface < 0) {
+        fprintf(stderr, "VaapiDecoder: No free surface\n");
+        return false;
+    }
+
+    if (!h264_dpb_start_picture(&decoder->dpb, sps, slice, surface)) {
+        return false;
+    }
+
+    VAStatus status = vaBeginPicture(decoder->va_display, decoder->va_context, decoder->va_surfaces[surface]);
     if (status != VA_STATUS_SUCCESS) {
         fprintf(stderr, "VaapiDecoder: vaBeginPicture failed: %d\n", status);
+        h264_dpb_abort_picture(&decoder->dpb);
         return false;
     }
 
-    // Create slice data buffer
-    VABufferID slice_data_buf;
-    status = vaCreateBuffer(
-        decoder->va_display,
-        decoder->va_context,
-        VASliceDataBufferType,
-        nal_length,
-        1,
-        (void*)nal_data,
-        &slice_data_buf
-    );
+    decoder->current_surface = surface;
+    decoder->capture_times[surface] = decoder->nal_capture_us;
+    decoder->picture_open = true;
+    decoder->first_slice = *slice;
+    decoder->have_picture = true;
+
+    return submit_picture_parameters(decoder, sps, pps, slice);
+}
+
+static bool end_picture(VaapiDecoder* decoder) {
+    decoder->picture_open = false;
+
+    VAStatus status = vaEndPicture(decoder->va_display, decoder->va_context);
+    release_picture_buffers(decoder);
 
     if (status != VA_STATUS_SUCCESS) {
-        vaEndPicture(decoder->va_display, decoder->va_context);
-        fprintf(stderr, "VaapiDecoder: vaCreateBuffer failed: %d\n", status);
+        fprintf(stderr, "VaapiDecoder: vaEndPicture failed: %d\n", status);
+        h264_dpb_abort_picture(&decoder->dpb);
+        decoder->waiting_for_idr = true;
         return false;
     }
 
-    // Render picture
-    status = vaRenderPicture(decoder->va_display, decoder->va_context, &slice_data_buf, 1);
-    if (status != VA_STATUS_SUCCESS) {
-        vaDestroyBuffer(decoder->va_display, slice_data_buf);
+    // Marks references and renders whatever is due for output
+    h264_dpb_finish_picture(&decoder->dpb, &decoder->first_slice);
+    return true;
+}
+
+// Give up on the picture being submitted; later pictures would reference it
+static void fail_picture(VaapiDecoder* decoder) {
+    if (decoder->picture_open) {
         vaEndPicture(decoder->va_display, decoder->va_context);
-        fprintf(stderr, "VaapiDecoder: vaRenderPicture failed: %d\n", status);
+        decoder->picture_open = false;
+    }
+    release_picture_buffers(decoder);
+    h264_dpb_abort_picture(&decoder->dpb);
+    decoder->waiting_for_idr = true;
+}
+
+static bool decode_slice(VaapiDecoder* decoder, const uint8_t* nal_data, int nal_length) {
+    H264SliceHeader* slice = &decoder->slice;
+    if (!h264_parse_slice_header(decoder->param_sets, nal_data, nal_length, slice)) {
+        fprintf(stderr, "VaapiDecoder: Invalid slice header\n");
         return false;
     }
 
-    // End picture
-    status = vaEndPicture(decoder->va_display, decoder->va_context);
-    vaDestroyBuffer(decoder->va_display, slice_data_buf);
+    // Redundant slices only matter when primary ones are lost
+    if (slice->redundant_pic_cnt > 0) {
+        return true;
+    }
+
+    if (decoder->waiting_for_idr && !slice->idr_pic_flag) {
+        return false;
+    }
+
+    const H264PPS* pps = &decoder->param_sets->pps[slice->pps_id];
+    const H264SPS* sps = &decoder->param_sets->sps[pps->sps_id];
+    if (!slice->idr_pic_flag && pps->sps_id != decoder->active_sps_id) {
+        fprintf(stderr, "VaapiDecoder: Slice refers to inactive SPS %d\n", pps->sps_id);
+        return false;
+    }
+
+    if (!is_new_picture(decoder, sps, slice)) {
+        if (!decoder->picture_open) {
+            // The access unit was already closed (or the picture failed)
+            fprintf(stderr, "VaapiDecoder: Slice after the end of its picture\n");
+            return false;
+        }
+    } else {
+        // The previous picture is complete once the next one starts
+        if (decoder->picture_open && !end_picture(decoder)) {
+            return false;
+        }
+        if (!begin_picture(decoder, sps, pps, slice)) {
+            fail_picture(decoder);
+            return false;
+        }
+        decoder->waiting_for_idr = false;
+    }
+
+    if (!submit_slice(decoder, sps, pps, slice, nal_data, nal_length)) {
+        fail_picture(decoder);
+        return false;
+    }
+
+    // Pictures stay open until the next picture, an access unit delimiter or
+    // vaapi_decoder_end_access_unit: the slice count is not known up front
+    return true;
+}
+
+static bool decode_nal(VaapiDecoder* decoder, const uint8_t* nal_data, int nal_length) {
+#ifdef SNACKA_HAVE_LIBAVCODEC
+    if (decoder->software) {
+        return decode_software(decoder, nal_data, nal_length);
+    }
+#endif
+
+    switch (nal_data[0] & 0x1f) {
+        case H264_NAL_SLICE:
+        case H264_NAL_IDR:
+            return decode_slice(decoder, nal_data, nal_length);
+
+        case H264_NAL_SPS:
+            // Takes effect at the next IDR picture
+            return h264_parse_sps(decoder->param_sets, nal_data, nal_length, NULL);
+
+        case H264_NAL_PPS:
+            return h264_parse_pps(decoder->param_sets, nal_data, nal_length, NULL);
+
+        case H264_NAL_AUD:
+            // Access unit delimiter: the previous picture is complete
+            if (decoder->picture_open) {
+                return end_picture(decoder);
+            }
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+static void apply_presentation(VaapiDecoder* decoder, int target_latency_ms) {
+    decoder->scheduler.target_latency_us = (int64_t)target_latency_ms * 1000;
+
+    // Scheduled frames go out once per refresh
+    if (target_latency_ms > 0) {
+        egl_renderer_set_swap_interval(decoder->renderer, 1);
+    }
+}
+
+// When the oldest waiting frame should be presented: frames due before the
+// middle of a refresh period go out with the swap for it
+static int64_t next_present_time(const VaapiDecoder* decoder) {
+    return decoder->pending[0].due_us - decoder->scheduler.stats.vsync_period_us / 2;
+}
+
+static void* decode_thread(void* arg) {
+    VaapiDecoder* decoder = (VaapiDecoder*)arg;
+    VaapiNalUnit nal = { NULL, 0, 0, -1, 0 };
+    int64_t last_present_us = now_us();
+
+    pthread_mutex_lock(&decoder->mutex);
+    while (true) {
+        // Sleep until there is input or a request, or a waiting frame is due
+        while (!decoder->stopping && decoder->queue_count == 0 &&
+               !decoder->resize_requested && !decoder->presentation_requested) {
+            if (decoder->num_pending == 0) {
+                pthread_cond_wait(&decoder->queue_cond, &decoder->mutex);
+                continue;
+            }
+
+            int64_t wake_us = next_present_time(decoder);
+            if (wake_us <= now_us()) {
+                break;
+            }
+            struct timespec deadline = {
+                .tv_sec = wake_us / 1000000,
+                .tv_nsec = (wake_us % 1000000) * 1000
+            };
+            pthread_cond_timedwait(&decoder->queue_cond, &decoder->mutex, &deadline);
+        }
+        if (decoder->stopping) {
+            break;
+        }
+
+        // Take the oldest NAL unit, leaving this thread's spare buffer in its slot
+        bool have_nal = decoder->queue_count > 0;
+        if (have_nal) {
+            VaapiNalUnit* slot = &decoder->queue[decoder->queue_head];
+            VaapiNalUnit spare = nal;
+            nal = *slot;
+            *slot = spare;
+            decoder->queue_head = (decoder->queue_head + 1) % decoder->queue_capacity;
+            decoder->queue_count--;
+        }
+
+        bool resize = decoder->resize_requested;
+        int width = decoder->requested_width;
+        int height = decoder->requested_height;
+        decoder->resize_requested = false;
+
+        bool reschedule = decoder->presentation_requested;
+        int latency_ms = decoder->requested_latency_ms;
+        decoder->presentation_requested = false;
+        pthread_mutex_unlock(&decoder->mutex);
+
+        if (resize && decoder->renderer) {
+            egl_renderer_set_display_size(decoder->renderer, width, height);
+        }
+        if (reschedule) {
+            apply_presentation(decoder, latency_ms);
+        }
+
+        if (have_nal) {
+            decoder->nal_capture_us = nal.capture_us;
+            frame_scheduler_add_arrival(&decoder->scheduler, nal.capture_us, nal.arrival_us);
+            decode_nal(decoder, nal.data, nal.length);
+        }
+
+        pthread_mutex_lock(&decoder->mutex);
+        bool caught_up = decoder->queue_count == 0;
+        pthread_mutex_unlock(&decoder->mutex);
+
+        if (decoder->num_pending > 0) {
+            int64_t now = now_us();
+            bool presented = false;
+            if (decoder->scheduler.target_latency_us > 0) {
+                // Frames are shown when due, whether or not input is waiting
+                presented = present_due_frame(decoder, now + decoder->scheduler.stats.vsync_period_us / 2);
+            } else if (caught_up || now - last_present_us >= MAX_PRESENT_DELAY_US) {
+                // Present once caught up with the input; frames decoded meanwhile
+                // replace each other, so a slow present only ever costs the
+                // latest frame
+                presented = present_due_frame(decoder, INT64_MAX);
+            }
+            if (presented) {
+                last_present_us = now_us();
+            }
+        }
+
+        pthread_mutex_lock(&decoder->mutex);
+    }
+    pthread_mutex_unlock(&decoder->mutex);
+
+    // The caller's thread destroys the renderer
+    egl_renderer_release_context(decoder->renderer);
+    free(nal.data);
+    return NULL;
+}
+
+bool vaapi_decoder_start_async(VaapiDecoder* decoder, int queue_capacity) {
+    if (!decoder || !decoder->initialized || decoder->async || decoder->headless) {
+        return false;
+    }
+
+    if (queue_capacity <= 0) {
+        queue_capacity = VAAPI_DEFAULT_QUEUE_CAPACITY;
+    }
+    if (queue_capacity > VAAPI_MAX_QUEUE_CAPACITY) {
+        queue_capacity = VAAPI_MAX_QUEUE_CAPACITY;
+    }
+
+    decoder->queue = (VaapiNalUnit*)calloc(queue_capacity, sizeof(VaapiNalUnit));
+    if (!decoder->queue) {
+        return false;
+    }
+    decoder->queue_capacity = queue_capacity;
+    decoder->queue_head = 0;
+    decoder->queue_count = 0;
+
+    // The EGL context moves to the decode thread
+    egl_renderer_release_context(decoder->renderer);
+
+    decoder->async = true;
+    if (pthread_create(&decoder->worker, NULL, decode_thread, decoder) != 0) {
+        fprintf(stderr, "VaapiDecoder: Failed to start decode thread\n");
+        decoder->async = false;
+        free(decoder->queue);
+        decoder->queue = NULL;
+        return false;
+    }
+
+    printf("VaapiDecoder: Decoding on a worker thread (queue of %d NAL units)\n", queue_capacity);
+    return true;
+}
+
+static VaapiNalUnit* queued_nal(VaapiDecoder* decoder, int position) {
+    return &decoder->queue[(decoder->queue_head + position) % decoder->queue_capacity];
+}
+
+static bool is_vcl_nal(uint8_t type) {
+    return type >= H264_NAL_SLICE && type <= H264_NAL_IDR;
+}
+
+// first_mb_in_slice opens the slice header, and its ue(v) code is a single 1
+// bit when it is 0, so the slice that starts a picture has the top bit set
+static bool slice_starts_picture(const uint8_t* nal_data, int nal_length) {
+    return nal_length > 1 && (nal_data[1] & 0x80) != 0;
+}
+
+// Make room for an IDR slice in a full queue (call with the mutex held). Once
+// the IDR picture decodes no queued picture is needed, so only these stay, in
+// order:
+// - the parameter sets, which the IDR picture may refer to
+// - the queued part of the IDR access unit: its AUD, SEI and parameter sets,
+//   and its first slices if the new slice continues the picture
+// The AUDs and SEI of the dropped pictures go with them: an AUD ends the
+// picture before it, which decode_slice also does when the IDR picture
+// starts, and SEI is not used for decoding. Slots keep their buffers.
+// Returns: the number removed
+static int drop_queued_slices(VaapiDecoder* decoder, bool idr_starts_picture) {
+    // Find where the IDR access unit starts: back over its earlier slices to
+    // the first one, then over the NAL units in front of that
+    int start = decoder->queue_count;
+    if (!idr_starts_picture) {
+        while (start > 0) {
+            VaapiNalUnit* slot = queued_nal(decoder, start - 1);
+            uint8_t type = slot->data[0] & 0x1f;
+            if (type != H264_NAL_IDR && is_vcl_nal(type)) {
+                break;
+            }
+            start--;
+            if (type == H264_NAL_IDR && slice_starts_picture(slot->data, slot->length)) {
+                break;
+            }
+        }
+    }
+    while (start > 0 && !is_vcl_nal(queued_nal(decoder, start - 1)->data[0] & 0x1f)) {
+        start--;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < decoder->queue_count; i++) {
+        VaapiNalUnit* slot = queued_nal(decoder, i);
+        uint8_t type = slot->data[0] & 0x1f;
+        if (i < start && type != H264_NAL_SPS && type != H264_NAL_PPS) {
+            continue;
+        }
+        VaapiNalUnit* target = queued_nal(decoder, kept);
+        if (target != slot) {
+            VaapiNalUnit swapped = *target;
+            *target = *slot;
+            *slot = swapped;
+        }
+        kept++;
+    }
 
+    int dropped = decoder->queue_count - kept;
+    decoder->queue_count = kept;
+    return dropped;
+}
+
+// Queue a NAL unit for the decode thread without blocking
+static bool queue_nal(VaapiDecoder* decoder, const uint8_t* nal_data, int nal_length, int64_t capture_us) {
+    uint8_t type = nal_data[0] & 0x1f;
+
+    pthread_mutex_lock(&decoder->mutex);
+
+    // After an overflow, slices are useless until the next IDR picture;
+    // parameter sets and access unit boundaries are still needed
+    if (decoder->dropping_until_idr) {
+        if (type == H264_NAL_IDR) {
+            decoder->dropping_until_idr = false;
+        } else if (type != H264_NAL_SPS && type != H264_NAL_PPS && type != H264_NAL_AUD) {
+            decoder->stats.nals_dropped++;
+            pthread_mutex_unlock(&decoder->mutex);
+            return false;
+        }
+    }
+
+    // An IDR picture makes the queued pictures before it unnecessary, so they
+    // give way to it
+    if (decoder->queue_count == decoder->queue_capacity && type == H264_NAL_IDR) {
+        int dropped = drop_queued_slices(decoder, slice_starts_picture(nal_data, nal_length));
+        if (dropped > 0) {
+            decoder->stats.nals_dropped += dropped;
+            decoder->stats.resyncs++;
+            fprintf(stderr, "VaapiDecoder: Decode queue full, skipped %d NAL units up to an IDR picture\n", dropped);
+        }
+    }
+
+    if (decoder->queue_count == decoder->queue_capacity) {
+        // The decode thread fell behind: what is queued still decodes, and the
+        // stream picks up again at the next IDR picture
+        decoder->dropping_until_idr = true;
+        decoder->stats.nals_dropped++;
+        decoder->stats.resyncs++;
+        pthread_mutex_unlock(&decoder->mutex);
+        fprintf(stderr, "VaapiDecoder: Decode queue full, waiting for the next IDR picture\n");
+        return false;
+    }
+
+    int index = (decoder->queue_head + decoder->queue_count) % decoder->queue_capacity;
+    VaapiNalUnit* slot = &decoder->queue[index];
+    if (slot->capacity < nal_length) {
+        uint8_t* data = (uint8_t*)realloc(slot->data, nal_length);
+        if (!data) {
+            decoder->stats.nals_dropped++;
+            pthread_mutex_unlock(&decoder->mutex);
+            return false;
+        }
+        slot->data = data;
+        slot->capacity = nal_length;
+    }
+    memcpy(slot->data, nal_data, nal_length);
+    slot->length = nal_length;
+    slot->capture_us = capture_us;
+    slot->arrival_us = now_us();
+
+    decoder->queue_count++;
+    decoder->stats.nals_queued++;
+    if ((uint32_t)decoder->queue_count > decoder->stats.max_queue_depth) {
+        decoder->stats.max_queue_depth = decoder->queue_count;
+    }
+    pthread_cond_signal(&decoder->queue_cond);
+    pthread_mutex_unlock(&decoder->mutex);
+    return true;
+}
+
+bool vaapi_decoder_decode_and_render(
+    VaapiDecoder* decoder,
+    const uint8_t* nal_data,
+    int nal_length,
+    bool is_keyframe
+) {
+    return vaapi_decoder_decode_and_render_timed(decoder, nal_data, nal_length, is_keyframe, -1);
+}
+
+bool vaapi_decoder_decode_and_render_timed(
+    VaapiDecoder* decoder,
+    const uint8_t* nal_data,
+    int nal_length,
+    bool is_keyframe,
+    int64_t capture_us
+) {
+    if (!decoder || !decoder->initialized || !nal_data || nal_length < 2) {
+        return false;
+    }
+
+    (void)is_keyframe;  // The slice header says whether a picture is IDR
+
+    if (capture_us < 0) {
+        capture_us = -1;
+    }
+
+    if (decoder->async) {
+        return queue_nal(decoder, nal_data, nal_length, capture_us);
+    }
+
+    decoder->nal_capture_us = capture_us;
+    frame_scheduler_add_arrival(&decoder->scheduler, capture_us, now_us());
+    return decode_nal(decoder, nal_data, nal_length);
+}
+
+bool vaapi_decoder_end_access_unit(VaapiDecoder* decoder) {
+    // Same as an access unit delimiter in the stream
+    static const uint8_t aud[2] = { H264_NAL_AUD, 0xf0 };
+    return vaapi_decoder_decode_and_render_timed(decoder, aud, sizeof(aud), false, -1);
+}
+
+bool vaapi_decoder_set_presentation(VaapiDecoder* decoder, int target_latency_ms) {
+    if (!decoder || target_latency_ms < 0) {
+        return false;
+    }
+
+    if (decoder->async) {
+        // Applied by the decode thread, which owns the renderer
+        pthread_mutex_lock(&decoder->mutex);
+        decoder->requested_latency_ms = target_latency_ms;
+        decoder->presentation_requested = true;
+        pthread_cond_signal(&decoder->queue_cond);
+        pthread_mutex_unlock(&decoder->mutex);
+        return true;
+    }
+
+    apply_presentation(decoder, target_latency_ms);
+    return true;
+}
+
+void vaapi_decoder_get_stats(VaapiDecoder* decoder, VaapiDecoderStats* stats) {
+    if (!decoder || !stats) {
+        return;
+    }
+
+    pthread_mutex_lock(&decoder->mutex);
+    *stats = decoder->stats;
+    stats->queue_depth = decoder->queue_count;
+    pthread_mutex_unlock(&decoder->mutex);
+}
+
+bool vaapi_decoder_configure_software(VaapiDecoder* decoder, int thread_count, int threading, bool force) {
+    if (!decoder || decoder->initialized || thread_count < 0 ||
+        threading < SW_THREADING_SLICE || threading > SW_THREADING_BOTH) {
+        return false;
+    }
+
+    decoder->software_threads = thread_count;
+    decoder->software_threading = threading;
+    decoder->force_software = force;
+    return true;
+}
+
+bool vaapi_decoder_is_hardware(VaapiDecoder* decoder) {
+    return decoder && decoder->initialized && !decoder->software;
+}
+
+bool vaapi_decoder_set_headless(VaapiDecoder* decoder) {
+    if (!decoder || decoder->initialized || decoder->gallery) {
+        return false;
+    }
+
+    decoder->headless = true;
+    return true;
+}
+
+// Copy rows of width bytes between buffers with different strides
+static void copy_plane(uint8_t* dst, int dst_stride, const uint8_t* src, int src_stride, int width, int rows) {
+    for (int row = 0; row < rows; row++) {
+        memcpy(dst + (size_t)row * dst_stride, src + (size_t)row * src_stride, width);
+    }
+}
+
+// Read the displayed surface back through an NV12 image
+static bool download_surface(VaapiDecoder* decoder, uint8_t* buffer, int stride) {
+    if (decoder->displayed_surface < 0) {
+        return false;
+    }
+
+    if (decoder->download_image.image_id == VA_INVALID_ID) {
+        VAImageFormat format = { 0 };
+        format.fourcc = VA_FOURCC_NV12;
+        format.byte_order = VA_LSB_FIRST;
+        format.bits_per_pixel = 12;
+
+        VAStatus status = vaCreateImage(decoder->va_display, &format,
+                                        decoder->coded_width, decoder->coded_height,
+                                        &decoder->download_image);
+        if (status != VA_STATUS_SUCCESS) {
+            fprintf(stderr, "VaapiDecoder: vaCreateImage failed: %d\n", status);
+            decoder->download_image.image_id = VA_INVALID_ID;
+            return false;
+        }
+    }
+
+    VAImage* image = &decoder->download_image;
+    VAStatus status = vaGetImage(decoder->va_display, decoder->va_surfaces[decoder->displayed_surface],
+                                 0, 0, image->width, image->height, image->image_id);
     if (status != VA_STATUS_SUCCESS) {
-        fprintf(stderr, "VaapiDecoder: vaEndPicture failed: %d\n", status);
+        fprintf(stderr, "VaapiDecoder: vaGetImage failed: %d\n", status);
         return false;
     }
 
-    // Sync surface
-    status = vaSyncSurface(decoder->va_display, surface);
+    uint8_t* data;
+    status = vaMapBuffer(decoder->va_display, image->buf, (void**)&data);
     if (status != VA_STATUS_SUCCESS) {
-        fprintf(stderr, "VaapiDecoder: vaSyncSurface failed: %d\n", status);
+        fprintf(stderr, "VaapiDecoder: vaMapBuffer failed: %d\n", status);
         return false;
     }
 
-    // Render to display
-    if (decoder->renderer) {
-        egl_renderer_render_surface(decoder->renderer, decoder->va_display, surface);
+    int chroma_rows = (decoder->height + 1) / 2;
+    int row_bytes = (decoder->width + 1) & ~1;
+    copy_plane(buffer, stride, data + image->offsets[0], image->pitches[0], decoder->width, decoder->height);
+    copy_plane(buffer + (size_t)stride * decoder->height, stride,
+               data + image->offsets[1], image->pitches[1], row_bytes, chroma_rows);
+
+    vaUnmapBuffer(decoder->va_display, image->buf);
+    return true;
+}
+
+#ifdef SNACKA_HAVE_LIBAVCODEC
+// Interleave the software decoder's latest frame into NV12
+static bool download_software_frame(VaapiDecoder* decoder, uint8_t* buffer, int stride) {
+    SwFrame frame;
+    if (!sw_decoder_get_frame(decoder->software, &frame) ||
+        frame.width != decoder->width || frame.height != decoder->height) {
+        return false;
     }
 
-    // Advance surface index
-    decoder->current_surface = (decoder->current_surface + 1) % decoder->num_surfaces;
+    copy_plane(buffer, stride, frame.planes[0], frame.strides[0], frame.width, frame.height);
+
+    int chroma_width = (frame.width + 1) / 2;
+    int chroma_rows = (frame.height + 1) / 2;
+    uint8_t* uv_plane = buffer + (size_t)stride * frame.height;
+    for (int row = 0; row < chroma_rows; row++) {
+        const uint8_t* u = frame.planes[1] + (size_t)row * frame.strides[1];
+        const uint8_t* v = frame.planes[2] + (size_t)row * frame.strides[2];
+        uint8_t* uv = uv_plane + (size_t)row * stride;
+        for (int col = 0; col < chroma_width; col++) {
+            uv[2 * col] = u[col];
+            uv[2 * col + 1] = v[col];
+        }
+    }
+    return true;
+}
+#endif
+
+bool vaapi_decoder_read_frame(
+    VaapiDecoder* decoder,
+    uint8_t* buffer,
+    int stride,
+    int buffer_size,
+    int* width,
+    int* height,
+    int64_t* capture_us
+) {
+    if (!decoder || !decoder->headless || !decoder->frame_unread || !buffer) {
+        return false;
+    }
+
+    // The stream's size may have changed since the caller sized the buffer
+    int chroma_rows = (decoder->height + 1) / 2;
+    if (stride < ((decoder->width + 1) & ~1) ||
+        (int64_t)stride * (decoder->height + chroma_rows) > buffer_size) {
+        return false;
+    }
+
+    bool copied;
+#ifdef SNACKA_HAVE_LIBAVCODEC
+    if (decoder->software) {
+        copied = download_software_frame(decoder, buffer, stride);
+    } else
+#endif
+    {
+        copied = download_surface(decoder, buffer, stride);
+    }
+    if (!copied) {
+        return false;
+    }
 
-    (void)is_keyframe;  // Currently unused
+    decoder->frame_unread = false;
+    if (width) *width = decoder->width;
+    if (height) *height = decoder->height;
+    if (capture_us) *capture_us = decoder->output_capture_us;
     return true;
 }
 
+bool vaapi_decoder_use_gallery(VaapiDecoder* decoder, GalleryCompositor* gallery) {
+    if (!decoder || !gallery || decoder->initialized || decoder->gallery || decoder->headless) {
+        return false;
+    }
+
+    gallery_compositor_retain(gallery);
+    decoder->gallery = gallery;
+    return true;
+}
+
+void vaapi_decoder_set_tile(VaapiDecoder* decoder, int x, int y, int width, int height) {
+    if (!decoder || !decoder->tile) {
+        return;
+    }
+
+    gallery_compositor_set_tile_rect(decoder->gallery, decoder->tile, x, y, width, height);
+}
+
 void* vaapi_decoder_get_view(VaapiDecoder* decoder) {
+    if (decoder && decoder->gallery) {
+        return gallery_compositor_get_view(decoder->gallery);
+    }
     if (!decoder || !decoder->renderer) {
         return NULL;
     }
@@ -438,5 +1619,16 @@ void vaapi_decoder_set_display_size(VaapiDecoder* decoder, int width, int height
         return;
     }
 
+    if (decoder->async) {
+        // Applied by the decode thread, which owns the renderer
+        pthread_mutex_lock(&decoder->mutex);
+        decoder->requested_width = width;
+        decoder->requested_height = height;
+        decoder->resize_requested = true;
+        pthread_cond_signal(&decoder->queue_cond);
+        pthread_mutex_unlock(&decoder->mutex);
+        return;
+    }
+
     egl_renderer_set_display_size(decoder->renderer, width, height);
 }
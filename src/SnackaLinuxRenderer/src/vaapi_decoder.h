@@ -3,44 +3,138 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <va/va.h>
 #include <va/va_x11.h>
 #include <va/va_drm.h>
 #include <X11/Xlib.h>
+#include "h264_parser.h"
+#include "h264_dpb.h"
+#include "frame_scheduler.h"
+#include "color_space.h"
 
 // Forward declarations
 struct EglRenderer;
+struct VaDevice;
+struct GalleryCompositor;
+struct GalleryTile;
+struct SwDecoder;
+
+// Default number of NAL units waiting for the decode thread
+#define VAAPI_DEFAULT_QUEUE_CAPACITY 64
+#define VAAPI_MAX_QUEUE_CAPACITY 1024
+
+// Decoded frames that may wait to be presented (async)
+#define VAAPI_MAX_PENDING_FRAMES 4
+
+// A queued NAL unit (buffers are reused)
+typedef struct VaapiNalUnit {
+    uint8_t* data;
+    int length;
+    int capacity;
+    int64_t capture_us;         // Sender's capture time (-1 if unknown)
+    int64_t arrival_us;         // When it was queued
+} VaapiNalUnit;
+
+// A decoded frame waiting to be presented
+typedef struct VaapiPendingFrame {
+    int surface;                // Surface index, or -1 for the software decoder's frame
+    int64_t capture_us;
+    int64_t due_us;             // When the scheduler wants it on screen
+} VaapiPendingFrame;
+
+// Decoder counters
+typedef struct VaapiDecoderStats {
+    uint32_t queue_depth;       // NAL units waiting for the decode thread
+    uint32_t max_queue_depth;
+    uint64_t nals_queued;
+    uint64_t nals_dropped;      // Rejected (queue full, waiting for an IDR) or skipped for an IDR
+    uint64_t resyncs;           // Queue overflows that dropped input up to an IDR
+    uint64_t frames_decoded;    // Frames output by the DPB
+    uint64_t frames_presented;
+    uint64_t frames_skipped;    // Replaced by a newer frame before they were presented
+    FrameTimingStats timing;    // Display latency and missed vsyncs
+} VaapiDecoderStats;
 
 // VA-API decoder structure
 typedef struct VaapiDecoder {
-    // VA-API
+    // VA-API (the display and config belong to the shared device)
+    struct VaDevice* device;
     VADisplay va_display;
-    VAConfigID va_config;
     VAContextID va_context;
     VASurfaceID* va_surfaces;
     int num_surfaces;
-    int current_surface;
+    int current_surface;        // Surface of the latest picture
+    int displayed_surface;      // Surface last handed to the renderer (-1 if none)
+    int64_t* capture_times;     // Capture time of the picture in each surface
 
     // Video parameters
-    int width;
+    int width;                  // Display size (cropped)
     int height;
-    uint8_t* sps;
-    int sps_length;
-    uint8_t* pps;
-    int pps_length;
-
-    // X11 Display
-    Display* x_display;
-
-    // EGL renderer
+    int coded_width;            // Surface size (whole macroblocks)
+    int coded_height;
+    ColorSpace color;           // From the active SPS's VUI
+
+    // H.264 state
+    H264ParamSets* param_sets;
+    H264Dpb dpb;
+    int active_sps_id;          // SPS of the current coded video sequence
+    bool waiting_for_idr;       // Nothing can be decoded before the next IDR picture
+    H264SliceHeader slice;      // Slice being submitted
+    H264SliceHeader first_slice; // First slice of the latest picture
+    int64_t nal_capture_us;     // Capture time of the NAL unit being decoded
+
+    // Picture being submitted (between vaBeginPicture and vaEndPicture)
+    bool picture_open;
+    bool have_picture;          // first_slice is valid
+    VABufferID* picture_buffers;
+    int num_picture_buffers;
+    int picture_buffer_capacity;
+
+    // Asynchronous mode: a worker thread decodes and presents, callers only queue
+    bool async;
+    pthread_t worker;
+    pthread_mutex_t mutex;      // Guards the queue, the requests below and stats
+    pthread_cond_t queue_cond;
+    VaapiNalUnit* queue;
+    int queue_capacity;
+    int queue_head;
+    int queue_count;
+    bool dropping_until_idr;    // The queue overflowed; input resumes at an IDR
+    bool stopping;
+    bool resize_requested;
+    int requested_width;
+    int requested_height;
+    bool presentation_requested;
+    int requested_latency_ms;
+    VaapiDecoderStats stats;
+
+    // Presentation: decoded frames wait until the scheduler says they are due
+    // (oldest first; async only, synchronous decoding presents immediately)
+    FrameScheduler scheduler;
+    VaapiPendingFrame pending[VAAPI_MAX_PENDING_FRAMES];
+    int num_pending;
+
+    // Software decoding (libavcodec), when VA-API cannot decode or it is forced
+    struct SwDecoder* software;
+    int software_threads;       // 0: one per CPU
+    int software_threading;     // SwThreading
+    bool force_software;
+
+    // Headless decoding: frames are kept for vaapi_decoder_read_frame instead
+    // of being shown
+    bool headless;
+    bool frame_unread;          // The latest output frame was not read yet
+    int64_t output_capture_us;
+    VAImage download_image;     // NV12 image frames are read back through
+
+    // EGL renderer (own window), or a tile of a shared gallery window
     struct EglRenderer* renderer;
+    struct GalleryCompositor* gallery;
+    struct GalleryTile* tile;
 
     // State
     bool initialized;
-    bool va_initialized;
-
-    // DRM fd (if using DRM backend)
-    int drm_fd;
 } VaapiDecoder;
 
 // Create a new decoder
@@ -49,7 +143,8 @@ VaapiDecoder* vaapi_decoder_create(void);
 // Destroy a decoder
 void vaapi_decoder_destroy(VaapiDecoder* decoder);
 
-// Initialize the decoder
+// Initialize the decoder. Surfaces are sized from the SPS; width and height
+// are only the caller's expectation.
 bool vaapi_decoder_initialize(
     VaapiDecoder* decoder,
     int width,
@@ -60,7 +155,10 @@ bool vaapi_decoder_initialize(
     int pps_length
 );
 
-// Decode and render a NAL unit
+// Decode a NAL unit: a slice (pictures may have several), or an SPS/PPS that
+// replaces a parameter set. A picture is complete when the first slice of the
+// next one, an access unit delimiter or vaapi_decoder_end_access_unit arrives;
+// pictures are rendered in output order once complete.
 bool vaapi_decoder_decode_and_render(
     VaapiDecoder* decoder,
     const uint8_t* nal_data,
@@ -68,13 +166,79 @@ bool vaapi_decoder_decode_and_render(
     bool is_keyframe
 );
 
-// Get the X11 window handle
+// Mark the end of an access unit, so its picture is decoded without waiting
+// for the next one (queued like a NAL unit in async mode)
+bool vaapi_decoder_end_access_unit(VaapiDecoder* decoder);
+
+// Configure the software decoder used when VA-API cannot decode (call before
+// vaapi_decoder_initialize)
+// thread_count: 0 for one thread per CPU
+// threading: SwThreading (slice threading adds no latency; frame threading
+// adds a frame per thread)
+// force: decode in software even if VA-API is available
+bool vaapi_decoder_configure_software(VaapiDecoder* decoder, int thread_count, int threading, bool force);
+
+// Check if the initialized decoder uses VA-API (false for software decoding)
+bool vaapi_decoder_is_hardware(VaapiDecoder* decoder);
+
+// Move decoding and presentation to a worker thread. Afterwards
+// vaapi_decoder_decode_and_render only queues the NAL unit; when presentation
+// falls behind, only the latest decoded frame is shown.
+// queue_capacity: NAL units that may wait (0 for the default)
+bool vaapi_decoder_start_async(VaapiDecoder* decoder, int queue_capacity);
+
+// Decode a NAL unit captured at capture_us (sender's clock, microseconds;
+// negative if unknown) so that it can be scheduled and its latency measured
+bool vaapi_decoder_decode_and_render_timed(
+    VaapiDecoder* decoder,
+    const uint8_t* nal_data,
+    int nal_length,
+    bool is_keyframe,
+    int64_t capture_us
+);
+
+// Schedule presentation: frames are held until target_latency_ms after their
+// earliest possible arrival and shown once per vsync, so that network jitter
+// does not become judder (0 shows every frame as soon as it is decoded).
+// Scheduling needs capture times and the worker thread.
+bool vaapi_decoder_set_presentation(VaapiDecoder* decoder, int target_latency_ms);
+
+// Get a snapshot of the counters
+void vaapi_decoder_get_stats(VaapiDecoder* decoder, VaapiDecoderStats* stats);
+
+// Decode without a window (call before vaapi_decoder_initialize). Frames are
+// not shown; the latest one is read with vaapi_decoder_read_frame. Headless
+// decoders decode synchronously.
+bool vaapi_decoder_set_headless(VaapiDecoder* decoder);
+
+// Copy the latest output frame as NV12: the Y plane (height rows of stride
+// bytes), then the interleaved UV plane ((height + 1) / 2 rows)
+// Returns: false if no frame was output since the last read, or it does not fit
+bool vaapi_decoder_read_frame(
+    VaapiDecoder* decoder,
+    uint8_t* buffer,
+    int stride,
+    int buffer_size,
+    int* width,
+    int* height,
+    int64_t* capture_us
+);
+
+// Show frames as a tile of a gallery instead of in an own window (call before
+// vaapi_decoder_initialize). The tile starts at the top-left corner.
+bool vaapi_decoder_use_gallery(VaapiDecoder* decoder, struct GalleryCompositor* gallery);
+
+// Place the decoder's gallery tile (top-left origin; zero size hides it)
+void vaapi_decoder_set_tile(VaapiDecoder* decoder, int x, int y, int width, int height);
+
+// Get the X11 window handle (the gallery's window for a gallery tile)
 void* vaapi_decoder_get_view(VaapiDecoder* decoder);
 
-// Set display size
+// Set display size (own window only; gallery tiles are placed with
+// vaapi_decoder_set_tile)
 void vaapi_decoder_set_display_size(VaapiDecoder* decoder, int width, int height);
 
-// Check if VA-API is available
+// Check if decoding is available (VA-API, or software if built with libavcodec)
 bool vaapi_decoder_is_available(void);
 
 #endif // VAAPI_DECODER_H
@@ -0,0 +1,453 @@
+// Table tests for the H.264 parser and DPB, on the CPU: each sample stream in
+// samples/ (see make_samples.py) is parsed and run through the DPB as
+// vaapi_decoder.c does, and every picture's frame_num, picture order count,
+// reference lists and the references left after it are compared with the
+// table below, as is the output order.
+//
+// h264_test <samples directory>
+
+#include "h264_dpb.h"
+#include "h264_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PICTURES 32
+#define NUM_SURFACES 20
+
+// Slice data in the samples starts with this, right after the header
+#define SLICE_DATA_MARKER 0xA55A
+
+typedef struct ExpectedPicture {
+    int frame_num;
+    int poc;                    // As computed when the picture starts
+    int slices;
+    const char* l0;             // Reference list POCs ("-" for a missing entry)
+    const char* l1;
+    const char* refs;           // References after the picture, by POC ("L": long-term)
+} ExpectedPicture;
+
+typedef struct Sample {
+    const char* file;
+    bool avcc;                  // 4-byte length prefixes instead of start codes
+    int width;                  // Display size of the SPS
+    int height;
+    int poc_type;
+    int matrix_coefficients;
+    const char* output;         // Decode indices in output order
+    int num_pictures;
+    const ExpectedPicture* pictures;
+} Sample;
+
+// 1080p, POC type 0, two references; frame_num and pic_order_cnt_lsb wrap
+static const ExpectedPicture s_idr_p[] = {
+    { 0,  0, 1, "",        "", "0" },
+    { 1,  2, 1, "0 -",     "", "0 2" },
+    { 2,  4, 1, "2 0",     "", "2 4" },
+    { 3,  6, 1, "4 2",     "", "4 6" },
+    { 4,  8, 1, "6 4",     "", "6 8" },
+    { 5, 10, 1, "8 6",     "", "8 10" },
+    { 6, 12, 1, "10 8",    "", "10 12" },
+    { 7, 14, 1, "12 10",   "", "12 14" },
+    { 8, 16, 1, "14 12",   "", "14 16" },
+    { 9, 18, 1, "16 14",   "", "16 18" },
+    { 10, 20, 1, "18 16",  "", "18 20" },
+    { 11, 22, 1, "20 18",  "", "20 22" },
+    { 12, 24, 1, "22 20",  "", "22 24" },
+    { 13, 26, 1, "24 22",  "", "24 26" },
+    { 14, 28, 1, "26 24",  "", "26 28" },
+    { 15, 30, 1, "28 26",  "", "28 30" },
+    { 0, 32, 1, "30 28",   "", "30 32" },
+    { 1, 34, 1, "32 30",   "", "32 34" },
+    { 2, 36, 1, "34 32",   "", "34 36" },
+    { 3, 38, 1, "36 34",   "", "36 38" },
+};
+
+// 640x360, POC type 2, four slices per picture; the last picture is not a
+// reference (odd POC)
+static const ExpectedPicture s_multi_slice[] = {
+    { 0,  0, 4, "",   "", "0" },
+    { 1,  2, 4, "0",  "", "2" },
+    { 2,  4, 4, "2",  "", "4" },
+    { 3,  6, 4, "4",  "", "6" },
+    { 4,  8, 4, "6",  "", "8" },
+    { 5, 10, 4, "8",  "", "10" },
+    { 6, 11, 4, "10", "", "10" },
+};
+
+// CIF, POC type 0, three references: long-term marking (MMCO 4, 6, 2, 3),
+// short-term removal (MMCO 1), list modification, the sliding window, and
+// MMCO 5, after which the picture counts as POC 0 and frame_num 0
+static const ExpectedPicture s_mmco[] = {
+    { 0,  0, 1, "",        "", "0" },
+    { 1,  2, 1, "0 - -",   "", "0 2" },
+    { 2,  4, 1, "2 0 -",   "", "0 2 L4" },
+    { 3,  6, 1, "4 2 0",   "", "2 L4 6" },
+    { 4,  8, 1, "2 6 4",   "", "L4 6 8" },
+    { 5, 10, 1, "8 6 4",   "", "6 L8 10" },
+    { 6, 12, 1, "10 6 8",  "", "0" },
+    { 1,  2, 1, "0 - -",   "", "0 2" },
+};
+
+// QCIF, POC type 1, I P B B P B B with non-reference B pictures and two
+// frames of reordering
+static const ExpectedPicture s_reorder[] = {
+    { 0,  0, 1, "",     "",     "0" },
+    { 1,  6, 1, "0",    "",     "0 6" },
+    { 2,  2, 1, "0 6",  "6 0",  "0 6" },
+    { 2,  4, 1, "0 6",  "6 0",  "0 6" },
+    { 2, 12, 1, "6",    "",     "6 12" },
+    { 3,  8, 1, "6 12", "12 6", "6 12" },
+    { 3, 10, 1, "6 12", "12 6", "6 12" },
+};
+
+#define COUNT(table) ((int)(sizeof(table) / sizeof((table)[0])))
+
+static const Sample s_samples[] = {
+    { "idr_p.h264", false, 1920, 1080, 0, 1,
+      "0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19", COUNT(s_idr_p), s_idr_p },
+    { "multi_slice.avcc", true, 640, 360, 2, 2,
+      "0 1 2 3 4 5 6", COUNT(s_multi_slice), s_multi_slice },
+    { "mmco.h264", false, 352, 288, 0, 2,
+      "0 1 2 3 4 5 6 7", COUNT(s_mmco), s_mmco },
+    { "reorder.h264", false, 176, 144, 1, 6,
+      "0 2 3 1 5 6 4", COUNT(s_reorder), s_reorder },
+};
+
+// State of one sample's run
+typedef struct Run {
+    const Sample* sample;
+    H264ParamSets* sets;
+    H264Dpb dpb;
+    const H264SPS* sps;
+    H264SliceHeader first_slice;
+    bool picture_open;
+    int picture;                // Decode index of the open picture
+    int slices;
+    int surface_picture[NUM_SURFACES]; // Decode index of the picture in each surface
+    char output[256];
+    int failures;
+} Run;
+
+static void fail(Run* run, const char* format, const char* expected, const char* actual) {
+    printf("FAIL %s picture %d: %s: expected \"%s\", got \"%s\"\n",
+           run->sample->file, run->picture, format, expected, actual);
+    run->failures++;
+}
+
+static void append(char* text, size_t size, const char* format, int value) {
+    size_t length = strlen(text);
+    snprintf(text + length, size - length, format, length > 0 ? " " : "", value);
+}
+
+static void on_output(void* user_data, const H264Picture* picture) {
+    Run* run = (Run*)user_data;
+    append(run->output, sizeof(run->output), "%s%d", run->surface_picture[picture->surface]);
+}
+
+static void format_list(char* text, size_t size, const H264Picture* const* list, int count) {
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        size_t length = strlen(text);
+        if (list[i]) {
+            snprintf(text + length, size - length, "%s%d", length > 0 ? " " : "", list[i]->pic_order_cnt);
+        } else {
+            snprintf(text + length, size - length, "%s-", length > 0 ? " " : "");
+        }
+    }
+}
+
+static int compare_refs(const void* a, const void* b) {
+    const H264Picture* pa = *(const H264Picture* const*)a;
+    const H264Picture* pb = *(const H264Picture* const*)b;
+    return (pa->pic_order_cnt > pb->pic_order_cnt) - (pa->pic_order_cnt < pb->pic_order_cnt);
+}
+
+static void finish_picture(Run* run) {
+    if (!run->picture_open) {
+        return;
+    }
+    run->picture_open = false;
+    h264_dpb_finish_picture(&run->dpb, &run->first_slice);
+
+    const ExpectedPicture* expected = &run->sample->pictures[run->picture];
+    if (run->slices != expected->slices) {
+        char a[16], e[16];
+        snprintf(a, sizeof(a), "%d", run->slices);
+        snprintf(e, sizeof(e), "%d", expected->slices);
+        fail(run, "slices", e, a);
+    }
+
+    const H264Picture* refs[H264_DPB_MAX_FRAMES];
+    int count = h264_dpb_get_references(&run->dpb, refs);
+    qsort(refs, count, sizeof(refs[0]), compare_refs);
+    char text[256] = "";
+    for (int i = 0; i < count; i++) {
+        size_t length = strlen(text);
+        snprintf(text + length, sizeof(text) - length, "%s%s%d", length > 0 ? " " : "",
+                 refs[i]->long_term_ref ? "L" : "", refs[i]->pic_order_cnt);
+    }
+    if (strcmp(text, expected->refs) != 0) {
+        fail(run, "references", expected->refs, text);
+    }
+}
+
+static void check_lists(Run* run, const H264SliceHeader* slice) {
+    const H264Picture* lists[2][H264_MAX_REFS];
+    h264_dpb_build_ref_lists(&run->dpb, run->sps, slice, lists);
+
+    const ExpectedPicture* expected = &run->sample->pictures[run->picture];
+    char text[256];
+    bool inter = slice->slice_type == H264_SLICE_P || slice->slice_type == H264_SLICE_B;
+    format_list(text, sizeof(text), lists[0], inter ? slice->num_ref_idx_l0_active_minus1 + 1 : 0);
+    if (strcmp(text, expected->l0) != 0) {
+        fail(run, "list 0", expected->l0, text);
+    }
+    format_list(text, sizeof(text), lists[1],
+                slice->slice_type == H264_SLICE_B ? slice->num_ref_idx_l1_active_minus1 + 1 : 0);
+    if (strcmp(text, expected->l1) != 0) {
+        fail(run, "list 1", expected->l1, text);
+    }
+}
+
+static void start_picture(Run* run, const H264SliceHeader* slice) {
+    run->picture++;
+    if (run->picture >= run->sample->num_pictures) {
+        fail(run, "pictures", "fewer", "more");
+        return;
+    }
+
+    const H264PPS* pps = &run->sets->pps[slice->pps_id];
+    run->sps = &run->sets->sps[pps->sps_id];
+    if (slice->idr_pic_flag) {
+        h264_dpb_configure(&run->dpb, run->sps);
+    }
+
+    int surface = 0;
+    while (surface < NUM_SURFACES && h264_dpb_is_surface_used(&run->dpb, surface)) {
+        surface++;
+    }
+    if (surface == NUM_SURFACES || !h264_dpb_start_picture(&run->dpb, run->sps, slice, surface)) {
+        fail(run, "start", "started", "failed");
+        return;
+    }
+    run->surface_picture[surface] = run->picture;
+    run->first_slice = *slice;
+    run->picture_open = true;
+    run->slices = 0;
+
+    const ExpectedPicture* expected = &run->sample->pictures[run->picture];
+    char a[32], e[32];
+    snprintf(a, sizeof(a), "%u/%d", slice->frame_num, run->dpb.current.pic_order_cnt);
+    snprintf(e, sizeof(e), "%d/%d", expected->frame_num, expected->poc);
+    if (strcmp(a, e) != 0) {
+        fail(run, "frame_num/POC", e, a);
+    }
+}
+
+static void on_nal(Run* run, const uint8_t* nal, size_t size) {
+    if (size < 2) {
+        return;
+    }
+    int type = nal[0] & 0x1f;
+    int id;
+
+    switch (type) {
+        case H264_NAL_SPS:
+            if (!h264_parse_sps(run->sets, nal, size, &id)) {
+                fail(run, "SPS", "parsed", "rejected");
+            }
+            break;
+
+        case H264_NAL_PPS:
+            if (!h264_parse_pps(run->sets, nal, size, &id)) {
+                fail(run, "PPS", "parsed", "rejected");
+            }
+            break;
+
+        case H264_NAL_AUD:
+            finish_picture(run);
+            break;
+
+        case H264_NAL_SLICE:
+        case H264_NAL_IDR: {
+            H264SliceHeader slice;
+            if (!h264_parse_slice_header(run->sets, nal, size, &slice)) {
+                fail(run, "slice header", "parsed", "rejected");
+                return;
+            }
+
+            // header_bits must point at the slice data, emulation prevention
+            // bytes in the header notwithstanding
+            H264BitReader br;
+            h264_br_init(&br, nal, size);
+            for (uint32_t skipped = 0; skipped < slice.header_bits; skipped += 8) {
+                uint32_t count = slice.header_bits - skipped < 8 ? slice.header_bits - skipped : 8;
+                h264_br_read_bits(&br, (int)count);
+            }
+            uint32_t marker = h264_br_read_bits(&br, 16);
+            if (marker != SLICE_DATA_MARKER) {
+                char a[16], e[16];
+                snprintf(a, sizeof(a), "%04x", marker);
+                snprintf(e, sizeof(e), "%04x", SLICE_DATA_MARKER);
+                fail(run, "slice data", e, a);
+            }
+
+            if (slice.first_mb_in_slice == 0) {
+                finish_picture(run);
+                start_picture(run, &slice);
+            }
+            if (!run->picture_open) {
+                return;
+            }
+            run->slices++;
+            check_lists(run, &slice);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* data = length > 0 ? (uint8_t*)malloc((size_t)length) : NULL;
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = data ? (size_t)length : 0;
+    return data;
+}
+
+// Split a byte stream at 3- and 4-byte start codes
+static void split_annexb(Run* run, const uint8_t* data, size_t size) {
+    size_t start = 0;
+    bool in_nal = false;
+    size_t i = 0;
+    while (i + 3 <= size) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (in_nal) {
+                size_t end = i;
+                if (end > start && data[end - 1] == 0) {
+                    end--;  // Leading zero of a 4-byte start code
+                }
+                on_nal(run, data + start, end - start);
+            }
+            i += 3;
+            start = i;
+            in_nal = true;
+        } else {
+            i++;
+        }
+    }
+    if (in_nal && start < size) {
+        on_nal(run, data + start, size - start);
+    }
+}
+
+static void split_avcc(Run* run, const uint8_t* data, size_t size) {
+    size_t pos = 0;
+    while (pos + 4 <= size) {
+        size_t length = ((size_t)data[pos] << 24) | ((size_t)data[pos + 1] << 16) |
+                        ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        pos += 4;
+        if (length > size - pos) {
+            fail(run, "AVCC length", "in bounds", "truncated");
+            return;
+        }
+        on_nal(run, data + pos, length);
+        pos += length;
+    }
+}
+
+static int run_sample(const char* directory, const Sample* sample) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", directory, sample->file);
+    size_t size;
+    uint8_t* data = read_file(path, &size);
+    if (!data) {
+        printf("FAIL %s: cannot read %s\n", sample->file, path);
+        return 1;
+    }
+
+    Run* run = (Run*)calloc(1, sizeof(Run));
+    run->sets = (H264ParamSets*)calloc(1, sizeof(H264ParamSets));
+    run->sample = sample;
+    run->picture = -1;
+    h264_dpb_init(&run->dpb, on_output, run);
+
+    if (sample->avcc) {
+        split_avcc(run, data, size);
+    } else {
+        split_annexb(run, data, size);
+    }
+    finish_picture(run);
+    h264_dpb_flush(&run->dpb);
+
+    if (run->picture + 1 != sample->num_pictures) {
+        char a[16], e[16];
+        snprintf(a, sizeof(a), "%d", run->picture + 1);
+        snprintf(e, sizeof(e), "%d", sample->num_pictures);
+        fail(run, "pictures", e, a);
+    }
+    if (strcmp(run->output, sample->output) != 0) {
+        fail(run, "output order", sample->output, run->output);
+    }
+
+    // The first SPS in the stream
+    const H264SPS* sps = NULL;
+    for (int i = 0; i < H264_MAX_SPS && !sps; i++) {
+        if (run->sets->sps[i].valid) {
+            sps = &run->sets->sps[i];
+        }
+    }
+    if (sps) {
+        int width, height;
+        h264_get_display_size(sps, &width, &height);
+        char a[64], e[64];
+        snprintf(a, sizeof(a), "%dx%d type %d matrix %d", width, height, sps->pic_order_cnt_type,
+                 sps->matrix_coefficients);
+        snprintf(e, sizeof(e), "%dx%d type %d matrix %d", sample->width, sample->height, sample->poc_type,
+                 sample->matrix_coefficients);
+        if (strcmp(a, e) != 0) {
+            fail(run, "SPS", e, a);
+        }
+    }
+
+    int failures = run->failures;
+    if (failures == 0) {
+        printf("%s: %d pictures as expected\n", sample->file, sample->num_pictures);
+    }
+    free(run->sets);
+    free(run);
+    free(data);
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: h264_test <samples directory>\n");
+        return 2;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < COUNT(s_samples); i++) {
+        failures += run_sample(argv[1], &s_samples[i]);
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
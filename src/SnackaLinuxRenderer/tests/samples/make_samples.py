@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+"""Writes the H.264 samples h264_test reads.
+
+The parameter sets and slice headers are coded bit for bit as in the H.264
+syntax; slice data is a marker (0xA55A, so the test can check where the
+header ends) followed by bytes that need emulation prevention. Nothing here
+decodes to an image: the samples exercise the parser and the DPB only.
+
+    python3 make_samples.py [output directory]
+"""
+
+import os
+import sys
+
+
+class BitWriter:
+    def __init__(self):
+        self.bits = []
+
+    def u(self, count, value):
+        for i in range(count - 1, -1, -1):
+            self.bits.append((value >> i) & 1)
+
+    def flag(self, value):
+        self.u(1, 1 if value else 0)
+
+    def ue(self, value):
+        value += 1
+        length = value.bit_length()
+        self.u(length - 1, 0)
+        self.u(length, value)
+
+    def se(self, value):
+        self.ue(2 * value - 1 if value > 0 else -2 * value)
+
+    def trailing_bits(self):
+        self.bits.append(1)
+        while len(self.bits) % 8:
+            self.bits.append(0)
+
+    def payload(self):
+        assert len(self.bits) % 8 == 0
+        return bytes(int("".join(map(str, self.bits[i:i + 8])), 2) for i in range(0, len(self.bits), 8))
+
+
+def escape(rbsp):
+    out = bytearray()
+    zeros = 0
+    for byte in rbsp:
+        if zeros >= 2 and byte <= 3:
+            out.append(3)
+            zeros = 0
+        out.append(byte)
+        zeros = zeros + 1 if byte == 0 else 0
+    return bytes(out)
+
+
+def nal(ref_idc, nal_type, writer):
+    return bytes([(ref_idc << 5) | nal_type]) + escape(writer.payload())
+
+
+def sps(sps_id, profile, level, width_mbs, height_mbs, log2_max_frame_num, poc_type,
+        max_refs, crop_bottom=0, log2_max_poc_lsb=4, poc1=None, vui=None):
+    w = BitWriter()
+    w.u(8, profile)
+    w.u(8, 0)                       # constraint flags
+    w.u(8, level)
+    w.ue(sps_id)
+    w.ue(log2_max_frame_num - 4)
+    w.ue(poc_type)
+    if poc_type == 0:
+        w.ue(log2_max_poc_lsb - 4)
+    elif poc_type == 1:
+        w.flag(0)                   # delta_pic_order_always_zero_flag
+        w.se(poc1["offset_for_non_ref_pic"])
+        w.se(0)                     # offset_for_top_to_bottom_field
+        w.ue(len(poc1["offset_for_ref_frame"]))
+        for offset in poc1["offset_for_ref_frame"]:
+            w.se(offset)
+    w.ue(max_refs)
+    w.flag(0)                       # gaps_in_frame_num_value_allowed_flag
+    w.ue(width_mbs - 1)
+    w.ue(height_mbs - 1)
+    w.flag(1)                       # frame_mbs_only_flag
+    w.flag(1)                       # direct_8x8_inference_flag
+    w.flag(crop_bottom > 0)
+    if crop_bottom > 0:
+        w.ue(0)
+        w.ue(0)
+        w.ue(0)
+        w.ue(crop_bottom)
+    w.flag(vui is not None)
+    if vui is not None:
+        w.flag(0)                   # aspect_ratio_info_present_flag
+        w.flag(0)                   # overscan_info_present_flag
+        w.flag(1)                   # video_signal_type_present_flag
+        w.u(3, 5)                   # video_format: unspecified
+        w.flag(vui.get("full_range", 0))
+        w.flag(1)                   # colour_description_present_flag
+        w.u(8, vui["matrix"])       # colour_primaries
+        w.u(8, vui["matrix"])       # transfer_characteristics
+        w.u(8, vui["matrix"])       # matrix_coefficients
+        w.flag(0)                   # chroma_loc_info_present_flag
+        w.flag(1)                   # timing_info_present_flag
+        w.u(32, 1)
+        w.u(32, 60)
+        w.flag(1)                   # fixed_frame_rate_flag
+        w.flag(0)                   # nal_hrd_parameters_present_flag
+        w.flag(0)                   # vcl_hrd_parameters_present_flag
+        w.flag(0)                   # pic_struct_present_flag
+        w.flag("reorder" in vui)
+        if "reorder" in vui:
+            w.flag(1)               # motion_vectors_over_pic_boundaries_flag
+            w.ue(2)                 # max_bytes_per_pic_denom
+            w.ue(1)                 # max_bits_per_mb_denom
+            w.ue(16)                # log2_max_mv_length_horizontal
+            w.ue(16)                # log2_max_mv_length_vertical
+            w.ue(vui["reorder"])
+            w.ue(vui["dpb"])
+    w.trailing_bits()
+    return nal(3, 7, w)
+
+
+def pps(pps_id, sps_id, refs_l0=1, refs_l1=1, deblocking_control=False):
+    w = BitWriter()
+    w.ue(pps_id)
+    w.ue(sps_id)
+    w.flag(0)                       # entropy_coding_mode_flag (CAVLC)
+    w.flag(0)                       # bottom_field_pic_order_in_frame_present_flag
+    w.ue(0)                         # num_slice_groups_minus1
+    w.ue(refs_l0 - 1)
+    w.ue(refs_l1 - 1)
+    w.flag(0)                       # weighted_pred_flag
+    w.u(2, 0)                       # weighted_bipred_idc
+    w.se(0)                         # pic_init_qp_minus26
+    w.se(0)                         # pic_init_qs_minus26
+    w.se(0)                         # chroma_qp_index_offset
+    w.flag(deblocking_control)
+    w.flag(0)                       # constrained_intra_pred_flag
+    w.flag(0)                       # redundant_pic_cnt_present_flag
+    w.trailing_bits()
+    return nal(3, 8, w)
+
+
+def aud(primary_pic_type):
+    w = BitWriter()
+    w.u(3, primary_pic_type)
+    w.trailing_bits()
+    return nal(0, 9, w)
+
+
+SLICE_P, SLICE_B, SLICE_I = 0, 1, 2
+
+
+def slice_nal(s, p, slice_type, frame_num, ref_idc=2, idr_pic_id=None, first_mb=0, poc_lsb=None,
+              delta_poc=None, refs=None, modifications=(), mmco=None, long_term=False, qp_delta=0):
+    """s and p describe the SPS and PPS: log2_max_frame_num, poc_type,
+    log2_max_poc_lsb, pps_id, deblocking_control"""
+    idr = idr_pic_id is not None
+    w = BitWriter()
+    w.ue(first_mb)
+    w.ue(slice_type + 5)            # All slices of the picture have this type
+    w.ue(p["pps_id"])
+    w.u(s["log2_max_frame_num"], frame_num)
+    if idr:
+        w.ue(idr_pic_id)
+    if s["poc_type"] == 0:
+        w.u(s["log2_max_poc_lsb"], poc_lsb)
+    elif s["poc_type"] == 1:
+        w.se(delta_poc or 0)
+    if slice_type == SLICE_B:
+        w.flag(1)                   # direct_spatial_mv_pred_flag
+    if slice_type in (SLICE_P, SLICE_B):
+        w.flag(refs is not None)    # num_ref_idx_active_override_flag
+        if refs is not None:
+            w.ue(refs[0] - 1)
+            if slice_type == SLICE_B:
+                w.ue(refs[1] - 1)
+        for l in range(2 if slice_type == SLICE_B else 1):
+            mods = modifications[l] if l < len(modifications) else ()
+            w.flag(len(mods) > 0)
+            if mods:
+                for idc, value in mods:
+                    w.ue(idc)
+                    w.ue(value)
+                w.ue(3)
+    if ref_idc != 0:
+        if idr:
+            w.flag(0)               # no_output_of_prior_pics_flag
+            w.flag(long_term)
+        else:
+            w.flag(mmco is not None)
+            if mmco is not None:
+                for op in mmco:
+                    w.ue(op[0])
+                    for value in op[1:]:
+                        w.ue(value)
+                w.ue(0)
+    w.se(qp_delta)
+    if p.get("deblocking_control"):
+        w.ue(0)                     # disable_deblocking_filter_idc
+        w.se(-1)                    # slice_alpha_c0_offset_div2
+        w.se(1)                     # slice_beta_offset_div2
+
+    # Slice data stand-in: the marker, then zeros that need escaping
+    w.u(16, 0xA55A)
+    for byte in (0, 0, 0, 1, 0, 0, 2, 0, 0, 3, first_mb & 0xFF):
+        w.u(8, byte)
+    w.trailing_bits()
+    return nal(ref_idc, 5 if idr else 1, w)
+
+
+def annexb(nals):
+    # Mostly 4-byte start codes, some 3-byte ones as encoders also write
+    return b"".join((b"\x00\x00\x01" if i % 3 == 2 else b"\x00\x00\x00\x01") + n for i, n in enumerate(nals))
+
+
+def avcc(nals):
+    return b"".join(len(n).to_bytes(4, "big") + n for n in nals)
+
+
+def idr_p():
+    """1080p, POC type 0: an IDR picture and 19 P pictures, so frame_num (4
+    bits) and pic_order_cnt_lsb (4 bits) both wrap. Two references."""
+    s = {"log2_max_frame_num": 4, "poc_type": 0, "log2_max_poc_lsb": 4}
+    p = {"pps_id": 0}
+    nals = [sps(0, 66, 40, 120, 68, 4, 0, 2, crop_bottom=4, log2_max_poc_lsb=4, vui={"matrix": 1}),
+            pps(0, 0, refs_l0=2)]
+    nals.append(slice_nal(s, p, SLICE_I, 0, ref_idc=3, idr_pic_id=0, poc_lsb=0))
+    for n in range(1, 20):
+        nals.append(slice_nal(s, p, SLICE_P, n % 16, poc_lsb=(2 * n) % 16, qp_delta=n % 3 - 1))
+    return annexb(nals)
+
+
+def multi_slice():
+    """640x360, POC type 2, AVCC framing: four slices per picture behind an
+    access unit delimiter. An IDR picture, five P pictures and a
+    non-reference P picture. The 16-bit frame_num and a large idr_pic_id put
+    an emulation prevention byte inside the IDR slice headers."""
+    s = {"log2_max_frame_num": 16, "poc_type": 2}
+    p = {"pps_id": 3, "deblocking_control": True}
+    nals = [sps(1, 77, 30, 40, 23, 16, 2, 1, crop_bottom=4), pps(3, 1, deblocking_control=True)]
+    for n in range(7):
+        nals.append(aud(0 if n == 0 else 1))
+        for first_mb in (0, 230, 460, 690):
+            if n == 0:
+                nals.append(slice_nal(s, p, SLICE_I, 0, ref_idc=3, idr_pic_id=65535, first_mb=first_mb))
+            else:
+                nals.append(slice_nal(s, p, SLICE_P, n, ref_idc=0 if n == 6 else 2, first_mb=first_mb,
+                                      qp_delta=first_mb // 230))
+    return avcc(nals)
+
+
+def mmco():
+    """CIF, POC type 0, three references: long-term marking, list
+    modification and a memory_management_control_operation 5 reset."""
+    s = {"log2_max_frame_num": 4, "poc_type": 0, "log2_max_poc_lsb": 6}
+    p = {"pps_id": 0}
+    nals = [sps(0, 77, 30, 22, 18, 4, 0, 3, log2_max_poc_lsb=6), pps(0, 0, refs_l0=3)]
+    nals.append(slice_nal(s, p, SLICE_I, 0, ref_idc=3, idr_pic_id=0, poc_lsb=0))
+    nals.append(slice_nal(s, p, SLICE_P, 1, poc_lsb=2))
+    # Limit long-term indices to 0, then the current picture becomes long-term 0
+    nals.append(slice_nal(s, p, SLICE_P, 2, poc_lsb=4, mmco=[(4, 1), (6, 0)]))
+    # Long-term 0 moves to the front; frame_num 0 (PicNum 3 - 3) becomes unused
+    nals.append(slice_nal(s, p, SLICE_P, 3, poc_lsb=6, modifications=[[(2, 0)]], mmco=[(1, 2)]))
+    # Sliding window; PicNum 4 - 3 = 1 moves to the front
+    nals.append(slice_nal(s, p, SLICE_P, 4, poc_lsb=8, modifications=[[(0, 2)]]))
+    # Two long-term indices; long-term 0 becomes unused; PicNum 4 becomes long-term 1
+    nals.append(slice_nal(s, p, SLICE_P, 5, poc_lsb=10, mmco=[(4, 2), (2, 0), (3, 0, 1)]))
+    # Everything becomes unused and this picture restarts at POC 0, frame_num 0
+    nals.append(slice_nal(s, p, SLICE_P, 6, poc_lsb=12, mmco=[(5,)]))
+    nals.append(slice_nal(s, p, SLICE_P, 1, poc_lsb=2))
+    return annexb(nals)
+
+
+def reorder():
+    """QCIF, POC type 1, IPBB order with non-reference B pictures: output
+    order differs from decode order (two frames of reordering in the VUI)."""
+    s = {"log2_max_frame_num": 4, "poc_type": 1}
+    p = {"pps_id": 0}
+    poc1 = {"offset_for_non_ref_pic": -4, "offset_for_ref_frame": [6]}
+    nals = [sps(0, 77, 30, 11, 9, 4, 1, 2, poc1=poc1, vui={"matrix": 6, "reorder": 2, "dpb": 3}),
+            pps(0, 0)]
+    nals.append(slice_nal(s, p, SLICE_I, 0, ref_idc=3, idr_pic_id=0))
+    nals.append(slice_nal(s, p, SLICE_P, 1))
+    nals.append(slice_nal(s, p, SLICE_B, 2, ref_idc=0, refs=(2, 2)))
+    nals.append(slice_nal(s, p, SLICE_B, 2, ref_idc=0, refs=(2, 2), delta_poc=2))
+    nals.append(slice_nal(s, p, SLICE_P, 2))
+    nals.append(slice_nal(s, p, SLICE_B, 3, ref_idc=0, refs=(2, 2)))
+    nals.append(slice_nal(s, p, SLICE_B, 3, ref_idc=0, refs=(2, 2), delta_poc=2))
+    return annexb(nals)
+
+
+def main():
+    out = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    for name, data in (("idr_p.h264", idr_p()), ("multi_slice.avcc", multi_slice()),
+                       ("mmco.h264", mmco()), ("reorder.h264", reorder())):
+        with open(os.path.join(out, name), "wb") as f:
+            f.write(data)
+
+
+if __name__ == "__main__":
+    main()